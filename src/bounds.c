@@ -40,6 +40,30 @@ static int errors = 0;
 #define bounds_error(t, ...) \
    do { errors++; error_at(tree_loc(t), __VA_ARGS__); } while (0)
 
+// A function call folded during analysis may never be executed so any
+// problem with its value is a warning here and is checked at run time
+#define bounds_error_folded(t, ...) do {                        \
+      const int folded = bounds_folded_call(t);                 \
+      if (folded == 0)                                          \
+         bounds_error(t, __VA_ARGS__);                          \
+      else if (folded == 1) {                                   \
+         warn_at(tree_loc(t), __VA_ARGS__);                     \
+         tree_add_attr_int(t, folded_call_i, 2);                \
+      }                                                         \
+   } while (0)
+
+static int bounds_folded_call(tree_t t)
+{
+   switch (tree_kind(t)) {
+   case T_LITERAL:
+   case T_REF:
+   case T_AGGREGATE:
+      return tree_attr_int(t, folded_call_i, 0);
+   default:
+      return 0;
+   }
+}
+
 static void bounds_check_string_literal(tree_t t)
 {
    type_t type = tree_type(t);
@@ -552,13 +576,14 @@ static void bounds_check_assignment(tree_t target, tree_t value)
              && folded_length(type_dim(value_type, i), &value_w)) {
             if (target_w != value_w) {
                if (i > 0)
-                  bounds_error(value, "length of dimension %d of value %"PRIi64
-                               " does not match length of target %"PRIi64,
-                               i + 1, value_w, target_w);
+                  bounds_error_folded(value, "length of dimension %d of "
+                                      "value %"PRIi64" does not match length "
+                                      "of target %"PRIi64,
+                                      i + 1, value_w, target_w);
                else
-                  bounds_error(value, "length of value %"PRIi64" does not "
-                               "match length of target %"PRIi64,
-                               value_w, target_w);
+                  bounds_error_folded(value, "length of value %"PRIi64" does "
+                                      "not match length of target %"PRIi64,
+                                      value_w, target_w);
             }
          }
       }
@@ -569,10 +594,10 @@ static void bounds_check_assignment(tree_t target, tree_t value)
       bool checked;
 
       if (is_out_of_range(value, r, &checked)) {
-         bounds_error(value, "value %s out of target bounds %s %s %s",
-                      value_str(value), value_str(r.left),
-                      (r.kind == RANGE_TO) ? "to" : "downto",
-                      value_str(r.right));
+         bounds_error_folded(value, "value %s out of target bounds %s %s %s",
+                             value_str(value), value_str(r.left),
+                             (r.kind == RANGE_TO) ? "to" : "downto",
+                             value_str(r.right));
       }
    }
 }
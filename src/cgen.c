@@ -23,6 +23,7 @@
 #include "array.h"
 #include "rt/rt.h"
 #include "rt/cover.h"
+#include "rt/pgo.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +49,8 @@ typedef struct {
    size_t             var_base;
    size_t             param_base;
    LLVMValueRef      *locals;
+   LLVMValueRef       pgo;
+   const int64_t     *profile;
 } cgen_ctx_t;
 
 typedef struct {
@@ -57,9 +60,20 @@ typedef struct {
 
 DECLARE_AND_DEFINE_ARRAY(size_list)
 
-static LLVMModuleRef  module = NULL;
-static LLVMBuilderRef builder = NULL;
-static LLVMValueRef   mod_name = NULL;
+typedef struct {
+   ident_t      name;
+   LLVMValueRef counters;
+   int          ncounters;
+   uint32_t     checksum;
+} pgo_ref_t;
+
+DECLARE_AND_DEFINE_ARRAY(pgo_ref)
+
+static LLVMModuleRef   module = NULL;
+static LLVMBuilderRef  builder = NULL;
+static LLVMValueRef    mod_name = NULL;
+static bool            pgo_collect = false;
+static pgo_ref_array_t pgo_refs;
 
 static LLVMValueRef cgen_support_fn(const char *name);
 
@@ -1192,12 +1206,55 @@ static void cgen_op_alloca(int op, cgen_ctx_t *ctx)
    }
 }
 
+static void cgen_pgo_count(cgen_ctx_t *ctx, int index, LLVMValueRef delta)
+{
+   LLVMValueRef indexes[] = { llvm_int32(0), llvm_int32(index) };
+   LLVMValueRef count_ptr = LLVMBuildGEP(builder, ctx->pgo, indexes,
+                                         ARRAY_LEN(indexes), "");
+
+   LLVMValueRef count = LLVMBuildLoad(builder, count_ptr, "pgo_count");
+   LLVMBuildStore(builder, LLVMBuildAdd(builder, count, delta, ""), count_ptr);
+}
+
+static void cgen_branch_weights(LLVMValueRef br, vcode_block_t block,
+                                cgen_ctx_t *ctx)
+{
+   uint64_t taken = ctx->profile[PGO_TAKEN(block)];
+   uint64_t total = ctx->profile[PGO_BLOCK(block)];
+   if (total == 0 || taken > total)
+      return;
+
+   uint64_t not_taken = total - taken;
+
+   // Branch weights are only 32 bits wide
+   while (taken > UINT32_MAX || not_taken > UINT32_MAX) {
+      taken >>= 1;
+      not_taken >>= 1;
+   }
+
+   LLVMValueRef weights[] = {
+      LLVMMDString("branch_weights", 14),
+      llvm_int32(taken),
+      llvm_int32(not_taken)
+   };
+   LLVMSetMetadata(br, LLVMGetMDKindID("prof", 4),
+                   LLVMMDNode(weights, ARRAY_LEN(weights)));
+}
+
 static void cgen_op_cond(int op, cgen_ctx_t *ctx)
 {
    LLVMValueRef test = cgen_get_arg(op, 0, ctx);
-   LLVMBuildCondBr(builder, test,
-                   ctx->blocks[vcode_get_target(op, 0)],
-                   ctx->blocks[vcode_get_target(op, 1)]);
+
+   if (ctx->pgo != NULL)
+      cgen_pgo_count(ctx, PGO_TAKEN(vcode_active_block()),
+                     LLVMBuildZExt(builder, test, LLVMInt64Type(), ""));
+
+   LLVMValueRef br = LLVMBuildCondBr(builder, test,
+                                     ctx->blocks[vcode_get_target(op, 0)],
+                                     ctx->blocks[vcode_get_target(op, 1)]);
+
+   if (ctx->profile != NULL)
+      cgen_branch_weights(br, vcode_active_block(), ctx);
 }
 
 static void cgen_op_wrap(int op, cgen_ctx_t *ctx)
@@ -2614,6 +2671,9 @@ static void cgen_block(int block, cgen_ctx_t *ctx)
 
    LLVMPositionBuilderAtEnd(builder, ctx->blocks[block]);
 
+   if (ctx->pgo != NULL)
+      cgen_pgo_count(ctx, PGO_BLOCK(block), llvm_int64(1));
+
    const int nops = vcode_count_ops();
    if (nops > 0) {
       for (int i = 0; i < nops; i++)
@@ -2682,6 +2742,67 @@ static void cgen_locals(cgen_ctx_t *ctx)
    }
 }
 
+static uint32_t cgen_pgo_checksum(void)
+{
+   // Used to detect profile data collected from a different version
+   // of the design
+   uint32_t hash = UINT32_C(2166136261);
+   const int nblocks = vcode_count_blocks();
+   for (int i = 0; i < nblocks; i++) {
+      vcode_select_block(i);
+
+      const int nops = vcode_count_ops();
+      for (int j = 0; j < nops; j++)
+         hash = (hash ^ vcode_get_op(j)) * UINT32_C(16777619);
+
+      hash = (hash ^ 0xff) * UINT32_C(16777619);
+   }
+
+   return hash;
+}
+
+static void cgen_pgo_unit(cgen_ctx_t *ctx)
+{
+   if (!pgo_collect && !pgo_loaded())
+      return;
+
+   ident_t name = vcode_unit_name();
+   const int ncounters = PGO_NCOUNTERS(vcode_count_blocks());
+   const uint32_t checksum = cgen_pgo_checksum();
+
+   if (pgo_collect) {
+      char *buf LOCAL = xasprintf("%s__pgo", istr(name));
+      LLVMTypeRef type = LLVMArrayType(LLVMInt64Type(), ncounters);
+      ctx->pgo = LLVMAddGlobal(module, type, buf);
+      LLVMSetLinkage(ctx->pgo, LLVMInternalLinkage);
+      LLVMSetInitializer(ctx->pgo, LLVMConstNull(type));
+
+      pgo_ref_t ref = {
+         .name      = name,
+         .counters  = ctx->pgo,
+         .ncounters = ncounters,
+         .checksum  = checksum
+      };
+      pgo_ref_array_add(&pgo_refs, ref);
+   }
+
+   if ((ctx->profile = pgo_counters(name, ncounters, checksum)) == NULL)
+      return;
+
+   switch (pgo_heat(name)) {
+   case PGO_COLD:
+      LLVMAddFunctionAttr(ctx->fn, LLVMNoInlineAttribute);
+      LLVMAddFunctionAttr(ctx->fn, LLVMOptimizeForSizeAttribute);
+      break;
+   case PGO_HOT:
+      if (vcode_unit_kind() != VCODE_UNIT_PROCESS)
+         LLVMAddFunctionAttr(ctx->fn, LLVMInlineHintAttribute);
+      break;
+   default:
+      break;
+   }
+}
+
 static LLVMTypeRef cgen_subprogram_type(LLVMTypeRef display_type,
                                         bool is_procecure)
 {
@@ -2733,6 +2854,7 @@ static void cgen_function(LLVMTypeRef display_type)
    cgen_ctx_t ctx = {
       .fn = fn
    };
+   cgen_pgo_unit(&ctx);
    cgen_alloc_context(&ctx);
 
    if (display_type != NULL)
@@ -2740,6 +2862,10 @@ static void cgen_function(LLVMTypeRef display_type)
 
    cgen_params(&ctx);
    cgen_locals(&ctx);
+
+   if (ctx.pgo != NULL)
+      cgen_pgo_count(&ctx, PGO_INVOCATIONS, llvm_int64(1));
+
    cgen_code(&ctx);
    cgen_free_context(&ctx);
 }
@@ -2830,6 +2956,7 @@ static void cgen_procedure(LLVMTypeRef display_type)
    cgen_ctx_t ctx = {
       .fn = fn
    };
+   cgen_pgo_unit(&ctx);
 
    const int nparams = vcode_count_params();
 
@@ -2886,6 +3013,9 @@ static void cgen_procedure(LLVMTypeRef display_type)
       ctx.regs[vcode_param_reg(i)] = LLVMBuildLoad(builder, param_ptr, "");
    }
 
+   if (ctx.pgo != NULL)
+      cgen_pgo_count(&ctx, PGO_INVOCATIONS, llvm_int64(1));
+
    cgen_jump_table(&ctx);
    cgen_code(&ctx);
    cgen_free_context(&ctx);
@@ -2908,6 +3038,7 @@ static void cgen_process(vcode_unit_t code)
    cgen_ctx_t ctx = {
       .fn = fn
    };
+   cgen_pgo_unit(&ctx);
    cgen_state_struct(&ctx);
    cgen_alloc_context(&ctx);
 
@@ -2932,6 +3063,10 @@ static void cgen_process(vcode_unit_t code)
    LLVMBuildBr(builder, ctx.blocks[0]);
 
    LLVMPositionBuilderAtEnd(builder, jump_bb);
+
+   if (ctx.pgo != NULL)
+      cgen_pgo_count(&ctx, PGO_INVOCATIONS, llvm_int64(1));
+
    cgen_jump_table(&ctx);
 
    cgen_code(&ctx);
@@ -3035,14 +3170,14 @@ static void cgen_reset_function(tree_t top)
 
 static void cgen_coverage_state(tree_t t)
 {
-   const int stmt_tags = tree_attr_int(t, ident_new("stmt_tags"), 0);
+   const int stmt_tags = tree_attr_int(t, stmt_tags_i, 0);
    if (stmt_tags > 0) {
       LLVMTypeRef type = LLVMArrayType(LLVMInt32Type(), stmt_tags);
       LLVMValueRef var = LLVMAddGlobal(module, type, "cover_stmts");
       LLVMSetInitializer(var, LLVMGetUndef(type));
    }
 
-   const int cond_tags = tree_attr_int(t, ident_new("cond_tags"), 0);
+   const int cond_tags = tree_attr_int(t, cond_tags_i, 0);
    if (cond_tags > 0) {
       LLVMTypeRef type = LLVMArrayType(LLVMInt32Type(), stmt_tags);
       LLVMValueRef var = LLVMAddGlobal(module, type, "cover_conds");
@@ -3050,6 +3185,54 @@ static void cgen_coverage_state(tree_t t)
    }
 }
 
+static void cgen_pgo_table(void)
+{
+   LLVMTypeRef fields[] = {
+      LLVMPointerType(LLVMInt8Type(), 0),
+      LLVMPointerType(LLVMInt64Type(), 0),
+      LLVMInt32Type(),
+      LLVMInt32Type()
+   };
+   LLVMTypeRef unit_type = LLVMStructType(fields, ARRAY_LEN(fields), false);
+
+   const int count = pgo_refs.count;
+   LLVMValueRef *init = xmalloc(sizeof(LLVMValueRef) * count);
+   for (int i = 0; i < count; i++) {
+      const pgo_ref_t *ref = &(pgo_refs.items[i]);
+
+      const char *name_str = istr(ref->name);
+      const size_t len = strlen(name_str);
+      LLVMTypeRef str_type = LLVMArrayType(LLVMInt8Type(), len + 1);
+      char *buf LOCAL = xasprintf("%s__pgo_name", name_str);
+      LLVMValueRef name = LLVMAddGlobal(module, str_type, buf);
+      LLVMSetInitializer(name, LLVMConstString(name_str, len, false));
+      LLVMSetLinkage(name, LLVMPrivateLinkage);
+      LLVMSetGlobalConstant(name, true);
+
+      LLVMValueRef values[] = {
+         LLVMConstBitCast(name, fields[0]),
+         LLVMConstBitCast(ref->counters, fields[1]),
+         llvm_int32(ref->ncounters),
+         llvm_int32(ref->checksum)
+      };
+      init[i] = LLVMConstStruct(values, ARRAY_LEN(values), false);
+   }
+
+   LLVMTypeRef table_type = LLVMArrayType(unit_type, count);
+   LLVMValueRef table = LLVMAddGlobal(module, table_type, "pgo_table");
+   LLVMSetInitializer(table, LLVMConstArray(unit_type, init, count));
+   LLVMSetGlobalConstant(table, true);
+
+   LLVMValueRef count_var = LLVMAddGlobal(module, LLVMInt32Type(), "pgo_count");
+   LLVMSetInitializer(count_var, llvm_int32(count));
+   LLVMSetGlobalConstant(count_var, true);
+
+   free(init);
+   free(pgo_refs.items);
+   pgo_refs.items = NULL;
+   pgo_refs.count = 0;
+}
+
 static void cgen_subprograms(tree_t t)
 {
    LLVMTypeRef display = NULL;
@@ -3151,6 +3334,9 @@ static void cgen_top(tree_t t)
          cgen_subprograms(p);
          cgen_process(tree_code(p));
       }
+
+      if (pgo_collect)
+         cgen_pgo_table();
    }
 }
 
@@ -3531,6 +3717,14 @@ void cgen(tree_t top)
    module = LLVMModuleCreateWithName(istr(tree_ident(top)));
    builder = LLVMCreateBuilder();
 
+   // Profile counters can only be added when generating code for the
+   // whole design as packages are compiled ahead of time
+   pgo_collect = (kind == T_ELAB) && opt_get_int("pgo-instrument");
+
+   const char *profile = opt_get_str("pgo-use");
+   if (kind == T_ELAB && profile != NULL)
+      pgo_read(top, profile);
+
    cgen_module_name(top);
    cgen_tmp_stack();
 
@@ -765,7 +765,6 @@ void intern_strings(void)
    fst_dir_i        = ident_new("fst_dir");
    scope_pop_i      = ident_new("scope_pop");
    partial_map_i    = ident_new("partial_map");
-   fst_data_i       = ident_new("fst_data");
    std_logic_i      = ident_new("IEEE.STD_LOGIC_1164.STD_LOGIC");
    std_ulogic_i     = ident_new("IEEE.STD_LOGIC_1164.STD_ULOGIC");
    std_bit_i        = ident_new("STD.STANDARD.BIT");
@@ -784,6 +783,7 @@ void intern_strings(void)
    mangled_i        = ident_new("mangled");
    last_value_i     = ident_new("LAST_VALUE");
    elide_bounds_i   = ident_new("elide_bounds");
+   folded_call_i    = ident_new("folded_call");
    null_range_i     = ident_new("null_range");
    deferred_i       = ident_new("deferred");
    prot_field_i     = ident_new("prot_field");
@@ -801,4 +801,16 @@ void intern_strings(void)
    conversion_i     = ident_new("conversion");
    std_i            = ident_new("STD");
    nnets_i          = ident_new("nnets");
+   comb_level_i     = ident_new("comb_level");
+   comb_net_i       = ident_new("comb_net");
+   fused_i          = ident_new("fused");
+   edge_i           = ident_new("edge");
+   clock_i          = ident_new("clock");
+   demoted_i        = ident_new("demoted");
+   memory_i         = ident_new("memory");
+   stmt_tags_i      = ident_new("stmt_tags");
+   cond_tags_i      = ident_new("cond_tags");
+   is_report_i      = ident_new("is_report");
+   guarded_i        = ident_new("guarded");
+   returned_i       = ident_new("returned");
 }
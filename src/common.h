@@ -158,7 +158,6 @@ GLOBAL ident_t inst_name_i;
 GLOBAL ident_t fst_dir_i;
 GLOBAL ident_t scope_pop_i;
 GLOBAL ident_t partial_map_i;
-GLOBAL ident_t fst_data_i;
 GLOBAL ident_t std_logic_i;
 GLOBAL ident_t std_ulogic_i;
 GLOBAL ident_t std_bool_i;
@@ -177,6 +176,7 @@ GLOBAL ident_t GLOBAL_i;
 GLOBAL ident_t mangled_i;
 GLOBAL ident_t last_value_i;
 GLOBAL ident_t elide_bounds_i;
+GLOBAL ident_t folded_call_i;
 GLOBAL ident_t null_range_i;
 GLOBAL ident_t deferred_i;
 GLOBAL ident_t prot_field_i;
@@ -195,6 +195,18 @@ GLOBAL ident_t simple_name_i;
 GLOBAL ident_t conversion_i;
 GLOBAL ident_t std_i;
 GLOBAL ident_t nnets_i;
+GLOBAL ident_t comb_level_i;
+GLOBAL ident_t comb_net_i;
+GLOBAL ident_t fused_i;
+GLOBAL ident_t edge_i;
+GLOBAL ident_t clock_i;
+GLOBAL ident_t demoted_i;
+GLOBAL ident_t memory_i;
+GLOBAL ident_t stmt_tags_i;
+GLOBAL ident_t cond_tags_i;
+GLOBAL ident_t is_report_i;
+GLOBAL ident_t guarded_i;
+GLOBAL ident_t returned_i;
 
 void intern_strings();
 
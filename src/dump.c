@@ -571,7 +571,7 @@ static void dump_decl(tree_t t, int indent)
    }
    printf(";");
 
-   if (tree_attr_int(t, ident_new("returned"), 0))
+   if (tree_attr_int(t, returned_i, 0))
       printf(" -- returned");
 
    printf("\n");
@@ -648,7 +648,7 @@ static void dump_stmt(tree_t t, int indent)
          dump_expr(tree_delay(t));
       }
       printf(";");
-      if (tree_attr_int(t, ident_new("static"), 0))
+      if (tree_attr_int(t, static_i, 0))
          printf("   -- static");
       printf("\n");
       return;
@@ -1027,8 +1027,8 @@ static void elab_signal_nets(tree_t decl, const elab_ctx_t *ctx)
    }
    else {
       const int width = type_width(tree_type(decl));
-      for (int i = 0; i < width; i++)
-         tree_add_net(decl, (*ctx->next_net)++);
+      tree_add_nets(decl, *ctx->next_net, width);
+      *ctx->next_net += width;
    }
 }
 
@@ -18,112 +18,130 @@
 #include "phase.h"
 #include "util.h"
 #include "common.h"
+#include "vcode.h"
+#include "hash.h"
+#include "rt/rt.h"
 
 #include <assert.h>
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <math.h>
+#include <inttypes.h>
+
+#define MAX_STEPS  10000000
+#define MAX_DEPTH  256
+#define MAX_HEAP   (64 * 1024 * 1024)
+#define CHUNK_SIZE (64 * 1024)
+#define MAX_MEMO   8
+
+typedef union value value_t;
+typedef struct uarray uarray_t;
+typedef struct chunk chunk_t;
+typedef struct eval_frame eval_frame_t;
+typedef struct eval_state eval_state_t;
+typedef struct memo memo_t;
+typedef struct fold fold_t;
+
+// Every scalar occupies one value slot and arrays and records are laid
+// out as contiguous runs of slots
+union value {
+   int64_t   integer;
+   double    real;
+   value_t  *pointer;
+   uarray_t *uarray;
+};
 
-#define VTABLE_SZ 16
-#define MAX_ITERS 1000
-
-typedef struct vtable vtable_t;
-typedef struct vtframe vtframe_t;
-
-struct vtframe {
+struct uarray {
+   value_t *data;
+   int      ndims;
    struct {
-      ident_t name;
-      tree_t  value;
-   } binding[VTABLE_SZ];
+      int64_t left;
+      int64_t right;
+      int64_t dir;
+   } dims[0];
+};
 
-   size_t     size;
-   vtframe_t *down;
+struct chunk {
+   chunk_t *next;
+   size_t   used;
+   size_t   size;
+   char     data[0];
 };
 
-struct vtable {
-   vtframe_t *top;
-   bool       failed;
-   ident_t    exit;
-   tree_t     result;
+struct eval_frame {
+   vcode_unit_t   unit;
+   value_t       *regs;
+   value_t      **vars;
+   chunk_t       *chunks;
+   vcode_block_t  block;
+   int            op;
+   bool           returned;
+   value_t        result;
 };
 
-static void eval_stmt(tree_t t, vtable_t *v);
-static tree_t eval_expr(tree_t t, vtable_t *v);
+struct eval_state {
+   tree_t        where;
+   eval_frame_t *frame;
+   chunk_t      *chunks;
+   size_t        allocated;
+   int           steps;
+   int           depth;
+   bool          failed;
+};
+
+// Results of calls with scalar arguments are cached across evaluations
+struct memo {
+   vcode_unit_t unit;
+   int          nargs;
+   int64_t      args[MAX_MEMO];
+   value_t      result;
+};
 
-static bool debug = true;
+// Results of top-level calls with literal arguments are cached so the
+// same call elsewhere in the design is not lowered and evaluated again
+struct fold {
+   tree_t        decl;
+   int           nargs;
+   int64_t       args[MAX_MEMO];
+   bool          ok;
+   value_t       scalar;
+   bool          uarray;
+   int64_t       left;
+   int64_t       right;
+   range_kind_t  dir;
+   int64_t       length;
+   value_t      *data;
+};
 
-#define eval_error(t, ...) do {                 \
-      if (unlikely(debug))                      \
-         warn_at(tree_loc(t),  __VA_ARGS__);    \
-      v->failed = true;                         \
+static bool debug = false;
+static hash_t *units = NULL;
+static memo_t *memo_table = NULL;
+static size_t memo_size = 0;
+static size_t memo_count = 0;
+static fold_t *fold_table = NULL;
+static size_t fold_size = 0;
+static size_t fold_count = 0;
+static int fold_hits = 0;
+static unsigned fold_epoch = 0;
+
+#define eval_error(state, ...) do {             \
+      eval_failed((state), __VA_ARGS__);        \
       return;                                   \
    } while (0)
 
-static void vtable_push(vtable_t *v)
-{
-   vtframe_t *f = xmalloc(sizeof(vtframe_t));
-   f->size = 0;
-   f->down = v->top;
-
-   v->top = f;
-}
-
-static void vtable_pop(vtable_t *v)
-{
-   vtframe_t *f = v->top;
-   v->top    = f->down;
-   v->result = NULL;
-   free(f);
-}
-
-static void vtable_bind(vtable_t *v, ident_t name, tree_t value)
-{
-   vtframe_t *f = v->top;
-   if (f == NULL)
-      return;
-
-   for (size_t i = 0; i < f->size; i++) {
-      if (f->binding[i].name == name) {
-         f->binding[i].value = value;
-         return;
-      }
-   }
-
-   assert(f->size < VTABLE_SZ);
-   f->binding[f->size].name  = name;
-   f->binding[f->size].value = value;
-   ++(f->size);
-}
-
-static tree_t vtframe_get(vtframe_t *f, ident_t name)
+static void eval_failed(eval_state_t *state, const char *fmt, ...)
 {
-   if (f == NULL)
-      return NULL;
-   else {
-      for (size_t i = 0; i < f->size; i++) {
-         if (f->binding[i].name == name)
-            return f->binding[i].value;
-      }
-      return vtframe_get(f->down, name);
+   if (unlikely(debug) && !state->failed) {
+      va_list ap;
+      va_start(ap, fmt);
+      char *msg = xvasprintf(fmt, ap);
+      warn_at(tree_loc(state->where), "cannot evaluate: %s", msg);
+      free(msg);
+      va_end(ap);
    }
-}
 
-static tree_t vtable_get(vtable_t *v, ident_t name)
-{
-   return vtframe_get(v->top, name);
-}
-
-static bool folded(tree_t t)
-{
-   tree_kind_t kind = tree_kind(t);
-   if (kind == T_LITERAL)
-      return true;
-   else if (kind == T_REF) {
-      bool dummy;
-      return folded_bool(t, &dummy);
-   }
-   else
-      return false;
+   state->failed = true;
 }
 
 static tree_t eval_fcall_log(tree_t t, ident_t builtin, bool *args)
@@ -311,71 +329,17 @@ static tree_t eval_fcall_str(tree_t t, ident_t builtin, tree_t *args)
       return t;
 }
 
-static void eval_stmts(tree_t t, unsigned (*count)(tree_t),
-                       tree_t (*get)(tree_t, unsigned), vtable_t *v)
-{
-   const int nstmts = (*count)(t);
-   for (int i = 0; i < nstmts; i++) {
-      eval_stmt((*get)(t, i), v);
-      if (v->failed || (v->result != NULL) || (v->exit != NULL))
-         return;
-   }
-}
-
-static void eval_func_body(tree_t t, vtable_t *v)
-{
-   const int ndecls = tree_decls(t);
-   for (int i = 0; i < ndecls; i++) {
-      tree_t decl = tree_decl(t, i);
-      if ((tree_kind(decl) == T_VAR_DECL) && tree_has_value(decl))
-         vtable_bind(v, tree_ident(decl), eval_expr(tree_value(decl), v));
-   }
 
-   eval_stmts(t, tree_stmts, tree_stmt, v);
-}
+static tree_t eval_expr(tree_t t);
 
-static tree_t eval_fcall(tree_t t, vtable_t *v)
+static tree_t eval_builtin(tree_t t, ident_t builtin)
 {
-   tree_t decl = tree_ref(t);
-   assert(tree_kind(decl) == T_FUNC_DECL
-          || tree_kind(decl) == T_FUNC_BODY);
-
-   ident_t builtin = tree_attr_str(decl, builtin_i);
-   if (builtin == NULL) {
-      if (tree_kind(decl) != T_FUNC_BODY)
-         return t;
-
-      // Only evaluating scalar functions is supported at the moment
-      if (type_is_array(tree_type(t)))
-         return t;
-
-      const int nports = tree_ports(decl);
-      tree_t params[nports];
-
-      for (int i = 0; i < nports; i++) {
-         params[i] = eval_expr(tree_value(tree_param(t, i)), v);
-
-         if (!folded(params[i]))
-            return t;    // Cannot fold this function call
-      }
-
-      vtable_push(v);
-      for (int i = 0; i < nports; i++)
-         vtable_bind(v, tree_ident(tree_port(decl, i)), params[i]);
-
-      eval_func_body(decl, v);
-      tree_t result = v->result;
-      vtable_pop(v);
-
-      return ((result != NULL) && folded(result)) ? result : t;
-   }
-
    const int nparams = tree_params(t);
 
    tree_t targs[nparams];
    for (int i = 0; i < nparams; i++) {
       tree_t p = tree_param(t, i);
-      targs[i] = eval_expr(tree_value(p), v);
+      targs[i] = eval_expr(tree_value(p));
    }
 
    if (icmp(builtin, "mulri") || icmp(builtin, "mulir")
@@ -414,20 +378,18 @@ static tree_t eval_fcall(tree_t t, vtable_t *v)
       return t;
 }
 
-static tree_t eval_ref(tree_t t, vtable_t *v)
+static tree_t eval_ref(tree_t t)
 {
    tree_t decl = tree_ref(t);
-   if (tree_kind(decl) == T_CONST_DECL)
-      return eval_expr(tree_value(decl), v);
-   else {
-      tree_t binding = vtable_get(v, tree_ident(tree_ref(t)));
-      return (binding != NULL) ? binding : t;
-   }
+   if (tree_kind(decl) == T_CONST_DECL && tree_has_value(decl))
+      return eval_expr(tree_value(decl));
+   else
+      return t;
 }
 
-static tree_t eval_type_conv(tree_t t, vtable_t *v)
+static tree_t eval_type_conv(tree_t t)
 {
-   tree_t value = eval_expr(tree_value(tree_param(t, 0)), v);
+   tree_t value = eval_expr(tree_value(tree_param(t, 0)));
 
    type_t from = tree_type(value);
    type_t to   = tree_type(t);
@@ -449,222 +411,1747 @@ static tree_t eval_type_conv(tree_t t, vtable_t *v)
    return t;
 }
 
-static tree_t eval_expr(tree_t t, vtable_t *v)
+static tree_t eval_expr(tree_t t)
 {
    switch (tree_kind(t)) {
    case T_FCALL:
-      return eval_fcall(t, v);
+      {
+         ident_t builtin = tree_attr_str(tree_ref(t), builtin_i);
+         return (builtin != NULL) ? eval_builtin(t, builtin) : t;
+      }
    case T_REF:
-      return eval_ref(t, v);
+      return eval_ref(t);
    case T_TYPE_CONV:
-      return eval_type_conv(t, v);
+      return eval_type_conv(t);
    default:
       return t;
    }
 }
 
-static void eval_return(tree_t t, vtable_t *v)
+static value_t *eval_alloc(eval_state_t *state, chunk_t **list, size_t nslots)
+{
+   const size_t bytes = MAX(nslots, 1) * sizeof(value_t);
+
+   chunk_t *c = *list;
+   if (c == NULL || c->used + bytes > c->size) {
+      const size_t size = MAX(bytes, CHUNK_SIZE);
+      if (state->allocated + size > MAX_HEAP) {
+         eval_failed(state, "memory limit exceeded");
+         return NULL;
+      }
+
+      c = xmalloc(sizeof(chunk_t) + size);
+      c->next = *list;
+      c->used = 0;
+      c->size = size;
+
+      *list = c;
+      state->allocated += size;
+   }
+
+   value_t *p = (value_t *)(c->data + c->used);
+   c->used += bytes;
+   memset(p, '\0', bytes);
+   return p;
+}
+
+static void eval_free_chunks(eval_state_t *state, chunk_t *list)
 {
-   assert(tree_has_value(t));
-   assert(v->result == NULL);
-   v->result = eval_expr(tree_value(t), v);
+   while (list != NULL) {
+      chunk_t *next = list->next;
+      state->allocated -= list->size;
+      free(list);
+      list = next;
+   }
 }
 
-static void eval_if(tree_t t, vtable_t *v)
+static size_t eval_slots(vcode_type_t type)
 {
-   tree_t cond = eval_expr(tree_value(t), v);
-   bool cond_b;
-   if (!folded_bool(cond, &cond_b))
-      eval_error(cond, "cannot constant fold expression");
+   switch (vtype_kind(type)) {
+   case VCODE_TYPE_CARRAY:
+      return vtype_size(type) * eval_slots(vtype_elem(type));
+   case VCODE_TYPE_RECORD:
+      {
+         size_t total = 0;
+         const int nfields = vtype_fields(type);
+         for (int i = 0; i < nfields; i++)
+            total += eval_slots(vtype_field(type, i));
+         return total;
+      }
+   default:
+      return 1;
+   }
+}
 
-   if (cond_b)
-      eval_stmts(t, tree_stmts, tree_stmt, v);
-   else
-      eval_stmts(t, tree_else_stmts, tree_else_stmt, v);
+static bool eval_is_aggregate(vcode_type_t type)
+{
+   const vtype_kind_t kind = vtype_kind(type);
+   return kind == VCODE_TYPE_CARRAY || kind == VCODE_TYPE_RECORD;
 }
 
-static void eval_case(tree_t t, vtable_t *v)
+static void eval_store(value_t *dest, vcode_type_t type, value_t value)
 {
-   tree_t value = tree_value(t);
+   // Arrays and records are passed around as pointers to their storage
+   if (eval_is_aggregate(type))
+      memmove(dest, value.pointer, eval_slots(type) * sizeof(value_t));
+   else
+      *dest = value;
+}
 
-   if (type_is_array(tree_type(value)))
-      eval_error(value, "cannot constant fold array case");
+static value_t *eval_reg(eval_state_t *state, vcode_reg_t reg)
+{
+   return &(state->frame->regs[reg]);
+}
 
-   int64_t value_int;
-   if (!folded_int(eval_expr(value, v), &value_int))
-      eval_error(value, "cannot constant fold expression");
+static value_t eval_arg(eval_state_t *state, int op, int arg)
+{
+   return *eval_reg(state, vcode_get_arg(op, arg));
+}
 
-   const int nassocs = tree_assocs(t);
-   for (int i = 0; i < nassocs; i++) {
-      tree_t a = tree_assoc(t, i);
-      switch (tree_subkind(a)) {
-      case A_NAMED:
-         {
-            int64_t cmp;
-            if (!folded_int(eval_expr(tree_name(a), v), &cmp))
-               eval_error(tree_name(a), "cannot constant fold expression");
-            else if (cmp == value_int) {
-               eval_stmt(tree_value(a), v);
-               return;
-            }
-         }
-         break;
+static value_t *eval_result(eval_state_t *state, int op)
+{
+   return eval_reg(state, vcode_get_result(op));
+}
 
-      case A_OTHERS:
-         eval_stmt(tree_value(a), v);
-         break;
+static bool eval_is_real(vcode_reg_t reg)
+{
+   return vcode_reg_kind(reg) == VCODE_TYPE_REAL;
+}
 
-      default:
-         assert(false);
-      }
+static value_t *eval_var(eval_state_t *state, vcode_var_t var)
+{
+   if (vcode_var_context(var) != vcode_unit_depth()) {
+      eval_failed(state, "reference to variable %s in enclosing scope",
+                  istr(vcode_var_name(var)));
+      return NULL;
    }
+
+   return state->frame->vars[vcode_var_index(var)];
 }
 
-static void eval_while(tree_t t, vtable_t *v)
+static void eval_jump(eval_state_t *state, vcode_block_t target)
 {
-   int iters = 0;
-   tree_t value = tree_has_value(t) ? tree_value(t) : NULL;
-   while (v->result == NULL) {
-      bool cond_b = true;
-      if (value != NULL) {
-         tree_t cond = eval_expr(value, v);
-         if (!folded_bool(cond, &cond_b))
-            eval_error(value, "cannot constant fold expression");
-      }
+   state->frame->block = target;
+   state->frame->op    = -1;
+   vcode_select_block(target);
+}
 
-      if (!cond_b || v->failed)
-         break;
-      else if (++iters == MAX_ITERS) {
-         warn_at(tree_loc(t), "iteration limit exceeded");
-         v->failed = true;
-         break;
-      }
+static void eval_op_const(int op, eval_state_t *state)
+{
+   eval_result(state, op)->integer = vcode_get_value(op);
+}
 
-      eval_stmts(t, tree_stmts, tree_stmt, v);
+static void eval_op_const_real(int op, eval_state_t *state)
+{
+   eval_result(state, op)->real = vcode_get_real(op);
+}
 
-      if (v->exit != NULL) {
-         if (v->exit == tree_ident(t))
-            v->exit = NULL;
-         break;
-      }
-   }
+static void eval_op_null(int op, eval_state_t *state)
+{
+   eval_result(state, op)->pointer = NULL;
 }
 
-static void eval_for(tree_t t, vtable_t *v)
+static void eval_op_const_array(int op, eval_state_t *state)
 {
-   range_t r = tree_range(t);
-   if (r.kind != RANGE_TO && r.kind != RANGE_DOWNTO) {
-      v->failed = true;
+   vcode_type_t type = vcode_reg_type(vcode_get_result(op));
+   vcode_type_t elem = (vtype_kind(type) == VCODE_TYPE_CARRAY)
+      ? vtype_elem(type) : vtype_pointed(type);
+
+   const size_t stride = eval_slots(elem);
+   const int nargs = vcode_count_args(op);
+
+   value_t *mem = eval_alloc(state, &(state->chunks), nargs * stride);
+   if (mem == NULL)
       return;
-   }
 
-   tree_t left  = eval_expr(r.left, v);
-   tree_t right = eval_expr(r.right, v);
+   for (int i = 0; i < nargs; i++)
+      eval_store(mem + i * stride, elem, eval_arg(state, op, i));
+
+   eval_result(state, op)->pointer = mem;
+}
+
+static void eval_op_const_record(int op, eval_state_t *state)
+{
+   vcode_type_t type = vcode_reg_type(vcode_get_result(op));
 
-   int64_t lefti, righti;
-   if (!folded_int(left, &lefti) || !folded_int(right, &righti)) {
-      v->failed = true;
+   value_t *mem = eval_alloc(state, &(state->chunks), eval_slots(type));
+   if (mem == NULL)
       return;
+
+   value_t *p = mem;
+   const int nargs = vcode_count_args(op);
+   for (int i = 0; i < nargs; i++) {
+      vcode_type_t ftype = vtype_field(type, i);
+      eval_store(p, ftype, eval_arg(state, op, i));
+      p += eval_slots(ftype);
    }
 
-   if ((r.kind == RANGE_TO && lefti > righti)
-       || (r.kind == RANGE_DOWNTO && righti < lefti))
-      return;
+   eval_result(state, op)->pointer = mem;
+}
 
-   tree_t idecl = tree_decl(t, 0);
-   int64_t ival = lefti;
-   do {
-      vtable_bind(v, tree_ident(idecl), get_int_lit(left, ival));
-      eval_stmts(t, tree_stmts, tree_stmt, v);
-      if (ival == righti)
-         break;
-      ival += (r.kind == RANGE_TO ? 1 : -1);
-   } while (v->result == NULL);
+static void eval_op_load(int op, eval_state_t *state)
+{
+   value_t *var = eval_var(state, vcode_get_address(op));
+   if (var != NULL)
+      *eval_result(state, op) = *var;
 }
 
-static void eval_var_assign(tree_t t, vtable_t *v)
+static void eval_op_store(int op, eval_state_t *state)
 {
-   tree_t target = tree_target(t);
-   if (tree_kind(target) != T_REF)
-      eval_error(target, "cannot evaluate this target");
+   vcode_var_t address = vcode_get_address(op);
+   value_t *var = eval_var(state, address);
+   if (var != NULL)
+      eval_store(var, vcode_var_type(address), eval_arg(state, op, 0));
+}
 
-   tree_t value = tree_value(t);
-   tree_t updated = eval_expr(value, v);
-   if (!folded(updated))
-      eval_error(value, "cannot constant fold expression");
+static void eval_op_load_indirect(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   vcode_type_t type = vcode_reg_type(result);
+
+   value_t *ptr = eval_arg(state, op, 0).pointer;
+   if (ptr == NULL)
+      eval_error(state, "null pointer dereference");
+
+   if (eval_is_aggregate(type)) {
+      // Take a copy so later stores through the pointer are not visible
+      const size_t nslots = eval_slots(type);
+      value_t *copy = eval_alloc(state, &(state->chunks), nslots);
+      if (copy == NULL)
+         return;
 
-   vtable_bind(v, tree_ident(tree_ref(target)), updated);
+      memcpy(copy, ptr, nslots * sizeof(value_t));
+      eval_reg(state, result)->pointer = copy;
+   }
+   else
+      *eval_reg(state, result) = *ptr;
 }
 
-static void eval_block(tree_t t, vtable_t *v)
+static void eval_op_store_indirect(int op, eval_state_t *state)
 {
-   assert(tree_decls(t) == 0);
-   eval_stmts(t, tree_stmts, tree_stmt, v);
+   vcode_reg_t ptr_reg = vcode_get_arg(op, 1);
+   value_t *ptr = eval_reg(state, ptr_reg)->pointer;
+   if (ptr == NULL)
+      eval_error(state, "null pointer dereference");
+
+   eval_store(ptr, vtype_pointed(vcode_reg_type(ptr_reg)),
+              eval_arg(state, op, 0));
 }
 
-static void eval_exit(tree_t t, vtable_t *v)
+static void eval_op_index(int op, eval_state_t *state)
 {
-   if (tree_has_value(t)) {
-      bool cond_b = true;
-      tree_t cond = eval_expr(tree_value(t), v);
-      if (!folded_bool(cond, &cond_b))
-         eval_error(tree_value(t), "cannot constant fold expression");
-      else if (!cond_b)
-         return;
+   vcode_var_t address = vcode_get_address(op);
+   value_t *var = eval_var(state, address);
+   if (var == NULL)
+      return;
+
+   if (vtype_kind(vcode_var_type(address)) == VCODE_TYPE_CARRAY
+       && vcode_count_args(op) > 0) {
+      vcode_type_t pointed = vtype_pointed(vcode_reg_type(vcode_get_result(op)));
+      const int64_t offset = eval_arg(state, op, 0).integer;
+      var += offset * eval_slots(pointed);
    }
 
-   v->exit = tree_ident2(t);
+   eval_result(state, op)->pointer = var;
 }
 
-static void eval_stmt(tree_t t, vtable_t *v)
+static void eval_op_record_ref(int op, eval_state_t *state)
 {
-   switch (tree_kind(t)) {
-   case T_RETURN:
-      eval_return(t, v);
-      break;
-   case T_WHILE:
-      eval_while(t, v);
-      break;
-   case T_FOR:
-      eval_for(t, v);
+   vcode_reg_t rec_reg = vcode_get_arg(op, 0);
+   vcode_type_t rtype = vtype_pointed(vcode_reg_type(rec_reg));
+
+   const int field = vcode_get_field(op);
+
+   size_t offset = 0;
+   for (int i = 0; i < field; i++)
+      offset += eval_slots(vtype_field(rtype, i));
+
+   value_t *ptr = eval_reg(state, rec_reg)->pointer;
+   if (ptr == NULL)
+      eval_error(state, "null pointer dereference");
+
+   eval_result(state, op)->pointer = ptr + offset;
+}
+
+static void eval_op_add(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   switch (vcode_reg_kind(result)) {
+   case VCODE_TYPE_POINTER:
+      {
+         // When adding pointers only the first argument is a pointer
+         vcode_type_t pointed = vtype_pointed(vcode_reg_type(result));
+         eval_reg(state, result)->pointer =
+            lhs.pointer + rhs.integer * eval_slots(pointed);
+      }
       break;
-   case T_IF:
-      eval_if(t, v);
+   case VCODE_TYPE_REAL:
+      eval_reg(state, result)->real = lhs.real + rhs.real;
       break;
-   case T_VAR_ASSIGN:
-      eval_var_assign(t, v);
+   default:
+      eval_reg(state, result)->integer =
+         (uint64_t)lhs.integer + (uint64_t)rhs.integer;
       break;
-   case T_BLOCK:
-      eval_block(t, v);
+   }
+}
+
+static void eval_op_sub(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   if (eval_is_real(result))
+      eval_reg(state, result)->real = lhs.real - rhs.real;
+   else
+      eval_reg(state, result)->integer =
+         (uint64_t)lhs.integer - (uint64_t)rhs.integer;
+}
+
+static void eval_op_mul(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   if (eval_is_real(result))
+      eval_reg(state, result)->real = lhs.real * rhs.real;
+   else
+      eval_reg(state, result)->integer =
+         (uint64_t)lhs.integer * (uint64_t)rhs.integer;
+}
+
+static void eval_op_div(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   if (eval_is_real(result))
+      eval_reg(state, result)->real = lhs.real / rhs.real;
+   else if (rhs.integer == 0)
+      eval_error(state, "division by zero");
+   else if (rhs.integer == -1)
+      eval_reg(state, result)->integer = -(uint64_t)lhs.integer;
+   else
+      eval_reg(state, result)->integer = lhs.integer / rhs.integer;
+}
+
+static void eval_op_mod(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   vcode_type_t type = vcode_reg_type(result);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   // Code generation uses an unsigned remainder on the native width
+   const int64_t low = vtype_low(type);
+   const unsigned bits = bits_for_range(low, vtype_high(type));
+   const uint64_t mask = (bits >= 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+
+   const uint64_t divisor = (uint64_t)rhs.integer & mask;
+   if (divisor == 0)
+      eval_error(state, "division by zero");
+
+   uint64_t r = ((uint64_t)lhs.integer & mask) % divisor;
+   if (low < 0 && bits < 64 && (r & (UINT64_C(1) << (bits - 1))))
+      r |= ~mask;
+
+   eval_reg(state, result)->integer = r;
+}
+
+static void eval_op_rem(int op, eval_state_t *state)
+{
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   if (rhs.integer == 0)
+      eval_error(state, "division by zero");
+   else if (rhs.integer == -1)
+      eval_result(state, op)->integer = 0;
+   else
+      eval_result(state, op)->integer = lhs.integer % rhs.integer;
+}
+
+static void eval_op_exp(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   if (eval_is_real(result)) {
+      const double exp = eval_is_real(vcode_get_arg(op, 1))
+         ? rhs.real : (double)rhs.integer;
+      eval_reg(state, result)->real = pow(lhs.real, exp);
+   }
+   else if (rhs.integer < 0)
+      eval_error(state, "negative exponent %"PRIi64, rhs.integer);
+   else {
+      uint64_t r = 1, base = lhs.integer;
+      for (int64_t n = rhs.integer; n > 0; n >>= 1) {
+         if (n & 1)
+            r *= base;
+         base *= base;
+      }
+      eval_reg(state, result)->integer = r;
+   }
+}
+
+static void eval_op_neg(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t arg = eval_arg(state, op, 0);
+
+   if (eval_is_real(result))
+      eval_reg(state, result)->real = -arg.real;
+   else
+      eval_reg(state, result)->integer = -(uint64_t)arg.integer;
+}
+
+static void eval_op_abs(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   value_t arg = eval_arg(state, op, 0);
+
+   if (eval_is_real(result))
+      eval_reg(state, result)->real = fabs(arg.real);
+   else if (arg.integer < 0)
+      eval_reg(state, result)->integer = -(uint64_t)arg.integer;
+   else
+      eval_reg(state, result)->integer = arg.integer;
+}
+
+static void eval_op_cmp(int op, eval_state_t *state)
+{
+   vcode_reg_t lhs_reg = vcode_get_arg(op, 0);
+   value_t lhs = eval_arg(state, op, 0);
+   value_t rhs = eval_arg(state, op, 1);
+
+   int cmp;
+   switch (vcode_reg_kind(lhs_reg)) {
+   case VCODE_TYPE_REAL:
+      cmp = (lhs.real > rhs.real) - (lhs.real < rhs.real);
       break;
-   case T_EXIT:
-      eval_exit(t, v);
+   case VCODE_TYPE_POINTER:
+   case VCODE_TYPE_ACCESS:
+      cmp = (lhs.pointer != rhs.pointer);
       break;
-   case T_CASE:
-      eval_case(t, v);
+   case VCODE_TYPE_INT:
+      if (vtype_low(vcode_reg_type(lhs_reg)) >= 0) {
+         const uint64_t l = lhs.integer, r = rhs.integer;
+         cmp = (l > r) - (l < r);
+         break;
+      }
+      // Fall-through
+   default:
+      cmp = (lhs.integer > rhs.integer) - (lhs.integer < rhs.integer);
       break;
+   }
+
+   bool r = false;
+   switch (vcode_get_cmp(op)) {
+   case VCODE_CMP_EQ:  r = (cmp == 0); break;
+   case VCODE_CMP_NEQ: r = (cmp != 0); break;
+   case VCODE_CMP_LT:  r = (cmp < 0); break;
+   case VCODE_CMP_GT:  r = (cmp > 0); break;
+   case VCODE_CMP_LEQ: r = (cmp <= 0); break;
+   case VCODE_CMP_GEQ: r = (cmp >= 0); break;
+   }
+
+   eval_result(state, op)->integer = r;
+}
+
+static void eval_op_cast(int op, eval_state_t *state)
+{
+   vcode_reg_t result = vcode_get_result(op);
+   vcode_reg_t arg_reg = vcode_get_arg(op, 0);
+   value_t arg = *eval_reg(state, arg_reg);
+
+   const bool to_real   = eval_is_real(result);
+   const bool from_real = eval_is_real(arg_reg);
+
+   if (to_real && !from_real)
+      eval_reg(state, result)->real = (double)arg.integer;
+   else if (from_real && !to_real)
+      eval_reg(state, result)->integer = (int64_t)arg.real;
+   else
+      *eval_reg(state, result) = arg;
+}
+
+static void eval_op_not(int op, eval_state_t *state)
+{
+   eval_result(state, op)->integer = !eval_arg(state, op, 0).integer;
+}
+
+static void eval_op_logical(int op, eval_state_t *state)
+{
+   const bool lhs = !!eval_arg(state, op, 0).integer;
+   const bool rhs = !!eval_arg(state, op, 1).integer;
+
+   bool r = false;
+   switch (vcode_get_op(op)) {
+   case VCODE_OP_AND:  r = lhs && rhs; break;
+   case VCODE_OP_OR:   r = lhs || rhs; break;
+   case VCODE_OP_XOR:  r = lhs ^ rhs; break;
+   case VCODE_OP_XNOR: r = !(lhs ^ rhs); break;
+   case VCODE_OP_NAND: r = !(lhs && rhs); break;
+   case VCODE_OP_NOR:  r = !(lhs || rhs); break;
    default:
-      eval_error(t, "cannot evaluate statement %s",
-                 tree_kind_str(tree_kind(t)));
+      assert(false);
    }
+
+   eval_result(state, op)->integer = r;
 }
 
-tree_t eval(tree_t fcall)
+static void eval_op_select(int op, eval_state_t *state)
 {
-   assert(tree_kind(fcall) == T_FCALL);
+   const bool test = !!eval_arg(state, op, 0).integer;
+   *eval_result(state, op) = eval_arg(state, op, test ? 1 : 2);
+}
 
-   static bool have_debug = false;
-   if (!have_debug) {
-      debug = (getenv("NVC_EVAL_DEBUG") != NULL);
-      have_debug = true;
+static void eval_op_jump(int op, eval_state_t *state)
+{
+   eval_jump(state, vcode_get_target(op, 0));
+}
+
+static void eval_op_cond(int op, eval_state_t *state)
+{
+   const bool test = !!eval_arg(state, op, 0).integer;
+   eval_jump(state, vcode_get_target(op, test ? 0 : 1));
+}
+
+static void eval_op_case(int op, eval_state_t *state)
+{
+   const int64_t value = eval_arg(state, op, 0).integer;
+
+   const int nargs = vcode_count_args(op);
+   for (int i = 1; i < nargs; i++) {
+      if (eval_arg(state, op, i).integer == value) {
+         eval_jump(state, vcode_get_target(op, i));
+         return;
+      }
    }
 
-   vtable_t vt = {
-      .top    = NULL,
-      .failed = false,
-      .exit   = NULL,
-      .result = NULL
-   };
-   tree_t r = eval_fcall(fcall, &vt);
-   return vt.failed ? fcall : r;
+   eval_jump(state, vcode_get_target(op, 0));
+}
+
+static void eval_op_return(int op, eval_state_t *state)
+{
+   if (vcode_count_args(op) > 0)
+      state->frame->result = eval_arg(state, op, 0);
+
+   state->frame->returned = true;
+}
+
+static void eval_op_bounds(int op, eval_state_t *state)
+{
+   vcode_type_t type = vcode_get_type(op);
+   if (vtype_kind(type) != VCODE_TYPE_INT)
+      return;
+
+   const int64_t value = eval_arg(state, op, 0).integer;
+   if (value < vtype_low(type) || value > vtype_high(type))
+      eval_error(state, "value %"PRIi64" out of bounds %"PRIi64" to %"PRIi64,
+                 value, vtype_low(type), vtype_high(type));
+}
+
+static void eval_op_dynamic_bounds(int op, eval_state_t *state)
+{
+   const int64_t value = eval_arg(state, op, 0).integer;
+   const int64_t low   = eval_arg(state, op, 1).integer;
+   const int64_t high  = eval_arg(state, op, 2).integer;
+
+   if (value < low || value > high)
+      eval_error(state, "value %"PRIi64" out of bounds %"PRIi64" to %"PRIi64,
+                 value, low, high);
+}
+
+static void eval_op_index_check(int op, eval_state_t *state)
+{
+   const int64_t low  = eval_arg(state, op, 0).integer;
+   const int64_t high = eval_arg(state, op, 1).integer;
+
+   int64_t min, max;
+   if (vcode_count_args(op) == 2) {
+      vcode_type_t bounds = vcode_get_type(op);
+      min = vtype_low(bounds);
+      max = vtype_high(bounds);
+   }
+   else {
+      min = eval_arg(state, op, 2).integer;
+      max = eval_arg(state, op, 3).integer;
+   }
+
+   if (high < low)
+      return;   // Null range
+   else if (low < min || high > max)
+      eval_error(state, "index range %"PRIi64" to %"PRIi64" outside of "
+                 "bounds %"PRIi64" to %"PRIi64, low, high, min, max);
+}
+
+static void eval_op_array_size(int op, eval_state_t *state)
+{
+   const int64_t llen = eval_arg(state, op, 0).integer;
+   const int64_t rlen = eval_arg(state, op, 1).integer;
+
+   if (llen != rlen)
+      eval_error(state, "length mismatch %"PRIi64" vs %"PRIi64, llen, rlen);
+}
+
+static void eval_op_null_check(int op, eval_state_t *state)
+{
+   if (eval_arg(state, op, 0).pointer == NULL)
+      eval_error(state, "null pointer dereference");
+}
+
+static void eval_op_assert(int op, eval_state_t *state)
+{
+   // A failing assertion of any severity must be reported at run time
+   if (!eval_arg(state, op, 0).integer)
+      eval_error(state, "assertion failed");
+}
+
+static void eval_op_alloca(int op, eval_state_t *state)
+{
+   vcode_type_t type = vcode_get_type(op);
+
+   size_t count = 1;
+   if (vcode_count_args(op) > 0) {
+      const int64_t n = eval_arg(state, op, 0).integer;
+      count = MAX(n, 0);
+   }
+
+   chunk_t **list = (vcode_get_subkind(op) == VCODE_ALLOCA_HEAP)
+      ? &(state->chunks) : &(state->frame->chunks);
+
+   value_t *mem = eval_alloc(state, list, count * eval_slots(type));
+   if (mem != NULL)
+      eval_result(state, op)->pointer = mem;
+}
+
+static void eval_op_new(int op, eval_state_t *state)
+{
+   vcode_type_t pointed = vtype_pointed(vcode_reg_type(vcode_get_result(op)));
+
+   size_t count = 1;
+   if (vcode_count_args(op) > 0) {
+      const int64_t n = eval_arg(state, op, 0).integer;
+      count = MAX(n, 0);
+   }
+
+   value_t *mem = eval_alloc(state, &(state->chunks),
+                             count * eval_slots(pointed));
+   if (mem != NULL)
+      eval_result(state, op)->pointer = mem;
+}
+
+static void eval_op_deallocate(int op, eval_state_t *state)
+{
+   value_t *ptr = eval_arg(state, op, 0).pointer;
+   ptr->pointer = NULL;
+}
+
+static void eval_op_copy(int op, eval_state_t *state)
+{
+   vcode_reg_t dest_reg = vcode_get_arg(op, 0);
+   value_t *dest = eval_reg(state, dest_reg)->pointer;
+   value_t *src  = eval_arg(state, op, 1).pointer;
+
+   int64_t count = 1;
+   if (vcode_count_args(op) > 2)
+      count = eval_arg(state, op, 2).integer;
+
+   if (count <= 0)
+      return;
+
+   const size_t stride = eval_slots(vtype_pointed(vcode_reg_type(dest_reg)));
+   memmove(dest, src, count * stride * sizeof(value_t));
+}
+
+static void eval_op_memset(int op, eval_state_t *state)
+{
+   vcode_reg_t ptr_reg = vcode_get_arg(op, 0);
+   vcode_type_t type = vtype_pointed(vcode_reg_type(ptr_reg));
+
+   value_t *ptr = eval_reg(state, ptr_reg)->pointer;
+   const int64_t value = eval_arg(state, op, 1).integer;
+   const int64_t bytes = eval_arg(state, op, 2).integer;
+
+   value_t fill;
+   size_t width;
+   switch (vtype_kind(type)) {
+   case VCODE_TYPE_INT:
+      {
+         const int64_t low = vtype_low(type);
+         const unsigned bits = bits_for_range(low, vtype_high(type));
+         width = (bits + 7) / 8;
+
+         if (width == 1)
+            fill.integer = value;
+         else {
+            // The fill byte is repeated across each element
+            uint64_t pattern = 0;
+            for (size_t i = 0; i < width; i++)
+               pattern = (pattern << 8) | (value & 0xff);
+
+            const unsigned nbits = width * 8;
+            if (low < 0 && nbits < 64 && (pattern >> (nbits - 1)))
+               pattern |= ~UINT64_C(0) << nbits;
+
+            fill.integer = pattern;
+         }
+      }
+      break;
+   case VCODE_TYPE_REAL:
+      if (value != 0)
+         eval_error(state, "cannot fill real array with byte %"PRIi64, value);
+      width = sizeof(double);
+      fill.real = 0.0;
+      break;
+   default:
+      eval_error(state, "cannot fill array of %d", vtype_kind(type));
+   }
+
+   const int64_t count = bytes / width;
+   for (int64_t i = 0; i < count; i++)
+      ptr[i] = fill;
+}
+
+static bool eval_equal(const value_t *lhs, const value_t *rhs,
+                       vcode_type_t type)
+{
+   // Reals must use floating point comparison as 0.0 = -0.0 but NaN is
+   // not equal to itself
+
+   switch (vtype_kind(type)) {
+   case VCODE_TYPE_REAL:
+      return lhs->real == rhs->real;
+   case VCODE_TYPE_CARRAY:
+      {
+         vcode_type_t elem = vtype_elem(type);
+         const size_t stride = eval_slots(elem);
+         const int size = vtype_size(type);
+         for (int i = 0; i < size; i++) {
+            if (!eval_equal(lhs + i * stride, rhs + i * stride, elem))
+               return false;
+         }
+         return true;
+      }
+   case VCODE_TYPE_RECORD:
+      {
+         const int nfields = vtype_fields(type);
+         for (int i = 0; i < nfields; i++) {
+            vcode_type_t ftype = vtype_field(type, i);
+            if (!eval_equal(lhs, rhs, ftype))
+               return false;
+
+            const size_t nslots = eval_slots(ftype);
+            lhs += nslots;
+            rhs += nslots;
+         }
+         return true;
+      }
+   default:
+      return lhs->integer == rhs->integer;
+   }
+}
+
+static void eval_op_memcmp(int op, eval_state_t *state)
+{
+   vcode_reg_t lhs_reg = vcode_get_arg(op, 0);
+   value_t *lhs = eval_reg(state, lhs_reg)->pointer;
+   value_t *rhs = eval_arg(state, op, 1).pointer;
+   const int64_t len = eval_arg(state, op, 2).integer;
+
+   vcode_type_t elem = vtype_pointed(vcode_reg_type(lhs_reg));
+   const size_t stride = eval_slots(elem);
+
+   bool equal = true;
+   for (int64_t i = 0; equal && i < len; i++)
+      equal = eval_equal(lhs + i * stride, rhs + i * stride, elem);
+
+   eval_result(state, op)->integer = equal;
+}
+
+static uarray_t *eval_new_uarray(eval_state_t *state, int ndims)
+{
+   const size_t bytes = sizeof(uarray_t) + ndims * 3 * sizeof(int64_t);
+   const size_t nslots = (bytes + sizeof(value_t) - 1) / sizeof(value_t);
+
+   uarray_t *u = (uarray_t *)eval_alloc(state, &(state->chunks), nslots);
+   if (u != NULL)
+      u->ndims = ndims;
+   return u;
+}
+
+static void eval_op_wrap(int op, eval_state_t *state)
+{
+   const int ndims = (vcode_count_args(op) - 1) / 3;
+
+   uarray_t *u = eval_new_uarray(state, ndims);
+   if (u == NULL)
+      return;
+
+   u->data = eval_arg(state, op, 0).pointer;
+   for (int i = 0; i < ndims; i++) {
+      u->dims[i].left  = eval_arg(state, op, 1 + i*3).integer;
+      u->dims[i].right = eval_arg(state, op, 2 + i*3).integer;
+      u->dims[i].dir   = eval_arg(state, op, 3 + i*3).integer;
+   }
+
+   eval_result(state, op)->uarray = u;
+}
+
+static void eval_op_unwrap(int op, eval_state_t *state)
+{
+   eval_result(state, op)->pointer = eval_arg(state, op, 0).uarray->data;
+}
+
+static void eval_op_uarray_dim(int op, eval_state_t *state)
+{
+   uarray_t *u = eval_arg(state, op, 0).uarray;
+   const unsigned dim = vcode_get_dim(op);
+   assert(dim < u->ndims);
+
+   const int64_t left  = u->dims[dim].left;
+   const int64_t right = u->dims[dim].right;
+   const int64_t dir   = u->dims[dim].dir;
+
+   int64_t r = 0;
+   switch (vcode_get_op(op)) {
+   case VCODE_OP_UARRAY_LEFT:
+      r = left;
+      break;
+   case VCODE_OP_UARRAY_RIGHT:
+      r = right;
+      break;
+   case VCODE_OP_UARRAY_DIR:
+      r = dir;
+      break;
+   case VCODE_OP_UARRAY_LEN:
+      r = MAX((dir == RANGE_DOWNTO ? left - right : right - left) + 1, 0);
+      break;
+   default:
+      assert(false);
+   }
+
+   eval_result(state, op)->integer = r;
+}
+
+static void eval_op_bit_vec_op(int op, eval_state_t *state)
+{
+   const int kind = vcode_get_subkind(op);
+
+   value_t *left = eval_arg(state, op, 0).pointer;
+   const int64_t left_len = eval_arg(state, op, 1).integer;
+   const int64_t left_dir = eval_arg(state, op, 2).integer;
+
+   value_t *right = NULL;
+   if (vcode_count_args(op) == 6) {
+      right = eval_arg(state, op, 3).pointer;
+      if (eval_arg(state, op, 4).integer != left_len)
+         eval_error(state, "arguments to bit vector operation are not the "
+                    "same length");
+   }
+
+   uarray_t *u = eval_new_uarray(state, 1);
+   value_t *buf = eval_alloc(state, &(state->chunks), left_len);
+   if (u == NULL || buf == NULL)
+      return;
+
+   for (int64_t i = 0; i < left_len; i++) {
+      const bool l = !!left[i].integer;
+      const bool r = (right != NULL) && right[i].integer;
+
+      switch (kind) {
+      case BIT_VEC_NOT:  buf[i].integer = !l; break;
+      case BIT_VEC_AND:  buf[i].integer = l && r; break;
+      case BIT_VEC_OR:   buf[i].integer = l || r; break;
+      case BIT_VEC_XOR:  buf[i].integer = l ^ r; break;
+      case BIT_VEC_XNOR: buf[i].integer = !(l ^ r); break;
+      case BIT_VEC_NAND: buf[i].integer = !(l && r); break;
+      case BIT_VEC_NOR:  buf[i].integer = !(l || r); break;
+      }
+   }
+
+   u->data = buf;
+   u->dims[0].left  = (left_dir == RANGE_TO) ? 0 : left_len - 1;
+   u->dims[0].right = (left_dir == RANGE_TO) ? left_len - 1 : 0;
+   u->dims[0].dir   = left_dir;
+
+   eval_result(state, op)->uarray = u;
+}
+
+static void eval_op_bit_shift(int op, eval_state_t *state)
+{
+   int kind = vcode_get_subkind(op);
+
+   value_t *data = eval_arg(state, op, 0).pointer;
+   const int64_t len = eval_arg(state, op, 1).integer;
+   const int64_t dir = eval_arg(state, op, 2).integer;
+   int64_t shift = eval_arg(state, op, 3).integer;
+
+   if (shift < 0) {
+      kind  = kind ^ 1;
+      shift = -shift;
+   }
+
+   if (len > 0)
+      shift %= len;
+
+   uarray_t *u = eval_new_uarray(state, 1);
+   value_t *buf = eval_alloc(state, &(state->chunks), len);
+   if (u == NULL || buf == NULL)
+      return;
+
+   for (int64_t i = 0; i < len; i++) {
+      switch (kind) {
+      case BIT_SHIFT_SLL:
+         buf[i].integer = (i < len - shift) ? data[i + shift].integer : 0;
+         break;
+      case BIT_SHIFT_SRL:
+         buf[i].integer = (i >= shift) ? data[i - shift].integer : 0;
+         break;
+      case BIT_SHIFT_SLA:
+         buf[i] = (i < len - shift) ? data[i + shift] : data[len - 1];
+         break;
+      case BIT_SHIFT_SRA:
+         buf[i] = (i >= shift) ? data[i - shift] : data[0];
+         break;
+      case BIT_SHIFT_ROL:
+         buf[i] = (i < len - shift) ? data[i + shift] : data[(i + shift) % len];
+         break;
+      case BIT_SHIFT_ROR:
+         buf[i] = (i >= shift) ? data[i - shift] : data[len + i - shift];
+         break;
+      }
+   }
+
+   u->data = buf;
+   u->dims[0].left  = (dir == RANGE_TO) ? 0 : len - 1;
+   u->dims[0].right = (dir == RANGE_TO) ? len - 1 : 0;
+   u->dims[0].dir   = dir;
+
+   eval_result(state, op)->uarray = u;
+}
+
+static void eval_op_heap_save(int op, eval_state_t *state)
+{
+   // Temporary allocations are released when evaluation finishes
+   eval_result(state, op)->integer = 0;
+}
+
+static void eval_call(eval_state_t *state, vcode_unit_t unit,
+                      const value_t *args, int nargs, value_t *result);
+
+static vcode_unit_t eval_find_unit(eval_state_t *state, ident_t name)
+{
+   if (units == NULL)
+      units = hash_new(256, true);
+
+   vcode_unit_t vu = hash_get(units, name);
+   if (vu == NULL) {
+      if ((vu = lower_func(name)) == NULL) {
+         eval_failed(state, "cannot lower %s", istr(name));
+         return NULL;
+      }
+
+      hash_put(units, name, vu);
+   }
+
+   return vu;
+}
+
+static uint32_t eval_memo_hash(const void *key, const int64_t *args,
+                               int nargs)
+{
+   uint64_t h = (uintptr_t)key >> 3;
+   for (int i = 0; i < nargs; i++)
+      h = (h ^ (uint64_t)args[i]) * UINT64_C(0x100000001b3);
+   return h ^ (h >> 32);
+}
+
+static memo_t *eval_memo_lookup(vcode_unit_t unit, const int64_t *args,
+                                int nargs)
+{
+   if (memo_table == NULL)
+      return NULL;
+
+   const size_t mask = memo_size - 1;
+   size_t slot = eval_memo_hash(unit, args, nargs) & mask;
+   for (;; slot = (slot + 1) & mask) {
+      memo_t *m = &(memo_table[slot]);
+      if (m->unit == NULL)
+         return NULL;
+      else if (m->unit == unit && m->nargs == nargs
+               && memcmp(m->args, args, nargs * sizeof(int64_t)) == 0)
+         return m;
+   }
+}
+
+static void eval_memo_insert(vcode_unit_t unit, const int64_t *args,
+                             int nargs, value_t result)
+{
+   if (memo_count * 2 >= memo_size) {
+      memo_t *old = memo_table;
+      const size_t old_size = memo_size;
+
+      memo_size  = MAX(memo_size * 2, 256);
+      memo_table = xcalloc(memo_size * sizeof(memo_t));
+      memo_count = 0;
+
+      for (size_t i = 0; i < old_size; i++) {
+         if (old[i].unit != NULL)
+            eval_memo_insert(old[i].unit, old[i].args, old[i].nargs,
+                             old[i].result);
+      }
+
+      free(old);
+   }
+
+   const size_t mask = memo_size - 1;
+   size_t slot = eval_memo_hash(unit, args, nargs) & mask;
+   while (memo_table[slot].unit != NULL)
+      slot = (slot + 1) & mask;
+
+   memo_t *m = &(memo_table[slot]);
+   m->unit   = unit;
+   m->nargs  = nargs;
+   m->result = result;
+   memcpy(m->args, args, nargs * sizeof(int64_t));
+
+   memo_count++;
+}
+
+static bool eval_memo_args(int op)
+{
+   const vcode_reg_t result = vcode_get_result(op);
+   if (result == VCODE_INVALID_REG)
+      return false;
+
+   const vtype_kind_t rkind = vcode_reg_kind(result);
+   if (rkind != VCODE_TYPE_INT && rkind != VCODE_TYPE_REAL)
+      return false;
+
+   const int nargs = vcode_count_args(op);
+   if (nargs > MAX_MEMO)
+      return false;
+
+   for (int i = 0; i < nargs; i++) {
+      switch (vcode_reg_kind(vcode_get_arg(op, i))) {
+      case VCODE_TYPE_INT:
+      case VCODE_TYPE_OFFSET:
+      case VCODE_TYPE_REAL:
+         break;
+      default:
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void eval_op_fcall(int op, eval_state_t *state)
+{
+   ident_t func = vcode_get_func(op);
+   vcode_reg_t result = vcode_get_result(op);
+
+   const int nargs = vcode_count_args(op);
+   value_t args[nargs];
+   for (int i = 0; i < nargs; i++)
+      args[i] = eval_arg(state, op, i);
+
+   // Pure functions of scalar arguments are cached by argument values
+   int64_t keys[MAX_MEMO];
+   const bool memo = eval_memo_args(op);
+   if (memo) {
+      for (int i = 0; i < nargs; i++)
+         keys[i] = args[i].integer;
+   }
+
+   eval_frame_t *caller = state->frame;
+
+   vcode_unit_t vu = eval_find_unit(state, func);
+
+   vcode_select_unit(caller->unit);
+   vcode_select_block(caller->block);
+
+   if (vu == NULL)
+      return;
+
+   if (memo) {
+      memo_t *m = eval_memo_lookup(vu, keys, nargs);
+      if (m != NULL) {
+         *eval_reg(state, result) = m->result;
+         return;
+      }
+   }
+
+   value_t r = { .integer = 0 };
+   eval_call(state, vu, args, nargs, &r);
+
+   if (state->failed)
+      return;
+
+   if (result != VCODE_INVALID_REG)
+      *eval_reg(state, result) = r;
+
+   if (memo)
+      eval_memo_insert(vu, keys, nargs, r);
+}
+
+static void eval_op(int op, eval_state_t *state)
+{
+   switch (vcode_get_op(op)) {
+   case VCODE_OP_COMMENT:
+   case VCODE_OP_STORAGE_HINT:
+   case VCODE_OP_DEBUG_OUT:
+   case VCODE_OP_COVER_STMT:
+   case VCODE_OP_COVER_COND:
+   case VCODE_OP_HEAP_RESTORE:
+      break;
+   case VCODE_OP_CONST:
+      eval_op_const(op, state);
+      break;
+   case VCODE_OP_CONST_REAL:
+      eval_op_const_real(op, state);
+      break;
+   case VCODE_OP_CONST_ARRAY:
+      eval_op_const_array(op, state);
+      break;
+   case VCODE_OP_CONST_RECORD:
+      eval_op_const_record(op, state);
+      break;
+   case VCODE_OP_NULL:
+      eval_op_null(op, state);
+      break;
+   case VCODE_OP_LOAD:
+      eval_op_load(op, state);
+      break;
+   case VCODE_OP_STORE:
+      eval_op_store(op, state);
+      break;
+   case VCODE_OP_LOAD_INDIRECT:
+      eval_op_load_indirect(op, state);
+      break;
+   case VCODE_OP_STORE_INDIRECT:
+      eval_op_store_indirect(op, state);
+      break;
+   case VCODE_OP_INDEX:
+      eval_op_index(op, state);
+      break;
+   case VCODE_OP_RECORD_REF:
+      eval_op_record_ref(op, state);
+      break;
+   case VCODE_OP_ADD:
+      eval_op_add(op, state);
+      break;
+   case VCODE_OP_SUB:
+      eval_op_sub(op, state);
+      break;
+   case VCODE_OP_MUL:
+      eval_op_mul(op, state);
+      break;
+   case VCODE_OP_DIV:
+      eval_op_div(op, state);
+      break;
+   case VCODE_OP_MOD:
+      eval_op_mod(op, state);
+      break;
+   case VCODE_OP_REM:
+      eval_op_rem(op, state);
+      break;
+   case VCODE_OP_EXP:
+      eval_op_exp(op, state);
+      break;
+   case VCODE_OP_NEG:
+      eval_op_neg(op, state);
+      break;
+   case VCODE_OP_ABS:
+      eval_op_abs(op, state);
+      break;
+   case VCODE_OP_CMP:
+      eval_op_cmp(op, state);
+      break;
+   case VCODE_OP_CAST:
+      eval_op_cast(op, state);
+      break;
+   case VCODE_OP_NOT:
+      eval_op_not(op, state);
+      break;
+   case VCODE_OP_AND:
+   case VCODE_OP_OR:
+   case VCODE_OP_XOR:
+   case VCODE_OP_XNOR:
+   case VCODE_OP_NAND:
+   case VCODE_OP_NOR:
+      eval_op_logical(op, state);
+      break;
+   case VCODE_OP_SELECT:
+      eval_op_select(op, state);
+      break;
+   case VCODE_OP_JUMP:
+      eval_op_jump(op, state);
+      break;
+   case VCODE_OP_COND:
+      eval_op_cond(op, state);
+      break;
+   case VCODE_OP_CASE:
+      eval_op_case(op, state);
+      break;
+   case VCODE_OP_RETURN:
+      eval_op_return(op, state);
+      break;
+   case VCODE_OP_FCALL:
+      eval_op_fcall(op, state);
+      break;
+   case VCODE_OP_BOUNDS:
+      eval_op_bounds(op, state);
+      break;
+   case VCODE_OP_DYNAMIC_BOUNDS:
+      eval_op_dynamic_bounds(op, state);
+      break;
+   case VCODE_OP_INDEX_CHECK:
+      eval_op_index_check(op, state);
+      break;
+   case VCODE_OP_ARRAY_SIZE:
+      eval_op_array_size(op, state);
+      break;
+   case VCODE_OP_NULL_CHECK:
+      eval_op_null_check(op, state);
+      break;
+   case VCODE_OP_ASSERT:
+      eval_op_assert(op, state);
+      break;
+   case VCODE_OP_ALLOCA:
+      eval_op_alloca(op, state);
+      break;
+   case VCODE_OP_NEW:
+      eval_op_new(op, state);
+      break;
+   case VCODE_OP_ALL:
+      *eval_result(state, op) = eval_arg(state, op, 0);
+      break;
+   case VCODE_OP_DEALLOCATE:
+      eval_op_deallocate(op, state);
+      break;
+   case VCODE_OP_COPY:
+      eval_op_copy(op, state);
+      break;
+   case VCODE_OP_MEMSET:
+      eval_op_memset(op, state);
+      break;
+   case VCODE_OP_MEMCMP:
+      eval_op_memcmp(op, state);
+      break;
+   case VCODE_OP_WRAP:
+      eval_op_wrap(op, state);
+      break;
+   case VCODE_OP_UNWRAP:
+      eval_op_unwrap(op, state);
+      break;
+   case VCODE_OP_UARRAY_LEFT:
+   case VCODE_OP_UARRAY_RIGHT:
+   case VCODE_OP_UARRAY_DIR:
+   case VCODE_OP_UARRAY_LEN:
+      eval_op_uarray_dim(op, state);
+      break;
+   case VCODE_OP_BIT_VEC_OP:
+      eval_op_bit_vec_op(op, state);
+      break;
+   case VCODE_OP_BIT_SHIFT:
+      eval_op_bit_shift(op, state);
+      break;
+   case VCODE_OP_HEAP_SAVE:
+      eval_op_heap_save(op, state);
+      break;
+   default:
+      eval_failed(state, "cannot evaluate %s operation",
+                  vcode_op_string(vcode_get_op(op)));
+      break;
+   }
+}
+
+static void eval_run(eval_state_t *state)
+{
+   eval_frame_t *frame = state->frame;
+
+   eval_jump(state, 0);
+
+   while (!frame->returned && !state->failed) {
+      if (++(state->steps) > MAX_STEPS) {
+         eval_failed(state, "exceeded maximum of %d steps", MAX_STEPS);
+         break;
+      }
+
+      const int op = ++(frame->op);
+      if (op >= vcode_count_ops()) {
+         eval_failed(state, "fell off end of block %d", frame->block);
+         break;
+      }
+
+      eval_op(op, state);
+   }
+}
+
+static void eval_call(eval_state_t *state, vcode_unit_t unit,
+                      const value_t *args, int nargs, value_t *result)
+{
+   if (state->depth >= MAX_DEPTH)
+      eval_error(state, "maximum call depth of %d exceeded", MAX_DEPTH);
+
+   vcode_select_unit(unit);
+
+   if (vcode_count_params() != nargs)
+      eval_error(state, "expected %d arguments but have %d",
+                 vcode_count_params(), nargs);
+
+   eval_frame_t frame = {
+      .unit     = unit,
+      .regs     = xcalloc(MAX(vcode_count_regs(), 1) * sizeof(value_t)),
+      .vars     = NULL,
+      .chunks   = NULL,
+      .block    = 0,
+      .op       = -1,
+      .returned = false
+   };
+
+   for (int i = 0; i < nargs; i++)
+      frame.regs[vcode_param_reg(i)] = args[i];
+
+   eval_frame_t *caller = state->frame;
+   state->frame = &frame;
+   state->depth++;
+
+   const int nvars = vcode_count_vars();
+   frame.vars = xmalloc(MAX(nvars, 1) * sizeof(value_t *));
+   for (int i = 0; i < nvars && !state->failed; i++) {
+      vcode_var_t var = vcode_var_handle(i);
+
+      // Variables whose address escapes the function must outlive it
+      chunk_t **list = vcode_var_use_heap(var)
+         ? &(state->chunks) : &(frame.chunks);
+
+      frame.vars[i] = eval_alloc(state, list, eval_slots(vcode_var_type(var)));
+   }
+
+   if (!state->failed)
+      eval_run(state);
+
+   if (frame.returned)
+      *result = frame.result;
+
+   eval_free_chunks(state, frame.chunks);
+   free(frame.regs);
+   free(frame.vars);
+
+   state->depth--;
+   state->frame = caller;
+
+   if (caller != NULL) {
+      vcode_select_unit(caller->unit);
+      vcode_select_block(caller->block);
+   }
+}
+
+static tree_t eval_scalar_tree(type_t type, const loc_t *loc,
+                               value_t value, bool *ok)
+{
+   if (type_is_enum(type)) {
+      type_t base = type_base_recur(type);
+      if (value.integer < 0 || value.integer >= type_enum_literals(base)) {
+         *ok = false;
+         return NULL;
+      }
+
+      tree_t lit = type_enum_literal(base, value.integer);
+
+      tree_t ref = tree_new(T_REF);
+      tree_set_loc(ref, loc);
+      tree_set_ref(ref, lit);
+      tree_set_type(ref, type);
+      tree_set_ident(ref, tree_ident(lit));
+      return ref;
+   }
+
+   tree_t lit = tree_new(T_LITERAL);
+   tree_set_loc(lit, loc);
+   tree_set_type(lit, type);
+
+   if (type_is_real(type)) {
+      tree_set_subkind(lit, L_REAL);
+      tree_set_dval(lit, value.real);
+   }
+   else {
+      tree_set_subkind(lit, L_INT);
+      tree_set_ival(lit, value.integer);
+   }
+
+   return lit;
+}
+
+static tree_t eval_array_tree(tree_t fcall, const fold_t *f)
+{
+   type_t type = tree_type(fcall);
+   type_t elem = type_elem(type);
+   const loc_t *loc = tree_loc(fcall);
+
+   type_t agg_type = type;
+
+   if (f->uarray) {
+      type_t index = index_type_of(type, 0);
+      bool ok = true;
+      value_t lv = { .integer = f->left }, rv = { .integer = f->right };
+      range_t r = {
+         .kind  = f->dir,
+         .left  = eval_scalar_tree(index, loc, lv, &ok),
+         .right = eval_scalar_tree(index, loc, rv, &ok)
+      };
+
+      if (!ok)
+         return fcall;
+
+      agg_type = type_new(T_SUBTYPE);
+      if (type_has_ident(type))
+         type_set_ident(agg_type, type_ident(type));
+      type_set_base(agg_type, type);
+      type_add_dim(agg_type, r);
+   }
+
+   tree_t agg = tree_new(T_AGGREGATE);
+   tree_set_loc(agg, loc);
+   tree_set_type(agg, agg_type);
+
+   for (int64_t i = 0; i < f->length; i++) {
+      bool ok = true;
+      tree_t value = eval_scalar_tree(elem, loc, f->data[i], &ok);
+      if (!ok)
+         return fcall;
+
+      tree_t a = tree_new(T_ASSOC);
+      tree_set_loc(a, loc);
+      tree_set_subkind(a, A_POS);
+      tree_set_value(a, value);
+
+      tree_add_assoc(agg, a);
+   }
+
+   return agg;
+}
+
+static bool eval_capture(fold_t *f, type_t type, value_t result)
+{
+   // Copy the result out of the evaluation heap so it can be reused
+
+   if (type_is_scalar(type)) {
+      f->scalar = result;
+      return true;
+   }
+
+   const value_t *data;
+   if (vtype_kind(vcode_unit_result()) == VCODE_TYPE_UARRAY) {
+      uarray_t *u = result.uarray;
+
+      f->uarray = true;
+      f->left   = u->dims[0].left;
+      f->right  = u->dims[0].right;
+      f->dir    = u->dims[0].dir;
+      f->length = MAX((f->dir == RANGE_DOWNTO ? f->left - f->right
+                       : f->right - f->left) + 1, 0);
+
+      data = u->data;
+   }
+   else {
+      int64_t low, high;
+      if (!folded_bounds(type_dim(type, 0), &low, &high))
+         return false;
+
+      f->length = MAX(high - low + 1, 0);
+
+      data = result.pointer;
+   }
+
+   f->data = xmalloc(MAX(f->length, 1) * sizeof(value_t));
+   memcpy(f->data, data, f->length * sizeof(value_t));
+   return true;
+}
+
+static tree_t eval_fold_tree(tree_t fcall, const fold_t *f)
+{
+   if (!f->ok)
+      return fcall;
+
+   tree_t t;
+   type_t type = tree_type(fcall);
+   if (type_is_scalar(type)) {
+      bool ok = true;
+      t = eval_scalar_tree(type, tree_loc(fcall), f->scalar, &ok);
+      if (!ok)
+         return fcall;
+   }
+   else if ((t = eval_array_tree(fcall, f)) == fcall)
+      return fcall;
+
+   // The bounds checker treats problems with the result as warnings as
+   // the call may never be executed
+   tree_add_attr_int(t, folded_call_i, 1);
+   return t;
+}
+
+static int eval_fold_args(tree_t fcall, int64_t *keys)
+{
+   // Returns the number of arguments if they are all literals which can
+   // be used as a key for the fold table or -1 otherwise
+
+   const int nparams = tree_params(fcall);
+   if (nparams > MAX_MEMO)
+      return -1;
+
+   for (int i = 0; i < nparams; i++) {
+      tree_t p = tree_param(fcall, i);
+      if (tree_subkind(p) != P_POS)
+         return -1;
+
+      tree_t value = tree_value(p);
+      switch (tree_kind(value)) {
+      case T_LITERAL:
+         switch (tree_subkind(value)) {
+         case L_INT:
+            keys[i] = tree_ival(value);
+            break;
+         case L_REAL:
+            {
+               const double dval = tree_dval(value);
+               memcpy(&(keys[i]), &dval, sizeof(int64_t));
+            }
+            break;
+         default:
+            return -1;
+         }
+         break;
+
+      case T_REF:
+         {
+            tree_t decl = tree_ref(value);
+            if (tree_kind(decl) != T_ENUM_LIT)
+               return -1;
+            keys[i] = tree_pos(decl);
+         }
+         break;
+
+      default:
+         return -1;
+      }
+   }
+
+   return nparams;
+}
+
+static void eval_fold_purge(void)
+{
+   // The table is keyed on declarations which may have been freed by a
+   // garbage collection since the entries were added
+
+   const unsigned epoch = tree_gc_epoch();
+   if (epoch == fold_epoch)
+      return;
+
+   for (size_t i = 0; i < fold_size; i++) {
+      if (fold_table[i].decl != NULL)
+         free(fold_table[i].data);
+   }
+
+   if (fold_table != NULL)
+      memset(fold_table, '\0', fold_size * sizeof(fold_t));
+
+   fold_count = 0;
+   fold_epoch = epoch;
+}
+
+static fold_t *eval_fold_lookup(tree_t decl, const int64_t *args, int nargs)
+{
+   eval_fold_purge();
+
+   if (fold_table == NULL)
+      return NULL;
+
+   const size_t mask = fold_size - 1;
+   size_t slot = eval_memo_hash(decl, args, nargs) & mask;
+   for (;; slot = (slot + 1) & mask) {
+      fold_t *f = &(fold_table[slot]);
+      if (f->decl == NULL)
+         return NULL;
+      else if (f->decl == decl && f->nargs == nargs
+               && memcmp(f->args, args, nargs * sizeof(int64_t)) == 0)
+         return f;
+   }
+}
+
+static void eval_fold_insert(const fold_t *f)
+{
+   if (fold_count * 2 >= fold_size) {
+      fold_t *old = fold_table;
+      const size_t old_size = fold_size;
+
+      fold_size  = MAX(fold_size * 2, 256);
+      fold_table = xcalloc(fold_size * sizeof(fold_t));
+      fold_count = 0;
+
+      for (size_t i = 0; i < old_size; i++) {
+         if (old[i].decl != NULL)
+            eval_fold_insert(&(old[i]));
+      }
+
+      free(old);
+   }
+
+   const size_t mask = fold_size - 1;
+   size_t slot = eval_memo_hash(f->decl, f->args, f->nargs) & mask;
+   while (fold_table[slot].decl != NULL)
+      slot = (slot + 1) & mask;
+
+   fold_table[slot] = *f;
+   fold_count++;
+}
+
+static tree_t eval_fold_params(tree_t fcall)
+{
+   // Arguments may refer to constants which have not been folded yet:
+   // substitute these into a copy of the call so the original is left
+   // unchanged if evaluation fails
+
+   tree_t copy = NULL;
+
+   const int nparams = tree_params(fcall);
+   for (int i = 0; i < nparams; i++) {
+      tree_t value = tree_value(tree_param(fcall, i));
+      if (tree_kind(value) == T_LITERAL)
+         continue;
+
+      tree_t folded = eval_expr(value);
+      if (folded == value || tree_kind(folded) != T_LITERAL)
+         continue;
+
+      if (copy == NULL) {
+         copy = tree_new(T_FCALL);
+         tree_set_loc(copy, tree_loc(fcall));
+         tree_set_ident(copy, tree_ident(fcall));
+         tree_set_ref(copy, tree_ref(fcall));
+         tree_set_type(copy, tree_type(fcall));
+
+         for (int j = 0; j < nparams; j++) {
+            tree_t p = tree_param(fcall, j);
+            const param_kind_t kind = tree_subkind(p);
+            add_param(copy, tree_value(p), kind,
+                      kind == P_NAMED ? tree_name(p) : NULL);
+         }
+      }
+
+      tree_set_value(tree_param(copy, i), folded);
+   }
+
+   return copy ?: fcall;
+}
+
+static bool eval_can_fold(tree_t fcall)
+{
+   tree_t decl = tree_ref(fcall);
+
+   const tree_kind_t kind = tree_kind(decl);
+   if (kind != T_FUNC_DECL && kind != T_FUNC_BODY)
+      return false;
+   else if (tree_attr_int(decl, impure_i, 0))
+      return false;
+
+   type_t type = tree_type(fcall);
+   if (type_is_scalar(type))
+      return true;
+   else if (type_is_array(type))
+      return array_dimension(type) == 1 && type_is_scalar(type_elem(type));
+   else
+      return false;
+}
+
+tree_t eval(tree_t fcall)
+{
+   assert(tree_kind(fcall) == T_FCALL);
+
+   static bool have_debug = false;
+   if (!have_debug) {
+      debug = (getenv("NVC_EVAL_DEBUG") != NULL);
+      have_debug = true;
+   }
+
+   ident_t builtin = tree_attr_str(tree_ref(fcall), builtin_i);
+   if (builtin != NULL)
+      return eval_builtin(fcall, builtin);
+
+   if (!eval_can_fold(fcall))
+      return fcall;
+
+   // Arguments may refer to constants which have not been folded yet so
+   // evaluate a copy of the call with those arguments replaced which
+   // leaves the original untouched if evaluation fails
+   tree_t call = eval_fold_params(fcall);
+
+   int64_t keys[MAX_MEMO];
+   const int nkeys = eval_fold_args(call, keys);
+   tree_t decl = tree_ref(fcall);
+
+   if (nkeys >= 0) {
+      const fold_t *f = eval_fold_lookup(decl, keys, nkeys);
+      if (f != NULL) {
+         fold_hits++;
+         return eval_fold_tree(fcall, f);
+      }
+   }
+
+   vcode_unit_t thunk = lower_thunk(call);
+   if (thunk == NULL)
+      return fcall;
+
+   eval_state_t state = {
+      .where     = fcall,
+      .frame     = NULL,
+      .chunks    = NULL,
+      .allocated = 0,
+      .steps     = 0,
+      .depth     = 0,
+      .failed    = false
+   };
+
+   value_t result = { .integer = 0 };
+   eval_call(&state, thunk, NULL, 0, &result);
+
+   fold_t f = { .ok = false };
+   if (!state.failed) {
+      vcode_select_unit(thunk);
+      f.ok = eval_capture(&f, tree_type(fcall), result);
+   }
+
+   vcode_close();
+   eval_free_chunks(&state, state.chunks);
+
+   tree_t folded = eval_fold_tree(fcall, &f);
+
+   // Failures are not cached as the body of a subprogram may not have
+   // been analysed yet
+   if (f.ok && nkeys >= 0) {
+      f.decl  = decl;
+      f.nargs = nkeys;
+      memcpy(f.args, keys, nkeys * sizeof(int64_t));
+      eval_fold_insert(&f);
+   }
+   else
+      free(f.data);
+
+   return folded;
+}
+
+int eval_fold_hits(void)
+{
+   return fold_hits;
 }
@@ -17,7 +17,7 @@
 
 #include "util.h"
 #include "fbuf.h"
-#include "fastlz.h"
+#include "lz4.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -31,24 +31,69 @@
 #define SPILL_SIZE 65536
 #define BLOCK_SIZE (SPILL_SIZE - (SPILL_SIZE / 16))
 
+// Files start with an eight byte header holding a magic number, the
+// format version, and flags. Compressed files end with an index giving
+// the offset and uncompressed length of every block followed by the
+// number of blocks and a magic number. Each block is compressed
+// independently so any block can be decoded without reading the ones
+// before it. Uncompressed files contain the raw stream after the header
+// which readers use directly from the mapping.
+#define FBUF_VERSION 3
+#define INDEX_MAGIC  UINT32_C(0x4e564958)
+#define HEADER_SIZE  8
+#define TRAILER_SIZE 8
+
+#define FBUF_F_RAW   (1 << 0)
+
+typedef struct {
+   uint32_t offset;
+   uint32_t length;
+   size_t   base;
+} fbuf_block_t;
+
 struct fbuf {
-   fbuf_mode_t  mode;
-   char        *fname;
-   FILE        *file;
-   uint8_t     *wbuf;
-   size_t       wpend;
-   uint8_t     *rbuf;
-   size_t       rptr;
-   size_t       ravail;
-   size_t       roff;
-   uint8_t     *rmap;
-   size_t       maplen;
-   fbuf_t      *next;
-   fbuf_t      *prev;
+   fbuf_mode_t   mode;
+   char         *fname;
+   FILE         *file;
+   uint8_t      *wbuf;
+   size_t        wpend;
+   size_t        walloc;
+   size_t        woff;
+   size_t        wtotal;
+   uint8_t      *rbuf;
+   size_t        rptr;
+   size_t        ravail;
+   size_t        rbase;
+   unsigned      rblock;
+   uint8_t      *rmap;
+   size_t        maplen;
+   fbuf_block_t *blocks;
+   unsigned      nblocks;
+   unsigned      blocks_alloc;
+   bool          mem;
+   bool          raw;
+   fbuf_t       *next;
+   fbuf_t       *prev;
 };
 
 static fbuf_t *open_list = NULL;
 
+static void put_u32_be(uint8_t *p, uint32_t u)
+{
+   p[0] = (u >> 24) & 0xff;
+   p[1] = (u >> 16) & 0xff;
+   p[2] = (u >> 8) & 0xff;
+   p[3] = u & 0xff;
+}
+
+static uint32_t get_u32_be(const uint8_t *p)
+{
+   return (uint32_t)(p[0] << 24)
+      | (uint32_t)(p[1] << 16)
+      | (uint32_t)(p[2] << 8)
+      | (uint32_t)p[3];
+}
+
 void fbuf_cleanup(void)
 {
    for (fbuf_t *it = open_list; it != NULL; it = it->next) {
@@ -59,7 +104,61 @@ void fbuf_cleanup(void)
    }
 }
 
-fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode)
+static void fbuf_read_index(fbuf_t *f)
+{
+   const uint8_t *trailer = f->rmap + f->maplen - TRAILER_SIZE;
+   if (f->maplen < HEADER_SIZE + TRAILER_SIZE
+       || get_u32_be(trailer + 4) != INDEX_MAGIC)
+      fatal("file %s is truncated or has no block index", f->fname);
+
+   f->nblocks = get_u32_be(trailer);
+
+   const size_t index_size = f->nblocks * 8;
+   if (index_size > f->maplen - HEADER_SIZE - TRAILER_SIZE)
+      fatal("file %s has a corrupt block index", f->fname);
+
+   const uint8_t *index = trailer - index_size;
+   const size_t limit = index - f->rmap;
+
+   f->blocks = xmalloc(MAX(f->nblocks, 1) * sizeof(fbuf_block_t));
+
+   size_t base = 0;
+   for (unsigned i = 0; i < f->nblocks; i++) {
+      fbuf_block_t *b = &(f->blocks[i]);
+      b->offset = get_u32_be(index + i * 8);
+      b->length = get_u32_be(index + i * 8 + 4);
+      b->base   = base;
+
+      if (b->offset + 4 > limit || b->length > BLOCK_SIZE
+          || b->offset + 4 + get_u32_be(f->rmap + b->offset) > limit)
+         fatal("file %s has a corrupt block index", f->fname);
+
+      base += b->length;
+   }
+}
+
+static void fbuf_read_header(fbuf_t *f)
+{
+   if (f->maplen < HEADER_SIZE
+       || memcmp(f->rmap, "NVC", 3) != 0
+       || f->rmap[3] != FBUF_VERSION)
+      fatal("file %s was not written by this version of " PACKAGE_NAME
+            ". Libraries created by earlier versions must be deleted "
+            "and reanalysed.", f->fname);
+
+   if (f->rmap[4] & FBUF_F_RAW) {
+      // Read directly from the mapping without copying
+      f->raw    = true;
+      f->rbuf   = f->rmap + HEADER_SIZE;
+      f->ravail = f->maplen - HEADER_SIZE;
+   }
+   else {
+      f->rbuf = xmalloc(SPILL_SIZE);
+      fbuf_read_index(f);
+   }
+}
+
+fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode, fbuf_flags_t flags)
 {
    fbuf_t *f = NULL;
 
@@ -70,13 +169,22 @@ fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode)
          if (h == NULL)
             return NULL;
 
-         f = xmalloc(sizeof(struct fbuf));
+         const bool raw = !!(flags & FBUF_UNCOMPRESSED);
+
+         const uint8_t header[HEADER_SIZE] = {
+            'N', 'V', 'C', FBUF_VERSION, raw ? FBUF_F_RAW : 0, 0, 0, 0
+         };
+         if (fwrite(header, HEADER_SIZE, 1, h) != 1)
+            fatal("fwrite failed");
+
+         f = xcalloc(sizeof(struct fbuf));
 
-         f->file  = h;
-         f->rmap  = NULL;
-         f->rbuf  = NULL;
-         f->wbuf  = xmalloc(SPILL_SIZE);
-         f->wpend = 0;
+         f->file         = h;
+         f->raw          = raw;
+         f->wbuf         = xmalloc(SPILL_SIZE);
+         f->woff         = HEADER_SIZE;
+         f->blocks_alloc = 16;
+         f->blocks       = xmalloc(f->blocks_alloc * sizeof(fbuf_block_t));
       }
       break;
 
@@ -96,94 +204,230 @@ fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode)
 
          close(fd);
 
-         f = xmalloc(sizeof(struct fbuf));
+         f = xcalloc(sizeof(struct fbuf));
 
-         f->file   = NULL;
          f->rmap   = rmap;
-         f->rbuf   = xmalloc(SPILL_SIZE);
-         f->rptr   = 0;
-         f->roff   = 0;
-         f->ravail = 0;
          f->maplen = buf.st_size;
-         f->wbuf   = NULL;
       }
       break;
    }
 
    f->fname = strdup(file);
    f->mode  = mode;
+   f->mem   = false;
    f->next  = open_list;
    f->prev  = NULL;
 
+   if (mode == FBUF_IN)
+      fbuf_read_header(f);
+
    if (open_list != NULL)
       open_list->prev = f;
 
    return (open_list = f);
 }
 
-static void fbuf_maybe_flush(fbuf_t *f, size_t more, bool finish)
+fbuf_t *fbuf_open_mem(const void *data, size_t len, fbuf_mode_t mode)
 {
-   assert(more <= BLOCK_SIZE);
-   if (f->wpend + more > BLOCK_SIZE) {
-      if (f->wpend < 16) {
-         // Write dummy bytes at and to meet fastlz block size requirement
-         assert(finish);
-         f->wpend = 16;
-      }
+   // Memory buffers are not compressed and are never added to the
+   // open list as there is no file to remove on cleanup
 
-      uint8_t out[SPILL_SIZE];
-      const int ret = fastlz_compress_level(2, f->wbuf, f->wpend, out);
+   fbuf_t *f = xcalloc(sizeof(struct fbuf));
+   f->fname = strdup("(memory)");
+   f->mode  = mode;
+   f->mem   = true;
 
-      assert((ret > 0) && (ret < SPILL_SIZE));
+   switch (mode) {
+   case FBUF_OUT:
+      f->walloc = MAX(len, 256);
+      f->wbuf   = xmalloc(f->walloc);
+      break;
 
-      const uint8_t blksz[4] = {
-         (ret >> 24) & 0xff,
-         (ret >> 16) & 0xff,
-         (ret >> 8) & 0xff,
-         ret & 0xff
-      };
+   case FBUF_IN:
+      f->rbuf   = (uint8_t *)data;
+      f->ravail = len;
+      break;
+   }
 
-      if (fwrite(blksz, 4, 1, f->file) != 1)
-         fatal("fwrite failed");
+   return f;
+}
+
+const void *fbuf_mem_data(fbuf_t *f, size_t *len)
+{
+   assert(f->mem);
+
+   if (f->mode == FBUF_OUT) {
+      *len = f->wpend;
+      return f->wbuf;
+   }
+   else {
+      *len = f->ravail;
+      return f->rbuf;
+   }
+}
+
+static void fbuf_write_block(fbuf_t *f)
+{
+   uint8_t out[LZ4_COMPRESSBOUND(BLOCK_SIZE)];
+   const int ret = LZ4_compress((char *)f->wbuf, (char *)out, f->wpend);
+
+   assert((ret > 0) && (ret <= sizeof(out)));
+
+   if (f->nblocks == f->blocks_alloc) {
+      f->blocks_alloc *= 2;
+      f->blocks = xrealloc(f->blocks, f->blocks_alloc * sizeof(fbuf_block_t));
+   }
 
-      if (fwrite(out, ret, 1, f->file) != 1)
+   fbuf_block_t *b = &(f->blocks[f->nblocks++]);
+   b->offset = f->woff;
+   b->length = f->wpend;
+   b->base   = f->wtotal;
+
+   uint8_t blksz[4];
+   put_u32_be(blksz, ret);
+
+   if (fwrite(blksz, 4, 1, f->file) != 1)
+      fatal("fwrite failed");
+
+   if (fwrite(out, ret, 1, f->file) != 1)
+      fatal("fwrite failed");
+
+   f->woff   += 4 + ret;
+   f->wtotal += f->wpend;
+   f->wpend   = 0;
+}
+
+static void fbuf_write_pending(fbuf_t *f)
+{
+   if (f->wpend > 0 && fwrite(f->wbuf, f->wpend, 1, f->file) != 1)
+      fatal("fwrite failed");
+
+   f->woff   += f->wpend;
+   f->wtotal += f->wpend;
+   f->wpend   = 0;
+}
+
+static void fbuf_write_index(fbuf_t *f)
+{
+   for (unsigned i = 0; i < f->nblocks; i++) {
+      uint8_t entry[8];
+      put_u32_be(entry, f->blocks[i].offset);
+      put_u32_be(entry + 4, f->blocks[i].length);
+
+      if (fwrite(entry, 8, 1, f->file) != 1)
          fatal("fwrite failed");
+   }
 
-      f->wpend = 0;
+   uint8_t trailer[TRAILER_SIZE];
+   put_u32_be(trailer, f->nblocks);
+   put_u32_be(trailer + 4, INDEX_MAGIC);
+
+   if (fwrite(trailer, TRAILER_SIZE, 1, f->file) != 1)
+      fatal("fwrite failed");
+}
+
+static void fbuf_maybe_flush(fbuf_t *f, size_t more)
+{
+   if (f->mem) {
+      if (f->wpend + more > f->walloc) {
+         f->walloc = MAX(f->walloc * 2, f->wpend + more);
+         f->wbuf = xrealloc(f->wbuf, f->walloc);
+      }
+      return;
+   }
+
+   assert(more <= BLOCK_SIZE);
+   if (f->wpend + more > BLOCK_SIZE) {
+      if (f->raw)
+         fbuf_write_pending(f);
+      else
+         fbuf_write_block(f);
    }
 }
 
+static size_t fbuf_decompress_block(fbuf_t *f, unsigned n, uint8_t *dest,
+                                    size_t max)
+{
+   const fbuf_block_t *b = &(f->blocks[n]);
+   const uint32_t blksz = get_u32_be(f->rmap + b->offset);
+
+   const int ret = LZ4_decompress_safe((char *)f->rmap + b->offset + 4,
+                                       (char *)dest, blksz, max);
+
+   if (ret != b->length)
+      fatal("file %s has invalid compression format", f->fname);
+
+   return ret;
+}
+
 static void fbuf_maybe_read(fbuf_t *f, size_t more)
 {
+   if (f->mem || f->raw) {
+      if (f->rptr + more > f->ravail)
+         fatal("unexpected end of data in %s", f->fname);
+      return;
+   }
+
    assert(more <= BLOCK_SIZE);
-   if (f->rptr + more > f->ravail) {
+   while (f->rptr + more > f->ravail) {
+      if (f->rblock == f->nblocks)
+         fatal("unexpected end of file %s", f->fname);
+
       const size_t overlap = f->ravail - f->rptr;
-      memcpy(f->rbuf, f->rbuf + f->rptr, overlap);
+      memmove(f->rbuf, f->rbuf + f->rptr, overlap);
 
-      const uint8_t *blksz_raw = f->rmap + f->roff;
+      f->rbase += f->rptr;
+      f->ravail = overlap + fbuf_decompress_block(f, f->rblock++,
+                                                  f->rbuf + overlap,
+                                                  SPILL_SIZE - overlap);
+      f->rptr   = 0;
+   }
+}
 
-      const uint32_t blksz =
-         (uint32_t)(blksz_raw[0] << 24)
-         | (uint32_t)(blksz_raw[1] << 16)
-         | (uint32_t)(blksz_raw[2] << 8)
-         | (uint32_t)blksz_raw[3];
+size_t fbuf_tell(fbuf_t *f)
+{
+   if (f->mode == FBUF_OUT)
+      return f->wtotal + f->wpend;
+   else
+      return f->rbase + f->rptr;
+}
 
-      if (blksz > SPILL_SIZE)
-         fatal("file %s has invalid compression format", f->fname);
+void fbuf_seek(fbuf_t *f, size_t pos)
+{
+   assert(f->mode == FBUF_IN);
 
-      f->roff += sizeof(uint32_t);
+   if (f->mem || f->raw) {
+      if (pos > f->ravail)
+         fatal("seek past end of %s", f->fname);
+      f->rptr = pos;
+      return;
+   }
 
-      const int ret = fastlz_decompress(f->rmap + f->roff,
-                                        blksz,
-                                        f->rbuf + overlap,
-                                        SPILL_SIZE - overlap);
+   // Binary search the block index for the block containing pos
+   unsigned low = 0, high = f->nblocks;
+   while (low < high) {
+      const unsigned mid = (low + high) / 2;
+      if (f->blocks[mid].base + f->blocks[mid].length <= pos)
+         low = mid + 1;
+      else
+         high = mid;
+   }
 
-      if (ret == 0)
-         fatal("file %s has invalid compression format", f->fname);
+   if (low == f->nblocks) {
+      const size_t total = f->nblocks == 0 ? 0
+         : f->blocks[f->nblocks - 1].base + f->blocks[f->nblocks - 1].length;
+      if (pos > total)
+         fatal("seek past end of %s", f->fname);
 
-      f->roff  += blksz;
-      f->ravail = overlap + ret;
-      f->rptr   = 0;
+      f->rbase  = total;
+      f->rptr   = f->ravail = 0;
+      f->rblock = f->nblocks;
+   }
+   else {
+      f->rbase  = f->blocks[low].base;
+      f->ravail = fbuf_decompress_block(f, low, f->rbuf, SPILL_SIZE);
+      f->rptr   = pos - f->rbase;
+      f->rblock = low + 1;
    }
 }
 
@@ -191,36 +435,46 @@ void fbuf_close(fbuf_t *f)
 {
    if (f->rmap != NULL) {
       munmap((void *)f->rmap, f->maplen);
-      free(f->rbuf);
+      if (!f->raw)
+         free(f->rbuf);
    }
 
    if (f->wbuf != NULL) {
-      fbuf_maybe_flush(f, BLOCK_SIZE, true);
+      if (f->raw)
+         fbuf_write_pending(f);
+      else if (!f->mem) {
+         if (f->wpend > 0)
+            fbuf_write_block(f);
+         fbuf_write_index(f);
+      }
       free(f->wbuf);
    }
 
    if (f->file != NULL)
       fclose(f->file);
 
-   if (f->prev == NULL) {
-      assert(f == open_list);
-      if (f->next != NULL)
-         f->next->prev = NULL;
-      open_list = f->next;
-   }
-   else {
-      f->prev->next = f->next;
-      if (f->next != NULL)
-         f->next->prev = f->prev;
+   if (!f->mem) {
+      if (f->prev == NULL) {
+         assert(f == open_list);
+         if (f->next != NULL)
+            f->next->prev = NULL;
+         open_list = f->next;
+      }
+      else {
+         f->prev->next = f->next;
+         if (f->next != NULL)
+            f->next->prev = f->prev;
+      }
    }
 
+   free(f->blocks);
    free(f->fname);
    free(f);
 }
 
 void write_u32(uint32_t u, fbuf_t *f)
 {
-   fbuf_maybe_flush(f, 4, false);
+   fbuf_maybe_flush(f, 4);
    *(f->wbuf + f->wpend++) = (u >>  0) & UINT32_C(0xff);
    *(f->wbuf + f->wpend++) = (u >>  8) & UINT32_C(0xff);
    *(f->wbuf + f->wpend++) = (u >> 16) & UINT32_C(0xff);
@@ -229,7 +483,7 @@ void write_u32(uint32_t u, fbuf_t *f)
 
 void write_u64(uint64_t u, fbuf_t *f)
 {
-   fbuf_maybe_flush(f, 8, false);
+   fbuf_maybe_flush(f, 8);
    *(f->wbuf + f->wpend++) = (u >>  0) & UINT64_C(0xff);
    *(f->wbuf + f->wpend++) = (u >>  8) & UINT64_C(0xff);
    *(f->wbuf + f->wpend++) = (u >> 16) & UINT64_C(0xff);
@@ -242,20 +496,20 @@ void write_u64(uint64_t u, fbuf_t *f)
 
 void write_u16(uint16_t s, fbuf_t *f)
 {
-   fbuf_maybe_flush(f, 2, false);
+   fbuf_maybe_flush(f, 2);
    *(f->wbuf + f->wpend++) = (s >> 0) & UINT16_C(0xff);
    *(f->wbuf + f->wpend++) = (s >> 8) & UINT16_C(0xff);
 }
 
 void write_u8(uint8_t u, fbuf_t *f)
 {
-   fbuf_maybe_flush(f, 1, false);
+   fbuf_maybe_flush(f, 1);
    *(f->wbuf + f->wpend++) = u;
 }
 
 void write_raw(const void *buf, size_t len, fbuf_t *f)
 {
-   fbuf_maybe_flush(f, len, false);
+   fbuf_maybe_flush(f, len);
    memcpy(f->wbuf + f->wpend, buf, len);
    f->wpend += len;
 }
@@ -264,22 +518,36 @@ uint32_t read_u32(fbuf_t *f)
 {
    fbuf_maybe_read(f, 4);
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   uint32_t val;
+   memcpy(&val, f->rbuf + f->rptr, sizeof(uint32_t));
+   f->rptr += sizeof(uint32_t);
+   return val;
+#else
    uint32_t val = 0;
    val |= (uint32_t)*(f->rbuf + f->rptr++) << 0;
    val |= (uint32_t)*(f->rbuf + f->rptr++) << 8;
    val |= (uint32_t)*(f->rbuf + f->rptr++) << 16;
    val |= (uint32_t)*(f->rbuf + f->rptr++) << 24;
    return val;
+#endif
 }
 
 uint16_t read_u16(fbuf_t *f)
 {
    fbuf_maybe_read(f, 2);
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   uint16_t val;
+   memcpy(&val, f->rbuf + f->rptr, sizeof(uint16_t));
+   f->rptr += sizeof(uint16_t);
+   return val;
+#else
    uint16_t val = 0;
    val |= (uint16_t)*(f->rbuf + f->rptr++) << 0;
    val |= (uint16_t)*(f->rbuf + f->rptr++) << 8;
    return val;
+#endif
 }
 
 uint8_t read_u8(fbuf_t *f)
@@ -292,6 +560,12 @@ uint64_t read_u64(fbuf_t *f)
 {
    fbuf_maybe_read(f, 8);
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+   uint64_t val;
+   memcpy(&val, f->rbuf + f->rptr, sizeof(uint64_t));
+   f->rptr += sizeof(uint64_t);
+   return val;
+#else
    uint64_t val = 0;
    val |= (uint64_t)*(f->rbuf + f->rptr++) << 0;
    val |= (uint64_t)*(f->rbuf + f->rptr++) << 8;
@@ -302,6 +576,7 @@ uint64_t read_u64(fbuf_t *f)
    val |= (uint64_t)*(f->rbuf + f->rptr++) << 48;
    val |= (uint64_t)*(f->rbuf + f->rptr++) << 56;
    return val;
+#endif
 }
 
 void read_raw(void *buf, size_t len, fbuf_t *f)
@@ -21,7 +21,7 @@
 #include "util.h"
 
 //
-// Compressed binary file input/output
+// Compressed or uncompressed binary file input/output
 //
 
 typedef struct fbuf fbuf_t;
@@ -31,7 +31,15 @@ typedef enum {
    FBUF_OUT,
 } fbuf_mode_t;
 
-fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode);
+typedef enum {
+   FBUF_UNCOMPRESSED = (1 << 0),
+} fbuf_flags_t;
+
+fbuf_t *fbuf_open(const char *file, fbuf_mode_t mode, fbuf_flags_t flags);
+fbuf_t *fbuf_open_mem(const void *data, size_t len, fbuf_mode_t mode);
+const void *fbuf_mem_data(fbuf_t *f, size_t *len);
+size_t fbuf_tell(fbuf_t *f);
+void fbuf_seek(fbuf_t *f, size_t pos);
 void fbuf_close(fbuf_t *f);
 void fbuf_cleanup(void);
 
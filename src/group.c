@@ -23,62 +23,197 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <stdio.h>
+
+typedef struct group_node group_node_t;
+
+// Groups are kept in an AVL tree ordered by the first net with each
+// node augmented with the extent of its subtree and the number of nets
+// it covers so that holes in a range of nets can be found quickly
+struct group_node {
+   group_node_t *next;
+   group_node_t *left;
+   group_node_t *right;
+   groupid_t     gid;
+   netid_t       first;
+   unsigned      length;
+   int           height;
+   netid_t       span_first;
+   netid_t       span_end;
+   unsigned      covered;
+};
 
 typedef struct {
-   group_t   *groups;
-   group_t   *free_list;
-   groupid_t  next_gid;
-   group_t  **lookup;
-   int        nnets;
+   netid_t  first;
+   unsigned length;
+} group_gap_t;
+
+typedef struct {
+   group_node_t *groups;
+   group_node_t *root;
+   groupid_t     next_gid;
+   int           nnets;
+   group_gap_t  *gaps;
+   unsigned      ngaps;
+   unsigned      maxgaps;
 } group_nets_ctx_t;
 
 static void group_target(tree_t t, group_nets_ctx_t *ctx);
 
-static groupid_t group_alloc(group_nets_ctx_t *ctx,
-                             netid_t first, unsigned length)
+static inline int group_height(group_node_t *n)
+{
+   return n == NULL ? 0 : n->height;
+}
+
+static void group_update(group_node_t *n)
+{
+   n->height     = MAX(group_height(n->left), group_height(n->right)) + 1;
+   n->span_first = n->left ? n->left->span_first : n->first;
+   n->span_end   = n->right ? n->right->span_end : n->first + n->length;
+   n->covered    = n->length
+      + (n->left ? n->left->covered : 0)
+      + (n->right ? n->right->covered : 0);
+}
+
+static group_node_t *group_rotate_left(group_node_t *n)
+{
+   group_node_t *r = n->right;
+   n->right = r->left;
+   r->left = n;
+   group_update(n);
+   group_update(r);
+   return r;
+}
+
+static group_node_t *group_rotate_right(group_node_t *n)
 {
-   group_t *g;
-   if (ctx->free_list != NULL) {
-      g = ctx->free_list;
-      ctx->free_list = g->next;
+   group_node_t *l = n->left;
+   n->left = l->right;
+   l->right = n;
+   group_update(n);
+   group_update(l);
+   return l;
+}
+
+static group_node_t *group_balance(group_node_t *n)
+{
+   group_update(n);
+
+   const int balance = group_height(n->left) - group_height(n->right);
+   if (balance > 1) {
+      if (group_height(n->left->left) < group_height(n->left->right))
+         n->left = group_rotate_left(n->left);
+      return group_rotate_right(n);
+   }
+   else if (balance < -1) {
+      if (group_height(n->right->right) < group_height(n->right->left))
+         n->right = group_rotate_right(n->right);
+      return group_rotate_left(n);
    }
    else
-      g = xmalloc(sizeof(group_t));
+      return n;
+}
+
+static group_node_t *group_insert(group_node_t *root, group_node_t *g)
+{
+   if (root == NULL)
+      return g;
+   else if (g->first < root->first)
+      root->left = group_insert(root->left, g);
+   else
+      root->right = group_insert(root->right, g);
+
+   return group_balance(root);
+}
 
+static group_node_t *group_new(group_nets_ctx_t *ctx,
+                               netid_t first, unsigned length)
+{
+   group_node_t *g = xmalloc(sizeof(group_node_t));
    g->next   = ctx->groups;
+   g->left   = NULL;
+   g->right  = NULL;
    g->gid    = ctx->next_gid++;
    g->first  = first;
    g->length = length;
 
+   group_update(g);
+
    ctx->groups = g;
+   return g;
+}
 
-   for (netid_t i = first; i < first + length; i++)
-      ctx->lookup[i] = g;
+static group_node_t *group_find(group_node_t *n, netid_t nid)
+{
+   while (n != NULL) {
+      if (nid < n->first)
+         n = n->left;
+      else if (nid >= n->first + n->length)
+         n = n->right;
+      else
+         return n;
+   }
 
-   return g->gid;
+   return NULL;
 }
 
-static void group_unlink(group_nets_ctx_t *ctx, group_t *where)
+static group_node_t *group_split(group_nets_ctx_t *ctx, group_node_t *n,
+                                 netid_t at)
 {
-   where->gid = GROUPID_INVALID;
+   // Ensure no group contains both nets at - 1 and at
+
+   if (n == NULL || at <= n->span_first || at >= n->span_end)
+      return n;
+   else if (at < n->first)
+      n->left = group_split(ctx, n->left, at);
+   else if (at >= n->first + n->length)
+      n->right = group_split(ctx, n->right, at);
+   else if (at > n->first) {
+      group_node_t *g = group_new(ctx, at, n->first + n->length - at);
+      n->length = at - n->first;
+      n->right = group_insert(n->right, g);
+   }
+   else
+      return n;
 
-   if (where == ctx->groups)
-      ctx->groups = where->next;
-   else {
-      for (group_t *it = ctx->groups; it != NULL; it = it->next) {
-         if (it->next == where) {
-            it->next = where->next;
-            return;
-         }
-      }
-      fatal_trace("unlink group not in list");
+   return group_balance(n);
+}
+
+static void group_add_gap(group_nets_ctx_t *ctx, netid_t first, netid_t end)
+{
+   if (ctx->ngaps == ctx->maxgaps) {
+      ctx->maxgaps = MAX(ctx->maxgaps * 2, 16);
+      ctx->gaps = xrealloc(ctx->gaps, ctx->maxgaps * sizeof(group_gap_t));
    }
+
+   ctx->gaps[ctx->ngaps].first  = first;
+   ctx->gaps[ctx->ngaps].length = end - first;
+   ctx->ngaps++;
 }
 
-static void group_reuse(group_nets_ctx_t *ctx, group_t *group)
+static void group_find_gaps(group_nets_ctx_t *ctx, group_node_t *n,
+                            netid_t end, netid_t *cursor)
 {
-   group->next = ctx->free_list;
-   ctx->free_list = group;
+   if (n == NULL || n->span_end <= *cursor || n->span_first >= end)
+      return;
+
+   if (n->span_end - n->span_first == n->covered) {
+      // There are no holes anywhere in this subtree
+      if (n->span_first > *cursor)
+         group_add_gap(ctx, *cursor, n->span_first);
+      *cursor = n->span_end;
+      return;
+   }
+
+   group_find_gaps(ctx, n->left, end, cursor);
+
+   if (n->first < end && n->first + n->length > *cursor) {
+      if (n->first > *cursor)
+         group_add_gap(ctx, *cursor, n->first);
+      *cursor = n->first + n->length;
+   }
+
+   group_find_gaps(ctx, n->right, end, cursor);
 }
 
 static groupid_t group_add(group_nets_ctx_t *ctx, netid_t first, int length)
@@ -87,93 +222,37 @@ static groupid_t group_add(group_nets_ctx_t *ctx, netid_t first, int length)
    assert(first < ctx->nnets);
    assert(first + length <= ctx->nnets);
 
-   for (netid_t i = first; i < first + length; i++) {
-      group_t *it = ctx->lookup[i];
-      if (it == NULL || it->gid == GROUPID_INVALID)
-         continue;
+   const netid_t end = first + length;
 
-      if ((it->first == first) && (it->length == length)) {
-         // Exactly matches
-         return it->gid;
-      }
-      else if (it->first >= first + length) {
-         // Disjoint, to the right
-      }
-      else if (first >= it->first + it->length) {
-         // Disjoint, to the left
-      }
-      else if ((first == it->first) && (length > it->length)) {
-         // Overlaps on left
-         group_add(ctx, first + it->length, length - it->length);
-         return GROUPID_INVALID;
-      }
-      else if ((first > it->first)
-               && (first + length == it->first + it->length)) {
-         // Overlaps on right
-         group_unlink(ctx, it);
-         group_add(ctx, it->first, first - it->first);
-         group_reuse(ctx, it);
-         return group_alloc(ctx, first, length);
-      }
-      else if ((first > it->first)
-               && (first + length < it->first + it->length)) {
-         // Overlaps completely
-         group_unlink(ctx, it);
-         group_add(ctx, it->first, first - it->first);
-         group_add(ctx, first + length,
-                   it->first + it->length - first - length);
-         group_reuse(ctx, it);
-         return group_alloc(ctx, first, length);
-      }
-      else if ((first < it->first)
-               && (first + length > it->first + it->length)) {
-         // Contains in middle
-         group_add(ctx, first, it->first - first);
-         group_add(ctx, it->first + it->length,
-                   first + length - it->first - it->length);
-         return GROUPID_INVALID;
-      }
-      else if ((first == it->first)
-               && (first + length < it->first + it->length)) {
-         // Contains on left
-         group_unlink(ctx, it);
-         group_add(ctx, first + length, it->length - length);
-         group_reuse(ctx, it);
-         return group_alloc(ctx, first, length);
-      }
-      else if ((first < it->first)
-               && (first + length == it->first + it->length)) {
-         // Contains on right
-         group_add(ctx, first, it->first - first);
-         return GROUPID_INVALID;
-      }
-      else if ((first < it->first) && (first + length > it->first)) {
-         // Split left
-         group_unlink(ctx, it);
-         group_add(ctx, first, it->first - first);
-         group_add(ctx, it->first, first + length - it->first);
-         group_add(ctx, first + length,
-                   it->first + it->length - first - length);
-         group_reuse(ctx, it);
-         return GROUPID_INVALID;
-      }
-      else if ((first > it->first) && (it->first + it->length > first)) {
-         // Split right
-         group_unlink(ctx, it);
-         group_add(ctx, it->first, first - it->first);
-         group_add(ctx, first, it->first + it->length - first);
-         group_add(ctx, it->first + it->length,
-                   first + length - it->first - it->length);
-         group_reuse(ctx, it);
-         return GROUPID_INVALID;
-      }
-      else
-         fatal("unhandled case in group_add: first=%d length=%d "
-               "it->first=%d it->length=%d", first, length,
-               it->first, it->length);
+   group_node_t *exact = group_find(ctx->root, first);
+   if (exact != NULL && exact->first == first && exact->length == length)
+      return exact->gid;
+
+   // Split any groups that straddle either end of the range
+   ctx->root = group_split(ctx, ctx->root, first);
+   ctx->root = group_split(ctx, ctx->root, end);
+
+   // Each run of nets in the range not already grouped becomes a
+   // new group
+   netid_t cursor = first;
+   ctx->ngaps = 0;
+   group_find_gaps(ctx, ctx->root, end, &cursor);
+   if (cursor < end)
+      group_add_gap(ctx, cursor, end);
+
+   for (unsigned i = 0; i < ctx->ngaps; i++) {
+      group_node_t *g = group_new(ctx, ctx->gaps[i].first,
+                                  ctx->gaps[i].length);
+      ctx->root = group_insert(ctx->root, g);
    }
 
-   return group_alloc(ctx, first, length);
+   group_node_t *g = group_find(ctx->root, first);
+   assert(g != NULL);
+
+   if (g->length == length)
+      return g->gid;
+   else
+      return GROUPID_INVALID;
 }
 
 static bool group_contains_record(type_t type)
@@ -229,22 +308,28 @@ static void group_decl(tree_t decl, group_nets_ctx_t *ctx, int start, int n)
    const bool record = group_contains_record(type);
    int ffield = -1;
    assert((n == -1) | (start + n <= nnets));
-   for (int i = start; i < (n == -1 ? nnets : start + n); i++) {
-      netid_t nid = tree_net(decl, i);
+   const int end = (n == -1 ? nnets : start + n);
+   for (int i = start; i < end;) {
+      // Records must be split at field boundaries but otherwise a whole
+      // run of consecutive nets can be added at once
+      unsigned avail;
+      netid_t nid = tree_net_run(decl, i, &avail);
+      const unsigned step = record ? 1 : MIN(avail, end - i);
       if (first == NETID_INVALID) {
          first  = nid;
-         len    = 1;
+         len    = step;
          ffield = record ? group_net_to_field(type, i) : -1;
       }
       else if (nid == first + len
                && (!record || group_net_to_field(type, i) == ffield))
-         ++len;
+         len += step;
       else {
          group_add(ctx, first, len);
          first  = nid;
-         len    = 1;
+         len    = step;
          ffield = record ? group_net_to_field(type, i) : -1;
       }
+      i += step;
    }
 
    if (first != NETID_INVALID)
@@ -388,6 +473,27 @@ static bool group_name(tree_t target, group_nets_ctx_t *ctx, int start, int n)
    }
 }
 
+static tree_t group_memory(tree_t name)
+{
+   // Signals tagged as memories by the optimiser are kept as one group
+   // however they are indexed
+
+   tree_kind_t kind;
+   while ((kind = tree_kind(name)) != T_REF) {
+      if ((kind == T_ARRAY_REF) || (kind == T_ARRAY_SLICE)
+          || (kind == T_RECORD_REF))
+         name = tree_value(name);
+      else
+         return NULL;
+   }
+
+   tree_t decl = tree_ref(name);
+   if (tree_kind(decl) == T_SIGNAL_DECL && tree_attr_int(decl, memory_i, 0))
+      return decl;
+   else
+      return NULL;
+}
+
 static void group_target(tree_t t, group_nets_ctx_t *ctx)
 {
    switch (tree_kind(t)) {
@@ -400,7 +506,10 @@ static void group_target(tree_t t, group_nets_ctx_t *ctx)
    case T_RECORD_REF:
       {
          type_t type = tree_type(t);
-         if (!type_known_width(type))
+         tree_t memory = group_memory(t);
+         if (memory != NULL)
+            group_decl(memory, ctx, 0, -1);
+         else if (!type_known_width(type))
             ungroup_name(t, ctx);
          else if (!group_name(t, ctx, 0, type_width(type)))
             ungroup_name(t, ctx);
@@ -449,6 +558,8 @@ static void ungroup_proc_params(tree_t t, group_nets_ctx_t *ctx)
 
       if (tree_kind(decl) != T_SIGNAL_DECL)
          return;
+      else if (tree_attr_int(decl, memory_i, 0))
+         continue;
 
       const int nnets = tree_nets(decl);
       for (int i = 0; i < nnets; i++)
@@ -487,42 +598,104 @@ static void group_nets_visit_fn(tree_t t, void *_ctx)
    }
 }
 
+static void group_sort(group_node_t *n, group_t *table, unsigned *pos)
+{
+   if (n == NULL)
+      return;
+
+   group_sort(n->left, table, pos);
+
+   table[*pos].first  = n->first;
+   table[*pos].length = n->length;
+   (*pos)++;
+
+   group_sort(n->right, table, pos);
+}
+
+static void group_write_section(FILE *f, long offset, const void *data,
+                                size_t size, const char *name)
+{
+   if (fseek(f, offset, SEEK_SET) != 0)
+      fatal_errno("seek in %s", name);
+
+   if (size > 0 && fwrite(data, size, 1, f) != 1)
+      fatal_errno("write to %s", name);
+}
+
 static void group_write_netdb(tree_t top, group_nets_ctx_t *ctx)
 {
-   char *name = xasprintf("_%s.netdb", istr(tree_ident(top)));
+   char *name LOCAL = xasprintf("_%s.netdb", istr(tree_ident(top)));
 
-   fbuf_t *f = lib_fbuf_open(lib_work(), name, FBUF_OUT);
+   FILE *f = lib_fopen(lib_work(), name, "wb");
    if (f == NULL)
       fatal("failed to create net database file %s", name);
 
-   free(name);
-
-   for (group_t *it = ctx->groups; it != NULL; it = it->next) {
-      write_u32(it->gid, f);
-      write_u32(it->first, f);
-      write_u32(it->length, f);
+   // Group IDs are renumbered so they match the order of the table
+   const unsigned ngroups = ctx->next_gid;
+   group_t *table = xmalloc(MAX(ngroups, 1) * sizeof(group_t));
+   unsigned pos = 0;
+   group_sort(ctx->root, table, &pos);
+   assert(pos == ngroups);
+
+   const netid_t nnets =
+      ngroups > 0 ? table[ngroups - 1].first + table[ngroups - 1].length : 0;
+
+   const unsigned chunk = 1 << NETDB_CHUNK_BITS;
+   const unsigned nchunks = (nnets + chunk - 1) / chunk;
+   groupid_t *index = xmalloc(MAX(nchunks, 1) * sizeof(groupid_t));
+
+   groupid_t gid = 0;
+   for (unsigned i = 0; i < nchunks; i++) {
+      while (table[gid].first + table[gid].length <= i * chunk)
+         gid++;
+      index[i] = gid;
    }
-   write_u32(GROUPID_INVALID, f);
 
-   fbuf_close(f);
+   const size_t table_size = ngroups * sizeof(group_t);
+
+   netdb_header_t header = {
+      .magic        = NETDB_MAGIC,
+      .version      = NETDB_VERSION,
+      .ngroups      = ngroups,
+      .nnets        = nnets,
+      .nchunks      = nchunks,
+      .group_offset = NETDB_ALIGN,
+      .index_offset = NETDB_ALIGN
+         + ((table_size + NETDB_ALIGN - 1) / NETDB_ALIGN) * NETDB_ALIGN
+   };
+
+   group_write_section(f, 0, &header, sizeof(header), name);
+   group_write_section(f, header.group_offset, table, table_size, name);
+   group_write_section(f, header.index_offset, index,
+                       nchunks * sizeof(groupid_t), name);
+
+   if (fclose(f) != 0)
+      fatal_errno("closing %s", name);
+
+   free(table);
+   free(index);
 }
 
-static void group_free_list(group_t *list)
+static void group_init_context(group_nets_ctx_t *ctx, int nnets)
 {
-   while (list != NULL) {
-      group_t *tmp = list->next;
-      free(list);
-      list = tmp;
-   }
+   ctx->groups   = NULL;
+   ctx->root     = NULL;
+   ctx->next_gid = 0;
+   ctx->nnets    = nnets;
+   ctx->gaps     = NULL;
+   ctx->ngaps    = 0;
+   ctx->maxgaps  = 0;
 }
 
-static void group_init_context(group_nets_ctx_t *ctx, int nnets)
+static void group_free_context(group_nets_ctx_t *ctx)
 {
-   ctx->groups    = NULL;
-   ctx->next_gid  = 0;
-   ctx->lookup    = xcalloc(nnets * sizeof(group_t *));
-   ctx->nnets     = nnets;
-   ctx->free_list = NULL;
+   while (ctx->groups != NULL) {
+      group_node_t *tmp = ctx->groups->next;
+      free(ctx->groups);
+      ctx->groups = tmp;
+   }
+
+   free(ctx->gaps);
 }
 
 void group_nets(tree_t top)
@@ -536,15 +709,10 @@ void group_nets(tree_t top)
    group_write_netdb(top, &ctx);
 
    if (opt_get_int("verbose")) {
-      int ngroups = 0;
-      for (group_t *it = ctx.groups; it != NULL; it = it->next)
-         ngroups++;
-
+      const int ngroups = ctx.next_gid;
       notef("%d nets, %d groups", nnets, ngroups);
       notef("nets:groups ratio %.3f", (float)nnets / (float)ngroups);
    }
 
-   group_free_list(ctx.groups);
-   group_free_list(ctx.free_list);
-   free(ctx.lookup);
+   group_free_context(&ctx);
 }
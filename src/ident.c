@@ -25,144 +25,183 @@
 #include <string.h>
 #include <stdint.h>
 
-#define MAP_DEPTH 3
-
-typedef struct clist clist_t;
-typedef struct trie  trie_t;
-
-struct clist {
-   char     value;
-   trie_t  *down;
-   clist_t *left;
-   clist_t *right;
+#define INITIAL_SIZE 4096
+#define CHUNK_SIZE   (1 << 16)
+
+// Identifiers are interned in an open addressing hash table. Lookups
+// do not take any lock and may run concurrently with inserts: slots
+// are only ever filled once and a table is never freed after it is
+// replaced by a larger one. A lookup which misses takes the insert
+// lock and searches again in the current table.
+
+struct ident {
+   uint32_t hash;
+   uint32_t length;
+   uint32_t write_gen;
+   uint32_t write_index;
+   char     bytes[0];
 };
 
-struct trie {
-   char      value;
-   uint16_t  write_gen;
-   uint16_t  depth;
-   uint32_t  write_index;
-   trie_t   *up;
-   clist_t  *list;
-   trie_t   *map[0];
-};
+typedef struct {
+   size_t  size;
+   size_t  count;
+   ident_t slots[0];
+} ident_tab_t;
 
 struct ident_rd_ctx {
    fbuf_t  *file;
    size_t   cache_sz;
    size_t   cache_alloc;
    ident_t *cache;
+   char    *buf;
+   size_t   bufsz;
 };
 
 struct ident_wr_ctx {
    fbuf_t   *file;
    uint32_t  next_index;
-   uint16_t  generation;
+   uint32_t  generation;
 };
 
-typedef struct {
-   trie_t  trie;
-   trie_t *map[256];
-} root_t;
-
-static root_t root = {
-   {
-      .value       = '\0',
-      .write_gen   = 0,
-      .write_index = 0,
-      .depth       = 1,
-      .up          = NULL
-   }
-};
+static ident_tab_t *table = NULL;
+static char        *chunk = NULL;
+static size_t       chunk_avail = 0;
+static char         insert_lock = 0;
 
-static trie_t *alloc_node(char ch, trie_t *prev)
+static uint32_t ident_hash(const char *str, size_t len)
 {
-   const size_t mapsz = (prev->depth < MAP_DEPTH) ? 256 * sizeof(trie_t *) : 0;
+   // FNV-1a
+   uint32_t hash = 2166136261u;
+   for (size_t i = 0; i < len; i++)
+      hash = (hash ^ (unsigned char)str[i]) * 16777619u;
+   return hash;
+}
 
-   trie_t *t = xmalloc(sizeof(trie_t) + mapsz);
-   t->value     = ch;
-   t->depth     = prev->depth + 1;
-   t->up        = prev;
-   t->write_gen = 0;
-   t->list      = NULL;
+static void ident_lock(void)
+{
+   while (__atomic_test_and_set(&insert_lock, __ATOMIC_ACQUIRE))
+      ;
+}
+
+static void ident_unlock(void)
+{
+   __atomic_clear(&insert_lock, __ATOMIC_RELEASE);
+}
 
-   if (mapsz > 0)
-      memset(t->map, '\0', mapsz);
+static ident_t ident_search(ident_tab_t *tab, const char *str, size_t len,
+                            uint32_t hash, size_t *slot)
+{
+   const size_t mask = tab->size - 1;
+   for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+      ident_t id = __atomic_load_n(&(tab->slots[i]), __ATOMIC_ACQUIRE);
+      if (id == NULL) {
+         *slot = i;
+         return NULL;
+      }
+      else if (id->hash == hash && id->length == len
+               && memcmp(id->bytes, str, len) == 0)
+         return id;
+   }
+}
 
-   if (prev->depth <= MAP_DEPTH)
-      prev->map[(unsigned char)ch] = t;
+static ident_t ident_alloc(const char *str, size_t len, uint32_t hash)
+{
+   // Identifiers are never freed so allocate them in large chunks
+   const size_t size =
+      (sizeof(struct ident) + len + 1 + sizeof(uint32_t) - 1)
+      & ~(sizeof(uint32_t) - 1);
+
+   ident_t id;
+   if (size > CHUNK_SIZE / 4)
+      id = xmalloc(size);
    else {
-      clist_t *c = xmalloc(sizeof(clist_t));
-      c->value    = ch;
-      c->down     = t;
-      c->left     = NULL;
-      c->right    = NULL;
-
-      clist_t *it, **where;
-      for (it = prev->list, where = &(prev->list);
-           it != NULL;
-           where = (ch < it->value ? &(it->left) : &(it->right)),
-              it = *where)
-         ;
+      if (size > chunk_avail) {
+         chunk = xmalloc(CHUNK_SIZE);
+         chunk_avail = CHUNK_SIZE;
+      }
 
-      *where = c;
+      id = (ident_t)chunk;
+      chunk += size;
+      chunk_avail -= size;
    }
 
-   return t;
+   id->hash        = hash;
+   id->length      = len;
+   id->write_gen   = 0;
+   id->write_index = 0;
+   memcpy(id->bytes, str, len);
+   id->bytes[len] = '\0';
+
+   return id;
 }
 
-static void build_trie(const char *str, trie_t *prev, trie_t **end)
+static void ident_grow(void)
 {
-   assert(*str != '\0');
-   assert(prev != NULL);
+   const size_t size = (table == NULL) ? INITIAL_SIZE : table->size * 2;
+
+   ident_tab_t *tab = xcalloc(sizeof(ident_tab_t) + size * sizeof(ident_t));
+   tab->size = size;
+
+   if (table != NULL) {
+      for (size_t i = 0; i < table->size; i++) {
+         ident_t id = table->slots[i];
+         if (id != NULL) {
+            size_t slot;
+            ident_search(tab, id->bytes, id->length, id->hash, &slot);
+            tab->slots[slot] = id;
+         }
+      }
 
-   trie_t *t = alloc_node(*str, prev);
+      tab->count = table->count;
+   }
 
-   if (*(++str) == '\0')
-      *end = t;
-   else
-      build_trie(str, t, end);
+   // The old table may still be in use by a concurrent lookup
+   __atomic_store_n(&table, tab, __ATOMIC_RELEASE);
 }
 
-static clist_t *search_node(trie_t *t, char ch)
+static ident_t ident_intern(const char *str, size_t len)
 {
-   clist_t *it;
-   for (it = t->list;
-        (it != NULL) && (it->value != ch);
-        it = (ch < it->value ? it->left : it->right))
-      ;
+   const uint32_t hash = ident_hash(str, len);
 
-   return it;
-}
+   ident_tab_t *tab = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
 
-static bool search_trie(const char **str, trie_t *t, trie_t **end)
-{
-   assert(**str != '\0');
-   assert(t != NULL);
+   size_t slot;
+   ident_t id;
+   if (likely(tab != NULL) && (id = ident_search(tab, str, len, hash, &slot)))
+      return id;
 
-   trie_t *next = NULL;
+   ident_lock();
 
-   if (t->depth <= MAP_DEPTH)
-      next = t->map[(unsigned char)**str];
-   else {
-      clist_t *it = search_node(t, **str);
-      next = (it != NULL) ? it->down : NULL;
+   if (table == NULL || (table->count + 1) * 2 > table->size)
+      ident_grow();
+
+   if ((id = ident_search(table, str, len, hash, &slot)) == NULL) {
+      id = ident_alloc(str, len, hash);
+      table->count++;
+      __atomic_store_n(&(table->slots[slot]), id, __ATOMIC_RELEASE);
    }
 
-   if (next == NULL) {
-      *end = t;
+   ident_unlock();
+   return id;
+}
+
+static bool ident_lookup(const char *str, size_t len, ident_t *result)
+{
+   const uint32_t hash = ident_hash(str, len);
+
+   ident_tab_t *tab = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
+   if (tab == NULL)
       return false;
-   }
-   else {
-      (*str)++;
 
-      if (**str == '\0') {
-         *end = next;
-         return true;
-      }
-      else
-         return search_trie(str, next, end);
-   }
+   size_t slot;
+   if ((*result = ident_search(tab, str, len, hash, &slot)))
+      return true;
+
+   ident_lock();
+   *result = ident_search(table, str, len, hash, &slot);
+   ident_unlock();
+
+   return *result != NULL;
 }
 
 ident_t ident_new(const char *str)
@@ -170,11 +209,7 @@ ident_t ident_new(const char *str)
    assert(str != NULL);
    assert(*str != '\0');
 
-   trie_t *result;
-   if (!search_trie(&str, &(root.trie), &result))
-      build_trie(str, result, &result);
-
-   return result;
+   return ident_intern(str, strlen(str));
 }
 
 bool ident_interned(const char *str)
@@ -182,27 +217,20 @@ bool ident_interned(const char *str)
    assert(str != NULL);
    assert(*str != '\0');
 
-   trie_t *result;
-   return search_trie(&str, &(root.trie), &result);
+   ident_t result;
+   return ident_lookup(str, strlen(str), &result);
 }
 
 const char *istr(ident_t ident)
 {
    assert(ident != NULL);
 
-   char *p = get_fmt_buf(ident->depth) + ident->depth - 1;
-   *p = '\0';
-
-   trie_t *it;
-   for (it = ident; it->value != '\0'; it = it->up)
-      *(--p) = it->value;
-
-   return p;
+   return ident->bytes;
 }
 
 ident_wr_ctx_t ident_write_begin(fbuf_t *f)
 {
-   static uint16_t ident_wr_gen = 1;
+   static uint32_t ident_wr_gen = 1;
    assert(ident_wr_gen > 0);
 
    struct ident_wr_ctx *ctx = xmalloc(sizeof(struct ident_wr_ctx));
@@ -228,7 +256,7 @@ void ident_write(ident_t ident, ident_wr_ctx_t ctx)
       write_u32(ident->write_index, ctx->file);
    else {
       write_u32(UINT32_MAX, ctx->file);
-      write_raw(istr(ident), ident->depth, ctx->file);
+      write_raw(ident->bytes, ident->length + 1, ctx->file);
 
       ident->write_gen   = ctx->generation;
       ident->write_index = ctx->next_index++;
@@ -244,6 +272,8 @@ ident_rd_ctx_t ident_read_begin(fbuf_t *f)
    ctx->cache_alloc = 256;
    ctx->cache_sz    = 0;
    ctx->cache       = xmalloc(ctx->cache_alloc * sizeof(ident_t));
+   ctx->bufsz       = 128;
+   ctx->buf         = xmalloc(ctx->bufsz);
 
    return ctx;
 }
@@ -251,6 +281,7 @@ ident_rd_ctx_t ident_read_begin(fbuf_t *f)
 void ident_read_end(ident_rd_ctx_t ctx)
 {
    free(ctx->cache);
+   free(ctx->buf);
    free(ctx);
 }
 
@@ -263,28 +294,22 @@ ident_t ident_read(ident_rd_ctx_t ctx)
          ctx->cache = xrealloc(ctx->cache, ctx->cache_alloc * sizeof(ident_t));
       }
 
-      trie_t *p = &(root.trie);
+      size_t len = 0;
       char ch;
       while ((ch = read_u8(ctx->file)) != '\0') {
-         trie_t *next = NULL;
-         if (p->depth <= MAP_DEPTH)
-            next = p->map[(unsigned char)ch];
-         else {
-            clist_t *it = search_node(p, ch);
-            next = (it != NULL) ? it->down : NULL;
+         if (len == ctx->bufsz) {
+            ctx->bufsz *= 2;
+            ctx->buf = xrealloc(ctx->buf, ctx->bufsz);
          }
-
-         if (next != NULL)
-            p = next;
-         else
-            p = alloc_node(ch, p);
+         ctx->buf[len++] = ch;
       }
 
-      if (p == &(root.trie))
+      if (len == 0)
          return NULL;
       else {
-         ctx->cache[ctx->cache_sz++] = p;
-         return p;
+         ident_t id = ident_intern(ctx->buf, len);
+         ctx->cache[ctx->cache_sz++] = id;
+         return id;
       }
    }
    else {
@@ -297,20 +322,15 @@ ident_t ident_uniq(const char *prefix)
 {
    static int counter = 0;
 
-   const char *start = prefix;
-   trie_t *end;
-   if (search_trie(&start, &(root.trie), &end)) {
+   if (ident_interned(prefix)) {
       const size_t len = strlen(prefix) + 16;
       char buf[len];
       snprintf(buf, len, "%s%d", prefix, counter++);
 
       return ident_new(buf);
    }
-   else {
-      trie_t *result;
-      build_trie(start, end, &result);
-      return result;
-   }
+   else
+      return ident_new(prefix);
 }
 
 ident_t ident_prefix(ident_t a, ident_t b, char sep)
@@ -320,24 +340,17 @@ ident_t ident_prefix(ident_t a, ident_t b, char sep)
    else if (b == NULL)
       return a;
 
-   trie_t *result;
-
-   if (sep != '\0') {
-      // Append separator
-      const char sep_str[] = { sep, '\0' };
-      const char *p_sep_str = sep_str;
-      if (!search_trie(&p_sep_str, a, &result))
-         build_trie(p_sep_str, result, &result);
-   }
-   else
-      result = a;
+   const size_t len = a->length + b->length + (sep != '\0');
+   char buf[len];
 
-   // Append b
-   const char *bstr = istr(b);
-   if (!search_trie(&bstr, result, &result))
-      build_trie(bstr, result, &result);
+   char *p = buf;
+   memcpy(p, a->bytes, a->length);
+   p += a->length;
+   if (sep != '\0')
+      *p++ = sep;
+   memcpy(p, b->bytes, b->length);
 
-   return result;
+   return ident_intern(buf, len);
 }
 
 ident_t ident_strip(ident_t a, ident_t b)
@@ -345,36 +358,40 @@ ident_t ident_strip(ident_t a, ident_t b)
    assert(a != NULL);
    assert(b != NULL);
 
-   while (a->value == b->value && b->value != '\0') {
-      a = a->up;
-      b = b->up;
-   }
+   if (b->length > a->length)
+      return NULL;
 
-   return (b->value == '\0' ? a : NULL);
+   const size_t len = a->length - b->length;
+   if (memcmp(a->bytes + len, b->bytes, b->length) != 0)
+      return NULL;
+
+   return ident_intern(a->bytes, len);
 }
 
 char ident_char(ident_t i, unsigned n)
 {
-   if (i == NULL)
+   if (i == NULL || n >= i->length)
       return '\0';
-   else if (n == 0)
-      return i->value;
    else
-      return ident_char(i->up, n - 1);
+      return i->bytes[i->length - 1 - n];
 }
 
 ident_t ident_suffix_until(ident_t i, char c, ident_t shared)
 {
    assert(i != NULL);
 
-   ident_t r = i;
-   while (i->value != '\0' && i->up != shared) {
-      if (i->value == c)
-         r = i->up;
-      i = i->up;
+   // The character immediately following the shared prefix is skipped
+   size_t start = 0;
+   if (shared != NULL && shared->length < i->length
+       && memcmp(i->bytes, shared->bytes, shared->length) == 0)
+      start = shared->length + 1;
+
+   for (size_t j = start; j < i->length; j++) {
+      if (i->bytes[j] == c)
+         return ident_intern(i->bytes, j);
    }
 
-   return r;
+   return i;
 }
 
 ident_t ident_until(ident_t i, char c)
@@ -386,75 +403,58 @@ ident_t ident_runtil(ident_t i, char c)
 {
    assert(i != NULL);
 
-   while (i->value != '\0') {
-      if (i->value == c)
-         return i->up;
-      i = i->up;
-   }
+   size_t len = i->length;
+   while (len > 0 && i->bytes[len - 1] != c)
+      len--;
 
-   return i;
+   return ident_intern(i->bytes, (len == 0) ? 0 : len - 1);
 }
 
 ident_t ident_from(ident_t i, char c)
 {
    assert(i != NULL);
 
-   char buf[i->depth + 1];
-   char *p = buf + i->depth;
-   *p-- = '\0';
-
-   char *from = NULL;
-   while (i->value != '\0') {
-      if (i->value == c)
-         from = p + 1;
-      *p-- = i->value;
-      i = i->up;
-   }
-
-   return (from == NULL) ? NULL : ident_new(from);
+   const char *p = memchr(i->bytes, c, i->length);
+   if (p == NULL || p + 1 == i->bytes + i->length)
+      return NULL;
+   else
+      return ident_intern(p + 1, i->length - (p + 1 - i->bytes));
 }
 
 ident_t ident_rfrom(ident_t i, char c)
 {
    assert(i != NULL);
 
-   char buf[i->depth + 1];
-   char *p = buf + i->depth;
-   *p-- = '\0';
-
-   while (i->value != '\0') {
-      if (i->value == c)
-         return ident_new(p + 1);
-      *p-- = i->value;
-      i = i->up;
-   }
+   size_t pos = i->length;
+   while (pos > 0 && i->bytes[pos - 1] != c)
+      pos--;
 
-   return NULL;
+   if (pos == 0 || pos == i->length)
+      return NULL;
+   else
+      return ident_intern(i->bytes + pos, i->length - pos);
 }
 
 bool icmp(ident_t i, const char *s)
 {
    assert(i != NULL);
 
-   trie_t *result;
-   if (!search_trie(&s, &(root.trie), &result))
-      return false;
-   else
-      return result == i;
+   return strcmp(i->bytes, s) == 0;
 }
 
-static bool ident_glob_walk(const trie_t *i, const char *g,
+static bool ident_glob_walk(const char *str, const char *g,
                             const char *const end)
 {
-   if (i->value == '\0')
-      return (g < end);
-   else if (g < end)
+   // A wildcard matches one or more characters
+   if (g == end)
+      return *str == '\0';
+   else if (*str == '\0')
       return false;
    else if (*g == '*')
-      return ident_glob_walk(i->up, g, end)
-         || ident_glob_walk(i->up, g - 1, end);
-   else if (i->value == *g)
-      return ident_glob_walk(i->up, g - 1, end);
+      return ident_glob_walk(str + 1, g, end)
+         || ident_glob_walk(str + 1, g + 1, end);
+   else if (*str == *g)
+      return ident_glob_walk(str + 1, g + 1, end);
    else
       return false;
 }
@@ -466,7 +466,7 @@ bool ident_glob(ident_t i, const char *glob, int length)
    if (length < 0)
       length = strlen(glob);
 
-   return ident_glob_walk(i, glob + length - 1, glob);
+   return ident_glob_walk(i->bytes, glob, glob + length);
 }
 
 void ident_list_add(ident_list_t **list, ident_t i)
@@ -68,9 +68,8 @@ bool icmp(ident_t i, const char *s);
 // if set to the length of glob
 bool ident_glob(ident_t i, const char *glob, int length);
 
-// Convert an identifier reference to a NULL-terminated string.
-// This function is quite slow so its use should be avoided except
-// for printing.
+// Convert an identifier reference to a NULL-terminated string. The
+// returned pointer is valid for the lifetime of the program.
 const char *istr(ident_t ident);
 
 ident_wr_ctx_t ident_write_begin(fbuf_t *f);
@@ -21,6 +21,7 @@
 #include "lib.h"
 #include "tree.h"
 #include "common.h"
+#include "hash.h"
 
 #include <assert.h>
 #include <limits.h>
@@ -54,16 +55,17 @@ struct lib_unit {
 struct lib_index {
    ident_t      name;
    tree_kind_t  kind;
+   lib_unit_t  *unit;
    lib_index_t *next;
 };
 
 struct lib {
    char         path[PATH_MAX];
    ident_t      name;
-   unsigned     n_units;
-   unsigned     units_alloc;
-   lib_unit_t  *units;
    lib_index_t *index;
+   unsigned     index_size;
+   hash_t      *lookup;
+   bool         has_index;
    int          lock_fd;
 };
 
@@ -134,14 +136,31 @@ static void lib_write_lock(lib_t lib)
       fatal_errno("flock");
 }
 
+static lib_index_t *lib_add_to_index(lib_t lib, ident_t name,
+                                     tree_kind_t kind)
+{
+   lib_index_t *in = xmalloc(sizeof(lib_index_t));
+   in->name = name;
+   in->kind = kind;
+   in->unit = NULL;
+   in->next = lib->index;
+
+   lib->index = in;
+   lib->index_size++;
+
+   hash_put(lib->lookup, name, in);
+   return in;
+}
+
 static lib_t lib_init(const char *name, const char *rpath, int lock_fd)
 {
    struct lib *l = xmalloc(sizeof(struct lib));
-   l->n_units = 0;
-   l->units   = NULL;
-   l->name    = upcase_name(name);
-   l->index   = NULL;
-   l->lock_fd = lock_fd;
+   l->name       = upcase_name(name);
+   l->index      = NULL;
+   l->index_size = 0;
+   l->lookup     = hash_new(256, true);
+   l->has_index  = false;
+   l->lock_fd    = lock_fd;
 
    if (realpath(rpath, l->path) == NULL)
       strncpy(l->path, rpath, PATH_MAX);
@@ -169,16 +188,13 @@ static lib_t lib_init(const char *name, const char *rpath, int lock_fd)
          tree_kind_t kind = read_u16(f);
          assert(kind < T_LAST_TREE_KIND);
 
-         lib_index_t *in = xmalloc(sizeof(lib_index_t));
-         in->name = name;
-         in->kind = kind;
-         in->next = l->index;
-
-         l->index = in;
+         lib_add_to_index(l, name, kind);
       }
 
       ident_read_end(ictx);
       fbuf_close(f);
+
+      l->has_index = true;
    }
 
    lib_unlock(l);
@@ -187,13 +203,7 @@ static lib_t lib_init(const char *name, const char *rpath, int lock_fd)
 
 static lib_index_t *lib_find_in_index(lib_t lib, ident_t name)
 {
-   lib_index_t *it;
-   for (it = lib->index;
-        (it != NULL) && (it->name != name);
-        it = it->next)
-      ;
-
-   return it;
+   return hash_get(lib->lookup, name);
 }
 
 static lib_unit_t *lib_put_aux(lib_t lib, tree_t unit,
@@ -203,46 +213,24 @@ static lib_unit_t *lib_put_aux(lib_t lib, tree_t unit,
    assert(lib != NULL);
    assert(unit != NULL);
 
-   lib_unit_t *where = NULL;
    ident_t name = tree_ident(unit);
 
-   for (unsigned i = 0; (where == NULL) && (i < lib->n_units); i++) {
-      if (tree_ident(lib->units[i].top) == tree_ident(unit))
-         where = &(lib->units[i]);
-   }
-
-   if (where == NULL) {
-      if (lib->n_units == 0) {
-         lib->units_alloc = 16;
-         lib->units = xmalloc(sizeof(lib_unit_t) * lib->units_alloc);
-      }
-      else if (lib->n_units == lib->units_alloc) {
-         lib->units_alloc *= 2;
-         lib->units = xrealloc(lib->units,
-                               sizeof(lib_unit_t) * lib->units_alloc);
-      }
+   lib_index_t *it = lib_find_in_index(lib, name);
+   if (it == NULL)
+      it = lib_add_to_index(lib, name, tree_kind(unit));
+   else
+      it->kind = tree_kind(unit);
 
-      where = &(lib->units[lib->n_units++]);
-   }
+   if (it->unit == NULL)
+      it->unit = xmalloc(sizeof(lib_unit_t));
 
+   lib_unit_t *where = it->unit;
    where->top      = unit;
    where->read_ctx = ctx;
    where->dirty    = dirty;
    where->mtime    = mtime;
    where->kind     = tree_kind(unit);
 
-   lib_index_t *it = lib_find_in_index(lib, name);
-   if (it == NULL) {
-      lib_index_t *new = xmalloc(sizeof(lib_index_t));
-      new->name = name;
-      new->kind = tree_kind(unit);
-      new->next = lib->index;
-
-      lib->index = new;
-   }
-   else
-      it->kind = tree_kind(unit);
-
    return where;
 }
 
@@ -489,7 +477,12 @@ FILE *lib_fopen(lib_t lib, const char *name, const char *mode)
 fbuf_t *lib_fbuf_open(lib_t lib, const char *name, fbuf_mode_t mode)
 {
    assert(lib != NULL);
-   return fbuf_open(lib_file_path(lib, name), mode);
+
+   fbuf_flags_t flags = 0;
+   if (mode == FBUF_OUT && opt_get_int("uncompressed"))
+      flags |= FBUF_UNCOMPRESSED;
+
+   return fbuf_open(lib_file_path(lib, name), mode, flags);
 }
 
 void lib_free(lib_t lib)
@@ -509,8 +502,14 @@ void lib_free(lib_t lib)
       }
    }
 
-   if (lib->units != NULL)
-      free(lib->units);
+   while (lib->index != NULL) {
+      lib_index_t *next = lib->index->next;
+      free(lib->index->unit);
+      free(lib->index);
+      lib->index = next;
+   }
+
+   hash_free(lib->lookup);
    free(lib);
 }
 
@@ -598,47 +597,42 @@ static lib_unit_t *lib_get_aux(lib_t lib, ident_t ident)
          ident = ident_prefix(lib->name, uname, '.');
    }
 
-   // Search in the list of already loaded units
-   for (unsigned n = 0; n < lib->n_units; n++) {
-      if (tree_ident(lib->units[n].top) == ident)
-         return &(lib->units[n]);
-   }
+   // Search in the table of already loaded units
+   lib_index_t *it = lib_find_in_index(lib, ident);
+   if (it != NULL && it->unit != NULL)
+      return it->unit;
 
    if (*(lib->path) == '\0')   // Temporary library
       return NULL;
 
-   lib_read_lock(lib);
+   // Every unit saved to the library is in the index so only libraries
+   // without an index need to check the filesystem for other names
+   if (it == NULL && lib->has_index)
+      return NULL;
 
-   // Otherwise search in the filesystem
-   DIR *d = opendir(lib->path);
-   if (d == NULL)
-      fatal("%s: %s", lib->path, strerror(errno));
+   lib_read_lock(lib);
 
+   // Units are stored in a file with the same name as the unit
    lib_unit_t *unit = NULL;
-   const char *search = istr(ident);
-   struct dirent *e;
-   while ((e = readdir(d))) {
-      if (strcmp(e->d_name, search) == 0) {
-         fbuf_t *f = lib_fbuf_open(lib, e->d_name, FBUF_IN);
-         tree_rd_ctx_t ctx = tree_read_begin(f, lib_file_path(lib, e->d_name));
-         tree_t top = tree_read(ctx);
-         fbuf_close(f);
+   const char *name = istr(ident);
+   fbuf_t *f = lib_fbuf_open(lib, name, FBUF_IN);
+   if (f != NULL) {
+      tree_rd_ctx_t ctx = tree_read_begin(f, lib_file_path(lib, name));
+      tree_t top = tree_read(ctx);
+      fbuf_close(f);
 
-         struct stat st;
-         if (stat(lib_file_path(lib, e->d_name), &st) < 0)
-            fatal_errno("%s", e->d_name);
+      struct stat st;
+      if (stat(lib_file_path(lib, name), &st) < 0)
+         fatal_errno("%s", name);
 
-         lib_mtime_t mt = lib_stat_mtime(&st);
+      lib_mtime_t mt = lib_stat_mtime(&st);
 
-         unit = lib_put_aux(lib, top, ctx, false, mt);
-         break;
-      }
+      unit = lib_put_aux(lib, top, ctx, false, mt);
    }
 
-   closedir(d);
    lib_unlock(lib);
 
-   if (unit == NULL && lib_find_in_index(lib, ident) != NULL)
+   if (unit == NULL && it != NULL)
       fatal("library %s corrupt: unit %s present in index but missing "
             "on disk", istr(lib->name), istr(ident));
 
@@ -691,6 +685,27 @@ tree_t lib_get(lib_t lib, ident_t ident)
       return NULL;
 }
 
+void lib_forget(lib_t lib, ident_t ident)
+{
+   // Drop a unit which has been saved so its objects can be released by
+   // the next full collection and the unit read back from disk the next
+   // time it is needed
+
+   lib_index_t *it = lib_find_in_index(lib, ident);
+   if (it == NULL || it->unit == NULL || it->unit->dirty)
+      return;
+
+   lib_unit_t *lu = it->unit;
+
+   if (lu->read_ctx != NULL)
+      tree_read_end(lu->read_ctx);
+
+   tree_unroot(lu->top);
+
+   free(lu);
+   it->unit = NULL;
+}
+
 tree_t lib_get_check_stale(lib_t lib, ident_t ident)
 {
    lib_unit_t *lu = lib_get_aux(lib, ident);
@@ -728,33 +743,30 @@ void lib_save(lib_t lib)
 
    lib_write_lock(lib);
 
-   for (unsigned n = 0; n < lib->n_units; n++) {
-      if (lib->units[n].dirty) {
-         const char *name = istr(tree_ident(lib->units[n].top));
+   lib_index_t *it;
+   for (it = lib->index; it != NULL; it = it->next) {
+      lib_unit_t *lu = it->unit;
+      if (lu != NULL && lu->dirty) {
+         const char *name = istr(tree_ident(lu->top));
          fbuf_t *f = lib_fbuf_open(lib, name, FBUF_OUT);
          if (f == NULL)
             fatal("failed to create %s in library %s", name, istr(lib->name));
          tree_wr_ctx_t ctx = tree_write_begin(f);
-         tree_write(lib->units[n].top, ctx);
+         tree_write(lu->top, ctx);
          tree_write_end(ctx);
          fbuf_close(f);
 
-         lib->units[n].dirty = false;
+         lu->dirty = false;
       }
    }
 
-   lib_index_t *it;
-   int index_sz = 0;
-   for (it = lib->index; it != NULL; it = it->next, ++index_sz)
-      ;
-
    fbuf_t *f = lib_fbuf_open(lib, "_index", FBUF_OUT);
    if (f == NULL)
       fatal("failed to create library %s index", istr(lib->name));
 
    ident_wr_ctx_t ictx = ident_write_begin(f);
 
-   write_u32(index_sz, f);
+   write_u32(lib->index_size, f);
    for (it = lib->index; it != NULL; it = it->next) {
       ident_write(it->name, ictx);
       write_u16(it->kind, f);
@@ -763,6 +775,8 @@ void lib_save(lib_t lib)
    ident_write_end(ictx);
    fbuf_close(f);
    lib_unlock(lib);
+
+   lib->has_index = true;
 }
 
 void lib_walk_index(lib_t lib, lib_index_fn_t fn, void *context)
@@ -778,11 +792,7 @@ unsigned lib_index_size(lib_t lib)
 {
    assert(lib != NULL);
 
-   unsigned n = 0;
-   for (lib_index_t *it = lib->index; it != NULL; it = it->next)
-      n++;
-
-   return n;
+   return lib->index_size;
 }
 
 void lib_realpath(lib_t lib, const char *name, char *buf, size_t buflen)
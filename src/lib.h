@@ -54,6 +54,7 @@ void lib_put(lib_t lib, tree_t unit);
 tree_t lib_get(lib_t lib, ident_t ident);
 tree_t lib_get_ctx(lib_t lib, ident_t ident, tree_rd_ctx_t *ctx);
 tree_t lib_get_check_stale(lib_t lib, ident_t ident);
+void lib_forget(lib_t lib, ident_t ident);
 lib_mtime_t lib_mtime(lib_t lib, ident_t ident);
 unsigned lib_index_size(lib_t lib);
 
@@ -19,12 +19,14 @@
 #include "phase.h"
 #include "tree.h"
 #include "common.h"
+#include "rt/pgo.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <limits.h>
 #include <string.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
@@ -46,6 +48,7 @@
 
 #define MAX_ARGS          64
 #define LINK_NATIVE_BYTES (100 * 1024)
+#define LINK_NATIVE_PGO   (10 * 1000 * 1000)
 
 static char        **args = NULL;
 static int           n_args = 0;
@@ -315,6 +318,7 @@ static void link_assembly(tree_t top)
 
    link_arg_f("%s/llc", LLVM_CONFIG_BINDIR);
    link_arg_f("-relocation-model=pic");
+   link_arg_f("-O%d", opt_get_int("optimise"));
    if (extra != NULL)
       link_arg_f("%s", extra);
    link_output(top, "bc");
@@ -407,63 +411,152 @@ static void link_write_module(tree_t top)
    fclose(f);
 }
 
+typedef void (*link_pass_fn_t)(LLVMPassManagerRef);
+
+typedef struct {
+   const char     *name;
+   link_pass_fn_t  add;
+   int             level;
+   bool            analysis;
+} link_pass_t;
+
+#define PASS(name, level) { #name, LLVMAdd##name##Pass, level, false }
+#define ANALYSIS(name) { #name, LLVMAdd##name##Pass, 0, true }
+
+// Short pipeline for -O1 which removes the redundant loads, stores, and
+// branches typical of generated process code without any of the more
+// expensive interprocedural or loop transformations
+static const link_pass_t link_fast_passes[] = {
+   PASS(PromoteMemoryToRegister, 1),
+   ANALYSIS(BasicAliasAnalysis),
+   ANALYSIS(TypeBasedAliasAnalysis),
+   PASS(EarlyCSE, 1),
+   PASS(SCCP, 1),
+   PASS(InstructionCombining, 1),
+   PASS(CFGSimplification, 1),
+   PASS(DeadStoreElimination, 1),
+   PASS(AggressiveDCE, 1),
+   PASS(CFGSimplification, 1),
+   PASS(StripDeadPrototypes, 1),
+   PASS(GlobalDCE, 1)
+};
+
+// Optimisations from LLVM opt -O2 with vectorisation and a second round
+// of loop unrolling added at -O3
+static const link_pass_t link_full_passes[] = {
+   // Basic cleanup optimisations
+   PASS(PromoteMemoryToRegister, 2),
+   PASS(GVN, 2),
+   PASS(ConstantPropagation, 2),
+
+   ANALYSIS(BasicAliasAnalysis),
+   ANALYSIS(TypeBasedAliasAnalysis),
+   PASS(SCCP, 2),
+   PASS(GlobalOptimizer, 2),
+   PASS(DeadArgElimination, 2),
+   PASS(InstructionCombining, 2),
+   PASS(CFGSimplification, 2),
+   PASS(PruneEH, 2),
+   PASS(FunctionInlining, 2),
+   PASS(FunctionAttrs, 2),
+   PASS(ArgumentPromotion, 2),
+   PASS(EarlyCSE, 2),
+   PASS(JumpThreading, 2),
+   PASS(CorrelatedValuePropagation, 2),
+   PASS(CFGSimplification, 2),
+   PASS(InstructionCombining, 2),
+   PASS(TailCallElimination, 2),
+   PASS(CFGSimplification, 2),
+   PASS(InstructionCombining, 2),
+   PASS(Reassociate, 2),
+   PASS(LoopRotate, 2),
+   PASS(LoopUnswitch, 2),
+   PASS(InstructionCombining, 2),
+   PASS(IndVarSimplify, 2),
+   PASS(LoopIdiom, 2),
+   PASS(LoopDeletion, 2),
+   PASS(LoopUnroll, 2),
+   PASS(GVN, 2),
+   PASS(MemCpyOpt, 2),
+   PASS(SCCP, 2),
+   PASS(InstructionCombining, 2),
+   PASS(JumpThreading, 2),
+   PASS(CorrelatedValuePropagation, 2),
+   PASS(SLPVectorize, 3),
+   PASS(AggressiveDCE, 2),
+   PASS(CFGSimplification, 2),
+   PASS(InstructionCombining, 2),
+   PASS(LoopVectorize, 3),
+   PASS(InstructionCombining, 3),
+   PASS(CFGSimplification, 3),
+   PASS(LoopUnroll, 3),
+   PASS(StripDeadPrototypes, 2),
+   PASS(GlobalDCE, 2),
+   PASS(ConstantMerge, 2)
+};
+
+static void link_opt_timed(const link_pass_t *passes, size_t npasses,
+                           int level)
+{
+   // Run each pass with its own pass manager so the time taken can be
+   // reported separately
+
+   unsigned total = 0;
+   for (size_t i = 0; i < npasses; i++) {
+      if (passes[i].analysis || passes[i].level > level)
+         continue;
+
+      LLVMPassManagerRef pm = LLVMCreatePassManager();
+
+      for (size_t j = 0; j < npasses; j++) {
+         if (passes[j].analysis)
+            (*passes[j].add)(pm);
+      }
+
+      (*passes[i].add)(pm);
+
+      const clock_t start = clock();
+      LLVMRunPassManager(pm, module);
+      const unsigned ms = (clock() - start) * 1000 / CLOCKS_PER_SEC;
+
+      LLVMDisposePassManager(pm);
+
+      notef("%s pass [%ums]", passes[i].name, ms);
+      total += ms;
+   }
+
+   notef("optimisation level %d [%ums]", level, total);
+}
+
 static void link_opt(tree_t top)
 {
-   LLVMPassManagerRef pm = LLVMCreatePassManager();
+   const int level = opt_get_int("optimise");
+   if (level == 0)
+      return;
+
+   const link_pass_t *passes = link_full_passes;
+   size_t npasses = ARRAY_LEN(link_full_passes);
+   if (level == 1) {
+      passes  = link_fast_passes;
+      npasses = ARRAY_LEN(link_fast_passes);
+   }
 
-   // Basic cleanup optimisations
-   LLVMAddPromoteMemoryToRegisterPass(pm);
-   LLVMAddGVNPass(pm);
-   LLVMAddConstantPropagationPass(pm);
-
-   // Optimisations from LLVM opt -O2
-   LLVMAddBasicAliasAnalysisPass(pm);
-   LLVMAddTypeBasedAliasAnalysisPass(pm);
-   LLVMAddSCCPPass(pm);
-   LLVMAddGlobalOptimizerPass(pm);
-   LLVMAddDeadArgEliminationPass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddCFGSimplificationPass(pm);
-   LLVMAddPruneEHPass(pm);
-   LLVMAddFunctionInliningPass(pm);
-   LLVMAddFunctionAttrsPass(pm);
-   LLVMAddArgumentPromotionPass(pm);
-   LLVMAddEarlyCSEPass(pm);
-   LLVMAddJumpThreadingPass(pm);
-   LLVMAddCorrelatedValuePropagationPass(pm);
-   LLVMAddCFGSimplificationPass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddTailCallEliminationPass(pm);
-   LLVMAddCFGSimplificationPass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddReassociatePass(pm);
-   LLVMAddLoopRotatePass(pm);
-   LLVMAddLoopUnswitchPass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddIndVarSimplifyPass(pm);
-   LLVMAddLoopIdiomPass(pm);
-   LLVMAddLoopDeletionPass(pm);
-   LLVMAddLoopUnrollPass(pm);
-   LLVMAddGVNPass(pm);
-   LLVMAddMemCpyOptPass(pm);
-   LLVMAddSCCPPass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddJumpThreadingPass(pm);
-   LLVMAddCorrelatedValuePropagationPass(pm);
-   LLVMAddSLPVectorizePass(pm);
-   LLVMAddAggressiveDCEPass(pm);
-   LLVMAddCFGSimplificationPass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddLoopVectorizePass(pm);
-   LLVMAddInstructionCombiningPass(pm);
-   LLVMAddCFGSimplificationPass(pm);
-   LLVMAddLoopUnrollPass(pm);
-   LLVMAddStripDeadPrototypesPass(pm);
-   LLVMAddGlobalDCEPass(pm);
-   LLVMAddConstantMergePass(pm);
+   if (opt_get_int("verbose"))
+      link_opt_timed(passes, npasses, level);
+   else {
+      LLVMPassManagerRef pm = LLVMCreatePassManager();
 
-   LLVMAddVerifierPass(pm);
+      for (size_t i = 0; i < npasses; i++) {
+         if (passes[i].level <= level)
+            (*passes[i].add)(pm);
+      }
 
+      LLVMRunPassManager(pm, module);
+      LLVMDisposePassManager(pm);
+   }
+
+   LLVMPassManagerRef pm = LLVMCreatePassManager();
+   LLVMAddVerifierPass(pm);
    LLVMRunPassManager(pm, module);
    LLVMDisposePassManager(pm);
 }
@@ -481,26 +574,28 @@ void link_bc(tree_t top)
    module = tree_attr_ptr(top, llvm_i);
    assert(module != NULL);
 
-   const bool opt_en = opt_get_int("optimise");
+   const int level = opt_get_int("optimise");
 
    FILE *deps = link_deps_file(top);
    link_all_context(top, deps, link_context_bc_fn);
    fclose(deps);
 
-   if (opt_en)
-      link_opt(top);
+   link_opt(top);
 
    link_write_module(top);
 
    bool native = false;
 
-   if (opt_get_int("native")) {
-      if (!opt_en)
-         fatal("optimisation must be enabled for native code generation");
-      else
-         native = true;
+   if (opt_get_int("native"))
+      native = true;
+   else if (level >= 2 && pgo_loaded()) {
+      // Compile natively if the profile shows the design runs for long
+      // enough to recover the cost of invoking the system compiler
+#ifdef ENABLE_NATIVE
+      native = (pgo_total_weight() > LINK_NATIVE_PGO);
+#endif  // ENABLE_NATIVE
    }
-   else if (opt_en) {
+   else if (level >= 2) {
       // Use a heuristic to decide if the generated bitcode file is large
       // enough to benefit from native complilation
 #ifdef ENABLE_NATIVE
@@ -19,13 +19,19 @@
 #include "phase.h"
 #include "vcode.h"
 #include "common.h"
+#include "hash.h"
+#include "lib.h"
 #include "rt/rt.h"
+#include "rt/netdb.h"
 
 #include <assert.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 
 typedef enum {
    EXPR_LVALUE,
@@ -42,6 +48,8 @@ typedef enum {
 typedef struct case_arc   case_arc_t;
 typedef struct case_state case_state_t;
 typedef struct loop_stack loop_stack_t;
+typedef struct eval_check eval_check_t;
+typedef struct image_value image_value_t;
 
 struct loop_stack {
    loop_stack_t  *up;
@@ -64,15 +72,36 @@ struct case_state {
    case_arc_t    arcs[MAX_CASE_ARCS];
 };
 
+// Tracks whether a subprogram can be lowered for evaluation
+struct eval_check {
+   tree_t  body;
+   hash_t *locals;
+   bool    ok;
+};
+
+// Constant initial value of a signal written to the image
+struct image_value {
+   uint32_t  size;
+   uint32_t  count;
+   uint8_t  *data;
+};
+
 static const char *verbose = NULL;
 static bool tmp_alloc_used = false;
+static bool eval_mode = false;
+static vcode_unit_t thunk_context = NULL;
+static hash_t *eval_names = NULL;
+static hash_t *eval_decls = NULL;
+static hash_t *eval_records = NULL;
+static unsigned eval_epoch = 0;
+static hash_t *image_values = NULL;
 
 static vcode_reg_t lower_expr(tree_t expr, expr_ctx_t ctx);
 static vcode_reg_t lower_reify_expr(tree_t expr);
 static vcode_type_t lower_bounds(type_t type);
 static void lower_stmt(tree_t stmt, loop_stack_t *loops);
-static void lower_func_body(tree_t body, vcode_unit_t context);
-static void lower_proc_body(tree_t body, vcode_unit_t context);
+static vcode_unit_t lower_func_body(tree_t body, vcode_unit_t context);
+static vcode_unit_t lower_proc_body(tree_t body, vcode_unit_t context);
 static vcode_reg_t lower_signal_ref(tree_t decl, expr_ctx_t ctx);
 static vcode_reg_t lower_record_aggregate(tree_t expr, bool nest,
                                           bool is_const, expr_ctx_t ctx);
@@ -85,6 +114,13 @@ static vcode_reg_t lower_array_dir(type_t type, int dim, vcode_reg_t reg);
 typedef vcode_reg_t (*lower_signal_flag_fn_t)(vcode_reg_t, vcode_reg_t);
 typedef vcode_reg_t (*arith_fn_t)(vcode_reg_t, vcode_reg_t);
 
+static uint32_t lower_index(tree_t t)
+{
+   // Trees are only assigned an index when they are serialised so code
+   // lowered for evaluation during analysis cannot refer to them
+   return eval_mode ? UINT32_MAX : tree_index(t);
+}
+
 static bool lower_is_const(tree_t t)
 {
    if (tree_kind(t) == T_AGGREGATE) {
@@ -325,10 +361,24 @@ static uint32_t lower_record_index(type_t type)
    // If a record type is not qualified with a package name then add a unique
    // index to its type name to avoid collisions
    ident_t name = type_ident(type);
-   if (ident_until(name, '.') == name)
-      return type_index(type);
-   else
+   if (ident_until(name, '.') != name)
       return UINT32_MAX;
+   else if (eval_mode) {
+      // The type may not be serialised yet so assign a private index
+      if (eval_records == NULL)
+         eval_records = hash_new(64, true);
+
+      void *index = hash_get(eval_records, type);
+      if (index == NULL) {
+         static uintptr_t counter = 0;
+         index = (void *)++counter;
+         hash_put(eval_records, type, index);
+      }
+
+      return (uintptr_t)index;
+   }
+   else
+      return type_index(type);
 }
 
 static vcode_type_t lower_type(type_t type)
@@ -532,8 +582,8 @@ static bool lower_scalar_has_static_bounds(type_t type, vcode_reg_t *low_reg,
 static void lower_check_scalar_bounds(vcode_reg_t value, type_t type,
                                       tree_t where, tree_t hint)
 {
-   const int index1 = tree_index(where);
-   const int index2 = hint == NULL ? index1 : tree_index(hint);
+   const int index1 = lower_index(where);
+   const int index2 = hint == NULL ? index1 : lower_index(hint);
 
    const bounds_kind_t kind = lower_type_bounds_kind(type);
 
@@ -859,8 +909,35 @@ static void lower_mangle_one_type(text_buf_t *buf, type_t type)
    }
 }
 
+static ident_t lower_eval_name(tree_t decl)
+{
+   // Subprograms lowered for evaluation get a private name which maps
+   // back to the declaration so the body can be found on demand
+
+   if (eval_names == NULL) {
+      eval_names = hash_new(256, true);
+      eval_decls = hash_new(256, true);
+   }
+
+   ident_t name = hash_get(eval_names, decl);
+   if (name == NULL) {
+      static int counter = 0;
+      LOCAL_TEXT_BUF buf = tb_new();
+      tb_printf(buf, "%s$eval%d", istr(tree_ident(decl)), counter++);
+
+      name = ident_new(tb_get(buf));
+      hash_put(eval_names, decl, (void *)name);
+      hash_put(eval_decls, name, decl);
+   }
+
+   return name;
+}
+
 static ident_t lower_mangle_func(tree_t decl, vcode_unit_t context)
 {
+   if (eval_mode)
+      return lower_eval_name(decl);
+
    ident_t prev = tree_attr_str(decl, mangled_i);
    if (prev != NULL)
       return prev;
@@ -972,7 +1049,7 @@ static vcode_reg_t lower_name_attr(tree_t ref, name_attr_t which)
    tree_t decl = tree_ref(ref);
 
    ident_t i = NULL;
-   ident_t instance = tree_attr_str(decl, ident_new("INSTANCE_NAME"));
+   ident_t instance = tree_attr_str(decl, inst_name_i);
    if (instance == NULL) {
       // Assume this is a package not an elaborated design
       i = ident_new(package_signal_path_name(tree_ident(decl)));
@@ -1131,7 +1208,7 @@ static vcode_reg_t lower_builtin(tree_t fcall, ident_t builtin)
       if (!type_eq(r0_type, r1_type))
          r1 = emit_cast(lower_type(r0_type), lower_bounds(r0_type), r1);
       return lower_narrow(tree_type(fcall),
-                          emit_div(r0, r1, tree_index(fcall)));
+                          emit_div(r0, r1, lower_index(fcall)));
    }
    else if (icmp(builtin, "exp")) {
       if (!type_eq(r0_type, r1_type))
@@ -1265,7 +1342,7 @@ static vcode_reg_t lower_builtin(tree_t fcall, ident_t builtin)
       vcode_type_t rtype  = lower_type(tree_type(fcall));
       return emit_cast(rtype, rtype,
                        emit_div(emit_cast(vreal, vreal, r0),
-                                r1, tree_index(fcall)));
+                                r1, lower_index(fcall)));
    }
    else
       fatal_at(tree_loc(fcall), "cannot lower builtin %s", istr(builtin));
@@ -1302,7 +1379,7 @@ static vcode_reg_t lower_fcall(tree_t fcall, expr_ctx_t ctx)
       tmp_alloc_used = true;
 
    vcode_type_t rtype = lower_func_result_type(decl);
-   const int nest_depth = tree_attr_int(decl, nested_i, 0);
+   const int nest_depth = eval_mode ? 0 : tree_attr_int(decl, nested_i, 0);
    if (nest_depth > 0) {
       const int hops = vcode_unit_depth() - nest_depth;
       return emit_nested_fcall(name, rtype, args, nargs, hops);
@@ -1475,7 +1552,7 @@ static vcode_reg_t lower_param_ref(tree_t decl, expr_ctx_t ctx)
       fatal_trace("missing register for parameter %s", istr(tree_ident(decl)));
    }
 
-   const int depth = tree_attr_int(decl, nested_i, 0);
+   const int depth = eval_mode ? 0 : tree_attr_int(decl, nested_i, 0);
    if (depth > 0 && vcode_unit_depth() != depth)
       return emit_param_upref(vcode_unit_depth() - depth, reg);
    else
@@ -1639,9 +1716,9 @@ static void lower_check_array_bounds(type_t type, int dim, vcode_reg_t array,
                   emit_const(kind_type, BOUNDS_ARRAY_DOWNTO),
                   emit_const(kind_type, BOUNDS_ARRAY_TO));
 
-   const int index = tree_index(where);
+   const int index = lower_index(where);
    emit_dynamic_bounds(value, min_reg, max_reg, kind_reg,
-                       index, (hint == NULL ? index : tree_index(hint)));
+                       index, (hint == NULL ? index : lower_index(hint)));
 }
 
 static vcode_reg_t lower_array_ref_offset(tree_t ref, vcode_reg_t array)
@@ -2414,7 +2491,7 @@ static vcode_reg_t lower_new(tree_t expr, expr_ctx_t ctx)
 static vcode_reg_t lower_all(tree_t all, expr_ctx_t ctx)
 {
    vcode_reg_t access_reg = lower_reify_expr(tree_value(all));
-   emit_null_check(access_reg, tree_index(all));
+   emit_null_check(access_reg, lower_index(all));
    vcode_reg_t all_reg = emit_all(access_reg);
 
    type_t type = tree_type(all);
@@ -2579,7 +2656,7 @@ static vcode_reg_t lower_attr_ref(tree_t expr, expr_ctx_t ctx)
       {
          tree_t value = tree_value(tree_param(expr, 0));
          tmp_alloc_used = true;
-         return emit_image(lower_param(value, NULL, PORT_IN), tree_index(name));
+         return emit_image(lower_param(value, NULL, PORT_IN), lower_index(name));
       }
 
    case ATTR_VALUE:
@@ -2589,7 +2666,7 @@ static vcode_reg_t lower_attr_ref(tree_t expr, expr_ctx_t ctx)
          vcode_reg_t arg = lower_param(value, NULL, PORT_IN);
          vcode_reg_t reg = emit_value(lower_array_data(arg),
                                       lower_array_len(tree_type(value), 0, arg),
-                                      tree_index(expr));
+                                      lower_index(expr));
          lower_check_scalar_bounds(reg, name_type, expr, NULL);
          return emit_cast(lower_type(name_type), lower_bounds(name_type), reg);
       }
@@ -2697,7 +2774,7 @@ static void lower_cleanup_temp_objects(vcode_reg_t saved_heap)
 
 static void lower_assert(tree_t stmt)
 {
-   const int is_report = tree_attr_int(stmt, ident_new("is_report"), 0);
+   const int is_report = tree_attr_int(stmt, is_report_i, 0);
 
    vcode_reg_t severity = lower_reify_expr(tree_severity(stmt));
 
@@ -2731,9 +2808,9 @@ static void lower_assert(tree_t stmt)
    }
 
    if (is_report)
-      emit_report(message, length, severity, tree_index(stmt));
+      emit_report(message, length, severity, lower_index(stmt));
    else
-      emit_assert(value, message, length, severity, tree_index(stmt));
+      emit_assert(value, message, length, severity, lower_index(stmt));
 
    if (saved_heap != VCODE_INVALID_REG)
       lower_cleanup_temp_objects(saved_heap);
@@ -2760,7 +2837,7 @@ static bool lower_signal_sequential_nets(tree_t decl)
    return (i == nnets) && (nnets > 0);
 }
 
-static void lower_sched_event(tree_t on, bool is_static)
+static void lower_sched_event(tree_t on, bool is_static, uint32_t edge)
 {
    tree_kind_t expr_kind = tree_kind(on);
    if (expr_kind != T_REF && expr_kind != T_ARRAY_REF
@@ -2788,7 +2865,7 @@ static void lower_sched_event(tree_t on, bool is_static)
 
    tree_kind_t kind = tree_kind(decl);
    if (kind == T_ALIAS) {
-      lower_sched_event(tree_value(decl), is_static);
+      lower_sched_event(tree_value(decl), is_static, edge);
       return;
    }
    else if (kind != T_SIGNAL_DECL && kind != T_PORT_DECL) {
@@ -2851,7 +2928,8 @@ static void lower_sched_event(tree_t on, bool is_static)
 
    const int flags =
       (sequential ? SCHED_SEQUENTIAL : 0)
-      | (is_static ? SCHED_STATIC : 0);
+      | (is_static ? SCHED_STATIC : 0)
+      | (edge << SCHED_EDGE_SHIFT);
 
    emit_sched_event(nets, n_elems, flags);
 }
@@ -2868,9 +2946,13 @@ static void lower_wait(tree_t wait)
       vcode_select_block(0);
    }
 
+   // Set by the optimiser if the process only needs to run for some
+   // values of its single trigger
+   const uint32_t edge = tree_attr_int(wait, edge_i, 0);
+
    const int ntriggers = tree_triggers(wait);
    for (int i = 0; i < ntriggers; i++)
-      lower_sched_event(tree_trigger(wait, i), is_static);
+      lower_sched_event(tree_trigger(wait, i), is_static, edge);
 
    if (is_static)
       vcode_select_block(active_bb);
@@ -2930,7 +3012,7 @@ static void lower_wait(tree_t wait)
       if (!is_static) {
          const int ntriggers = tree_triggers(wait);
          for (int i = 0; i < ntriggers; i++)
-            lower_sched_event(tree_trigger(wait, i), is_static);
+            lower_sched_event(tree_trigger(wait, i), is_static, 0);
       }
 
       emit_wait(resume, timeout_reg);
@@ -2947,7 +3029,7 @@ static void lower_check_array_sizes(tree_t t, type_t ltype, type_t rtype,
    vcode_reg_t llen_reg = lower_array_len(ltype, 0, lval);
    vcode_reg_t rlen_reg = lower_array_len(rtype, 0, rval);
 
-   emit_array_size(llen_reg, rlen_reg, tree_index(t));
+   emit_array_size(llen_reg, rlen_reg, lower_index(t));
 }
 
 static void lower_find_matching_refs(tree_t ref, void *context)
@@ -3224,7 +3306,7 @@ static void lower_pcall(tree_t pcall)
 
    ident_t name = lower_mangle_func(decl, vcode_unit_context());
 
-   const int nest_depth = tree_attr_int(decl, nested_i, 0);
+   const int nest_depth = eval_mode ? 0 : tree_attr_int(decl, nested_i, 0);
    const bool never_waits =
       tree_attr_int(decl, wait_level_i, WAITS_MAYBE) == WAITS_NO;
    const bool use_fcall =
@@ -3291,6 +3373,14 @@ static void lower_for(tree_t stmt, loop_stack_t *loops)
    if (vcode_reg_const(left_reg, &lconst)
        && vcode_reg_const(right_reg, &rconst))
       bounds = vtype_int(MIN(lconst, rconst), MAX(lconst, rconst));
+   else {
+      // The induction variable always lies between the bounds of the
+      // left and right expressions
+      vcode_type_t lbounds = vcode_reg_bounds(left_reg);
+      vcode_type_t rbounds = vcode_reg_bounds(right_reg);
+      bounds = vtype_int(MIN(vtype_low(lbounds), vtype_low(rbounds)),
+                         MAX(vtype_high(lbounds), vtype_high(rbounds)));
+   }
 
    tree_t idecl = tree_decl(stmt, 0);
    ident_t ident = ident_prefix(tree_ident2(stmt), tree_ident(stmt), '.');
@@ -3780,7 +3870,7 @@ static void lower_check_indexes(type_t type, vcode_reg_t array, tree_t hint)
 
       if (type_is_enum(index))
          emit_index_check(left_reg, right_reg, vbounds,
-                          BOUNDS_INDEX_TO, tree_index(hint));
+                          BOUNDS_INDEX_TO, lower_index(hint));
       else {
          range_t rindex = type_dim(index, 0);
          bounds_kind_t bkind  = rindex.kind == RANGE_TO
@@ -3800,7 +3890,7 @@ static void lower_check_indexes(type_t type, vcode_reg_t array, tree_t hint)
 
          if (lower_is_const(rindex.left) && lower_is_const(rindex.right)) {
             emit_index_check(rlow_reg, rhigh_reg, vbounds,
-                             bkind, tree_index(hint));
+                             bkind, lower_index(hint));
          }
          else {
             vcode_reg_t bleft  = lower_reify_expr(rindex.left);
@@ -3810,7 +3900,7 @@ static void lower_check_indexes(type_t type, vcode_reg_t array, tree_t hint)
             vcode_reg_t bmax = bkind == BOUNDS_INDEX_TO ? bright : bleft;
 
             emit_dynamic_index_check(rlow_reg, rhigh_reg, bmin, bmax,
-                                     bkind, tree_index(hint));
+                                     bkind, lower_index(hint));
          }
       }
    }
@@ -3901,6 +3991,14 @@ static void lower_var_decl(tree_t decl)
    vcode_reg_t value = lower_expr(tree_value(decl), EXPR_RVALUE);
 
    if (type_is_array(type)) {
+      if (type_is_unconstrained(type)
+          && vcode_reg_kind(value) != VCODE_TYPE_UARRAY) {
+         // The initial value may have been folded to a constrained
+         // aggregate after the declaration was checked
+         value = lower_wrap(tree_type(tree_value(decl)),
+                            lower_array_data(value));
+      }
+
       lower_check_indexes(type, value, decl);
 
       if (type_is_unconstrained(type)) {
@@ -3925,6 +4023,153 @@ static void lower_var_decl(tree_t decl)
       emit_store(value, var);
 }
 
+static bool lower_image_value(tree_t decl, vcode_type_t ltype,
+                              vcode_reg_t init_reg)
+{
+   // Signals whose initial value is a compile-time constant are
+   // initialised from the image written at elaboration time rather
+   // than by the reset code
+
+   if (image_values == NULL)
+      return false;
+
+   vcode_type_t elem = ltype;
+   if (vtype_kind(ltype) == VCODE_TYPE_CARRAY)
+      elem = vtype_elem(ltype);
+
+   if (vtype_kind(elem) != VCODE_TYPE_INT)
+      return false;
+
+   const int nnets = tree_nets(decl);
+   int64_t *values LOCAL = xmalloc(nnets * sizeof(int64_t));
+   if (vcode_reg_const_data(init_reg, values, nnets) != nnets)
+      return false;
+
+   const int bits = bits_for_range(vtype_low(elem), vtype_high(elem));
+   const int size = (bits == 1) ? 1 : bits / 8;
+
+   image_value_t *iv = xmalloc(sizeof(image_value_t));
+   iv->size  = size;
+   iv->count = nnets;
+   iv->data  = xmalloc(size * nnets);
+
+   for (int i = 0; i < nnets; i++) {
+      switch (size) {
+      case 1: ((uint8_t *)iv->data)[i] = values[i]; break;
+      case 2: ((uint16_t *)iv->data)[i] = values[i]; break;
+      case 4: ((uint32_t *)iv->data)[i] = values[i]; break;
+      case 8: ((uint64_t *)iv->data)[i] = values[i]; break;
+      default:
+         fatal_trace("cannot handle size %d in image", size);
+      }
+   }
+
+   hash_put(image_values, decl, iv);
+   return true;
+}
+
+static void lower_write_image(tree_t top)
+{
+   const int ndecls = tree_decls(top);
+   image_entry_t *entries = xmalloc(MAX(ndecls, 1) * sizeof(image_entry_t));
+   image_value_t **ivs = xmalloc(MAX(ndecls, 1) * sizeof(image_value_t *));
+
+   unsigned nentries = 0;
+   size_t data_size = 0;
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         continue;
+
+      image_value_t *iv = hash_get(image_values, d);
+      if (iv == NULL)
+         continue;
+
+      image_entry_t *e = &(entries[nentries]);
+      e->decl   = i;
+      e->first  = tree_net(d, 0);
+      e->count  = iv->count;
+      e->size   = iv->size;
+      e->offset = data_size;
+
+      // Only signals with sequential nets are added to the image
+      for (unsigned j = 1; j < iv->count; j++)
+         assert(tree_net(d, j) == e->first + j);
+
+      ivs[nentries++] = iv;
+
+      // Keep every signal aligned for its largest scalar
+      data_size += ((iv->size * iv->count) + 7) & ~7;
+   }
+
+   char *name LOCAL = xasprintf("_%s.image", istr(tree_ident(top)));
+
+   if (nentries == 0) {
+      // Remove any image left by an earlier elaboration of this design
+      char path[PATH_MAX];
+      lib_realpath(lib_work(), name, path, sizeof(path));
+      if (unlink(path) != 0 && errno != ENOENT)
+         fatal_errno("unlink %s", path);
+
+      free(entries);
+      free(ivs);
+      return;
+   }
+
+   FILE *f = lib_fopen(lib_work(), name, "wb");
+   if (f == NULL)
+      fatal("failed to create initial value image %s", name);
+
+   // The values are stored twice for the resolved and last value
+   uint8_t *data = xcalloc(MAX(data_size * 2, 1));
+   for (unsigned i = 0; i < nentries; i++) {
+      const size_t nbytes = ivs[i]->size * ivs[i]->count;
+      memcpy(data + entries[i].offset, ivs[i]->data, nbytes);
+      memcpy(data + data_size + entries[i].offset, ivs[i]->data, nbytes);
+
+      free(ivs[i]->data);
+      free(ivs[i]);
+   }
+
+   const size_t entry_size = nentries * sizeof(image_entry_t);
+
+   image_header_t header = {
+      .magic        = IMAGE_MAGIC,
+      .version      = IMAGE_VERSION,
+      .nentries     = nentries,
+      .data_size    = data_size,
+      .entry_offset = NETDB_ALIGN,
+      .data_offset  = NETDB_ALIGN
+         + ((entry_size + NETDB_ALIGN - 1) / NETDB_ALIGN) * NETDB_ALIGN
+   };
+
+   const struct {
+      long        offset;
+      const void *data;
+      size_t      size;
+   } sections[] = {
+      { 0, &header, sizeof(header) },
+      { header.entry_offset, entries, entry_size },
+      { header.data_offset, data, data_size * 2 }
+   };
+
+   for (int i = 0; i < ARRAY_LEN(sections); i++) {
+      if (fseek(f, sections[i].offset, SEEK_SET) != 0)
+         fatal_errno("seek in %s", name);
+
+      if (sections[i].size > 0
+          && fwrite(sections[i].data, sections[i].size, 1, f) != 1)
+         fatal_errno("write to %s", name);
+   }
+
+   if (fclose(f) != 0)
+      fatal_errno("closing %s", name);
+
+   free(entries);
+   free(ivs);
+   free(data);
+}
+
 static void lower_signal_decl(tree_t decl)
 {
    const int nnets = tree_nets(decl);
@@ -3992,7 +4237,12 @@ static void lower_signal_decl(tree_t decl)
          rtype = lower_type(rbase);
       }
 
-      emit_set_initial(sig, init_reg, tree_index(decl), rfunc, rtype);
+      // The runtime returns early for signals loaded from the image but
+      // the call is still needed to attach any resolution function and
+      // to initialise the signal if the image is missing
+      if (can_use_shadow)
+         lower_image_value(decl, ltype, init_reg);
+      emit_set_initial(sig, init_reg, lower_index(decl), rfunc, rtype);
    }
 
    // Identify signals which potentially need 'LAST_VALUE
@@ -4078,7 +4328,7 @@ static void lower_finished(void)
 
 static void lower_cleanup(tree_t scope)
 {
-   if (tree_kind(scope) == T_FUNC_BODY) {
+   if (tree_kind(scope) == T_FUNC_BODY || eval_mode) {
       const int nports = tree_ports(scope);
       for (int i = 0; i < nports; i++)
          tree_remove_attr(tree_port(scope, i), vcode_obj_i);
@@ -4238,7 +4488,7 @@ static void lower_subprogram_ports(tree_t body, bool has_subprograms)
    }
 }
 
-static void lower_proc_body(tree_t body, vcode_unit_t context)
+static vcode_unit_t lower_proc_body(tree_t body, vcode_unit_t context)
 {
    const bool never_waits =
       tree_attr_int(body, wait_level_i, WAITS_MAYBE) == WAITS_NO;
@@ -4267,11 +4517,14 @@ static void lower_proc_body(tree_t body, vcode_unit_t context)
 
    lower_finished();
 
-   tree_set_code(body, vu);
+   if (!eval_mode)
+      tree_set_code(body, vu);
+
    lower_cleanup(body);
+   return vu;
 }
 
-static void lower_func_body(tree_t body, vcode_unit_t context)
+static vcode_unit_t lower_func_body(tree_t body, vcode_unit_t context)
 {
    vcode_select_unit(context);
 
@@ -4291,10 +4544,13 @@ static void lower_func_body(tree_t body, vcode_unit_t context)
 
    lower_finished();
 
-   assert(!tree_has_code(body));
-   tree_set_code(body, vu);
+   if (!eval_mode) {
+      assert(!tree_has_code(body));
+      tree_set_code(body, vu);
+   }
 
    lower_cleanup(body);
+   return vu;
 }
 
 static bool lower_driver_nets(tree_t t, tree_t *decl,
@@ -4522,8 +4778,15 @@ static void lower_elab(tree_t unit)
    vcode_unit_t context = emit_context(tree_ident(unit));
    tree_set_code(unit, context);
 
+   image_values = hash_new(128, true);
+
    lower_decls(unit, context);
 
+   lower_write_image(unit);
+
+   hash_free(image_values);
+   image_values = NULL;
+
    emit_return(VCODE_INVALID_REG);
 
    lower_finished();
@@ -4590,3 +4853,355 @@ void lower_unit(tree_t unit)
 
    vcode_close();
 }
+
+static bool lower_eval_folded(tree_t decl)
+{
+   if (!type_is_scalar(tree_type(decl)) || !tree_has_value(decl))
+      return false;
+
+   tree_t value = tree_value(decl);
+   switch (tree_kind(value)) {
+   case T_LITERAL:
+      return true;
+   case T_REF:
+      return tree_kind(tree_ref(value)) == T_ENUM_LIT;
+   default:
+      return false;
+   }
+}
+
+static void lower_eval_check_decl(tree_t t, void *context)
+{
+   eval_check_t *check = context;
+
+   switch (tree_kind(t)) {
+   case T_VAR_DECL:
+   case T_CONST_DECL:
+   case T_FILE_DECL:
+   case T_PORT_DECL:
+   case T_ALIAS:
+      hash_put(check->locals, t, t);
+      break;
+
+   case T_FUNC_BODY:
+   case T_PROC_BODY:
+      // Nested subprograms need access to the enclosing frame
+      if (t != check->body)
+         check->ok = false;
+      break;
+
+   case T_PROT_BODY:
+   case T_WAIT:
+      check->ok = false;
+      break;
+
+   case T_ATTR_REF:
+      {
+         const predef_attr_t predef = tree_attr_int(t, builtin_i, -1);
+         if (predef == -1 || predef == ATTR_PATH_NAME
+             || predef == ATTR_INSTANCE_NAME)
+            check->ok = false;
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+static void lower_eval_check_use(tree_t t, void *context);
+
+static void lower_eval_check_range(range_t r, eval_check_t *check)
+{
+   if (r.left != NULL)
+      tree_visit(r.left, lower_eval_check_use, check);
+   if (r.right != NULL)
+      tree_visit(r.right, lower_eval_check_use, check);
+}
+
+static void lower_eval_check_type(type_t type, eval_check_t *check)
+{
+   switch (type_kind(type)) {
+   case T_SUBTYPE:
+      {
+         const int ndims = type_dims(type);
+         for (int i = 0; i < ndims; i++)
+            lower_eval_check_range(type_dim(type, i), check);
+
+         lower_eval_check_type(type_base(type), check);
+      }
+      break;
+
+   case T_CARRAY:
+      {
+         const int ndims = type_dims(type);
+         for (int i = 0; i < ndims; i++)
+            lower_eval_check_range(type_dim(type, i), check);
+
+         lower_eval_check_type(type_elem(type), check);
+      }
+      break;
+
+   case T_UARRAY:
+      lower_eval_check_type(type_elem(type), check);
+      break;
+
+   case T_RECORD:
+      {
+         const int nfields = type_fields(type);
+         for (int i = 0; i < nfields; i++)
+            lower_eval_check_type(tree_type(type_field(type, i)), check);
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+static void lower_eval_check_use(tree_t t, void *context)
+{
+   eval_check_t *check = context;
+   if (!check->ok)
+      return;
+
+   switch (tree_kind(t)) {
+   case T_REF:
+      {
+         tree_t decl = tree_ref(t);
+         switch (tree_kind(decl)) {
+         case T_VAR_DECL:
+         case T_FILE_DECL:
+         case T_PORT_DECL:
+         case T_ALIAS:
+         case T_SIGNAL_DECL:
+            if (hash_get(check->locals, decl) == NULL)
+               check->ok = false;
+            break;
+
+         case T_CONST_DECL:
+            if (hash_get(check->locals, decl) == NULL
+                && !lower_eval_folded(decl))
+               check->ok = false;
+            break;
+
+         case T_ENUM_LIT:
+         case T_TYPE_DECL:
+         case T_FIELD_DECL:
+            break;
+
+         default:
+            check->ok = false;
+            break;
+         }
+      }
+      break;
+
+   case T_FCALL:
+   case T_PCALL:
+      {
+         // Arguments are checked against the parameter subtypes
+         tree_t decl = tree_ref(t);
+         const int nports = tree_ports(decl);
+         for (int i = 0; i < nports; i++)
+            lower_eval_check_type(tree_type(tree_port(decl, i)), check);
+      }
+      break;
+
+   case T_VAR_DECL:
+   case T_CONST_DECL:
+   case T_PORT_DECL:
+   case T_ALIAS:
+   case T_AGGREGATE:
+   case T_QUALIFIED:
+   case T_TYPE_CONV:
+   case T_NEW:
+      if (tree_has_type(t))
+         lower_eval_check_type(tree_type(t), check);
+      break;
+
+   default:
+      break;
+   }
+}
+
+static bool lower_eval_self_contained(tree_t t, tree_t body)
+{
+   // Code lowered for evaluation may only refer to objects declared
+   // within the subprogram itself or to folded constants
+
+   eval_check_t check = {
+      .body   = body,
+      .locals = hash_new(64, true),
+      .ok     = true
+   };
+
+   tree_visit(t, lower_eval_check_decl, &check);
+
+   if (check.ok)
+      tree_visit(t, lower_eval_check_use, &check);
+
+   hash_free(check.locals);
+   return check.ok;
+}
+
+static tree_t lower_eval_find_body(tree_t decl)
+{
+   const tree_kind_t kind = tree_kind(decl);
+   if (kind == T_FUNC_BODY || kind == T_PROC_BODY)
+      return decl;
+   else if (kind != T_FUNC_DECL && kind != T_PROC_DECL)
+      return NULL;
+
+   // Search for the body in the package containing the declaration
+
+   ident_t name = tree_ident(decl);
+   ident_t pack = ident_runtil(name, '.');
+   if (pack == name)
+      return NULL;
+
+   lib_t lib = lib_loaded(ident_until(name, '.'));
+   if (lib == NULL)
+      return NULL;
+
+   tree_t unit = lib_get(lib, ident_prefix(pack, ident_new("body"), '-'));
+   if (unit == NULL)
+      return NULL;
+
+   const tree_kind_t body_kind =
+      kind == T_FUNC_DECL ? T_FUNC_BODY : T_PROC_BODY;
+   type_t type = tree_type(decl);
+
+   const int ndecls = tree_decls(unit);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(unit, i);
+      if (tree_kind(d) == body_kind && tree_ident(d) == name
+          && type_eq(tree_type(d), type))
+         return d;
+   }
+
+   return NULL;
+}
+
+static void lower_eval_purge(void)
+{
+   // The tables used during evaluation are keyed on trees and types which
+   // may have been freed by a garbage collection since they were filled
+   // in: names already handed out stay unique as the counters are not
+   // reset
+
+   const unsigned epoch = tree_gc_epoch();
+   if (epoch == eval_epoch)
+      return;
+
+   if (eval_names != NULL) {
+      hash_free(eval_names);
+      hash_free(eval_decls);
+      eval_names = eval_decls = NULL;
+   }
+
+   if (eval_records != NULL) {
+      hash_free(eval_records);
+      eval_records = NULL;
+   }
+
+   eval_epoch = epoch;
+}
+
+static void lower_eval_begin(void)
+{
+   assert(!eval_mode);
+   eval_mode = true;
+
+   if (thunk_context == NULL)
+      thunk_context = emit_context(ident_new("thunk"));
+   else
+      vcode_select_unit(thunk_context);
+}
+
+static void lower_eval_end(void)
+{
+   vcode_close();
+
+   tmp_alloc_used = false;
+   eval_mode = false;
+}
+
+vcode_unit_t lower_thunk(tree_t expr)
+{
+   if (!lower_eval_self_contained(expr, NULL))
+      return NULL;
+
+   lower_eval_purge();
+   lower_eval_begin();
+
+   type_t type = tree_type(expr);
+
+   vcode_type_t vtype;
+   if (type_is_array(type) && lower_const_bounds(type))
+      vtype = vtype_pointer(lower_type(lower_elem_recur(type)));
+   else
+      vtype = lower_type(type);
+
+   vcode_unit_t vu = emit_function(ident_uniq("thunk"), thunk_context, vtype);
+
+   if (type_is_scalar(type))
+      emit_return(emit_cast(vtype, vtype, lower_reify_expr(expr)));
+   else if (vtype_kind(vtype) == VCODE_TYPE_UARRAY) {
+      vcode_reg_t array = lower_expr(expr, EXPR_RVALUE);
+
+      if (vtype_kind(vcode_reg_type(array)) == VCODE_TYPE_UARRAY)
+         emit_return(array);
+      else
+         emit_return(lower_wrap(type, lower_array_data(array)));
+   }
+   else if (vtype_kind(vtype) == VCODE_TYPE_POINTER)
+      emit_return(lower_array_data(lower_expr(expr, EXPR_RVALUE)));
+   else
+      emit_return(lower_expr(expr, EXPR_RVALUE));
+
+   lower_finished();
+   lower_eval_end();
+
+   return vu;
+}
+
+vcode_unit_t lower_func(ident_t name)
+{
+   lower_eval_purge();
+
+   tree_t decl = eval_decls ? hash_get(eval_decls, name) : NULL;
+   if (decl == NULL)
+      return NULL;
+
+   if (tree_attr_str(decl, builtin_i) != NULL
+       || tree_attr_tree(decl, foreign_i) != NULL)
+      return NULL;
+
+   tree_t body = lower_eval_find_body(decl);
+   if (body == NULL)
+      return NULL;
+
+   const bool is_proc = tree_kind(body) == T_PROC_BODY;
+   if (is_proc && tree_attr_int(body, wait_level_i, WAITS_MAYBE) != WAITS_NO)
+      return NULL;
+
+   if (!lower_eval_self_contained(body, body))
+      return NULL;
+
+   // Recursive calls through the body should find this unit
+   if (body != decl && hash_get(eval_names, body) == NULL)
+      hash_put(eval_names, body, (void *)name);
+
+   lower_eval_begin();
+
+   vcode_unit_t vu;
+   if (is_proc)
+      vu = lower_proc_body(body, thunk_context);
+   else
+      vu = lower_func_body(body, thunk_context);
+
+   lower_eval_end();
+
+   return vu;
+}
@@ -150,8 +150,10 @@ static int analyse(int argc, char **argv)
       input_from_file(argv[i]);
 
       tree_t unit;
-      while ((unit = parse()) && sem_check(unit))
+      while ((unit = parse()) && sem_check(unit)) {
          ARRAY_APPEND(units, unit, n_units, unit_list_sz);
+         tree_gc();
+      }
    }
 
    for (int i = 0; i < n_units; i++) {
@@ -222,6 +224,16 @@ static void parse_generic(const char *str)
    elab_set_generic(copy, split + 1);
 }
 
+static int parse_optimise(const char *str)
+{
+   char *eptr = NULL;
+   const long level = strtol(str, &eptr, 10);
+   if (*str == '\0' || *eptr != '\0' || level < 0 || level > 3)
+      fatal("invalid optimisation level '%s' (use -O0 to -O3)", str);
+
+   return level;
+}
+
 static void set_top_level(char **argv, int next_cmd)
 {
    if (optind == next_cmd) {
@@ -232,6 +244,12 @@ static void set_top_level(char **argv, int next_cmd)
       top_level = to_unit_name(argv[optind]);
 }
 
+static void forget_design_unit(ident_t name, int kind, void *context)
+{
+   if (kind == T_ENTITY || kind == T_ARCH)
+      lib_forget((lib_t)context, name);
+}
+
 static int elaborate(int argc, char **argv)
 {
    static struct option long_options[] = {
@@ -241,18 +259,23 @@ static int elaborate(int argc, char **argv)
       { "native",      no_argument,       0, 'n' },
       { "cover",       no_argument,       0, 'c' },
       { "verbose",     no_argument,       0, 'V' },
+      { "pgo-collect", no_argument,       0, 'p' },
+      { "pgo-use",     optional_argument, 0, 'u' },
       { 0, 0, 0, 0 }
    };
 
    const int next_cmd = scan_cmd(2, argc, argv);
    bool verbose = false;
    int c, index = 0;
-   const char *spec = "Vg:";
+   const char *spec = "Vg:O:";
    while ((c = getopt_long(next_cmd, argv, spec, long_options, &index)) != -1) {
       switch (c) {
       case 'o':
          opt_set_int("optimise", 0);
          break;
+      case 'O':
+         opt_set_int("optimise", parse_optimise(optarg));
+         break;
       case 'd':
          opt_set_int("dump-llvm", 1);
          break;
@@ -269,6 +292,12 @@ static int elaborate(int argc, char **argv)
          verbose = true;
          opt_set_int("verbose", 1);
          break;
+      case 'p':
+         opt_set_int("pgo-instrument", 1);
+         break;
+      case 'u':
+         opt_set_str("pgo-use", optarg ?: "");
+         break;
       case 'g':
          parse_generic(optarg);
          break;
@@ -299,6 +328,12 @@ static int elaborate(int argc, char **argv)
 
    elab_verbose(verbose, "elaborating design");
 
+   // The elaborated design does not need the library units it was built
+   // from so these and the copies made during elaboration can be released
+   lib_walk_index(lib_work(), forget_design_unit, lib_work());
+   tree_gc_full();
+   elab_verbose(verbose, "collecting garbage");
+
    opt(e);
    elab_verbose(verbose, "optimising design");
 
@@ -428,6 +463,7 @@ static int run(int argc, char **argv)
       { "include",       required_argument, 0, 'i' },
       { "exclude",       required_argument, 0, 'e' },
       { "exit-severity", required_argument, 0, 'x' },
+      { "pgo-collect",   optional_argument, 0, 'p' },
 #if ENABLE_VHPI
       { "load",          required_argument, 0, 'l' },
       { "vhpi-trace",    no_argument,       0, 'T' },
@@ -508,6 +544,9 @@ static int run(int argc, char **argv)
       case 'x':
          rt_set_exit_severity(parse_severity(optarg));
          break;
+      case 'p':
+         opt_set_str("pgo-collect", optarg ?: "");
+         break;
       default:
          abort();
       }
@@ -723,7 +762,7 @@ static void set_default_opts(void)
    opt_set_int("rt_trace_en", 0);
    opt_set_int("vhpi_trace_en", 0);
    opt_set_int("dump-llvm", 0);
-   opt_set_int("optimise", 1);
+   opt_set_int("optimise", 2);
    opt_set_int("native", 0);
    opt_set_int("bootstrap", 0);
    opt_set_int("cover", 0);
@@ -736,7 +775,12 @@ static void set_default_opts(void)
    opt_set_int("relax", 0);
    opt_set_int("ignore-time", 0);
    opt_set_int("force-init", 0);
+   opt_set_int("uncompressed", 0);
+   opt_set_int("gc-stats", 0);
    opt_set_int("verbose", 0);
+   opt_set_int("pgo-instrument", 0);
+   opt_set_str("pgo-collect", NULL);
+   opt_set_str("pgo-use", NULL);
 }
 
 static void usage(void)
@@ -754,12 +798,14 @@ static void usage(void)
           "\n"
           "Global options may be placed before COMMAND:\n"
           "     --force-init\tCreate a library in an existing directory\n"
+          "     --gc-stats\t\tPrint garbage collector statistics at exit\n"
           " -h, --help\t\tDisplay this message and exit\n"
           "     --ignore-time\tSkip source file timestamp check\n"
           " -L PATH\t\tAdd PATH to library search paths\n"
           "     --map=LIB:PATH\tMap library LIB to PATH\n"
           "     --messages=STYLE\tSelect full or compact message format\n"
           "     --std=REV\t\tVHDL standard revision to use\n"
+          "     --uncompressed\tWrite library files without compression\n"
           " -v, --version\t\tDisplay version and copyright information\n"
           "     --work=NAME\tUse NAME as the work library\n"
           "\n"
@@ -769,11 +815,14 @@ static void usage(void)
           "\n"
           "Elaborate options:\n"
           "     --cover\t\tEnable code coverage reporting\n"
-          "     --disable-opt\tDisable LLVM optimisations\n"
+          "     --disable-opt\tDisable LLVM optimisations (same as -O0)\n"
           "     --dump-llvm\tPrint generated LLVM IR\n"
           "     --dump-vcode\tPrint generated intermediate code\n"
           " -g NAME=VALUE\t\tSet top level generic NAME to VALUE\n"
           "     --native\t\tGenerate native code shared library\n"
+          " -O LEVEL\t\tSet LLVM optimisation level 0 to 3 (default 2)\n"
+          "     --pgo-collect\tInstrument code to collect a profile\n"
+          "     --pgo-use[=FILE]\tOptimise using profile from FILE\n"
           " -V, --verbose\t\tPrint resource usage at each step\n"
           "\n"
           "Run options:\n"
@@ -783,6 +832,7 @@ static void usage(void)
           "     --exit-severity=S\tExit after assertion failure of severity S\n"
           "     --format=FMT\tWaveform format is one of lxt, fst, or vcd\n"
           "     --include=GLOB\tInclude signals matching GLOB in wave dump\n"
+          "     --pgo-collect[=FILE]\tWrite execution profile to FILE\n"
 #ifdef ENABLE_VHPI
           "     --load=PLUGIN\tLoad VHPI plugin at startup\n"
 #endif
@@ -941,6 +991,8 @@ int main(int argc, char **argv)
       { "map",         required_argument, 0, 'p' },
       { "ignore-time", no_argument,       0, 'i' },
       { "force-init",  no_argument,       0, 'f' },
+      { "uncompressed", no_argument,      0, 'U' },
+      { "gc-stats",    no_argument,       0, 'G' },
       { 0, 0, 0, 0 }
    };
 
@@ -985,6 +1037,12 @@ int main(int argc, char **argv)
       case 'f':
          opt_set_int("force-init", 1);
          break;
+      case 'U':
+         opt_set_int("uncompressed", 1);
+         break;
+      case 'G':
+         opt_set_int("gc-stats", 1);
+         break;
       case '?':
          fatal("unrecognised global option %s", argv[optind - 1]);
       default:
@@ -992,6 +1050,12 @@ int main(int argc, char **argv)
       }
    }
 
+   if (opt_get_int("gc-stats")) {
+      // Handlers run in reverse order so collect before printing
+      atexit(tree_gc_stats);
+      atexit(tree_gc);
+   }
+
    work = lib_new(work_name, work_path);
    lib_set_work(work);
 
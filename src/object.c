@@ -17,12 +17,15 @@
 
 #include "object.h"
 #include "common.h"
+#include "fbuf.h"
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
 
 DEFINE_ARRAY(tree);
-DEFINE_ARRAY(netid);
 DEFINE_ARRAY(type);
 DEFINE_ARRAY(range);
 DEFINE_ARRAY(ident);
@@ -40,12 +43,96 @@ static const char *item_text_map[] = {
    "I_ATTRS",    "I_PTYPES",    "I_CHARS",    "I_CODE"
 };
 
+#define LAZY_CHUNK 4096
+
+// Objects are allocated by bumping a pointer through large chunks owned
+// by an arena. Chunks are aligned to their size so the owning arena can
+// be found from any object address. An arena is released in one go once
+// the garbage collector finds none of its objects are live.
+#define CHUNK_SIZE  (1 << 16)
+#define CHUNK_ALIGN 8
+
+typedef struct chunk chunk_t;
+
+struct chunk {
+   arena_t *arena;
+   chunk_t *next;
+   size_t   used;
+   char     data[0] __attribute__((aligned(CHUNK_ALIGN)));
+};
+
+struct arena {
+   arena_t  *next;
+   chunk_t  *chunks;
+   unsigned  live;
+};
+
+#define ATTR_PAGE_BITS 8
+#define ATTR_PAGE_SIZE (1 << ATTR_PAGE_BITS)
+
+// Each key has a table of pages indexed by attribute slot which are only
+// allocated when an object in that range of slots has the attribute
+typedef struct {
+   uint64_t     present[ATTR_PAGE_SIZE / 64];
+   attr_value_t values[ATTR_PAGE_SIZE];
+} attr_page_t;
+
+typedef struct {
+   ident_t       name;
+   attr_kind_t   kind;
+   unsigned      npages;
+   attr_page_t **pages;
+} attr_key_t;
+
+typedef struct {
+   unsigned next;
+   unsigned left;
+} attr_iter_t;
+
+struct lazy {
+   lazy_t          *next;
+   object_rd_ctx_t *root;
+   tree_array_t    *array;
+   index_t          first;
+   unsigned         nobjects;
+   unsigned         count;
+   uint8_t         *data;
+   size_t           len;
+};
+
 static object_class_t *classes[4];
 static uint32_t        format_digest;
 static generation_t    next_generation = 1;
 static object_t      **all_objects = NULL;
 static size_t          max_objects = 256;   // Grows at runtime
 static size_t          n_objects_alloc = 0;
+static arena_t        *arenas = NULL;
+static arena_t        *current_arena = NULL;
+static size_t          n_objects_old = 0;
+static object_t      **remembered = NULL;
+static size_t          n_remembered = 0;
+static size_t          max_remembered = 64;
+static attr_key_t    **attr_keys = NULL;
+static unsigned        n_attr_keys = 0;
+static attr_key_t    **attr_key_hash = NULL;
+static size_t          attr_key_hash_size = 0;
+static uint16_t       *attr_slot_count = NULL;
+static attr_slot_t     n_attr_slots = 1;   // Slot zero is not used
+static attr_slot_t     max_attr_slots = 0;
+static attr_slot_t    *attr_free_slots = NULL;
+static size_t          n_attr_free = 0;
+static size_t          max_attr_free = 64;
+static size_t          old_at_full = 0;
+
+static struct {
+   unsigned minor;
+   unsigned full;
+   uint64_t allocated;
+   uint64_t freed;
+   uint64_t scanned;
+   uint64_t remembered;
+   uint64_t usecs;
+} gc_stats;
 
 void object_lookup_failed(const char *name, const char **kind_text_map,
                           int kind, imask_t mask)
@@ -77,11 +164,354 @@ uint32_t object_index(const object_t *object)
    return object->index;
 }
 
+static size_t object_attr_hash(ident_t name, attr_kind_t kind)
+{
+   return (((uintptr_t)name >> 4) ^ kind) * UINT32_C(2654435761);
+}
+
+static void object_attr_hash_insert(attr_key_t *key)
+{
+   const size_t mask = attr_key_hash_size - 1;
+   size_t slot = object_attr_hash(key->name, key->kind) & mask;
+   while (attr_key_hash[slot] != NULL)
+      slot = (slot + 1) & mask;
+
+   attr_key_hash[slot] = key;
+}
+
+static attr_key_t *object_attr_key(ident_t name, attr_kind_t kind,
+                                   bool create)
+{
+   if (attr_key_hash != NULL) {
+      const size_t mask = attr_key_hash_size - 1;
+      size_t slot = object_attr_hash(name, kind) & mask;
+      for (; attr_key_hash[slot] != NULL; slot = (slot + 1) & mask) {
+         attr_key_t *key = attr_key_hash[slot];
+         if (key->name == name && key->kind == kind)
+            return key;
+      }
+   }
+
+   if (!create)
+      return NULL;
+
+   if ((n_attr_keys + 1) * 2 > attr_key_hash_size) {
+      attr_key_hash_size = MAX(attr_key_hash_size * 2, 64);
+      attr_key_hash = xrealloc(attr_key_hash,
+                               attr_key_hash_size * sizeof(attr_key_t *));
+      memset(attr_key_hash, '\0', attr_key_hash_size * sizeof(attr_key_t *));
+
+      for (unsigned i = 0; i < n_attr_keys; i++)
+         object_attr_hash_insert(attr_keys[i]);
+
+      attr_keys = xrealloc(attr_keys,
+                           (attr_key_hash_size / 2) * sizeof(attr_key_t *));
+   }
+
+   attr_key_t *key = xcalloc(sizeof(attr_key_t));
+   key->name = name;
+   key->kind = kind;
+
+   attr_keys[n_attr_keys++] = key;
+   object_attr_hash_insert(key);
+
+   return key;
+}
+
+static attr_value_t *object_attr_lookup(attr_key_t *key, attr_slot_t slot)
+{
+   const unsigned page = slot >> ATTR_PAGE_BITS;
+   if (page >= key->npages || key->pages[page] == NULL)
+      return NULL;
+
+   attr_page_t *p = key->pages[page];
+   const unsigned off = slot & (ATTR_PAGE_SIZE - 1);
+   if (p->present[off / 64] & (UINT64_C(1) << (off % 64)))
+      return &(p->values[off]);
+   else
+      return NULL;
+}
+
+static void object_attr_clear(attr_key_t *key, attr_slot_t slot)
+{
+   attr_page_t *p = key->pages[slot >> ATTR_PAGE_BITS];
+   const unsigned off = slot & (ATTR_PAGE_SIZE - 1);
+   p->present[off / 64] &= ~(UINT64_C(1) << (off % 64));
+
+   attr_slot_count[slot]--;
+}
+
+static attr_iter_t object_attr_iter(attr_slot_t slot)
+{
+   const attr_iter_t it = {
+      .next = 0,
+      .left = slot == 0 ? 0 : attr_slot_count[slot]
+   };
+   return it;
+}
+
+static attr_key_t *object_attr_next(attr_slot_t slot, attr_iter_t *it,
+                                    attr_value_t **value)
+{
+   // Visits every key in order of registration but stops as soon as all
+   // the attributes of this slot have been found
+   while (it->left > 0) {
+      attr_key_t *key = attr_keys[it->next++];
+      if ((*value = object_attr_lookup(key, slot)) != NULL) {
+         it->left--;
+         return key;
+      }
+   }
+
+   return NULL;
+}
+
+static void object_attr_release(attr_slot_t slot)
+{
+   if (slot == 0)
+      return;
+
+   attr_value_t *value;
+   attr_iter_t it = object_attr_iter(slot);
+   attr_key_t *key;
+   while ((key = object_attr_next(slot, &it, &value)))
+      object_attr_clear(key, slot);
+
+   assert(attr_slot_count[slot] == 0);
+
+   if (unlikely(attr_free_slots == NULL))
+      attr_free_slots = xmalloc(sizeof(attr_slot_t) * max_attr_free);
+
+   ARRAY_APPEND(attr_free_slots, slot, n_attr_free, max_attr_free);
+}
+
+attr_value_t *object_attr_find(attr_slot_t slot, ident_t name,
+                               attr_kind_t kind)
+{
+   if (slot == 0)
+      return NULL;
+
+   attr_key_t *key = object_attr_key(name, kind, false);
+   if (key == NULL)
+      return NULL;
+
+   return object_attr_lookup(key, slot);
+}
+
+attr_value_t *object_attr_add(attr_slot_t *slot, ident_t name,
+                              attr_kind_t kind)
+{
+   if (*slot == 0) {
+      if (n_attr_free > 0)
+         *slot = attr_free_slots[--n_attr_free];
+      else {
+         if (n_attr_slots >= max_attr_slots) {
+            max_attr_slots = MAX(max_attr_slots * 2, 1024);
+            attr_slot_count = xrealloc(attr_slot_count,
+                                       max_attr_slots * sizeof(uint16_t));
+         }
+
+         *slot = n_attr_slots++;
+      }
+
+      attr_slot_count[*slot] = 0;
+   }
+
+   attr_key_t *key = object_attr_key(name, kind, true);
+
+   const unsigned page = *slot >> ATTR_PAGE_BITS;
+   if (page >= key->npages) {
+      const unsigned npages = MAX(next_power_of_2(page + 1), 16);
+      key->pages = xrealloc(key->pages, npages * sizeof(attr_page_t *));
+      memset(key->pages + key->npages, '\0',
+             (npages - key->npages) * sizeof(attr_page_t *));
+      key->npages = npages;
+   }
+
+   if (key->pages[page] == NULL)
+      key->pages[page] = xcalloc(sizeof(attr_page_t));
+
+   attr_page_t *p = key->pages[page];
+   const unsigned off = *slot & (ATTR_PAGE_SIZE - 1);
+   const uint64_t bit = UINT64_C(1) << (off % 64);
+   if (!(p->present[off / 64] & bit)) {
+      p->present[off / 64] |= bit;
+      p->values[off].pval = NULL;
+      attr_slot_count[*slot]++;
+   }
+
+   return &(p->values[off]);
+}
+
+void object_attr_remove(attr_slot_t slot, ident_t name)
+{
+   if (slot == 0)
+      return;
+
+   const attr_kind_t kinds[] = { A_STRING, A_INT, A_PTR, A_TREE };
+   for (size_t i = 0; i < ARRAY_LEN(kinds); i++) {
+      attr_key_t *key = object_attr_key(name, kinds[i], false);
+      if (key != NULL && object_attr_lookup(key, slot) != NULL)
+         object_attr_clear(key, slot);
+   }
+}
+
+void netid_runs_reserve(netid_runs_t *r, unsigned nruns)
+{
+   // Storage is allocated in the same power-of-two steps as the
+   // generic arrays so the capacity is implied by the number of runs
+
+   assert(r->nruns == 0 && r->runs == NULL);
+
+   if (nruns > 0) {
+      const int sz = (nruns <= ARRAY_BASE_SZ)
+         ? ARRAY_BASE_SZ : next_power_of_2(nruns);
+      r->runs = xmalloc(sizeof(netid_run_t) * sz);
+   }
+}
+
+static netid_run_t *netid_runs_insert(netid_runs_t *r, unsigned pos)
+{
+   assert(pos <= r->nruns);
+
+   if (unlikely(r->nruns == 0))
+      netid_runs_reserve(r, 1);
+   else if (((r->nruns & (r->nruns - 1)) == 0)
+            && (r->nruns >= ARRAY_BASE_SZ)) {
+      const int sz = next_power_of_2(r->nruns + 1);
+      r->runs = xrealloc(r->runs, sizeof(netid_run_t) * sz);
+   }
+
+   memmove(&(r->runs[pos + 1]), &(r->runs[pos]),
+           (r->nruns - pos) * sizeof(netid_run_t));
+   r->nruns++;
+
+   return &(r->runs[pos]);
+}
+
+static unsigned netid_runs_end(const netid_runs_t *r, unsigned i)
+{
+   return (i + 1 < r->nruns) ? r->runs[i + 1].offset : r->count;
+}
+
+static bool netid_runs_contiguous(const netid_runs_t *r, unsigned i)
+{
+   // True if run i+1 continues run i and the two can be merged
+   const netid_run_t *a = &(r->runs[i]);
+   const netid_run_t *b = &(r->runs[i + 1]);
+
+   if (a->first == NETID_INVALID || b->first == NETID_INVALID)
+      return a->first == b->first;
+   else
+      return a->first + (b->offset - a->offset) == b->first;
+}
+
+static unsigned netid_runs_find(const netid_runs_t *r, unsigned n)
+{
+   // Index of the run containing offset n
+   unsigned low = 0, high = r->nruns - 1;
+   while (low < high) {
+      const unsigned mid = (low + high + 1) / 2;
+      if (r->runs[mid].offset <= n)
+         low = mid;
+      else
+         high = mid - 1;
+   }
+
+   return low;
+}
+
+void netid_runs_add(netid_runs_t *r, netid_t first, unsigned count)
+{
+   if (count == 0)
+      return;
+
+   if (r->nruns > 0) {
+      const netid_run_t *last = &(r->runs[r->nruns - 1]);
+      const bool extends = (last->first == NETID_INVALID)
+         ? first == NETID_INVALID
+         : (first != NETID_INVALID
+            && last->first + (r->count - last->offset) == first);
+      if (extends) {
+         r->count += count;
+         return;
+      }
+   }
+
+   netid_run_t *run = netid_runs_insert(r, r->nruns);
+   run->offset = r->count;
+   run->first  = first;
+
+   r->count += count;
+}
+
+void netid_runs_set(netid_runs_t *r, unsigned n, netid_t nid)
+{
+   if (n >= r->count) {
+      netid_runs_add(r, NETID_INVALID, n - r->count);
+      netid_runs_add(r, nid, 1);
+      return;
+   }
+
+   unsigned i = netid_runs_find(r, n);
+   const netid_run_t old = r->runs[i];
+   const unsigned end = netid_runs_end(r, i);
+
+   const netid_t prev = (old.first == NETID_INVALID)
+      ? NETID_INVALID : old.first + (n - old.offset);
+   if (prev == nid)
+      return;
+
+   // Split the run into at most three pieces around offset n
+   if (n > old.offset)
+      netid_runs_insert(r, ++i);
+   r->runs[i].offset = n;
+   r->runs[i].first  = nid;
+
+   if (n + 1 < end) {
+      netid_run_t *tail = netid_runs_insert(r, i + 1);
+      tail->offset = n + 1;
+      tail->first  = (old.first == NETID_INVALID)
+         ? NETID_INVALID : old.first + (n + 1 - old.offset);
+   }
+
+   // Merge the new run with its neighbours where possible
+   if (i + 1 < r->nruns && netid_runs_contiguous(r, i)) {
+      memmove(&(r->runs[i + 1]), &(r->runs[i + 2]),
+              (r->nruns - i - 2) * sizeof(netid_run_t));
+      r->nruns--;
+   }
+
+   if (i > 0 && netid_runs_contiguous(r, i - 1)) {
+      memmove(&(r->runs[i]), &(r->runs[i + 1]),
+              (r->nruns - i - 1) * sizeof(netid_run_t));
+      r->nruns--;
+   }
+}
+
+netid_t netid_runs_nth(const netid_runs_t *r, unsigned n, unsigned *avail)
+{
+   assert(n < r->count);
+
+   const unsigned i = (r->nruns == 1) ? 0 : netid_runs_find(r, n);
+   const netid_run_t *run = &(r->runs[i]);
+
+   if (avail != NULL)
+      *avail = netid_runs_end(r, i) - n;
+
+   if (run->first == NETID_INVALID)
+      return NETID_INVALID;
+   else
+      return run->first + (n - run->offset);
+}
+
 void object_change_kind(const object_class_t *class, object_t *object, int kind)
 {
    if (kind == object->kind)
       return;
 
+   object_write_barrier(object);
+
    bool allow = false;
    for (size_t i = 0; (class->change_allowed[i][0] != -1) && !allow; i++) {
       allow = (class->change_allowed[i][0] == object->kind)
@@ -108,8 +538,11 @@ void object_change_kind(const object_class_t *class, object_t *object, int kind)
    for (imask_t mask = 1; np < new_nitems; mask <<= 1) {
       if ((old_has & mask) && (new_has & mask))
          object->items[np++] = tmp[op++];
-      else if (old_has & mask)
+      else if (old_has & mask) {
+         if (ITEM_ATTRS & mask)
+            object_attr_release(tmp[op].attr_slot);
          ++op;
+      }
       else if (new_has & mask)
          memset(&(object->items[np++]), '\0', sizeof(item_t));
    }
@@ -148,6 +581,14 @@ static void object_init(object_class_t *class)
       }
    }
 
+   if (class->lazy_items != NULL) {
+      for (const lazy_item_t *l = class->lazy_items; l->kind != -1; l++) {
+         format_digest += (uint32_t)(l->kind + 1) * UINT32_C(2654435761);
+         format_digest += (uint32_t)l->items * UINT32_C(2654435761);
+         format_digest += l->min_count * UINT32_C(2654435761);
+      }
+   }
+
    bool changed = false;
    do {
       changed = false;
@@ -186,7 +627,7 @@ void object_one_time_init(void)
 
       // Increment this each time a incompatible change is made to the
       // on-disk format not expressed in the tree and type items table
-      const uint32_t format_fudge = 7;
+      const uint32_t format_fudge = 8;
 
       format_digest += format_fudge * UINT32_C(2654435761);
 
@@ -194,6 +635,100 @@ void object_one_time_init(void)
    }
 }
 
+arena_t *object_arena_new(void)
+{
+   arena_t *a = xcalloc(sizeof(arena_t));
+   a->next = arenas;
+   arenas = a;
+   return a;
+}
+
+arena_t *object_arena_set(arena_t *a)
+{
+   arena_t *old = current_arena;
+   current_arena = a;
+   return old;
+}
+
+static void *object_arena_alloc(size_t size)
+{
+   if (unlikely(current_arena == NULL))
+      current_arena = object_arena_new();
+
+   arena_t *a = current_arena;
+   chunk_t *c = a->chunks;
+
+   size = (size + CHUNK_ALIGN - 1) & ~(CHUNK_ALIGN - 1);
+   assert(size <= CHUNK_SIZE - sizeof(chunk_t));
+
+   if (c == NULL || c->used + size > CHUNK_SIZE - sizeof(chunk_t)) {
+      void *mem;
+      if (posix_memalign(&mem, CHUNK_SIZE, CHUNK_SIZE) != 0)
+         fatal("memory exhausted (posix_memalign %d)", CHUNK_SIZE);
+
+      c = mem;
+      c->arena  = a;
+      c->next   = a->chunks;
+      c->used   = 0;
+      a->chunks = c;
+   }
+
+   void *p = c->data + c->used;
+   c->used += size;
+   a->live++;
+
+   memset(p, '\0', size);
+   return p;
+}
+
+static arena_t *object_arena(object_t *object)
+{
+   return ((chunk_t *)((uintptr_t)object & ~(uintptr_t)(CHUNK_SIZE - 1)))->arena;
+}
+
+static unsigned object_arena_release(void)
+{
+   unsigned nreleased = 0;
+   for (arena_t **it = &arenas; *it != NULL;) {
+      arena_t *a = *it;
+      if (a->live == 0 && a->chunks != NULL) {
+         for (chunk_t *c = a->chunks, *tmp; c != NULL; c = tmp) {
+            tmp = c->next;
+            free(c);
+         }
+         a->chunks = NULL;
+         nreleased++;
+
+         if (a != current_arena) {
+            *it = a->next;
+            free(a);
+            continue;
+         }
+      }
+
+      it = &(a->next);
+   }
+
+   return nreleased;
+}
+
+unsigned object_arena_count(void)
+{
+   unsigned count = 0;
+   for (arena_t *a = arenas; a != NULL; a = a->next) {
+      if (a->chunks != NULL)
+         count++;
+   }
+
+   return count;
+}
+
+size_t object_live_count(void)
+{
+   // Includes objects allocated since the last collection
+   return n_objects_alloc;
+}
+
 object_t *object_new(const object_class_t *class, int kind)
 {
    if (unlikely(kind >= class->last_kind))
@@ -201,12 +736,14 @@ object_t *object_new(const object_class_t *class, int kind)
 
    object_one_time_init();
 
-   object_t *object = xcalloc(class->object_size[kind]);
+   object_t *object = object_arena_alloc(class->object_size[kind]);
 
    object->kind  = kind;
    object->tag   = class->tag;
    object->index = UINT32_MAX;
 
+   gc_stats.allocated++;
+
    if (unlikely(all_objects == NULL))
       all_objects = xmalloc(sizeof(object_t *) * max_objects);
 
@@ -224,14 +761,22 @@ static void object_sweep(object_t *object)
    imask_t mask = 1;
    for (int n = 0; n < nitems; mask <<= 1) {
       if (has & mask) {
-         if (ITEM_TREE_ARRAY & mask)
-            free(object->items[n].tree_array.items);
-         else if (ITEM_NETID_ARRAY & mask)
-            free(object->items[n].netid_array.items);
+         if (ITEM_TREE_ARRAY & mask) {
+            tree_array_t *a = &(object->items[n].tree_array);
+            if (a->count == LAZY_COUNT) {
+               // Other lazy arrays may still refer to objects in this one
+               // so keep the data until the whole unit is released
+               ((lazy_t *)a->items)->array = NULL;
+            }
+            else
+               free(a->items);
+         }
+         else if (ITEM_NETID_RUNS & mask)
+            free(object->items[n].netid_runs.runs);
          else if (ITEM_RANGE & mask)
             free(object->items[n].range);
          else if (ITEM_ATTRS & mask)
-            free(object->items[n].attrs.table);
+            object_attr_release(object->items[n].attr_slot);
          else if (ITEM_RANGE_ARRAY & mask)
             free(object->items[n].range_array.items);
          else if (ITEM_TEXT_BUF & mask) {
@@ -242,61 +787,154 @@ static void object_sweep(object_t *object)
       }
    }
 
-   free(object);
+   // The memory for the object itself is reclaimed with its arena
+   object_arena(object)->live--;
 }
 
-void object_gc(void)
+void object_unroot(object_t *object)
 {
-   // Generation will be updated by tree_visit
-   const generation_t base_gen = next_generation;
+   // The object and anything only reachable through it can be released
+   // by the next full collection
+   object->unrooted = 1;
+}
 
-   // Mark
-   for (unsigned i = 0; i < n_objects_alloc; i++) {
-      assert(all_objects[i] != NULL);
+void object_pin(object_t *object)
+{
+   object->pinned = 1;
+}
 
-      const object_class_t *class = classes[all_objects[i]->tag];
+void object_remember(object_t *object)
+{
+   if (unlikely(remembered == NULL))
+      remembered = xmalloc(sizeof(object_t *) * max_remembered);
 
-      bool top_level = false;
-      for (int j = 0; (j < class->gc_num_roots) && !top_level; j++) {
-         if (class->gc_roots[j] == all_objects[i]->kind)
-            top_level = true;
-      }
+   object->remembered = 1;
+   ARRAY_APPEND(remembered, object, n_remembered, max_remembered);
+}
 
-      if (top_level) {
-         object_visit_ctx_t ctx = {
-            .count      = 0,
-            .postorder  = NULL,
-            .preorder   = NULL,
-            .context    = NULL,
-            .kind       = T_LAST_TREE_KIND,
-            .generation = next_generation++,
-            .deep       = true
-         };
+static bool object_is_root(object_t *object)
+{
+   if (object->pinned)
+      return true;
+   else if (object->unrooted)
+      return false;
+
+   const object_class_t *class = classes[object->tag];
+
+   for (int j = 0; j < class->gc_num_roots; j++) {
+      if (class->gc_roots[j] == object->kind)
+         return true;
+   }
 
+   return false;
+}
+
+static uint64_t object_gc_usecs(void)
+{
+   struct timespec ts;
+   if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+      fatal_errno("clock_gettime");
+
+   return (ts.tv_sec * UINT64_C(1000000)) + (ts.tv_nsec / 1000);
+}
+
+void object_gc(bool full)
+{
+   // A minor collection only considers objects allocated since the last
+   // collection: old objects are assumed to be live and any old object
+   // modified since then is scanned for references to young objects.
+   // Collect everything once the old generation has doubled in size.
+
+   if (!full && n_objects_old > 2 * old_at_full + 1024)
+      full = true;
+
+   const uint64_t start = object_gc_usecs();
+
+   object_visit_ctx_t ctx = {
+      .count      = 0,
+      .postorder  = NULL,
+      .preorder   = NULL,
+      .context    = NULL,
+      .kind       = T_LAST_TREE_KIND,
+      .generation = next_generation++,
+      .deep       = true,
+      .skip_lazy  = true,
+      .young_only = !full
+   };
+
+   // Mark
+   const size_t first = full ? 0 : n_objects_old;
+   for (size_t i = first; i < n_objects_alloc; i++) {
+      assert(all_objects[i] != NULL);
+
+      if (object_is_root(all_objects[i]))
          object_visit(all_objects[i], &ctx);
+   }
+
+   for (size_t i = 0; i < n_remembered; i++) {
+      object_t *object = remembered[i];
+      object->remembered = 0;
+
+      if (!full) {
+         // Scan the fields of the old object but not the object itself
+         object->old = 0;
+         object_visit(object, &ctx);
+         object->old = 1;
       }
    }
 
+   const size_t n_remembered_now = n_remembered;
+   n_remembered = 0;
+
    // Sweep
-   for (unsigned i = 0; i < n_objects_alloc; i++) {
+   for (size_t i = first; i < n_objects_alloc; i++) {
       object_t *object = all_objects[i];
-      if (object->generation < base_gen) {
+      if (object->generation != ctx.generation && (full || !object->old)) {
          object_sweep(object);
          all_objects[i] = NULL;
       }
+      else
+         object->old = 1;
    }
 
    // Compact
-   size_t p = 0;
-   for (unsigned i = 0; i < n_objects_alloc; i++) {
+   size_t p = first;
+   for (size_t i = first; i < n_objects_alloc; i++) {
       if (all_objects[i] != NULL)
          all_objects[p++] = all_objects[i];
    }
 
+   const unsigned nreleased = object_arena_release();
+
+   const size_t nfreed = n_objects_alloc - p;
+   const uint64_t usecs = object_gc_usecs() - start;
+
+   if (full) {
+      gc_stats.full++;
+      old_at_full = p;
+   }
+   else
+      gc_stats.minor++;
+
+   gc_stats.freed      += nfreed;
+   gc_stats.scanned    += ctx.count;
+   gc_stats.remembered += n_remembered_now;
+   gc_stats.usecs      += usecs;
+
    if ((getenv("NVC_GC_VERBOSE") != NULL) || is_debugger_running())
-      notef("GC: freed %zu objects; %zu allocated", n_objects_alloc - p, p);
+      notef("GC: %s collection freed %zu objects; %zu allocated; released "
+            "%u arenas", full ? "full" : "minor", nfreed, p, nreleased);
+
+   n_objects_alloc = n_objects_old = p;
+}
 
-   n_objects_alloc = p;
+void object_gc_stats(void)
+{
+   notef("GC: %u minor %u full collections; allocated:%"PRIu64
+         " freed:%"PRIu64" live:%zu scanned:%"PRIu64" remembered:%"PRIu64
+         " time:%"PRIu64"ms", gc_stats.minor, gc_stats.full,
+         gc_stats.allocated, gc_stats.freed, n_objects_alloc,
+         gc_stats.scanned, gc_stats.remembered, gc_stats.usecs / 1000);
 }
 
 void object_visit(object_t *object, object_visit_ctx_t *ctx)
@@ -307,6 +945,8 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
 
    if ((object == NULL) || (object->generation == ctx->generation))
       return;
+   else if (ctx->young_only && object->old)
+      return;
 
    object->generation = ctx->generation;
 
@@ -332,8 +972,13 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
             object_visit((object_t *)object->items[i].tree, ctx);
          else if (ITEM_TREE_ARRAY & mask) {
             tree_array_t *a = &(object->items[i].tree_array);
-            for (unsigned j = 0; j < a->count; j++)
-               object_visit((object_t *)a->items[j], ctx);
+            if (a->count == LAZY_COUNT && ctx->skip_lazy)
+               ;   // Everything it references was loaded with it
+            else {
+               object_array(a);
+               for (unsigned j = 0; j < a->count; j++)
+                  object_visit((object_t *)a->items[j], ctx);
+            }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             type_array_t *a = &(object->items[i].type_array);
@@ -359,21 +1004,18 @@ void object_visit(object_t *object, object_visit_ctx_t *ctx)
                object_visit((object_t *)a->items[j].right, ctx);
             }
          }
-         else if (ITEM_NETID_ARRAY & mask)
+         else if (ITEM_NETID_RUNS & mask)
             ;
          else if (ITEM_TEXT_BUF & mask)
             ;
          else if (ITEM_ATTRS & mask) {
-            attr_tab_t *attrs = &(object->items[i].attrs);
-            for (unsigned j = 0; j < attrs->num; j++) {
-               switch (attrs->table[j].kind) {
-               case A_TREE:
-                  object_visit((object_t *)attrs->table[j].tval, ctx);
-                  break;
-
-               default:
-                  break;
-               }
+            const attr_slot_t slot = object->items[i].attr_slot;
+            attr_iter_t it = object_attr_iter(slot);
+            attr_value_t *value;
+            attr_key_t *key;
+            while ((key = object_attr_next(slot, &it, &value))) {
+               if (key->kind == A_TREE)
+                  object_visit((object_t *)value->tval, ctx);
             }
          }
          else if (ITEM_CODE & mask)
@@ -403,6 +1045,8 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
       return ctx->cache[object->index];
    }
 
+   object_write_barrier(object);
+
    const imask_t skip_mask = (I_REF | I_ATTRS | I_NETS);
 
    const object_class_t *class = classes[object->tag];
@@ -419,7 +1063,7 @@ object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx)
             object->items[n].tree =
                (tree_t)object_rewrite((object_t *)object->items[n].tree, ctx);
          else if (ITEM_TREE_ARRAY & mask) {
-            tree_array_t *a = &(object->items[n].tree_array);
+            tree_array_t *a = object_array(&(object->items[n].tree_array));
 
             for (size_t i = 0; i < a->count; i++)
                a->items[i] =
@@ -550,6 +1194,56 @@ static void write_loc(loc_t *l, object_wr_ctx_t *ctx)
    write_u64(merged, ctx->file);
 }
 
+static bool object_is_lazy(const object_class_t *class, int kind,
+                           imask_t mask, unsigned count)
+{
+   if (class->lazy_items == NULL)
+      return false;
+
+   for (const lazy_item_t *l = class->lazy_items; l->kind != -1; l++) {
+      if (l->kind == kind && (l->items & mask))
+         return count >= l->min_count;
+   }
+
+   return false;
+}
+
+static void object_write_lazy(const tree_array_t *a, object_wr_ctx_t *ctx)
+{
+   // The elements are written to a separate buffer with their own
+   // identifier and file name tables so they can be decoded later
+   // independently of the rest of the stream. Object indexes continue
+   // from the enclosing context so back references work in both
+   // directions.
+
+   fbuf_t *f = fbuf_open_mem(NULL, 0, FBUF_OUT);
+
+   object_wr_ctx_t *sub = xcalloc(sizeof(object_wr_ctx_t));
+   sub->file       = f;
+   sub->generation = ctx->generation;
+   sub->n_objects  = ctx->n_objects;
+   sub->ident_ctx  = ident_write_begin(f);
+
+   for (unsigned i = 0; i < a->count; i++)
+      object_write((object_t *)a->items[i], sub);
+
+   size_t len;
+   const uint8_t *data = fbuf_mem_data(f, &len);
+
+   write_u32(LAZY_COUNT, ctx->file);
+   write_u32(a->count, ctx->file);
+   write_u32(sub->n_objects - ctx->n_objects, ctx->file);
+   write_u32(len, ctx->file);
+   for (size_t off = 0; off < len; off += LAZY_CHUNK)
+      write_raw(data + off, MIN(LAZY_CHUNK, len - off), ctx->file);
+
+   ctx->n_objects = sub->n_objects;
+
+   ident_write_end(sub->ident_ctx);
+   free(sub);
+   fbuf_close(f);
+}
+
 void object_write(object_t *object, object_wr_ctx_t *ctx)
 {
    if (object == NULL) {
@@ -586,10 +1280,15 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
          else if (ITEM_TYPE & mask)
             object_write((object_t *)object->items[n].type, ctx);
          else if (ITEM_TREE_ARRAY & mask) {
-            const tree_array_t *a = &(object->items[n].tree_array);
-            write_u32(a->count, ctx->file);
-            for (unsigned i = 0; i < a->count; i++)
-               object_write((object_t *)a->items[i], ctx);
+            const tree_array_t *a =
+               object_array(&(object->items[n].tree_array));
+            if (object_is_lazy(class, object->kind, mask, a->count))
+               object_write_lazy(a, ctx);
+            else {
+               write_u32(a->count, ctx->file);
+               for (unsigned i = 0; i < a->count; i++)
+                  object_write((object_t *)a->items[i], ctx);
+            }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             const type_array_t *a = &(object->items[n].type_array);
@@ -608,11 +1307,14 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
             else
                write_u8(UINT8_C(0xff), ctx->file);
          }
-         else if (ITEM_NETID_ARRAY & mask) {
-            const netid_array_t *a = &(object->items[n].netid_array);
-            write_u32(a->count, ctx->file);
-            for (unsigned i = 0; i < a->count; i++)
-               write_u32(a->items[i], ctx->file);
+         else if (ITEM_NETID_RUNS & mask) {
+            const netid_runs_t *r = &(object->items[n].netid_runs);
+            write_u32(r->count, ctx->file);
+            write_u32(r->nruns, ctx->file);
+            for (unsigned i = 0; i < r->nruns; i++) {
+               write_u32(r->runs[i].offset, ctx->file);
+               write_u32(r->runs[i].first, ctx->file);
+            }
          }
          else if (ITEM_DOUBLE & mask) {
             union { double d; uint64_t i; } u;
@@ -620,23 +1322,27 @@ void object_write(object_t *object, object_wr_ctx_t *ctx)
             write_u64(u.i, ctx->file);
          }
          else if (ITEM_ATTRS & mask) {
-            const attr_tab_t *attrs = &(object->items[n].attrs);
-            write_u16(attrs->num, ctx->file);
-            for (unsigned i = 0; i < attrs->num; i++) {
-               write_u16(attrs->table[i].kind, ctx->file);
-               ident_write(attrs->table[i].name, ctx->ident_ctx);
+            const attr_slot_t slot = object->items[n].attr_slot;
+            attr_iter_t it = object_attr_iter(slot);
+            write_u16(it.left, ctx->file);
+
+            attr_value_t *value;
+            attr_key_t *key;
+            while ((key = object_attr_next(slot, &it, &value))) {
+               write_u16(key->kind, ctx->file);
+               ident_write(key->name, ctx->ident_ctx);
 
-               switch (attrs->table[i].kind) {
+               switch (key->kind) {
                case A_STRING:
-                  ident_write(attrs->table[i].sval, ctx->ident_ctx);
+                  ident_write(value->sval, ctx->ident_ctx);
                   break;
 
                case A_INT:
-                  write_u32(attrs->table[i].ival, ctx->file);
+                  write_u32(value->ival, ctx->file);
                   break;
 
                case A_TREE:
-                  object_write((object_t *)attrs->table[i].tval, ctx);
+                  object_write((object_t *)value->tval, ctx);
                   break;
 
                case A_PTR:
@@ -724,7 +1430,139 @@ static loc_t read_loc(object_rd_ctx_t *ctx)
    return l;
 }
 
-object_t *object_read(object_rd_ctx_t *ctx, int tag)
+static void object_read_reserve(object_rd_ctx_t *root, unsigned n)
+{
+   if (n >= root->store_sz) {
+      while (n >= root->store_sz)
+         root->store_sz *= 2;
+      root->store = xrealloc(root->store, root->store_sz * sizeof(object_t *));
+   }
+}
+
+static void object_read_maybe_free(object_rd_ctx_t *root)
+{
+   // Objects inside lazy arrays may still need to resolve back
+   // references through the store after the caller is finished with it
+
+   if (root->ended && root->lazy == NULL && root->decoding == 0) {
+      free(root->store);
+      free(root->db_fname);
+      free(root);
+   }
+}
+
+static void object_read_lazy(object_rd_ctx_t *ctx, tree_array_t *a)
+{
+   object_rd_ctx_t *root = ctx->root;
+
+   lazy_t *l = xmalloc(sizeof(lazy_t));
+   l->root     = root;
+   l->array    = a;
+   l->count    = read_u32(ctx->file);
+   l->nobjects = read_u32(ctx->file);
+   l->len      = read_u32(ctx->file);
+   l->data     = xmalloc(l->len);
+   l->first    = ctx->n_objects;
+   l->next     = root->lazy;
+
+   for (size_t off = 0; off < l->len; off += LAZY_CHUNK)
+      read_raw(l->data + off, MIN(LAZY_CHUNK, l->len - off), ctx->file);
+
+   // The slots for nested lazy arrays were already reserved when the
+   // enclosing array was read
+   ctx->n_objects += l->nobjects;
+   if (ctx == root) {
+      object_read_reserve(root, root->n_objects);
+      memset(root->store + l->first, '\0', l->nobjects * sizeof(object_t *));
+   }
+
+   root->lazy = l;
+
+   a->count = LAZY_COUNT;
+   a->items = (tree_t *)l;
+}
+
+static object_t *object_read_aux(object_rd_ctx_t *ctx, int tag);
+
+static void object_lazy_decode(lazy_t *l)
+{
+   object_rd_ctx_t *root = l->root;
+
+   lazy_t **p;
+   for (p = &(root->lazy); *p != l; p = &((*p)->next))
+      assert(*p != NULL);
+   *p = l->next;
+
+   tree_array_t *a = l->array;
+   if (a != NULL) {
+      a->count = 0;
+      a->items = NULL;
+      tree_array_resize(a, l->count, NULL);
+   }
+
+   fbuf_t *f = fbuf_open_mem(l->data, l->len, FBUF_IN);
+
+   object_rd_ctx_t *sub = xcalloc(sizeof(object_rd_ctx_t));
+   sub->file      = f;
+   sub->root      = root;
+   sub->n_objects = l->first;
+   sub->ident_ctx = ident_read_begin(f);
+
+   root->decoding++;
+
+   // Allocate in the arena of the unit so these objects are released
+   // together with the rest of it
+   arena_t *old = current_arena;
+   if (root->arena != NULL)
+      current_arena = root->arena;
+
+   for (unsigned i = 0; i < l->count; i++) {
+      tree_t t = (tree_t)object_read_aux(sub, OBJECT_TAG_TREE);
+      if (a != NULL)
+         a->items[i] = t;
+   }
+
+   current_arena = old;
+
+   assert(sub->n_objects == l->first + l->nobjects);
+
+   root->decoding--;
+
+   ident_read_end(sub->ident_ctx);
+   free(sub);
+   fbuf_close(f);
+   free(l->data);
+   free(l);
+
+   object_read_maybe_free(root);
+}
+
+void object_force_lazy(tree_array_t *a)
+{
+   assert(a->count == LAZY_COUNT);
+   object_lazy_decode((lazy_t *)a->items);
+}
+
+static object_t *object_read_index(object_rd_ctx_t *root, index_t index)
+{
+   while (root->store[index] == NULL) {
+      // The object is inside a lazy array that has not been decoded yet
+      lazy_t *it;
+      for (it = root->lazy; it != NULL; it = it->next) {
+         if (index >= it->first && index < it->first + it->nobjects)
+            break;
+      }
+
+      if (it == NULL)
+         fatal_trace("object %u missing from %s", index, root->db_fname);
+
+      object_lazy_decode(it);
+   }
+
+   return root->store[index];
+}
+
+static object_t *object_read_aux(object_rd_ctx_t *ctx, int tag)
 {
    uint16_t marker = read_u16(ctx->file);
    if (marker == UINT16_C(0xffff))
@@ -732,8 +1570,8 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
    else if (marker == UINT16_C(0xfffe)) {
       // Back reference marker
       index_t index = read_u32(ctx->file);
-      assert(index < ctx->n_objects);
-      return ctx->store[index];
+      assert(index < ctx->root->n_objects);
+      return object_read_index(ctx->root, index);
    }
 
    const object_class_t *class = classes[tag];
@@ -741,6 +1579,7 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
    assert(marker < class->last_kind);
 
    object_t *object = object_new(class, marker);
+   object->old = 1;   // Library units are only released by a full GC
 
    if (tag == OBJECT_TAG_TREE)
       object->loc = read_loc(ctx);
@@ -749,11 +1588,8 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
    // This must be done early as a child node of this type may
    // reference upwards
    object->index = ctx->n_objects++;
-   if (ctx->n_objects == ctx->store_sz) {
-      ctx->store_sz *= 2;
-      ctx->store = xrealloc(ctx->store, ctx->store_sz * sizeof(tree_t));
-   }
-   ctx->store[object->index] = object;
+   object_read_reserve(ctx->root, ctx->n_objects);
+   ctx->root->store[object->index] = object;
 
    const imask_t has = class->has_map[object->kind];
    const int nitems = class->object_nitems[object->kind];
@@ -763,20 +1599,25 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
          if (ITEM_IDENT & mask)
             object->items[n].ident = ident_read(ctx->ident_ctx);
          else if (ITEM_TREE & mask)
-            object->items[n].tree = (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+            object->items[n].tree = (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
          else if (ITEM_TYPE & mask)
-            object->items[n].tree = (tree_t)object_read(ctx, OBJECT_TAG_TYPE);
+            object->items[n].tree = (tree_t)object_read_aux(ctx, OBJECT_TAG_TYPE);
          else if (ITEM_TREE_ARRAY & mask) {
             tree_array_t *a = &(object->items[n].tree_array);
-            tree_array_resize(a, read_u32(ctx->file), NULL);
-            for (unsigned i = 0; i < a->count; i++)
-               a->items[i] = (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+            const uint32_t count = read_u32(ctx->file);
+            if (count == LAZY_COUNT)
+               object_read_lazy(ctx, a);
+            else {
+               tree_array_resize(a, count, NULL);
+               for (unsigned i = 0; i < a->count; i++)
+                  a->items[i] = (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
+            }
          }
          else if (ITEM_TYPE_ARRAY & mask) {
             type_array_t *a = &(object->items[n].type_array);
             type_array_resize(a, read_u16(ctx->file), NULL);
             for (unsigned i = 0; i < a->count; i++)
-               a->items[i] = (type_t)object_read(ctx, OBJECT_TAG_TYPE);
+               a->items[i] = (type_t)object_read_aux(ctx, OBJECT_TAG_TYPE);
          }
          else if (ITEM_INT64 & mask)
             object->items[n].ival = read_u64(ctx->file);
@@ -786,9 +1627,9 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
                object->items[n].range = xmalloc(sizeof(range_t));
                object->items[n].range->kind = rmarker;
                object->items[n].range->left =
-                  (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+                  (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
                object->items[n].range->right =
-                  (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+                  (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
             }
          }
          else if (ITEM_RANGE_ARRAY & mask) {
@@ -799,18 +1640,22 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
             for (unsigned i = 0; i < a->count; i++) {
                a->items[i].kind  = read_u8(ctx->file);
                a->items[i].left  =
-                  (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+                  (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
                a->items[i].right =
-                  (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+                  (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
             }
          }
          else if (ITEM_TEXT_BUF & mask)
             ;
-         else if (ITEM_NETID_ARRAY & mask) {
-            netid_array_t *a = &(object->items[n].netid_array);
-            netid_array_resize(a, read_u32(ctx->file), NETID_INVALID);
-            for (unsigned i = 0; i < a->count; i++)
-               a->items[i] = read_u32(ctx->file);
+         else if (ITEM_NETID_RUNS & mask) {
+            netid_runs_t *r = &(object->items[n].netid_runs);
+            r->count = read_u32(ctx->file);
+            const unsigned nruns = read_u32(ctx->file);
+            netid_runs_reserve(r, nruns);
+            for (; r->nruns < nruns; r->nruns++) {
+               r->runs[r->nruns].offset = read_u32(ctx->file);
+               r->runs[r->nruns].first  = read_u32(ctx->file);
+            }
          }
          else if (ITEM_DOUBLE & mask) {
             union { uint64_t i; double d; } u;
@@ -818,35 +1663,32 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
             object->items[n].dval = u.d;
          }
          else if (ITEM_ATTRS & mask) {
-            attr_tab_t *attrs = &(object->items[n].attrs);
-
-            attrs->num = read_u16(ctx->file);
-            if (attrs->num > 0) {
-               attrs->alloc = next_power_of_2(attrs->num);
-               attrs->table = xmalloc(sizeof(attr_t) * attrs->alloc);
-            }
+            attr_slot_t *slot = &(object->items[n].attr_slot);
 
-            for (unsigned i = 0; i < attrs->num; i++) {
-               attrs->table[i].kind = read_u16(ctx->file);
-               attrs->table[i].name = ident_read(ctx->ident_ctx);
+            const unsigned num = read_u16(ctx->file);
+            for (unsigned i = 0; i < num; i++) {
+               const attr_kind_t kind = read_u16(ctx->file);
+               ident_t name = ident_read(ctx->ident_ctx);
 
-               switch (attrs->table[i].kind) {
+               attr_value_t value;
+               switch (kind) {
                case A_STRING:
-                  attrs->table[i].sval = ident_read(ctx->ident_ctx);
+                  value.sval = ident_read(ctx->ident_ctx);
                   break;
 
                case A_INT:
-                  attrs->table[i].ival = read_u32(ctx->file);
+                  value.ival = read_u32(ctx->file);
                   break;
 
                case A_TREE:
-                  attrs->table[i].tval =
-                     (tree_t)object_read(ctx, OBJECT_TAG_TREE);
+                  value.tval = (tree_t)object_read_aux(ctx, OBJECT_TAG_TREE);
                   break;
 
                default:
                   abort();
                }
+
+               *object_attr_add(slot, name, kind) = value;
             }
          }
          else if (ITEM_CODE & mask)
@@ -860,6 +1702,19 @@ object_t *object_read(object_rd_ctx_t *ctx, int tag)
    return object;
 }
 
+object_t *object_read(object_rd_ctx_t *ctx, int tag)
+{
+   // Objects read from a design unit are allocated together
+   if (ctx->arena == NULL)
+      return object_read_aux(ctx, tag);
+
+   arena_t *old = object_arena_set(ctx->arena);
+   object_t *object = object_read_aux(ctx, tag);
+   object_arena_set(old);
+
+   return object;
+}
+
 static void object_read_recover_fn(object_t *object, object_rd_ctx_t *ctx)
 {
    object->index = (ctx->n_objects)++;
@@ -882,6 +1737,7 @@ object_rd_ctx_t *object_read_recover(object_t *object, const char *fname)
    ctx->store_sz  = 256;
    ctx->store     = xcalloc(ctx->store_sz * sizeof(object_t *));
    ctx->n_objects = 0;
+   ctx->root      = ctx;
    ctx->db_fname  = strdup(fname);
 
    object_visit_ctx_t visit_ctx = {
@@ -921,7 +1777,9 @@ object_rd_ctx_t *object_read_begin(fbuf_t *f, const char *fname)
    ctx->store_sz  = 256;
    ctx->store     = xmalloc(ctx->store_sz * sizeof(object_t *));
    ctx->n_objects = 0;
+   ctx->root      = ctx;
    ctx->db_fname  = strdup(fname);
+   ctx->arena     = object_arena_new();
 
    return ctx;
 }
@@ -930,9 +1788,12 @@ void object_read_end(object_rd_ctx_t *ctx)
 {
    if (ctx->ident_ctx != NULL)
       ident_read_end(ctx->ident_ctx);
-   free(ctx->store);
-   free(ctx->db_fname);
-   free(ctx);
+
+   ctx->ident_ctx = NULL;
+   ctx->file      = NULL;
+   ctx->ended     = true;
+
+   object_read_maybe_free(ctx);
 }
 
 fbuf_t *object_read_file(object_rd_ctx_t *ctx)
@@ -943,7 +1804,7 @@ fbuf_t *object_read_file(object_rd_ctx_t *ctx)
 object_t *object_read_recall(object_rd_ctx_t *ctx, index_t index)
 {
    assert(index < ctx->n_objects);
-   return ctx->store[index];
+   return object_read_index(ctx, index);
 }
 
 unsigned object_next_generation(void)
@@ -984,7 +1845,7 @@ bool object_copy_mark(object_t *object, object_copy_ctx_t *ctx)
          else if (ITEM_DOUBLE & mask)
             ;
          else if (ITEM_TREE_ARRAY & mask) {
-            tree_array_t *a = &(object->items[n].tree_array);
+            tree_array_t *a = object_array(&(object->items[n].tree_array));
             for (unsigned i = 0; i < a->count; i++)
                marked = object_copy_mark((object_t *)a->items[i], ctx)
                   || marked;
@@ -1015,7 +1876,7 @@ bool object_copy_mark(object_t *object, object_copy_ctx_t *ctx)
                   || marked;
             }
          }
-         else if (ITEM_NETID_ARRAY & mask)
+         else if (ITEM_NETID_RUNS & mask)
             ;
          else if (ITEM_ATTRS & mask)
             ;
@@ -1077,7 +1938,8 @@ object_t *object_copy_sweep(object_t *object, object_copy_ctx_t *ctx)
          else if (ITEM_DOUBLE & mask)
             copy->items[n].dval = object->items[n].dval;
          else if (ITEM_TREE_ARRAY & mask) {
-            const tree_array_t *from = &(object->items[n].tree_array);
+            const tree_array_t *from =
+               object_array(&(object->items[n].tree_array));
             tree_array_t *to = &(copy->items[n].tree_array);
 
             tree_array_resize(to, from->count, NULL);
@@ -1102,23 +1964,24 @@ object_t *object_copy_sweep(object_t *object, object_copy_ctx_t *ctx)
                   (tree_t)object_copy_sweep((object_t *)from->right, ctx);
             }
          }
-         else if (ITEM_NETID_ARRAY & mask) {
-            const netid_array_t *from = &(object->items[n].netid_array);
-            netid_array_t *to = &(copy->items[n].netid_array);
-
-            netid_array_resize(to, from->count, NETID_INVALID);
-
-            for (unsigned i = 0; i < from->count; i++)
-               to->items[i] = from->items[i];
+         else if (ITEM_NETID_RUNS & mask) {
+            const netid_runs_t *from = &(object->items[n].netid_runs);
+            netid_runs_t *to = &(copy->items[n].netid_runs);
+
+            netid_runs_reserve(to, from->nruns);
+            memcpy(to->runs, from->runs, from->nruns * sizeof(netid_run_t));
+            to->nruns = from->nruns;
+            to->count = from->count;
          }
          else if (ITEM_ATTRS & mask) {
-            if ((copy->items[n].attrs.num = object->items[n].attrs.num) > 0) {
-               copy->items[n].attrs.alloc = object->items[n].attrs.alloc;
-               copy->items[n].attrs.table =
-                  xmalloc(sizeof(attr_t) * copy->items[n].attrs.alloc);
-               for (unsigned i = 0; i < object->items[n].attrs.num; i++)
-                  copy->items[n].attrs.table[i] =
-                     object->items[n].attrs.table[i];
+            const attr_slot_t slot = object->items[n].attr_slot;
+            attr_iter_t it = object_attr_iter(slot);
+            attr_value_t *value;
+            attr_key_t *key;
+            while ((key = object_attr_next(slot, &it, &value))) {
+               const attr_value_t tmp = *value;
+               *object_attr_add(&(copy->items[n].attr_slot),
+                                key->name, key->kind) = tmp;
             }
          }
          else if (ITEM_RANGE_ARRAY & mask) {
@@ -1163,6 +2026,8 @@ void object_replace(object_t *t, object_t *a)
 {
    const object_class_t *class = classes[t->tag];
 
+   object_write_barrier(t);
+
    object_change_kind(class, t, a->kind);
 
    const imask_t has = class->has_map[t->kind];
@@ -1184,8 +2049,8 @@ void object_replace(object_t *t, object_t *a)
          else if (ITEM_TREE & mask)
             t->items[n].tree = a->items[n].tree;
          else if (ITEM_TREE_ARRAY & mask) {
-            const tree_array_t *from = &(a->items[n].tree_array);
-            tree_array_t *to = &(t->items[n].tree_array);
+            const tree_array_t *from = object_array(&(a->items[n].tree_array));
+            tree_array_t *to = object_array(&(t->items[n].tree_array));
 
             tree_array_resize(to, from->count, NULL);
 
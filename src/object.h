@@ -95,7 +95,7 @@ typedef uint64_t imask_t;
                           | I_FILE)
 #define ITEM_INT64       (I_POS | I_SUBKIND | I_CLASS | I_IVAL)
 #define ITEM_RANGE       (I_RANGE)
-#define ITEM_NETID_ARRAY (I_NETS)
+#define ITEM_NETID_RUNS  (I_NETS)
 #define ITEM_DOUBLE      (I_DVAL)
 #define ITEM_TYPE_ARRAY  (I_PTYPES | I_CONSTR)
 #define ITEM_RANGE_ARRAY (I_DIMS)
@@ -108,7 +108,6 @@ typedef uint64_t imask_t;
 
 #define MAX_FILES 512
 
-DECLARE_ARRAY(netid);
 DECLARE_ARRAY(range);
 DECLARE_ARRAY(tree);
 DECLARE_ARRAY(type);
@@ -131,6 +130,11 @@ DECLARE_ARRAY(ident);
          &((t)->object.items[n]);                                       \
       })
 
+#define mutate_item(class, t, mask) ({                                  \
+         object_write_barrier(&(t)->object);                            \
+         lookup_item(class, t, mask);                                   \
+      })
+
 typedef enum {
    A_STRING, A_INT, A_PTR, A_TREE
 } attr_kind_t;
@@ -138,22 +142,30 @@ typedef enum {
 typedef uint16_t generation_t;
 typedef uint32_t index_t;
 
+typedef union {
+   ident_t sval;
+   int     ival;
+   void    *pval;
+   tree_t  tval;
+} attr_value_t;
+
+// Attribute values are held in a side table for each key indexed by the
+// attribute slot of the object which is assigned when the first attribute
+// is added: zero means the object has no attributes
+typedef uint32_t attr_slot_t;
+
+// Net IDs are stored as runs of consecutive IDs as most signals are
+// assigned a single contiguous block during elaboration
 typedef struct {
-   attr_kind_t kind;
-   ident_t     name;
-   union {
-      ident_t sval;
-      int     ival;
-      void    *pval;
-      tree_t  tval;
-   };
-} attr_t;
+   uint32_t offset;
+   netid_t  first;     // NETID_INVALID for an unassigned hole
+} netid_run_t;
 
 typedef struct {
-   uint16_t  alloc;
-   uint16_t  num;
-   attr_t   *table;
-} attr_tab_t;
+   uint32_t     count;
+   uint32_t     nruns;
+   netid_run_t *runs;
+} netid_runs_t;
 
 typedef union {
    ident_t        ident;
@@ -164,18 +176,22 @@ typedef union {
    int64_t        ival;
    double         dval;
    range_t       *range;
-   netid_array_t  netid_array;
+   netid_runs_t   netid_runs;
    range_array_t  range_array;
    text_buf_t    *text_buf;
    type_array_t   type_array;
-   attr_tab_t     attrs;
+   attr_slot_t    attr_slot;
    ident_array_t  ident_array;
    vcode_unit_t   code;
 } item_t;
 
 typedef struct {
    uint8_t      kind;
-   uint8_t      tag;
+   uint8_t      tag : 2;
+   uint8_t      old : 1;          // Survived a collection or read from disk
+   uint8_t      remembered : 1;   // Old object modified since last GC
+   uint8_t      unrooted : 1;     // Root kind no longer held by its owner
+   uint8_t      pinned : 1;       // Held by a static pointer in C code
    generation_t generation;
    index_t      index;
    loc_t        loc;
@@ -207,18 +223,29 @@ typedef struct {
    tree_kind_t      kind;
    unsigned         generation;
    bool             deep;
+   bool             skip_lazy;
+   bool             young_only;
 } object_visit_ctx_t;
 
 typedef int change_allowed_t[2];
 
+// Tree array items which are serialised as a separate blob and only
+// decoded when first accessed if they have at least `min_count' elements
+typedef struct {
+   int      kind;
+   imask_t  items;
+   unsigned min_count;
+} lazy_item_t;
+
 typedef struct {
    const char             *name;
    const change_allowed_t *change_allowed;
+   const lazy_item_t      *lazy_items;
    const imask_t          *has_map;
    const char            **kind_text_map;
    const int               tag;
    const int               last_kind;
-   const int               gc_roots[6];
+   const int               gc_roots[8];
    const int               gc_num_roots;
    int                    *object_nitems;
    size_t                 *object_size;
@@ -233,28 +260,71 @@ typedef struct {
    const char     *file_names[MAX_FILES];
 } object_wr_ctx_t;
 
-typedef struct {
-   fbuf_t         *file;
-   ident_rd_ctx_t  ident_ctx;
-   unsigned        n_objects;
-   object_t      **store;
-   unsigned        store_sz;
-   char           *db_fname;
-   const char     *file_names[MAX_FILES];
-} object_rd_ctx_t;
+typedef struct object_rd_ctx object_rd_ctx_t;
+typedef struct lazy lazy_t;
+typedef struct arena arena_t;
+
+struct object_rd_ctx {
+   fbuf_t           *file;
+   ident_rd_ctx_t    ident_ctx;
+   unsigned          n_objects;
+   object_rd_ctx_t  *root;
+   object_t        **store;
+   unsigned          store_sz;
+   char             *db_fname;
+   lazy_t           *lazy;
+   arena_t          *arena;
+   unsigned          decoding;
+   bool              ended;
+   const char       *file_names[MAX_FILES];
+};
+
+// A tree array which has not been decoded yet has this count and its
+// items field points at the pending lazy_t
+#define LAZY_COUNT UINT32_MAX
 
 __attribute__((noreturn))
 void object_lookup_failed(const char *name, const char **kind_text_map,
                           int kind, imask_t mask);
 
 void item_without_type(imask_t mask);
+void object_remember(object_t *object);
+
+static inline void object_write_barrier(object_t *object)
+{
+   // Old objects are not scanned by a minor collection so any which
+   // are modified must be remembered as they may now point at young
+   // objects
+   if (unlikely(object->old && !object->remembered))
+      object_remember(object);
+}
+void object_force_lazy(tree_array_t *a);
+
+static inline tree_array_t *object_array(tree_array_t *a)
+{
+   if (unlikely(a->count == LAZY_COUNT))
+      object_force_lazy(a);
+   return a;
+}
 
 uint32_t object_index(const object_t *object);
+attr_value_t *object_attr_find(attr_slot_t slot, ident_t name,
+                               attr_kind_t kind);
+attr_value_t *object_attr_add(attr_slot_t *slot, ident_t name,
+                              attr_kind_t kind);
+void object_attr_remove(attr_slot_t slot, ident_t name);
 void object_change_kind(const object_class_t *class,
                         object_t *object, int kind);
 object_t *object_new(const object_class_t *class, int kind);
 void object_one_time_init(void);
-void object_gc(void);
+void object_gc(bool full);
+void object_gc_stats(void);
+void object_unroot(object_t *object);
+void object_pin(object_t *object);
+unsigned object_arena_count(void);
+size_t object_live_count(void);
+arena_t *object_arena_new(void);
+arena_t *object_arena_set(arena_t *a);
 void object_visit(object_t *object, object_visit_ctx_t *ctx);
 object_t *object_rewrite(object_t *object, object_rewrite_ctx_t *ctx);
 unsigned object_next_generation(void);
@@ -262,6 +332,11 @@ object_t *object_copy_sweep(object_t *object, object_copy_ctx_t *ctx);
 bool object_copy_mark(object_t *object, object_copy_ctx_t *ctx);
 void object_replace(object_t *t, object_t *a);
 
+void netid_runs_add(netid_runs_t *r, netid_t first, unsigned count);
+void netid_runs_set(netid_runs_t *r, unsigned n, netid_t nid);
+void netid_runs_reserve(netid_runs_t *r, unsigned nruns);
+netid_t netid_runs_nth(const netid_runs_t *r, unsigned n, unsigned *avail);
+
 void object_write(object_t *object, object_wr_ctx_t *ctx);
 object_wr_ctx_t *object_write_begin(fbuf_t *f);
 void object_write_end(object_wr_ctx_t *ctx);
@@ -18,8 +18,11 @@
 #include "util.h"
 #include "phase.h"
 #include "common.h"
+#include "hash.h"
+#include "rt/rt.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -132,6 +135,1873 @@ static void opt_tag_last_value_fcall(tree_t t)
    }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Levelise combinational processes
+//
+//   process (a, b) is
+//   begin
+//     x <= a and b;
+//   end process;
+//
+// A process whose only wait statement is a static sensitivity list that
+// includes every signal it reads always computes the same outputs from
+// the same inputs. These are sorted topologically using the nets each
+// reads and drives and tagged with their depth so the kernel can run a
+// chain of them in a single delta cycle.
+//
+// The delta cycle in which a signal changes must not be affected. A
+// process at depth N would normally run N delta cycles after the
+// processes at depth zero, so every process at depth N must only read
+// signals driven by processes at depth N - 1, and only processes at depth
+// zero may read other signals. Anything else, and anything on a feedback
+// loop, keeps the normal scheduling. Signals with a single levelised
+// driver which are only read by levelised processes are tagged so the
+// kernel updates them within the delta cycle. The kernel holds back any
+// other assignment from a process at depth N for N delta cycles so its
+// readers see it at the usual time.
+//
+// The sensitivity list of a levelised process is narrowed to the parts
+// of each signal it reads. Running a combinational process when nothing
+// it reads has changed cannot cause an event and this stops processes
+// being woken by later levels in the same delta cycle. This is not done
+// if an attribute such as 'ACTIVE of a signal it drives is read as the
+// extra transactions could then be seen.
+//
+
+typedef struct opt_proc opt_proc_t;
+
+typedef struct {
+   netid_t     first;
+   unsigned    count;
+   opt_proc_t *proc;
+} opt_span_t;
+
+typedef struct {
+   opt_span_t *items;
+   unsigned    count;
+   unsigned    max;
+} opt_span_list_t;
+
+struct opt_proc {
+   tree_t       process;
+   bool         comb;
+   int          level;
+   int          indegree;
+   unsigned     nwaits;
+   opt_proc_t **succs;
+   unsigned     nsuccs;
+   unsigned     maxsuccs;
+   unsigned     first_read;
+   unsigned     nreads;
+   unsigned     first_sens;
+   unsigned     nsens;
+   bool         observed;
+   tree_t      *names;
+   unsigned     nnames;
+};
+
+typedef struct {
+   opt_proc_t      *proc;
+   tree_t          *refs;
+   unsigned         nrefs;
+   unsigned         maxrefs;
+   hash_t          *targets;
+   hash_t          *narrow;
+   hash_t          *locals;
+   bool             opaque;
+   opt_span_list_t  reads;
+   opt_span_list_t  sens;
+   opt_span_list_t  active;
+   opt_span_list_t  writes;
+} opt_level_ctx_t;
+
+typedef struct {
+   int    offset;
+   int    width;
+   tree_t name;
+} opt_slice_t;
+
+static void opt_span_add(opt_span_list_t *list, netid_t first,
+                         unsigned count, opt_proc_t *proc)
+{
+   if (list->count == list->max) {
+      list->max = MAX(list->max * 2, 16);
+      list->items = xrealloc(list->items, list->max * sizeof(opt_span_t));
+   }
+
+   opt_span_t *s = &(list->items[list->count++]);
+   s->first = first;
+   s->count = count;
+   s->proc  = proc;
+}
+
+static void opt_span_add_decl(opt_span_list_t *list, tree_t decl,
+                              int offset, int width, opt_proc_t *proc)
+{
+   // Add the nets for part of a signal which may be split into several
+   // runs by port maps
+   const int end = MIN(offset + width, tree_nets(decl));
+   while (offset < end) {
+      unsigned length;
+      netid_t first = tree_net_run(decl, offset, &length);
+      length = MIN(length, end - offset);
+      opt_span_add(list, first, length, proc);
+      offset += length;
+   }
+}
+
+static int opt_span_cmp(const void *a, const void *b)
+{
+   const netid_t fa = ((const opt_span_t *)a)->first;
+   const netid_t fb = ((const opt_span_t *)b)->first;
+   return (fa > fb) - (fa < fb);
+}
+
+static tree_t opt_level_static(tree_t name, int *offset, int *width,
+                               tree_t *prefix)
+{
+   // Find the range of nets within a signal referenced by the longest
+   // static prefix of a name which is also returned in prefix
+
+   switch (tree_kind(name)) {
+   case T_REF:
+      {
+         tree_t decl = tree_ref(name);
+         if (tree_kind(decl) != T_SIGNAL_DECL)
+            return NULL;
+
+         *offset = 0;
+         *width  = tree_nets(decl);
+         *prefix = name;
+         return decl;
+      }
+
+   case T_ARRAY_REF:
+      {
+         tree_t value = tree_value(name);
+         tree_t decl = opt_level_static(value, offset, width, prefix);
+         if (decl == NULL || *prefix != value)
+            return decl;
+
+         type_t type = tree_type(value);
+         if (type_is_unconstrained(type) || tree_params(name) != 1)
+            return decl;
+
+         tree_t index = tree_value(tree_param(name, 0));
+         if (tree_kind(index) != T_LITERAL)
+            return decl;
+
+         const int stride = type_width(type_elem(type));
+         *offset += stride * rebase_index(type, 0, assume_int(index));
+         *width   = stride;
+         *prefix  = name;
+         return decl;
+      }
+
+   case T_ARRAY_SLICE:
+      {
+         tree_t value = tree_value(name);
+         tree_t decl = opt_level_static(value, offset, width, prefix);
+         if (decl == NULL || *prefix != value)
+            return decl;
+
+         type_t type = tree_type(value);
+         if (type_is_unconstrained(type))
+            return decl;
+
+         range_t slice = tree_range(name);
+         if (tree_kind(slice.left) != T_LITERAL
+             || tree_kind(slice.right) != T_LITERAL)
+            return decl;
+
+         int64_t low, high;
+         range_bounds(slice, &low, &high);
+
+         const int stride = type_width(type_elem(type));
+         *offset += stride * rebase_index(type, 0, assume_int(slice.left));
+         *width   = stride * MAX(high - low + 1, 0);
+         *prefix  = name;
+         return decl;
+      }
+
+   case T_RECORD_REF:
+      {
+         tree_t value = tree_value(name);
+         tree_t decl = opt_level_static(value, offset, width, prefix);
+         if (decl == NULL || *prefix != value)
+            return decl;
+
+         *offset += record_field_to_net(tree_type(value), tree_ident(name));
+         *width   = type_width(tree_type(name));
+         *prefix  = name;
+         return decl;
+      }
+
+   default:
+      return NULL;
+   }
+}
+
+static tree_t opt_level_name(tree_t name, int *offset, int *width)
+{
+   // Find the range of nets within a signal referenced by a static name
+   // or the whole prefix if it cannot be determined at this point
+
+   tree_t prefix;
+   return opt_level_static(name, offset, width, &prefix);
+}
+
+static tree_t opt_level_prefix(tree_t name)
+{
+   tree_kind_t kind;
+   while ((kind = tree_kind(name)) != T_REF) {
+      if ((kind == T_ARRAY_REF) || (kind == T_ARRAY_SLICE)
+          || (kind == T_RECORD_REF))
+         name = tree_value(name);
+      else
+         return NULL;
+   }
+
+   return name;
+}
+
+static void opt_level_add_ref(opt_level_ctx_t *ctx, tree_t ref)
+{
+   if (ctx->nrefs == ctx->maxrefs) {
+      ctx->maxrefs = MAX(ctx->maxrefs * 2, 16);
+      ctx->refs = xrealloc(ctx->refs, ctx->maxrefs * sizeof(tree_t));
+   }
+
+   ctx->refs[ctx->nrefs++] = ref;
+}
+
+static void opt_level_add_succ(opt_proc_t *from, opt_proc_t *to)
+{
+   if (from->nsuccs == from->maxsuccs) {
+      from->maxsuccs = MAX(from->maxsuccs * 2, 4);
+      from->succs = xrealloc(from->succs,
+                             from->maxsuccs * sizeof(opt_proc_t *));
+   }
+
+   from->succs[from->nsuccs++] = to;
+   to->indegree++;
+}
+
+static void opt_level_target(opt_level_ctx_t *ctx, tree_t target)
+{
+   if (tree_kind(target) == T_AGGREGATE) {
+      // Each element still creates a driver
+      ctx->proc->comb = false;
+
+      const int nassocs = tree_assocs(target);
+      for (int i = 0; i < nassocs; i++)
+         opt_level_target(ctx, tree_value(tree_assoc(target, i)));
+      return;
+   }
+
+   tree_t ref = opt_level_prefix(target);
+
+   int offset, width;
+   tree_t decl = opt_level_name(target, &offset, &width);
+   if (ref == NULL || decl == NULL) {
+      // The nets driven are unknown so no signal can be assumed to
+      // have a single driver
+      ctx->proc->comb = false;
+      ctx->opaque = true;
+      return;
+   }
+
+   hash_put(ctx->targets, ref, ref);
+   opt_span_add_decl(&(ctx->writes), decl, offset, width, ctx->proc);
+}
+
+static void opt_level_narrow(opt_level_ctx_t *ctx, tree_t name)
+{
+   // Remember the smallest part of the signal read through this prefix
+   tree_t ref = opt_level_prefix(name);
+   if (ref == NULL)
+      return;
+
+   opt_slice_t slice;
+   if (opt_level_static(name, &(slice.offset), &(slice.width),
+                        &(slice.name)) == NULL)
+      return;
+
+   opt_slice_t *prev = hash_get(ctx->narrow, ref);
+   if (prev == NULL) {
+      prev = xmalloc(sizeof(opt_slice_t));
+      *prev = slice;
+      hash_put(ctx->narrow, ref, prev);
+   }
+   else if (slice.width < prev->width)
+      *prev = slice;
+}
+
+static void opt_level_observe(opt_level_ctx_t *ctx, tree_t name)
+{
+   // Attributes such as 'ACTIVE can see every transaction on a signal
+   // and not just the events
+
+   int offset, width;
+   tree_t decl = opt_level_name(name, &offset, &width);
+   if (decl != NULL)
+      opt_span_add_decl(&(ctx->active), decl, offset, width, ctx->proc);
+}
+
+static void opt_level_visit_fn(tree_t t, void *context)
+{
+   opt_level_ctx_t *ctx = context;
+
+   switch (tree_kind(t)) {
+   case T_REF:
+      opt_level_add_ref(ctx, t);
+      break;
+
+   case T_ARRAY_REF:
+   case T_ARRAY_SLICE:
+   case T_RECORD_REF:
+      opt_level_narrow(ctx, t);
+      break;
+
+   case T_SIGNAL_ASSIGN:
+      opt_level_target(ctx, tree_target(t));
+      break;
+
+   case T_WAIT:
+      ctx->proc->nwaits++;
+      break;
+
+   case T_VAR_DECL:
+   case T_FILE_DECL:
+      hash_put(ctx->locals, t, t);
+      break;
+
+   case T_ATTR_REF:
+      {
+         // Attributes such as 'EVENT indicate a clocked process
+         tree_t prefix = opt_level_prefix(tree_name(t));
+         if (prefix != NULL && tree_kind(tree_ref(prefix)) == T_SIGNAL_DECL)
+            ctx->proc->comb = false;
+
+         switch (tree_attr_int(t, builtin_i, -1)) {
+         case ATTR_ACTIVE:
+         case ATTR_LAST_ACTIVE:
+         case ATTR_QUIET:
+         case ATTR_TRANSACTION:
+            opt_level_observe(ctx, tree_name(t));
+            break;
+         default:
+            break;
+         }
+      }
+      break;
+
+   case T_FCALL:
+      {
+         tree_t decl = tree_ref(t);
+         if (tree_attr_int(decl, impure_i, 0))
+            ctx->proc->comb = false;
+
+         // As above for functions like RISING_EDGE
+         const int nparams = MIN(tree_params(t), tree_ports(decl));
+         for (int i = 0; i < nparams; i++) {
+            if (tree_class(tree_port(decl, i)) == C_SIGNAL) {
+               ctx->proc->comb = false;
+               opt_level_observe(ctx, tree_value(tree_param(t, i)));
+            }
+         }
+      }
+      break;
+
+   case T_PCALL:
+      {
+         ctx->proc->comb = false;
+
+         // Signal parameters of mode out or inout create drivers
+         tree_t decl = tree_ref(t);
+         const int nparams = MIN(tree_params(t), tree_ports(decl));
+         for (int i = 0; i < nparams; i++) {
+            tree_t port = tree_port(decl, i);
+            if (tree_class(port) != C_SIGNAL)
+               continue;
+
+            tree_t value = tree_value(tree_param(t, i));
+            opt_level_observe(ctx, value);
+            if (tree_subkind(port) != PORT_IN)
+               opt_level_target(ctx, value);
+         }
+      }
+      break;
+
+   case T_CPCALL:
+      ctx->proc->comb = false;
+      break;
+
+   default:
+      break;
+   }
+}
+
+static bool opt_level_trigger(tree_t name)
+{
+   switch (tree_kind(name)) {
+   case T_REF:
+      return true;
+   case T_ARRAY_REF:
+   case T_ARRAY_SLICE:
+      return tree_kind(tree_value(name)) == T_REF;
+   default:
+      return false;
+   }
+}
+
+static bool opt_level_sensitive(tree_t wait, tree_t decl)
+{
+   const int ntriggers = tree_triggers(wait);
+   for (int i = 0; i < ntriggers; i++) {
+      tree_t t = tree_trigger(wait, i);
+      if (tree_kind(t) == T_REF && tree_ref(t) == decl)
+         return true;
+   }
+
+   return false;
+}
+
+static void opt_level_process(opt_level_ctx_t *ctx, opt_proc_t *p)
+{
+   tree_t process = p->process;
+
+   p->comb       = !tree_attr_int(process, postponed_i, 0);
+   p->level      = -1;
+   p->indegree   = 0;
+   p->nwaits     = 0;
+   p->succs      = NULL;
+   p->nsuccs     = 0;
+   p->maxsuccs   = 0;
+   p->first_read = ctx->reads.count;
+   p->nreads     = 0;
+   p->first_sens = ctx->sens.count;
+   p->nsens      = 0;
+   p->observed   = false;
+   p->names      = NULL;
+   p->nnames     = 0;
+
+   ctx->proc     = p;
+   ctx->nrefs    = 0;
+   ctx->targets  = hash_new(16, true);
+   ctx->narrow   = hash_new(16, true);
+   ctx->locals   = hash_new(16, true);
+
+   const int ndecls = tree_decls(process);
+   for (int i = 0; i < ndecls; i++)
+      tree_visit(tree_decl(process, i), opt_level_visit_fn, ctx);
+
+   // The same tree may appear both in the body and in the sensitivity
+   // list so visit the final wait statement separately
+   const int nstmts = tree_stmts(process);
+   for (int i = 0; i < nstmts - 1; i++)
+      tree_visit(tree_stmt(process, i), opt_level_visit_fn, ctx);
+
+   const unsigned nbody = ctx->nrefs;
+
+   tree_t wait = (nstmts > 0) ? tree_stmt(process, nstmts - 1) : NULL;
+   if (wait != NULL)
+      tree_visit(wait, opt_level_visit_fn, ctx);
+
+   if (p->nwaits != 1 || tree_kind(wait) != T_WAIT
+       || !tree_attr_int(wait, static_i, 0)
+       || tree_has_delay(wait) || tree_has_value(wait))
+      p->comb = false;
+
+   // Names in the sensitivity list are kept separately as a levelised
+   // process is only sensitive to the names it reads
+   for (unsigned i = 0; i < ctx->nrefs; i++) {
+      tree_t ref = ctx->refs[i];
+      tree_t decl = tree_ref(ref);
+      switch (tree_kind(decl)) {
+      case T_SIGNAL_DECL:
+         if (hash_get(ctx->targets, ref) == NULL) {
+            const bool trigger = (i >= nbody);
+            if (p->comb && !trigger && !opt_level_sensitive(wait, decl))
+               p->comb = false;
+
+            opt_span_list_t *list = trigger ? &(ctx->sens) : &(ctx->reads);
+
+            // The kernel wakes a levelised process on exactly the nets
+            // it reads so only narrow to names a wait can use
+            opt_slice_t *slice = hash_get(ctx->narrow, ref);
+            if (slice != NULL && p->comb && !opt_level_trigger(slice->name))
+               slice = NULL;
+
+            if (slice != NULL)
+               opt_span_add_decl(list, decl, slice->offset,
+                                 slice->width, p);
+            else
+               opt_span_add_decl(list, decl, 0, tree_nets(decl), p);
+
+            if (p->comb && !trigger) {
+               p->names = xrealloc(p->names,
+                                   (p->nnames + 1) * sizeof(tree_t));
+               p->names[p->nnames++] = (slice != NULL) ? slice->name : ref;
+            }
+         }
+         break;
+
+      case T_VAR_DECL:
+      case T_FILE_DECL:
+         // Shared variables and files are not visible to the scheduler
+         if (hash_get(ctx->locals, decl) == NULL)
+            p->comb = false;
+         break;
+
+      case T_ALIAS:
+         p->comb = false;
+         break;
+
+      default:
+         break;
+      }
+   }
+
+   p->nreads = ctx->reads.count - p->first_read;
+   p->nsens  = ctx->sens.count - p->first_sens;
+
+   // Something like an implicit 'TRANSACTION signal process whose value
+   // depends only on its previous value is not combinational
+   if (p->comb && p->nnames == 0 && tree_triggers(wait) > 0)
+      p->comb = false;
+
+   hash_iter_t it = HASH_BEGIN;
+   const void *key;
+   void *value;
+   while (hash_iter(ctx->narrow, &it, &key, &value))
+      free(value);
+
+   hash_free(ctx->targets);
+   hash_free(ctx->narrow);
+   hash_free(ctx->locals);
+}
+
+static netid_t *opt_span_sort(opt_span_list_t *list)
+{
+   // Sort spans by their first net and return the running maximum of
+   // the end of each span for use with opt_span_overlap
+
+   qsort(list->items, list->count, sizeof(opt_span_t), opt_span_cmp);
+
+   netid_t *max_end = xmalloc(MAX(list->count, 1) * sizeof(netid_t));
+   for (unsigned i = 0; i < list->count; i++) {
+      const netid_t end = list->items[i].first + list->items[i].count;
+      max_end[i] = (i > 0) ? MAX(max_end[i - 1], end) : end;
+   }
+
+   return max_end;
+}
+
+static int opt_span_overlap(const opt_span_list_t *list,
+                            const netid_t *max_end, netid_t first,
+                            unsigned count, int from)
+{
+   // Return the index of the next span before `from' which overlaps the
+   // given range or -1 if there are no more: pass from = list->count to
+   // begin a new search
+
+   if (from == list->count) {
+      // Find the first span starting after the end of the range
+      unsigned low = 0, high = list->count;
+      while (low < high) {
+         const unsigned mid = (low + high) / 2;
+         if (list->items[mid].first < first + count)
+            low = mid + 1;
+         else
+            high = mid;
+      }
+      from = low;
+   }
+
+   for (int j = from - 1; j >= 0 && max_end[j] > first; j--) {
+      if (list->items[j].first + list->items[j].count > first)
+         return j;
+   }
+
+   return -1;
+}
+
+static void opt_level_edges(const opt_span_list_t *writes,
+                            const netid_t *max_end,
+                            const opt_span_list_t *reads)
+{
+   // Add an edge from each combinational process driving a net to each
+   // combinational process that reads it
+
+   for (unsigned i = 0; i < reads->count; i++) {
+      const opt_span_t *r = &(reads->items[i]);
+      if (!r->proc->comb)
+         continue;
+
+      int j = writes->count;
+      while ((j = opt_span_overlap(writes, max_end, r->first,
+                                   r->count, j)) != -1) {
+         if (writes->items[j].proc->comb)
+            opt_level_add_succ(writes->items[j].proc, r->proc);
+      }
+   }
+}
+
+static bool opt_span_overlap_decl(const opt_span_list_t *list,
+                                  const netid_t *max_end, tree_t decl)
+{
+   // True if any net of the signal is covered by a span in the list
+
+   const int nnets = tree_nets(decl);
+   for (int offset = 0; offset < nnets; ) {
+      unsigned length;
+      netid_t first = tree_net_run(decl, offset, &length);
+      length = MIN(length, nnets - offset);
+      if (opt_span_overlap(list, max_end, first, length, list->count) != -1)
+         return true;
+      offset += length;
+   }
+
+   return false;
+}
+
+static opt_proc_t *opt_level_writer(const opt_span_list_t *writes,
+                                    const netid_t *max_end, tree_t decl)
+{
+   // Return the only process driving the signal or NULL if there is
+   // more than one or none
+
+   opt_proc_t *writer = NULL;
+
+   const int nnets = tree_nets(decl);
+   for (int offset = 0; offset < nnets; ) {
+      unsigned length;
+      netid_t first = tree_net_run(decl, offset, &length);
+      length = MIN(length, nnets - offset);
+
+      int j = writes->count;
+      while ((j = opt_span_overlap(writes, max_end, first, length, j)) != -1) {
+         if (writer == NULL)
+            writer = writes->items[j].proc;
+         else if (writer != writes->items[j].proc)
+            return NULL;
+      }
+
+      offset += length;
+   }
+
+   return writer;
+}
+
+static void opt_level_signals(tree_t top, opt_level_ctx_t *ctx,
+                              const netid_t *wmax, bool *comb)
+{
+   // Find the nets with a single levelised driver which are not read by
+   // any other process
+
+   if (ctx->opaque)
+      return;
+
+   opt_span_list_t external = {};
+   for (int pass = 0; pass < 2; pass++) {
+      const opt_span_list_t *list = pass ? &(ctx->sens) : &(ctx->reads);
+      for (unsigned i = 0; i < list->count; i++) {
+         const opt_span_t *r = &(list->items[i]);
+         if (r->proc->level < 0)
+            opt_span_add(&external, r->first, r->count, r->proc);
+      }
+   }
+
+   netid_t *max_end = opt_span_sort(&external);
+
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         continue;
+
+      const int nnets = tree_nets(d);
+      if (nnets == 0)
+         continue;
+
+      opt_proc_t *writer = opt_level_writer(&(ctx->writes), wmax, d);
+      const bool is_comb = writer != NULL && writer->level >= 0
+         && !opt_span_overlap_decl(&external, max_end, d);
+
+      for (int j = 0; j < nnets; j++)
+         comb[tree_net(d, j)] = is_comb;
+   }
+
+   free(external.items);
+   free(max_end);
+}
+
+static bool opt_level_inputs(opt_level_ctx_t *ctx, opt_proc_t *p,
+                             const opt_span_t *spans, unsigned count,
+                             const netid_t *wmax, const bool *comb,
+                             int *depth, bool *external)
+{
+   for (unsigned i = 0; i < count; i++) {
+      const opt_span_t *r = &(spans[i]);
+
+      int j = ctx->writes.count;
+      while ((j = opt_span_overlap(&(ctx->writes), wmax, r->first,
+                                   r->count, j)) != -1) {
+         const opt_span_t *w = &(ctx->writes.items[j]);
+         const netid_t nid = MAX(r->first, w->first);
+
+         if (w->proc == p)
+            return false;
+         else if (w->proc->level >= 0 && comb[nid]) {
+            if (*depth == -1)
+               *depth = w->proc->level;
+            else if (*depth != w->proc->level)
+               return false;
+         }
+         else
+            *external = true;
+      }
+   }
+
+   return true;
+}
+
+static int opt_level_depth(opt_level_ctx_t *ctx, opt_proc_t *p,
+                           const netid_t *wmax, const bool *comb)
+{
+   // The depth of a process is one more than that of the levelised
+   // processes which drive the nets it reads or -1 if these are not all
+   // at the same depth or it also reads any other signal
+
+   bool external = false;
+   int depth = -1;
+
+   const opt_span_t *reads = ctx->reads.items + p->first_read;
+   if (!opt_level_inputs(ctx, p, reads, p->nreads, wmax, comb,
+                         &depth, &external))
+      return -1;
+
+   // The sensitivity list of a process whose transactions can be seen
+   // is left alone so each signal in it must be treated as if read
+   const opt_span_t *sens = ctx->sens.items + p->first_sens;
+   if (p->observed && !opt_level_inputs(ctx, p, sens, p->nsens, wmax,
+                                        comb, &depth, &external))
+      return -1;
+
+   if (depth == -1)
+      return 0;
+   else if (external)
+      return -1;
+   else
+      return depth + 1;
+}
+
+static tree_t opt_level_wait_fn(tree_t t, void *context)
+{
+   opt_proc_t *p = context;
+
+   if (tree_kind(t) != T_WAIT)
+      return t;
+
+   tree_t wait = tree_new(T_WAIT);
+   tree_set_loc(wait, tree_loc(t));
+   tree_set_ident(wait, tree_ident(t));
+   tree_add_attr_int(wait, static_i, 1);
+
+   for (unsigned i = 0; i < p->nnames; i++) {
+      bool dup = false;
+      for (unsigned j = 0; j < i && !dup; j++)
+         dup = (p->names[j] == p->names[i]);
+
+      if (!dup)
+         tree_add_trigger(wait, p->names[i]);
+   }
+
+   return wait;
+}
+
+static void opt_levelise(tree_t top)
+{
+   const int nstmts = tree_stmts(top);
+   const int nnets = tree_attr_int(top, nnets_i, 0);
+   if (nstmts == 0 || nnets == 0)
+      return;
+
+   opt_level_ctx_t ctx = {};
+
+   opt_proc_t *procs = xmalloc(nstmts * sizeof(opt_proc_t));
+   for (int i = 0; i < nstmts; i++) {
+      procs[i].process = tree_stmt(top, i);
+      opt_level_process(&ctx, &(procs[i]));
+   }
+
+   // Transactions from a process are visible if anything reads an
+   // attribute such as 'ACTIVE of a signal it drives
+   netid_t *amax = opt_span_sort(&(ctx.active));
+   for (unsigned i = 0; i < ctx.writes.count; i++) {
+      opt_span_t *w = &(ctx.writes.items[i]);
+      if (opt_span_overlap(&(ctx.active), amax, w->first, w->count,
+                           ctx.active.count) != -1)
+         w->proc->observed = true;
+   }
+
+   netid_t *wmax = opt_span_sort(&(ctx.writes));
+
+   opt_level_edges(&(ctx.writes), wmax, &(ctx.reads));
+
+   // Kahn's algorithm: anything left with a non-zero in-degree is on or
+   // downstream of a cycle and keeps the normal scheduling
+   opt_proc_t **queue = xmalloc(nstmts * sizeof(opt_proc_t *));
+   int qhead = 0, qtail = 0;
+   for (int i = 0; i < nstmts; i++) {
+      if (procs[i].comb && procs[i].indegree == 0)
+         queue[qtail++] = &(procs[i]);
+   }
+
+   while (qhead < qtail) {
+      opt_proc_t *p = queue[qhead++];
+      p->level = 0;
+
+      for (unsigned i = 0; i < p->nsuccs; i++) {
+         opt_proc_t *s = p->succs[i];
+         if (--(s->indegree) == 0)
+            queue[qtail++] = s;
+      }
+   }
+
+   // Removing a process which cannot be given a consistent depth makes
+   // it an outside reader of the signals it reads so repeat until no
+   // more are removed
+   bool *comb = xcalloc(nnets * sizeof(bool));
+   bool changed;
+   do {
+      opt_level_signals(top, &ctx, wmax, comb);
+
+      changed = false;
+      for (int i = 0; i < qtail; i++) {
+         opt_proc_t *p = queue[i];
+         if (p->level >= 0) {
+            p->level = opt_level_depth(&ctx, p, wmax, comb);
+            changed = changed || (p->level < 0);
+         }
+      }
+   } while (changed);
+
+   for (int i = 0; i < qtail; i++) {
+      opt_proc_t *p = queue[i];
+      if (p->level < 0)
+         continue;
+
+      tree_add_attr_int(p->process, comb_level_i, p->level);
+
+      if (!p->observed)
+         tree_rewrite(p->process, opt_level_wait_fn, p);
+   }
+
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) == T_SIGNAL_DECL && tree_nets(d) > 0
+          && comb[tree_net(d, 0)])
+         tree_add_attr_int(d, comb_net_i, 1);
+   }
+
+   for (int i = 0; i < nstmts; i++) {
+      free(procs[i].succs);
+      free(procs[i].names);
+   }
+
+   free(ctx.reads.items);
+   free(ctx.sens.items);
+   free(ctx.active.items);
+   free(ctx.writes.items);
+   free(ctx.refs);
+   free(wmax);
+   free(amax);
+   free(comb);
+   free(queue);
+   free(procs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Restrict clocked processes to wake only on the active edge
+//
+//   process (clk) is
+//   begin
+//     if rising_edge(clk) then
+//       ...
+//     end if;
+//   end process;
+//
+// A process sensitive to a single scalar signal whose body is guarded by
+// a condition on the new value of that signal does nothing when woken by
+// any other value. The static wait is tagged with the set of enumeration
+// positions for which the condition may hold and the kernel checks this
+// before waking the process. Only conjuncts before the first one which
+// constrains the value are inspected as anything else may have side
+// effects.
+//
+
+static bool opt_edge_is_signal(tree_t expr, tree_t signal)
+{
+   return (tree_kind(expr) == T_REF) && (tree_ref(expr) == signal);
+}
+
+static uint32_t opt_edge_literals(type_t type, const char *lit1,
+                                  const char *lit2)
+{
+   type_t base = type_base_recur(type);
+
+   uint32_t mask = 0;
+   const int nlits = type_enum_literals(base);
+   for (int i = 0; i < nlits; i++) {
+      const char *name = istr(tree_ident(type_enum_literal(base, i)));
+      if (strcmp(name, lit1) == 0 || strcmp(name, lit2) == 0)
+         mask |= (1 << i);
+   }
+
+   return mask;
+}
+
+static bool opt_edge_conjunct(tree_t expr, tree_t signal, uint32_t *mask)
+{
+   // Returns false if this conjunct is not understood otherwise narrows
+   // the set of values for which it may be true
+
+   switch (tree_kind(expr)) {
+   case T_ATTR_REF:
+      return (tree_attr_int(expr, builtin_i, -1) == ATTR_EVENT)
+         && opt_edge_is_signal(tree_name(expr), signal);
+
+   case T_FCALL:
+      {
+         tree_t decl = tree_ref(expr);
+         ident_t builtin = tree_attr_str(decl, builtin_i);
+         const int nparams = tree_params(expr);
+
+         if (builtin == ident_new("and") && nparams == 2) {
+            tree_t left  = tree_value(tree_param(expr, 0));
+            tree_t right = tree_value(tree_param(expr, 1));
+
+            // The right hand side is only evaluated if the left is true
+            if (!opt_edge_conjunct(left, signal, mask))
+               return false;
+            else if (*mask != ~0u)
+               return true;
+            else
+               return opt_edge_conjunct(right, signal, mask);
+         }
+         else if (builtin == ident_new("eq") && nparams == 2) {
+            tree_t left  = tree_value(tree_param(expr, 0));
+            tree_t right = tree_value(tree_param(expr, 1));
+
+            tree_t lit = NULL;
+            if (opt_edge_is_signal(left, signal))
+               lit = right;
+            else if (opt_edge_is_signal(right, signal))
+               lit = left;
+
+            if (lit == NULL || tree_kind(lit) != T_REF
+                || tree_kind(tree_ref(lit)) != T_ENUM_LIT)
+               return false;
+
+            *mask &= (1 << tree_pos(tree_ref(lit)));
+            return true;
+         }
+         else if (builtin == NULL && nparams == 1
+                  && opt_edge_is_signal(tree_value(tree_param(expr, 0)),
+                                        signal)) {
+            // RISING_EDGE and FALLING_EDGE use To_X01 on the new value
+            ident_t name = tree_ident(decl);
+            type_t type = tree_type(signal);
+            if (name == ident_new("IEEE.STD_LOGIC_1164.RISING_EDGE"))
+               *mask &= opt_edge_literals(type, "'1'", "'H'");
+            else if (name == ident_new("IEEE.STD_LOGIC_1164.FALLING_EDGE"))
+               *mask &= opt_edge_literals(type, "'0'", "'L'");
+            else
+               return false;
+
+            return true;
+         }
+         else
+            return false;
+      }
+
+   default:
+      return false;
+   }
+}
+
+static void opt_edge_process(tree_t process)
+{
+   if (tree_attr_int(process, postponed_i, 0)
+       || tree_attr_int(process, comb_level_i, -1) >= 0)
+      return;
+
+   if (tree_stmts(process) != 2)
+      return;
+
+   tree_t guard = tree_stmt(process, 0);
+   tree_t wait  = tree_stmt(process, 1);
+
+   if (tree_kind(guard) != T_IF || tree_else_stmts(guard) > 0)
+      return;
+
+   if (tree_kind(wait) != T_WAIT || !tree_attr_int(wait, static_i, 0)
+       || tree_has_delay(wait) || tree_has_value(wait)
+       || tree_triggers(wait) != 1)
+      return;
+
+   tree_t trigger = tree_trigger(wait, 0);
+   if (tree_kind(trigger) != T_REF)
+      return;
+
+   tree_t signal = tree_ref(trigger);
+   if (tree_kind(signal) != T_SIGNAL_DECL)
+      return;
+
+   type_t type = tree_type(signal);
+   if (!type_is_enum(type)
+       || type_enum_literals(type_base_recur(type)) > SCHED_EDGE_MAX)
+      return;
+
+   uint32_t mask = ~0u;
+   if (!opt_edge_conjunct(tree_value(guard), signal, &mask) || mask == ~0u)
+      return;
+
+   tree_add_attr_int(wait, edge_i, mask);
+}
+
+static void opt_edge(tree_t top)
+{
+   const int nstmts = tree_stmts(top);
+   for (int i = 0; i < nstmts; i++)
+      opt_edge_process(tree_stmt(top, i));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Detect free-running clock generators
+//
+//   clk <= not clk after 5 ns;
+//
+//   process is
+//   begin
+//     clk <= '0';
+//     wait for 5 ns;
+//     clk <= '1';
+//     wait for 5 ns;
+//   end process;
+//
+// These are tagged with the "clock" attribute and the kernel toggles the
+// signal directly from a periodic event without running the process. The
+// first form updates the signal at the start of each period and the
+// second one delta cycle later. At most two phases are recognised.
+//
+
+static bool opt_clock_value(tree_t value, tree_t signal)
+{
+   // Either a literal or NOT applied to the signal itself
+   unsigned pos;
+   if (folded_enum(value, &pos))
+      return true;
+   else if (tree_kind(value) == T_FCALL && tree_params(value) == 1) {
+      tree_t decl = tree_ref(value);
+      return (tree_attr_str(decl, builtin_i) == ident_new("not"))
+         && opt_edge_is_signal(tree_value(tree_param(value, 0)), signal);
+   }
+   else
+      return false;
+}
+
+static bool opt_clock_delay(tree_t delay)
+{
+   int64_t value;
+   return folded_int(delay, &value) && (value > 0);
+}
+
+static tree_t opt_clock_assign(tree_t stmt, tree_t signal, bool after)
+{
+   if (tree_kind(stmt) != T_SIGNAL_ASSIGN || tree_waveforms(stmt) != 1)
+      return NULL;
+
+   tree_t target = tree_target(stmt);
+   if (tree_kind(target) != T_REF)
+      return NULL;
+
+   tree_t decl = tree_ref(target);
+   if (tree_kind(decl) != T_SIGNAL_DECL)
+      return NULL;
+   else if (signal != NULL && decl != signal)
+      return NULL;
+
+   type_t type = tree_type(decl);
+   if (!type_is_enum(type) || type_enum_literals(type_base_recur(type)) > 256)
+      return NULL;
+
+   tree_t wave = tree_waveform(stmt, 0);
+   if (!opt_clock_value(tree_value(wave), decl))
+      return NULL;
+   else if (after != tree_has_delay(wave))
+      return NULL;
+   else if (after && !opt_clock_delay(tree_delay(wave)))
+      return NULL;
+
+   if (tree_has_reject(stmt)) {
+      // A concurrent assignment has an inertial reject limit equal to
+      // the delay but there is never more than one pending transaction
+      int64_t reject, delay;
+      if (!after || !folded_int(tree_reject(stmt), &reject)
+          || !folded_int(tree_delay(wave), &delay) || reject > delay)
+         return NULL;
+   }
+
+   return decl;
+}
+
+static void opt_clock_process(tree_t process)
+{
+   if (tree_attr_int(process, postponed_i, 0)
+       || tree_attr_int(process, comb_level_i, -1) >= 0
+       || tree_decls(process) > 0)
+      return;
+
+   const int nstmts = tree_stmts(process);
+   if (nstmts == 2 && tree_attr_int(tree_stmt(process, 1), static_i, 0)) {
+      // Concurrent assignment with a delay sensitive to its own target
+      tree_t signal = opt_clock_assign(tree_stmt(process, 0), NULL, true);
+      if (signal == NULL)
+         return;
+
+      tree_t wait = tree_stmt(process, 1);
+      if (tree_kind(wait) != T_WAIT || tree_has_delay(wait)
+          || tree_has_value(wait) || tree_triggers(wait) != 1
+          || !opt_edge_is_signal(tree_trigger(wait, 0), signal))
+         return;
+
+      tree_add_attr_int(process, clock_i, 1);
+   }
+   else if (nstmts == 2 || nstmts == 4) {
+      // Loop of assignments each followed by a wait for a fixed time
+      tree_t signal = NULL;
+      for (int i = 0; i < nstmts; i += 2) {
+         if ((signal = opt_clock_assign(tree_stmt(process, i),
+                                        signal, false)) == NULL)
+            return;
+
+         tree_t wait = tree_stmt(process, i + 1);
+         if (tree_kind(wait) != T_WAIT || !tree_has_delay(wait)
+             || tree_has_value(wait) || tree_triggers(wait) > 0
+             || !opt_clock_delay(tree_delay(wait)))
+            return;
+      }
+
+      tree_add_attr_int(process, clock_i, nstmts / 2);
+   }
+}
+
+static void opt_clock(tree_t top)
+{
+   const int nstmts = tree_stmts(top);
+   for (int i = 0; i < nstmts; i++)
+      opt_clock_process(tree_stmt(top, i));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Fuse processes with identical static sensitivity
+//
+//   process (clk) is              process (clk) is
+//   begin                         begin
+//     a <= x;                       a <= x;
+//   end process;          =>        b <= y;
+//                                 end process;
+//   process (clk) is
+//   begin
+//     b <= y;
+//   end process;
+//
+// Processes whose only wait is at the end and sensitive to the same set of
+// signals always run in the same delta cycle so their bodies can be
+// executed one after another by a single process. Each process has its
+// own drivers so two processes which assign the same signal are not fused.
+// The original processes are chained from the fused process with the
+// "fused" attribute and each assertion is tagged with the process it came
+// from so messages still name the original process.
+//
+
+#define OPT_FUSE_MAX 64
+
+typedef struct {
+   tree_t    process;
+   int       index;
+   tree_t   *sens;
+   unsigned  nsens;
+   unsigned  edge;
+   tree_t   *targets;
+   unsigned  ntargets;
+   unsigned  maxtargets;
+   unsigned  nwaits;
+   bool      ok;
+} opt_fuse_t;
+
+static void opt_fuse_add_target(opt_fuse_t *f, tree_t decl)
+{
+   if (f->ntargets == f->maxtargets) {
+      f->maxtargets = MAX(f->maxtargets * 2, 4);
+      f->targets = xrealloc(f->targets, f->maxtargets * sizeof(tree_t));
+   }
+
+   f->targets[f->ntargets++] = decl;
+}
+
+static void opt_fuse_visit_fn(tree_t t, void *context)
+{
+   opt_fuse_t *f = context;
+
+   switch (tree_kind(t)) {
+   case T_WAIT:
+      f->nwaits++;
+      break;
+
+   case T_SIGNAL_ASSIGN:
+      {
+         tree_t ref = opt_level_prefix(tree_target(t));
+         if (ref == NULL)
+            f->ok = false;   // Aggregate targets are not analysed
+         else
+            opt_fuse_add_target(f, tree_ref(ref));
+      }
+      break;
+
+   case T_PCALL:
+      {
+         // A procedure which waits would suspend every fused process and
+         // one with signal parameters may create drivers
+         tree_t decl = tree_ref(t);
+         if (tree_attr_int(decl, wait_level_i, WAITS_MAYBE) != WAITS_NO)
+            f->ok = false;
+         else {
+            const int nports = tree_ports(decl);
+            for (int i = 0; i < nports; i++) {
+               if (tree_class(tree_port(decl, i)) == C_SIGNAL)
+                  f->ok = false;
+            }
+         }
+      }
+      break;
+
+   default:
+      break;
+   }
+}
+
+static int opt_fuse_ptr_cmp(const void *a, const void *b)
+{
+   const uintptr_t pa = (uintptr_t)*(const tree_t *)a;
+   const uintptr_t pb = (uintptr_t)*(const tree_t *)b;
+   return (pa > pb) - (pa < pb);
+}
+
+static bool opt_fuse_candidate(opt_fuse_t *f)
+{
+   tree_t process = f->process;
+
+   if (tree_attr_int(process, postponed_i, 0)
+       || tree_attr_int(process, comb_level_i, -1) >= 0
+       || tree_attr_int(process, clock_i, 0) > 0)
+      return false;
+
+   // Local subprograms and types are named after the enclosing process
+   const int ndecls = tree_decls(process);
+   for (int i = 0; i < ndecls; i++) {
+      const tree_kind_t kind = tree_kind(tree_decl(process, i));
+      if ((kind != T_VAR_DECL) && (kind != T_CONST_DECL))
+         return false;
+   }
+
+   const int nstmts = tree_stmts(process);
+   if (nstmts == 0)
+      return false;
+
+   tree_t wait = tree_stmt(process, nstmts - 1);
+   if (tree_kind(wait) != T_WAIT || !tree_attr_int(wait, static_i, 0)
+       || tree_has_delay(wait) || tree_has_value(wait))
+      return false;
+
+   const int ntriggers = tree_triggers(wait);
+   if (ntriggers == 0)
+      return false;
+
+   // Processes woken on different edges cannot share a wait
+   f->edge = tree_attr_int(wait, edge_i, 0);
+
+   f->sens = xmalloc(ntriggers * sizeof(tree_t));
+   for (int i = 0; i < ntriggers; i++) {
+      tree_t trigger = tree_trigger(wait, i);
+      if (tree_kind(trigger) != T_REF)
+         return false;
+      f->sens[f->nsens++] = tree_ref(trigger);
+   }
+
+   qsort(f->sens, f->nsens, sizeof(tree_t), opt_fuse_ptr_cmp);
+
+   unsigned nsens = 1;
+   for (unsigned i = 1; i < f->nsens; i++) {
+      if (f->sens[i] != f->sens[nsens - 1])
+         f->sens[nsens++] = f->sens[i];
+   }
+   f->nsens = nsens;
+
+   f->ok = true;
+   tree_visit(process, opt_fuse_visit_fn, f);
+
+   return f->ok && (f->nwaits == 1);
+}
+
+static int opt_fuse_cmp(const void *a, const void *b)
+{
+   const opt_fuse_t *fa = *(const opt_fuse_t **)a;
+   const opt_fuse_t *fb = *(const opt_fuse_t **)b;
+
+   if (fa->nsens != fb->nsens)
+      return (fa->nsens > fb->nsens) - (fa->nsens < fb->nsens);
+   else if (fa->edge != fb->edge)
+      return (fa->edge > fb->edge) - (fa->edge < fb->edge);
+
+   for (unsigned i = 0; i < fa->nsens; i++) {
+      const int cmp = opt_fuse_ptr_cmp(&(fa->sens[i]), &(fb->sens[i]));
+      if (cmp != 0)
+         return cmp;
+   }
+
+   return fa->index - fb->index;
+}
+
+static bool opt_fuse_same_sens(const opt_fuse_t *a, const opt_fuse_t *b)
+{
+   return (a->nsens == b->nsens) && (a->edge == b->edge)
+      && (memcmp(a->sens, b->sens, a->nsens * sizeof(tree_t)) == 0);
+}
+
+static void opt_fuse_tag_fn(tree_t t, void *context)
+{
+   tree_add_attr_tree(t, fused_i, (tree_t)context);
+}
+
+static tree_t opt_fuse_build(opt_fuse_t **members, int count)
+{
+   tree_t first = members[0]->process;
+
+   tree_t fused = tree_new(T_PROCESS);
+   tree_set_ident(fused, tree_ident(first));
+   tree_set_loc(fused, tree_loc(first));
+
+   for (int i = 0; i < count; i++) {
+      tree_t p = members[i]->process;
+
+      const int ndecls = tree_decls(p);
+      for (int j = 0; j < ndecls; j++)
+         tree_add_decl(fused, tree_decl(p, j));
+
+      const int nstmts = tree_stmts(p);
+      for (int j = 0; j < nstmts - 1; j++)
+         tree_add_stmt(fused, tree_stmt(p, j));
+
+      tree_visit_only(p, opt_fuse_tag_fn, p, T_ASSERT);
+
+      if (i + 1 < count)
+         tree_add_attr_tree(p, fused_i, members[i + 1]->process);
+   }
+
+   tree_add_stmt(fused, tree_stmt(first, tree_stmts(first) - 1));
+   tree_add_attr_tree(fused, fused_i, first);
+
+   return fused;
+}
+
+static void opt_fuse_group(opt_fuse_t **members, int count, hash_t *map)
+{
+   // Greedily pick processes in order that do not share any driven
+   // signals with those already picked and repeat with the remainder
+   opt_fuse_t **pick = xmalloc(count * sizeof(opt_fuse_t *));
+   opt_fuse_t **rest = xmalloc(count * sizeof(opt_fuse_t *));
+
+   while (count > 1) {
+      hash_t *driven = hash_new(64, true);
+      int npick = 0, nrest = 0;
+
+      for (int i = 0; i < count; i++) {
+         opt_fuse_t *f = members[i];
+
+         bool clash = (npick == OPT_FUSE_MAX);
+         for (unsigned j = 0; !clash && j < f->ntargets; j++)
+            clash = (hash_get(driven, f->targets[j]) != NULL);
+
+         if (clash)
+            rest[nrest++] = f;
+         else {
+            for (unsigned j = 0; j < f->ntargets; j++)
+               hash_put(driven, f->targets[j], f);
+            pick[npick++] = f;
+         }
+      }
+
+      hash_free(driven);
+
+      if (npick > 1) {
+         tree_t fused = opt_fuse_build(pick, npick);
+         for (int i = 0; i < npick; i++)
+            hash_put(map, pick[i]->process, fused);
+      }
+
+      memcpy(members, rest, nrest * sizeof(opt_fuse_t *));
+      count = nrest;
+   }
+
+   free(pick);
+   free(rest);
+}
+
+static tree_t opt_fuse_rewrite_fn(tree_t t, void *context)
+{
+   if (tree_kind(t) != T_PROCESS)
+      return t;
+
+   tree_t fused = hash_get((hash_t *)context, t);
+   if (fused == NULL)
+      return t;
+   else if (tree_attr_tree(fused, fused_i) == t)
+      return fused;   // Replaces the first process in the group
+   else
+      return NULL;
+}
+
+static void opt_fuse(tree_t top)
+{
+   const int nstmts = tree_stmts(top);
+   if (nstmts < 2)
+      return;
+
+   opt_fuse_t *all = xcalloc(nstmts * sizeof(opt_fuse_t));
+   opt_fuse_t **cands = xmalloc(nstmts * sizeof(opt_fuse_t *));
+   int ncands = 0;
+
+   for (int i = 0; i < nstmts; i++) {
+      all[i].process = tree_stmt(top, i);
+      all[i].index   = i;
+      if (opt_fuse_candidate(&(all[i])))
+         cands[ncands++] = &(all[i]);
+   }
+
+   qsort(cands, ncands, sizeof(opt_fuse_t *), opt_fuse_cmp);
+
+   hash_t *map = hash_new(ncands * 2 + 16, true);
+   bool changed = false;
+
+   for (int i = 0; i < ncands; ) {
+      int j = i + 1;
+      while (j < ncands && opt_fuse_same_sens(cands[i], cands[j]))
+         j++;
+
+      if (j - i > 1) {
+         opt_fuse_group(&(cands[i]), j - i, map);
+         changed = true;
+      }
+
+      i = j;
+   }
+
+   if (changed)
+      tree_rewrite(top, opt_fuse_rewrite_fn, map);
+
+   for (int i = 0; i < nstmts; i++) {
+      free(all[i].sens);
+      free(all[i].targets);
+   }
+
+   hash_free(map);
+   free(cands);
+   free(all);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Demote signals whose events are never observed
+//
+//   process (clk) is
+//   begin
+//     if rising_edge(clk) then
+//       count <= count + 1;
+//     end if;
+//   end process;
+//
+// If no process waits on a signal and nothing reads an attribute such as
+// 'EVENT then the only visible effect of an assignment with no delay is
+// the new value one delta cycle later. These signals are tagged
+// "demoted" and the kernel writes the value straight into the driver and
+// commits it once every process in the delta cycle has run rather than
+// scheduling a transaction. Signals assigned with a delay are excluded
+// as the pending transactions would be lost. Whether the signal has a
+// single driver and no resolution function is left to the kernel.
+//
+
+static void opt_demote_name(opt_span_list_t *events, tree_t name)
+{
+   // Mark the nets referenced by name as having observed events
+
+   int offset, width;
+   tree_t decl = opt_level_name(name, &offset, &width);
+   if (decl != NULL)
+      opt_span_add_decl(events, decl, offset, width, NULL);
+   else if ((name = opt_level_prefix(name)) != NULL) {
+      tree_t alias = tree_ref(name);
+      if (tree_kind(alias) == T_ALIAS)
+         opt_demote_name(events, tree_value(alias));
+   }
+}
+
+static void opt_demote_refs_fn(tree_t t, void *context)
+{
+   if (tree_kind(t) == T_REF)
+      opt_demote_name(context, t);
+}
+
+static void opt_demote_actuals(opt_span_list_t *events, tree_t call)
+{
+   // A signal parameter could be waited on or have its attributes read
+   // in the subprogram body
+
+   tree_t decl = tree_ref(call);
+   const int nports = tree_ports(decl);
+   for (int i = 0; i < nports; i++) {
+      if (tree_class(tree_port(decl, i)) == C_SIGNAL)
+         tree_visit(tree_value(tree_param(call, i)), opt_demote_refs_fn,
+                    events);
+   }
+}
+
+static bool opt_demote_no_delay(tree_t stmt)
+{
+   if (tree_waveforms(stmt) != 1)
+      return false;
+
+   tree_t wave = tree_waveform(stmt, 0);
+   if (!tree_has_delay(wave))
+      return true;
+
+   int64_t delay;
+   return folded_int(tree_delay(wave), &delay) && (delay == 0);
+}
+
+static bool opt_demote_signal_attr(tree_t t)
+{
+   switch (tree_attr_int(t, builtin_i, -1)) {
+   case ATTR_EVENT:
+   case ATTR_ACTIVE:
+   case ATTR_LAST_EVENT:
+   case ATTR_LAST_ACTIVE:
+   case ATTR_LAST_VALUE:
+   case ATTR_DELAYED:
+   case ATTR_STABLE:
+   case ATTR_QUIET:
+   case ATTR_TRANSACTION:
+   case ATTR_DRIVING:
+   case ATTR_DRIVING_VALUE:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static void opt_demote_visit_fn(tree_t t, void *context)
+{
+   opt_span_list_t *events = context;
+
+   switch (tree_kind(t)) {
+   case T_WAIT:
+      {
+         const int ntriggers = tree_triggers(t);
+         for (int i = 0; i < ntriggers; i++)
+            opt_demote_name(events, tree_trigger(t, i));
+      }
+      break;
+
+   case T_ATTR_REF:
+      if (opt_demote_signal_attr(t))
+         opt_demote_name(events, tree_name(t));
+      break;
+
+   case T_SIGNAL_ASSIGN:
+      if (!opt_demote_no_delay(t)) {
+         tree_t target = tree_target(t);
+         if (tree_kind(target) == T_AGGREGATE)
+            tree_visit(target, opt_demote_refs_fn, events);
+         else
+            opt_demote_name(events, target);
+      }
+      break;
+
+   case T_FCALL:
+   case T_PCALL:
+      opt_demote_actuals(events, t);
+      break;
+
+   default:
+      break;
+   }
+}
+
+static void opt_demote(tree_t top)
+{
+   opt_span_list_t events = {};
+
+   const int nstmts = tree_stmts(top);
+   for (int i = 0; i < nstmts; i++)
+      tree_visit(tree_stmt(top, i), opt_demote_visit_fn, &events);
+
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++)
+      tree_visit(tree_decl(top, i), opt_demote_visit_fn, &events);
+
+   netid_t *max_end = opt_span_sort(&events);
+
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         continue;
+
+      if (tree_nets(d) > 0 && !opt_span_overlap_decl(&events, max_end, d))
+         tree_add_attr_int(d, demoted_i, 1);
+   }
+
+   free(events.items);
+   free(max_end);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Identify signals used as memories
+//
+//   signal mem : mem_t(0 to 65535);
+//   ...
+//   mem(addr) <= data;
+//
+// Assigning or waiting on an element with an index only known at run
+// time would normally split the signal into one net group per element.
+// A large one dimensional array signal indexed this way and driven by a
+// single process is instead kept as one group and tagged "memory" with
+// the number of nets in each element. The kernel then records which
+// elements have been written in each delta cycle and only compares and
+// wakes processes for those. Attributes such as 'EVENT would refer to the
+// whole signal so signals which use them are not treated as memories.
+//
+
+#define OPT_MEMORY_MIN_WORDS 64
+
+typedef struct {
+   tree_t process;
+   bool   dynamic;
+   bool   ok;
+} opt_memory_t;
+
+typedef struct {
+   hash_t *signals;
+   tree_t  process;
+} opt_memory_ctx_t;
+
+static opt_memory_t *opt_memory_get(opt_memory_ctx_t *ctx, tree_t name)
+{
+   tree_t ref = opt_level_prefix(name);
+   if (ref == NULL)
+      return NULL;
+
+   return hash_get(ctx->signals, tree_ref(ref));
+}
+
+static bool opt_memory_dynamic(tree_t name)
+{
+   for (; tree_kind(name) != T_REF; name = tree_value(name)) {
+      if (tree_kind(name) == T_ARRAY_REF
+          && tree_kind(tree_value(tree_param(name, 0))) != T_LITERAL)
+         return true;
+   }
+
+   return false;
+}
+
+static void opt_memory_access(opt_memory_ctx_t *ctx, tree_t name)
+{
+   opt_memory_t *m = opt_memory_get(ctx, name);
+   if (m != NULL && opt_memory_dynamic(name))
+      m->dynamic = true;
+}
+
+static void opt_memory_reject_fn(tree_t t, void *context)
+{
+   if (tree_kind(t) == T_REF) {
+      opt_memory_t *m = hash_get(((opt_memory_ctx_t *)context)->signals,
+                                 tree_ref(t));
+      if (m != NULL)
+         m->ok = false;
+   }
+}
+
+static void opt_memory_assign(opt_memory_ctx_t *ctx, tree_t stmt)
+{
+   tree_t target = tree_target(stmt);
+   opt_memory_t *m = opt_memory_get(ctx, target);
+   if (m == NULL) {
+      if (tree_kind(target) == T_AGGREGATE)
+         tree_visit(target, opt_memory_reject_fn, ctx);
+      return;
+   }
+
+   // The kernel only tracks writes which take effect in the next delta
+   if (ctx->process == NULL || !opt_demote_no_delay(stmt))
+      m->ok = false;
+   else if (m->process == NULL)
+      m->process = ctx->process;
+   else if (m->process != ctx->process)
+      m->ok = false;
+
+   opt_memory_access(ctx, target);
+}
+
+static void opt_memory_visit_fn(tree_t t, void *context)
+{
+   opt_memory_ctx_t *ctx = context;
+
+   switch (tree_kind(t)) {
+   case T_SIGNAL_ASSIGN:
+      opt_memory_assign(ctx, t);
+      break;
+
+   case T_WAIT:
+      {
+         const int ntriggers = tree_triggers(t);
+         for (int i = 0; i < ntriggers; i++)
+            opt_memory_access(ctx, tree_trigger(t, i));
+      }
+      break;
+
+   case T_ATTR_REF:
+      if (opt_demote_signal_attr(t)) {
+         opt_memory_t *m = opt_memory_get(ctx, tree_name(t));
+         if (m != NULL)
+            m->ok = false;
+      }
+      break;
+
+   case T_FCALL:
+   case T_PCALL:
+      {
+         tree_t decl = tree_ref(t);
+         const int nports = tree_ports(decl);
+         for (int i = 0; i < nports; i++) {
+            if (tree_class(tree_port(decl, i)) == C_SIGNAL)
+               tree_visit(tree_value(tree_param(t, i)),
+                          opt_memory_reject_fn, ctx);
+         }
+      }
+      break;
+
+   case T_ALIAS:
+      tree_visit(tree_value(t), opt_memory_reject_fn, ctx);
+      break;
+
+   default:
+      break;
+   }
+}
+
+static bool opt_memory_candidate(tree_t decl)
+{
+   // Levelised updates are applied to the whole group
+   if (tree_attr_int(decl, comb_net_i, 0))
+      return false;
+
+   type_t type = tree_type(decl);
+   if (!type_is_array(type) || type_is_unconstrained(type)
+       || type_dims(type) != 1)
+      return false;
+
+   type_t elem = type_elem(type);
+   if (type_is_record(elem) || !type_known_width(elem))
+      return false;
+
+   const int nnets = tree_nets(decl);
+   if (nnets < OPT_MEMORY_MIN_WORDS * type_width(elem))
+      return false;
+
+   // The nets must form a single run for the signal to be one group
+   unsigned length;
+   tree_net_run(decl, 0, &length);
+   return length >= nnets;
+}
+
+static void opt_memory(tree_t top)
+{
+   opt_memory_ctx_t ctx = {
+      .signals = hash_new(64, true),
+      .process = NULL
+   };
+
+   opt_span_list_t nets = {};
+
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         continue;
+
+      opt_span_add_decl(&nets, d, 0, tree_nets(d), NULL);
+
+      if (opt_memory_candidate(d)) {
+         opt_memory_t *m = xmalloc(sizeof(opt_memory_t));
+         m->process = NULL;
+         m->dynamic = false;
+         m->ok      = true;
+         hash_put(ctx.signals, d, m);
+      }
+   }
+
+   const int nstmts = tree_stmts(top);
+   for (int i = 0; i < nstmts; i++) {
+      ctx.process = tree_stmt(top, i);
+      tree_visit(ctx.process, opt_memory_visit_fn, &ctx);
+   }
+
+   ctx.process = NULL;
+   for (int i = 0; i < ndecls; i++)
+      tree_visit(tree_decl(top, i), opt_memory_visit_fn, &ctx);
+
+   netid_t *max_end = opt_span_sort(&nets);
+
+   hash_iter_t it = HASH_BEGIN;
+   const void *key;
+   void *value;
+   while (hash_iter(ctx.signals, &it, &key, &value)) {
+      tree_t d = (tree_t)key;
+      opt_memory_t *m = value;
+
+      // Signals which share nets with a port cannot be kept as one group
+      unsigned length;
+      netid_t first = tree_net_run(d, 0, &length);
+      int overlaps = 0, j = nets.count;
+      while ((j = opt_span_overlap(&nets, max_end, first,
+                                   tree_nets(d), j)) != -1)
+         overlaps++;
+
+      if (m->ok && m->dynamic && overlaps == 1)
+         tree_add_attr_int(d, memory_i,
+                           type_width(type_elem(tree_type(d))));
+
+      free(m);
+   }
+
+   hash_free(ctx.signals);
+   free(nets.items);
+   free(max_end);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 static void opt_tag(tree_t t, void *ctx)
@@ -157,8 +2027,20 @@ static void opt_tag(tree_t t, void *ctx)
 
 void opt(tree_t top)
 {
-   if (tree_kind(top) == T_ELAB)
+   if (tree_kind(top) == T_ELAB) {
       opt_delete_wait_only(top);
 
+      if (opt_get_int("optimise") >= 3)
+         opt_levelise(top);
+
+      if (opt_get_int("optimise") >= 2) {
+         opt_clock(top);
+         opt_edge(top);
+         opt_fuse(top);
+         opt_demote(top);
+         opt_memory(top);
+      }
+   }
+
    tree_visit(top, opt_tag, NULL);
 }
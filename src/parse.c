@@ -4490,7 +4490,7 @@ static tree_t p_report_statement(ident_t label)
 
    consume(tSEMI);
 
-   tree_add_attr_int(t, ident_new("is_report"), 1);
+   tree_add_attr_int(t, is_report_i, 1);
 
    set_label_and_loc(t, label, CURRENT_LOC);
    return t;
@@ -4909,7 +4909,7 @@ static tree_t p_options(tree_t stmt)
    BEGIN("options");
 
    if (optional(tGUARDED))
-      tree_add_attr_int(stmt, ident_new("guarded"), 1);
+      tree_add_attr_int(stmt, guarded_i, 1);
 
    return p_delay_mechanism();
 }
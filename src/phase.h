@@ -39,6 +39,9 @@ int bounds_errors(void);
 // Evaluate a function call at compile time
 tree_t eval(tree_t fcall);
 
+// Number of calls folded from the result of an earlier identical call
+int eval_fold_hits(void);
+
 // Elaborate a top level entity
 tree_t elab(tree_t top);
 
@@ -85,4 +88,12 @@ int parse_errors(void);
 // Generate vcode for a design unit
 void lower_unit(tree_t unit);
 
+// Generate a vcode function which computes the value of an expression
+// for compile time evaluation or NULL if it cannot be lowered
+vcode_unit_t lower_thunk(tree_t expr);
+
+// Lower the body of a subprogram called from code generated by
+// lower_thunk or NULL if it cannot be evaluated
+vcode_unit_t lower_func(ident_t name);
+
 #endif  // _PHASE_H
@@ -61,7 +61,7 @@ typedef struct range {
 typedef struct tree_wr_ctx *tree_wr_ctx_t;
 typedef struct tree_rd_ctx *tree_rd_ctx_t;
 
-typedef struct trie *ident_t;
+typedef struct ident *ident_t;
 
 typedef struct vcode_unit *vcode_unit_t;
 
@@ -23,12 +23,13 @@
 
 #include <assert.h>
 
-static tree_t   fst_top;
-static void    *fst_ctx;
-static uint64_t last_time;
-
 typedef struct fst_data fst_data_t;
 
+static tree_t       fst_top;
+static void        *fst_ctx;
+static uint64_t     last_time;
+static fst_data_t **fst_data;   // Indexed by position in top-level decls
+
 typedef void (*fst_fmt_fn_t)(tree_t, watch_t *, fst_data_t *);
 
 typedef struct {
@@ -50,12 +51,6 @@ struct fst_data {
    watch_t      *watch;
 };
 
-static void fst_close(void)
-{
-   fstWriterEmitTimeChange(fst_ctx, rt_now(NULL));
-   fstWriterClose(fst_ctx);
-}
-
 static void fst_fmt_int(tree_t decl, watch_t *w, fst_data_t *data)
 {
    uint64_t val;
@@ -174,7 +169,38 @@ static bool fst_can_fmt_chars(type_t type, fst_data_t *data,
       return false;
 }
 
-static void fst_process_signal(tree_t d)
+static void fst_free_data(void)
+{
+   const int ndecls = tree_decls(fst_top);
+   for (int i = 0; i < ndecls; i++) {
+      fst_data_t *data = fst_data[i];
+      if (data == NULL)
+         continue;
+
+      if (data->fmt == fst_fmt_physical) {
+         type_t base = type_base_recur(tree_type(tree_decl(fst_top, i)));
+         const int nunits = type_units(base);
+         for (int j = 0; j < nunits; j++)
+            free(data->type.units[j].name);
+         free(data->type.units);
+      }
+
+      free(data);
+      fst_data[i] = NULL;
+   }
+}
+
+static void fst_close(void)
+{
+   fstWriterEmitTimeChange(fst_ctx, rt_now(NULL));
+   fstWriterClose(fst_ctx);
+
+   fst_free_data();
+   free(fst_data);
+   fst_data = NULL;
+}
+
+static fst_data_t *fst_process_signal(tree_t d)
 {
    type_t type = tree_type(d);
    type_t base = type_base_recur(type);
@@ -191,7 +217,7 @@ static void fst_process_signal(tree_t d)
          warn_at(tree_loc(d), "cannot represent multidimensional arrays "
                  "in FST format");
          free(data);
-         return;
+         return NULL;
       }
 
       range_t r = type_dim(type, 0);
@@ -210,7 +236,7 @@ static void fst_process_signal(tree_t d)
          warn_at(tree_loc(d), "cannot represent arrays of type %s "
                  "in FST format", type_pp(elem));
          free(data);
-         return;
+         return NULL;
       }
       else {
          ident_t ident = type_ident(base);
@@ -273,7 +299,7 @@ static void fst_process_signal(tree_t d)
          warn_at(tree_loc(d), "cannot represent type %s in FST format",
                  type_pp(type));
          free(data);
-         return;
+         return NULL;
       }
    }
 
@@ -304,9 +330,8 @@ static void fst_process_signal(tree_t d)
       FST_SVT_VHDL_SIGNAL,
       sdt);
 
-   tree_add_attr_ptr(d, fst_data_i, data);
-
    data->watch = rt_set_event_cb(d, fst_event_cb, data, true);
+   return data;
 }
 
 static void fst_process_hier(tree_t h)
@@ -338,6 +363,9 @@ void fst_restart(void)
    if (fst_ctx == NULL)
       return;
 
+   // Data from the previous run refers to watches which no longer exist
+   fst_free_data();
+
    const int ndecls = tree_decls(fst_top);
    for (int i = 0; i < ndecls; i++) {
       tree_t d = tree_decl(fst_top, i);
@@ -345,7 +373,7 @@ void fst_restart(void)
       switch (tree_kind(d)) {
       case T_SIGNAL_DECL:
          if (wave_should_dump(d))
-            fst_process_signal(d);
+            fst_data[i] = fst_process_signal(d);
          break;
       case T_HIER:
          fst_process_hier(d);
@@ -354,7 +382,7 @@ void fst_restart(void)
          break;
       }
 
-      int npop = tree_attr_int(d, ident_new("scope_pop"), 0);
+      int npop = tree_attr_int(d, scope_pop_i, 0);
       while (npop-- > 0)
          fstWriterSetUpscope(fst_ctx);
    }
@@ -362,12 +390,9 @@ void fst_restart(void)
    last_time = UINT64_MAX;
 
    for (int i = 0; i < ndecls; i++) {
-      tree_t d = tree_decl(fst_top, i);
-      if (tree_kind(d) == T_SIGNAL_DECL) {
-         fst_data_t *data = tree_attr_ptr(d, fst_data_i);
-         if (likely(data != NULL))
-            fst_event_cb(0, d, data->watch, data);
-      }
+      fst_data_t *data = fst_data[i];
+      if (data != NULL)
+         fst_event_cb(0, tree_decl(fst_top, i), data->watch, data);
    }
 }
 
@@ -385,5 +410,6 @@ void fst_init(const char *file, tree_t top)
 
    atexit(fst_close);
 
-   fst_top = top;
+   fst_top  = top;
+   fst_data = xcalloc(tree_decls(top) * sizeof(fst_data_t *));
 }
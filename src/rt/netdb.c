@@ -1,5 +1,5 @@
 //
-//  Copyright (C) 2013  Nick Gasson
+//  Copyright (C) 2013-2016  Nick Gasson
 //
 //  This program is free software: you can redistribute it and/or modify
 //  it under the terms of the GNU General Public License as published by
@@ -17,69 +17,141 @@
 
 #include "netdb.h"
 #include "util.h"
+#include "lib.h"
 
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 netdb_t *netdb_open(tree_t top)
 {
-   char *name = xasprintf("_%s.netdb", istr(tree_ident(top)));
-   fbuf_t *f = lib_fbuf_open(lib_work(), name, FBUF_IN);
-   if (f == NULL)
+   char *name LOCAL = xasprintf("_%s.netdb", istr(tree_ident(top)));
+
+   char path[PATH_MAX];
+   lib_realpath(lib_work(), name, path, sizeof(path));
+
+   int fd = open(path, O_RDONLY);
+   if (fd < 0)
       fatal("failed to open net database file %s", name);
-   free(name);
+
+   struct stat buf;
+   if (fstat(fd, &buf) != 0)
+      fatal_errno("fstat");
+
+   if (buf.st_size < sizeof(netdb_header_t))
+      fatal("net database file %s is truncated", name);
+
+   void *map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (map == MAP_FAILED)
+      fatal_errno("mmap");
+
+   close(fd);
+
+   const netdb_header_t *hdr = map;
+   if (hdr->magic != NETDB_MAGIC)
+      fatal("%s is not a valid net database file", name);
+   else if (hdr->version != NETDB_VERSION)
+      fatal("net database file %s was created by a different version of "
+            "this program: elaborate the design again", name);
+
+   const size_t group_end =
+      hdr->group_offset + (size_t)hdr->ngroups * sizeof(group_t);
+   const size_t index_end =
+      hdr->index_offset + (size_t)hdr->nchunks * sizeof(groupid_t);
+   if ((hdr->ngroups > 0 && group_end > buf.st_size)
+       || (hdr->nchunks > 0 && index_end > buf.st_size))
+      fatal("net database file %s is truncated", name);
 
    netdb_t *db = xmalloc(sizeof(struct netdb));
-   db->groups = NULL;
-   db->max    = 0;
-   db->nnets  = 0;
-
-   groupid_t gid;
-   while ((gid = read_u32(f)) != GROUPID_INVALID) {
-      group_t *g = xmalloc(sizeof(struct group));
-      g->next   = db->groups;
-      g->gid    = gid;
-      g->first  = read_u32(f);
-      g->length = read_u32(f);
-
-      db->groups = g;
-      db->max    = MAX(db->max, gid);
-      db->nnets  = MAX(db->nnets, g->first + g->length);
-   }
-
-   fbuf_close(f);
-
-   db->map = xmalloc(sizeof(groupid_t) * db->nnets);
-   for (netid_t i = 0; i < db->nnets; i++)
-      db->map[i] = GROUPID_INVALID;
-
-   for (group_t *it = db->groups; it != NULL; it = it->next) {
-      for (netid_t i = it->first; i < it->first + it->length; i++)
-         db->map[i] = it->gid;
-   }
+   db->map     = map;
+   db->maplen  = buf.st_size;
+   db->groups  = (const group_t *)((char *)map + hdr->group_offset);
+   db->index   = (const groupid_t *)((char *)map + hdr->index_offset);
+   db->ngroups = hdr->ngroups;
+   db->nnets   = hdr->nnets;
 
    return db;
 }
 
 void netdb_close(netdb_t *db)
 {
-   while (db->groups != NULL) {
-      group_t *next = db->groups->next;
-      free(db->groups);
-      db->groups = next;
-   }
-
-   free(db->map);
+   munmap(db->map, db->maplen);
    free(db);
 }
 
 unsigned netdb_size(netdb_t *db)
 {
-   return db->max + 1;
+   return db->ngroups;
 }
 
 void netdb_walk(netdb_t *db, netdb_walk_fn_t fn)
 {
-   for (group_t *it = db->groups; it != NULL; it = it->next)
-      (*fn)(it->gid, it->first, it->length);
+   for (groupid_t gid = 0; gid < db->ngroups; gid++)
+      (*fn)(gid, db->groups[gid].first, db->groups[gid].length);
+}
+
+image_t *netdb_open_image(tree_t top)
+{
+   char *name LOCAL = xasprintf("_%s.image", istr(tree_ident(top)));
+
+   char path[PATH_MAX];
+   lib_realpath(lib_work(), name, path, sizeof(path));
+
+   // There is no image if no signal has a constant initial value
+   int fd = open(path, O_RDONLY);
+   if (fd < 0 && errno == ENOENT)
+      return NULL;
+   else if (fd < 0)
+      fatal_errno("failed to open initial value image %s", name);
+
+   struct stat buf;
+   if (fstat(fd, &buf) != 0)
+      fatal_errno("fstat");
+
+   if (buf.st_size < sizeof(image_header_t))
+      fatal("initial value image %s is truncated", name);
+
+   // The data section is written to in place by the runtime
+   void *map = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE, fd, 0);
+   if (map == MAP_FAILED)
+      fatal_errno("mmap");
+
+   close(fd);
+
+   const image_header_t *hdr = map;
+   if (hdr->magic != IMAGE_MAGIC)
+      fatal("%s is not a valid initial value image", name);
+   else if (hdr->version != IMAGE_VERSION)
+      fatal("initial value image %s was created by a different version of "
+            "this program: elaborate the design again", name);
+
+   const size_t entry_end =
+      hdr->entry_offset + (size_t)hdr->nentries * sizeof(image_entry_t);
+   const size_t data_end =
+      hdr->data_offset + (size_t)hdr->data_size * 2;
+   if ((hdr->nentries > 0 && entry_end > buf.st_size)
+       || (hdr->data_size > 0 && data_end > buf.st_size))
+      fatal("initial value image %s is truncated", name);
+
+   image_t *image = xmalloc(sizeof(struct image));
+   image->map       = map;
+   image->maplen    = buf.st_size;
+   image->entries   = (const image_entry_t *)((char *)map + hdr->entry_offset);
+   image->data      = (uint8_t *)map + hdr->data_offset;
+   image->nentries  = hdr->nentries;
+   image->data_size = hdr->data_size;
+
+   return image;
+}
+
+void netdb_close_image(image_t *image)
+{
+   munmap(image->map, image->maplen);
+   free(image);
 }
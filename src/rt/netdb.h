@@ -1,5 +1,5 @@
 //
-//  Copyright (C) 2013-2014  Nick Gasson
+//  Copyright (C) 2013-2016  Nick Gasson
 //
 //  This program is free software: you can redistribute it and/or modify
 //  it under the terms of the GNU General Public License as published by
@@ -28,42 +28,111 @@ typedef uint32_t groupid_t;
 #define GROUPID_INVALID UINT32_MAX
 #define NETDB_DEBUG     0
 
+#define NETDB_MAGIC      0x4244564e   // "NVDB"
+#define NETDB_VERSION    1
+#define NETDB_ALIGN      4096
+#define NETDB_CHUNK_BITS 4
+
+#define IMAGE_MAGIC      0x4e49564e   // "NVIN"
+#define IMAGE_VERSION    1
+
 typedef struct netdb netdb_t;
 typedef struct group group_t;
+typedef struct image image_t;
 
 typedef void (*netdb_walk_fn_t)(groupid_t, netid_t, unsigned);
 
+// The net database file is a header followed by the table of groups
+// sorted by first net, where the group ID is the index in this table,
+// and an index giving the first group that ends after the start of
+// each chunk of 2^NETDB_CHUNK_BITS nets. Each section starts on a
+// NETDB_ALIGN boundary so the file can be mapped directly.
+
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t ngroups;
+   uint32_t nnets;
+   uint32_t nchunks;
+   uint32_t group_offset;
+   uint32_t index_offset;
+   uint32_t reserved;
+} netdb_header_t;
+
 struct group {
-   group_t  *next;
-   groupid_t gid;
-   netid_t   first;
-   unsigned  length;
+   netid_t  first;
+   uint32_t length;
 };
 
+// The initial value image is written next to the net database and
+// holds the resolved values of every signal whose initial value is a
+// compile-time constant. The data section contains all the resolved
+// values followed by a second copy used for 'LAST_VALUE and is mapped
+// privately so the runtime can use it in place without copying. The
+// image is only written if at least one signal qualifies and the reset
+// code still initialises every signal if it is missing.
+//
+// TODO: driver counts and initial driver waveforms are still allocated
+// by _alloc_driver during reset and could also be stored here.
+
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t nentries;
+   uint32_t data_size;
+   uint32_t entry_offset;
+   uint32_t data_offset;
+} image_header_t;
+
+typedef struct {
+   uint32_t decl;     // Position in top-level declarations
+   netid_t  first;
+   uint32_t count;
+   uint32_t size;
+   uint32_t offset;
+} image_entry_t;
+
 struct netdb {
-   group_t   *groups;
-   groupid_t *map;
-   netid_t    nnets;
-   unsigned   max;
+   void            *map;
+   size_t           maplen;
+   const group_t   *groups;
+   const groupid_t *index;
+   unsigned         ngroups;
+   netid_t          nnets;
+};
+
+struct image {
+   void                *map;
+   size_t               maplen;
+   const image_entry_t *entries;
+   uint8_t             *data;
+   unsigned             nentries;
+   size_t               data_size;
 };
 
 netdb_t *netdb_open(tree_t top);
 void netdb_close(netdb_t *db);
 unsigned netdb_size(netdb_t *db);
 void netdb_walk(netdb_t *db, netdb_walk_fn_t fn);
+image_t *netdb_open_image(tree_t top);
+void netdb_close_image(image_t *image);
 
 static inline groupid_t netdb_lookup(const netdb_t *db, netid_t nid)
 {
 #if NETDB_DEBUG
    assert(nid < db->nnets);
-   groupid_t gid = db->map[nid];
-   if (likely(gid != GROUPID_INVALID))
-      return gid;
-   else
+#endif
+
+   groupid_t gid = db->index[nid >> NETDB_CHUNK_BITS];
+   while (db->groups[gid].first + db->groups[gid].length <= nid)
+      gid++;
+
+#if NETDB_DEBUG
+   if (unlikely(db->groups[gid].first > nid))
       fatal_trace("net %d not in database", nid);
-#else
-   return db->map[nid];
 #endif
+
+   return gid;
 }
 
 #endif  // _NETDB_H
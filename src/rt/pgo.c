@@ -0,0 +1,188 @@
+//
+//  Copyright (C) 2016  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "util.h"
+#include "pgo.h"
+#include "lib.h"
+#include "hash.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+
+#define PGO_MAGIC     "nvc-profile"
+#define PGO_VERSION   1
+#define PGO_MAX_NAME  1024
+#define PGO_HOT_RATIO 100
+
+typedef struct {
+   int64_t  *counters;
+   int       ncounters;
+   uint32_t  checksum;
+   uint64_t  weight;
+} pgo_entry_t;
+
+static hash_t   *profile = NULL;
+static uint64_t  total_weight = 0;
+static uint64_t  max_weight = 0;
+
+static void pgo_path(tree_t top, const char *path, char *buf, size_t len)
+{
+   if (path == NULL || *path == '\0') {
+      char *name LOCAL = xasprintf("_%s.profile", istr(tree_ident(top)));
+      lib_realpath(lib_work(), name, buf, len);
+   }
+   else
+      checked_sprintf(buf, len, "%s", path);
+}
+
+static uint64_t pgo_weight(const int64_t *counters, int ncounters)
+{
+   // The weight of a unit is the total number of blocks executed which
+   // approximates the time spent in it
+   uint64_t weight = 0;
+   for (int i = PGO_BLOCK(0); i < ncounters; i += 2)
+      weight += counters[i];
+   return weight;
+}
+
+void pgo_write(tree_t top, const char *path,
+               const pgo_unit_t *units, int count)
+{
+   char fname[PATH_MAX];
+   pgo_path(top, path, fname, sizeof(fname));
+
+   FILE *f = fopen(fname, "w");
+   if (f == NULL)
+      fatal_errno("cannot create %s", fname);
+
+   fprintf(f, "%s %d %d\n", PGO_MAGIC, PGO_VERSION, count);
+
+   for (int i = 0; i < count; i++) {
+      fprintf(f, "%d %u %s\n", units[i].ncounters, units[i].checksum,
+              units[i].name);
+      for (int j = 0; j < units[i].ncounters; j++)
+         fprintf(f, "%s%"PRIi64, j > 0 ? " " : "", units[i].counters[j]);
+      fputc('\n', f);
+   }
+
+   if (ferror(f))
+      fatal_errno("error writing %s", fname);
+
+   fclose(f);
+}
+
+void pgo_read(tree_t top, const char *path)
+{
+   char fname[PATH_MAX];
+   pgo_path(top, path, fname, sizeof(fname));
+
+   FILE *f = fopen(fname, "r");
+   if (f == NULL)
+      fatal_errno("cannot open %s", fname);
+
+   char magic[16];
+   int version, count;
+   if (fscanf(f, "%15s %d %d", magic, &version, &count) != 3
+       || strcmp(magic, PGO_MAGIC) != 0)
+      fatal("%s is not a profile file", fname);
+   else if (version != PGO_VERSION)
+      fatal("%s has unsupported profile version %d", fname, version);
+
+   if (profile == NULL)
+      profile = hash_new(count * 2 + 16, true);
+
+   for (int i = 0; i < count; i++) {
+      int ncounters;
+      unsigned checksum;
+      char name[PGO_MAX_NAME];
+      if (fscanf(f, "%d %u ", &ncounters, &checksum) != 2 || ncounters <= 0)
+         fatal("%s: corrupt profile entry %d", fname, i);
+      else if (fgets(name, sizeof(name), f) == NULL)
+         fatal("%s: corrupt profile entry %d", fname, i);
+
+      const size_t len = strlen(name);
+      if (len == 0 || name[len - 1] != '\n')
+         fatal("%s: profile unit name too long", fname);
+      name[len - 1] = '\0';
+
+      pgo_entry_t *e = xmalloc(sizeof(pgo_entry_t));
+      e->counters  = xmalloc(ncounters * sizeof(int64_t));
+      e->ncounters = ncounters;
+      e->checksum  = checksum;
+
+      for (int j = 0; j < ncounters; j++) {
+         if (fscanf(f, "%"SCNi64, &(e->counters[j])) != 1)
+            fatal("%s: missing counters for %s", fname, name);
+      }
+
+      e->weight = pgo_weight(e->counters, ncounters);
+      total_weight += e->weight;
+      if (e->weight > max_weight)
+         max_weight = e->weight;
+
+      hash_put(profile, ident_new(name), e);
+   }
+
+   fclose(f);
+}
+
+const int64_t *pgo_counters(ident_t unit, int ncounters, uint32_t checksum)
+{
+   if (profile == NULL)
+      return NULL;
+
+   pgo_entry_t *e = hash_get(profile, unit);
+   if (e == NULL || e->ncounters == 0)
+      return NULL;
+   else if (e->ncounters != ncounters || e->checksum != checksum) {
+      // The design has changed since the profile was collected
+      warnf("ignoring stale profile data for %s", istr(unit));
+      e->ncounters = 0;
+      return NULL;
+   }
+   else
+      return e->counters;
+}
+
+pgo_heat_t pgo_heat(ident_t unit)
+{
+   if (profile == NULL)
+      return PGO_UNKNOWN;
+
+   pgo_entry_t *e = hash_get(profile, unit);
+   if (e == NULL || e->ncounters == 0)
+      return PGO_UNKNOWN;
+   else if (e->counters[PGO_INVOCATIONS] == 0)
+      return PGO_COLD;
+   else if (e->weight * PGO_HOT_RATIO >= max_weight)
+      return PGO_HOT;
+   else
+      return PGO_WARM;
+}
+
+uint64_t pgo_total_weight(void)
+{
+   return total_weight;
+}
+
+bool pgo_loaded(void)
+{
+   return profile != NULL;
+}
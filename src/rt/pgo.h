@@ -0,0 +1,59 @@
+//
+//  Copyright (C) 2016  Nick Gasson
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef _PGO_H
+#define _PGO_H
+
+#include "util.h"
+#include "tree.h"
+#include "ident.h"
+
+#include <stdint.h>
+
+// Layout of the per-unit counter array generated with --pgo-collect:
+// the number of times the unit was entered followed by a pair of
+// counters for each vcode block giving the number of times the block
+// was executed and the number of times its conditional branch was taken
+#define PGO_INVOCATIONS  0
+#define PGO_BLOCK(b)     (1 + 2 * (b))
+#define PGO_TAKEN(b)     (2 + 2 * (b))
+#define PGO_NCOUNTERS(n) (1 + 2 * (n))
+
+// Must match the layout of the pgo_table global emitted by cgen
+typedef struct {
+   const char *name;
+   int64_t    *counters;
+   int32_t     ncounters;
+   uint32_t    checksum;
+} pgo_unit_t;
+
+typedef enum {
+   PGO_UNKNOWN,
+   PGO_COLD,
+   PGO_WARM,
+   PGO_HOT
+} pgo_heat_t;
+
+void pgo_write(tree_t top, const char *path,
+               const pgo_unit_t *units, int count);
+void pgo_read(tree_t top, const char *path);
+const int64_t *pgo_counters(ident_t unit, int ncounters, uint32_t checksum);
+pgo_heat_t pgo_heat(ident_t unit);
+uint64_t pgo_total_weight(void);
+bool pgo_loaded(void);
+
+#endif  // _PGO_H
@@ -65,7 +65,12 @@ typedef enum {
    NET_F_FORCED     = (1 << 2),
    NET_F_OWNS_MEM   = (1 << 3),
    NET_F_GLOBAL     = (1 << 4),
-   NET_F_LAST_VALUE = (1 << 5)
+   NET_F_LAST_VALUE = (1 << 5),
+   NET_F_COMB       = (1 << 6),
+   NET_F_DEMOTED    = (1 << 7),
+   NET_F_STAGED     = (1 << 8),
+   NET_F_MEMORY     = (1 << 9),
+   NET_F_IMAGE      = (1 << 10)
 } net_flags_t;
 
 typedef enum {
@@ -73,6 +78,12 @@ typedef enum {
    SCHED_STATIC     = (1 << 1)
 } sched_flags_t;
 
+// The upper bits of the _sched_event flags may hold a set of enumeration
+// positions for a scalar signal: the process is then only woken when the
+// new value of the signal is one of these
+#define SCHED_EDGE_SHIFT 16
+#define SCHED_EDGE_MAX   16
+
 typedef enum {
    RT_START_OF_SIMULATION,
    RT_END_OF_SIMULATION,
@@ -133,6 +144,7 @@ void wave_include_glob(const char *glob);
 void wave_exclude_glob(const char *glob);
 void wave_include_file(const char *base);
 bool wave_should_dump(tree_t decl);
+void wave_reset(void);
 
 #ifdef ENABLE_VHPI
 void vhpi_load_plugins(tree_t top, const char *plugins);
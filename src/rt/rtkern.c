@@ -24,6 +24,7 @@
 #include "common.h"
 #include "netdb.h"
 #include "cover.h"
+#include "pgo.h"
 #include "hash.h"
 
 #include <assert.h>
@@ -60,6 +61,9 @@ typedef struct value      value_t;
 typedef struct watch_list watch_list_t;
 typedef struct res_memo   res_memo_t;
 typedef struct callback   callback_t;
+typedef struct rt_clock   rt_clock_t;
+typedef struct rt_memory  rt_memory_t;
+typedef struct rt_defer   rt_defer_t;
 
 struct rt_proc {
    tree_t    source;
@@ -67,14 +71,25 @@ struct rt_proc {
    uint32_t  wakeup_gen;
    void     *tmp_stack;
    uint32_t  tmp_alloc;
+   int32_t   level;
    bool      postponed;
    bool      pending;
 };
 
+struct rt_defer {
+   rt_defer_t *next;
+   rt_proc_t  *proc;
+   netid_t     first;
+   int32_t     count;
+   int64_t     reject;
+   uint8_t     data[0];
+};
+
 typedef enum {
    E_TIMEOUT,
    E_DRIVER,
-   E_PROCESS
+   E_PROCESS,
+   E_CLOCK
 } event_kind_t;
 
 struct event {
@@ -86,6 +101,7 @@ struct event {
    netgroup_t   *group;
    timeout_fn_t  timeout_fn;
    void         *timeout_user;
+   rt_clock_t   *clock;
 };
 
 struct waveform {
@@ -101,6 +117,7 @@ struct sens_list {
    uint32_t      wakeup_gen;
    netid_t       first;
    netid_t       last;
+   uint32_t      edge;
 };
 
 struct driver {
@@ -129,6 +146,7 @@ struct netgroup {
    value_t      *free_values;
    sens_list_t  *pending;
    watch_list_t *watching;
+   rt_memory_t  *memory;
 };
 
 struct uarray {
@@ -195,6 +213,26 @@ struct callback {
    callback_t    *next;
 };
 
+struct rt_clock {
+   netgroup_t *group;
+   rt_proc_t  *proc;
+   int         phase;
+   int         nphases;
+   int         values[2];    // Enumeration position or -1 to invert
+   uint64_t    delays[2];
+   bool        deferred;     // Update one delta after the clock edge
+   bool        due;
+};
+
+struct rt_memory {
+   unsigned  stride;       // Nets in each word
+   uint64_t *dirty;        // One bit for each word with a staged value
+   uint32_t *words;        // Staged words in the order first written
+   uint8_t  *data;         // Staged value of each word in the list
+   unsigned  nstaged;
+   unsigned  maxstaged;
+};
+
 static struct rt_proc   *procs = NULL;
 static struct rt_proc   *active_proc = NULL;
 static struct loaded    *loaded = NULL;
@@ -210,6 +248,7 @@ static nvc_rusage_t  ready_rusage;
 static jmp_buf       fatal_jmp;
 static bool          aborted = false;
 static netdb_t      *netdb = NULL;
+static image_t      *image = NULL;
 static netgroup_t   *groups = NULL;
 static sens_list_t  *pending = NULL;
 static sens_list_t  *resume = NULL;
@@ -238,13 +277,35 @@ static netgroup_t **active_groups;
 static unsigned     n_active_groups = 0;
 static unsigned     n_active_alloc = 0;
 
+static sens_list_t **level_resume = NULL;
+static event_t     **level_drivers = NULL;
+static int           n_levels = 0;
+static int           level_next = 0;
+static bool          level_bypass = true;
+static rt_defer_t  **level_defer = NULL;
+static unsigned      n_deferred = 0;
+static uint64_t      n_deltas = 0;
+static uint64_t      n_runs = 0;
+static rt_clock_t   *clocks = NULL;
+static netgroup_t  **staged_groups = NULL;
+static unsigned      n_staged = 0;
+static unsigned      n_staged_alloc = 0;
+
 static void deltaq_insert_proc(uint64_t delta, rt_proc_t *wake);
+static void level_insert_driver(netgroup_t *group, rt_proc_t *driver);
+static void level_defer_waveform(netgroup_t *group, netid_t first, int count,
+                                 const void *values, int64_t reject);
+static void rt_stage_group(netgroup_t *group, const void *values);
+static void rt_stage_memory(netgroup_t *group, int skip, int count,
+                            const void *values);
+static void rt_event_callback(bool postponed);
 static void deltaq_insert_driver(uint64_t delta, netgroup_t *group,
                                  rt_proc_t *driver);
 static bool rt_sched_driver(netgroup_t *group, uint64_t after,
                             uint64_t reject, value_t *values);
+static void rt_update_group(netgroup_t *group, int driver, void *values);
 static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
-                           rt_proc_t *proc, bool is_static);
+                           rt_proc_t *proc, bool is_static, uint32_t edge);
 static void *rt_tmp_alloc(size_t sz);
 static value_t *rt_alloc_value(netgroup_t *g);
 static tree_t rt_recall_tree(const char *unit, int32_t where);
@@ -379,10 +440,41 @@ void _sched_waveform(void *_nids, void *values, int32_t n,
       if (likely(nid != NETID_INVALID)) {
          netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
 
+         if (unlikely(active_proc->level > 0 && after == 0 && !level_bypass
+                      && !(g->flags & NET_F_COMB))) {
+            const int skip  = nid - g->first;
+            const int count = MIN(n - offset, g->length - skip);
+            level_defer_waveform(g, nid, count, vp, reject);
+            vp += g->size * count;
+            offset += count;
+            continue;
+         }
+         else if (unlikely(g->flags & NET_F_MEMORY)) {
+            const int skip  = nid - g->first;
+            const int count = MIN(n - offset, g->length - skip);
+            assert(after == 0);
+            rt_stage_memory(g, skip, count, vp);
+            vp += g->size * count;
+            offset += count;
+            continue;
+         }
+         else if (after == 0 && (g->flags & NET_F_DEMOTED)) {
+            rt_stage_group(g, vp);
+            vp += g->size * g->length;
+            offset += g->length;
+            continue;
+         }
+
          value_t *values_copy = rt_alloc_value(g);
          memcpy(values_copy->data, vp, g->size * g->length);
 
-         if (!rt_sched_driver(g, after, reject, values_copy))
+         if (rt_sched_driver(g, after, reject, values_copy))
+            ;
+         else if (after == 0 && (g->flags & NET_F_COMB)
+                  && active_proc->level >= 0 && g->n_drivers == 1
+                  && !level_bypass)
+            level_insert_driver(g, active_proc);
+         else
             deltaq_insert_driver(after, g, active_proc);
 
          vp += g->size * g->length;
@@ -405,15 +497,23 @@ void _sched_event(void *_nids, int32_t n, int32_t flags)
    netgroup_t *g0 = &(groups[netdb_lookup(netdb, nids[0])]);
 
    if (g0->length == n) {
+      // An edge filter only applies to a scalar with a one byte value
+      const uint32_t edge = (g0->length == 1 && g0->size == 1)
+         ? (uint32_t)flags >> SCHED_EDGE_SHIFT : 0;
       rt_sched_event(&(g0->pending), NETID_INVALID, NETID_INVALID,
-                     active_proc, flags & SCHED_STATIC);
+                     active_proc, flags & SCHED_STATIC, edge);
+   }
+   else if (g0->flags & NET_F_MEMORY) {
+      // Memory groups only wake processes waiting on the words changed
+      rt_sched_event(&(g0->pending), nids[0], nids[n - 1], active_proc,
+                     flags & SCHED_STATIC, 0);
    }
    else {
       const bool global = !!(flags & SCHED_SEQUENTIAL);
       if (global) {
          // Place on the global pending list
          rt_sched_event(&pending, nids[0], nids[n - 1], active_proc,
-                        flags & SCHED_STATIC);
+                        flags & SCHED_STATIC, 0);
       }
 
       int offset = 0;
@@ -424,7 +524,7 @@ void _sched_event(void *_nids, int32_t n, int32_t flags)
          else {
             // Place on the net group's pending list
             rt_sched_event(&(g->pending), NETID_INVALID, NETID_INVALID,
-                           active_proc, flags & SCHED_STATIC);
+                           active_proc, flags & SCHED_STATIC, 0);
          }
 
          offset += g->length;
@@ -531,6 +631,12 @@ void _set_initial(int32_t nid, const uint8_t *values, const int32_t *size_list,
                   int32_t nparts, void *resolution, int32_t index,
                   const char *module)
 {
+   // Values loaded from the image only need the resolution function
+   // to be attached
+   const bool in_image = groups[netdb_lookup(netdb, nid)].flags & NET_F_IMAGE;
+   if (in_image && resolution == NULL)
+      return;
+
    tree_t decl = rt_recall_tree(module, index);
    assert(tree_kind(decl) == T_SIGNAL_DECL);
 
@@ -541,6 +647,16 @@ void _set_initial(int32_t nid, const uint8_t *values, const int32_t *size_list,
    if (resolution != NULL)
       memo = rt_memo_resolution_fn(tree_type(decl), resolution);
 
+   if (in_image) {
+      const int nnets = tree_nets(decl);
+      for (int offset = 0; offset < nnets;) {
+         netgroup_t *g = &(groups[netdb_lookup(netdb, nid + offset)]);
+         g->resolution = memo;
+         offset += g->length;
+      }
+      return;
+   }
+
    int total_size = 0;
    for (int i = 0; i < nparts; i++)
       total_size += size_list[i * 2] * size_list[(i * 2) + 1];
@@ -610,7 +726,7 @@ void _assert_fail(const uint8_t *msg, int32_t msg_len, int8_t severity,
 
    tree_t t = rt_recall_tree(module, where);
    const loc_t *loc = tree_loc(t);
-   bool is_report = tree_attr_int(t, ident_new("is_report"), 0);
+   bool is_report = tree_attr_int(t, is_report_i, 0);
 
    char *copy = NULL;
    if (msg_len >= 0) {
@@ -631,13 +747,17 @@ void _assert_fail(const uint8_t *msg, int32_t msg_len, int8_t severity,
    if (severity >= exit_severity)
       fn = fatal_at;
 
+   // Assertions in a fused process are tagged with the original process
+   tree_t proc = tree_attr_tree(t, fused_i);
+   if (proc == NULL && active_proc != NULL)
+      proc = active_proc->source;
+
    (*fn)(loc, "%s+%d: %s %s: %s\r\tProcess %s",
          fmt_time(now), iteration,
          (is_report ? "Report" : "Assertion"),
          levels[severity],
          (copy != NULL ? copy : (const char *)msg),
-         ((active_proc == NULL) ? "(init)"
-          : istr(tree_ident(active_proc->source))));
+         ((active_proc == NULL) ? "(init)" : istr(tree_ident(proc))));
 
    if (copy != NULL)
       free(copy);
@@ -1115,14 +1235,17 @@ static void _tracef(const char *fmt, ...)
 
 static void deltaq_insert(event_t *e)
 {
+   // Clock edges are ordered with other driver updates
+   const event_kind_t kind = (e->kind == E_CLOCK) ? E_DRIVER : e->kind;
+
    if (e->when == now) {
-      event_t **chain = (e->kind == E_DRIVER) ? &delta_driver : &delta_proc;
+      event_t **chain = (kind == E_DRIVER) ? &delta_driver : &delta_proc;
       e->delta_chain = *chain;
       *chain = e;
    }
    else {
       e->delta_chain = NULL;
-      heap_insert(eventq_heap, heap_key(e->when, e->kind), e);
+      heap_insert(eventq_heap, heap_key(e->when, kind), e);
    }
 }
 
@@ -1150,6 +1273,88 @@ static void deltaq_insert_driver(uint64_t delta, netgroup_t *group,
    deltaq_insert(e);
 }
 
+static void level_insert_driver(netgroup_t *group, rt_proc_t *driver)
+{
+   // Zero-delay update of a net which is only read by levelised
+   // processes: apply it later in this cycle once every process at the
+   // driver's level has run
+   event_t *e = rt_alloc(event_stack);
+   e->when        = now;
+   e->kind        = E_DRIVER;
+   e->group       = group;
+   e->proc        = driver;
+   e->wakeup_gen  = UINT32_MAX;
+   e->delta_chain = level_drivers[driver->level];
+
+   level_drivers[driver->level] = e;
+   level_next = MIN(level_next, driver->level);
+}
+
+static void level_defer_waveform(netgroup_t *group, netid_t first, int count,
+                                 const void *values, int64_t reject)
+{
+   // A process at level N would normally run N delta cycles after those
+   // at level zero so hold back an update to a net read by anything else
+   // for that many cycles to keep its events in the same delta
+   const size_t valuesz = group->size * count;
+   rt_defer_t *d = xmalloc(sizeof(rt_defer_t) + valuesz);
+   d->proc   = active_proc;
+   d->first  = first;
+   d->count  = count;
+   d->reject = reject;
+   memcpy(d->data, values, valuesz);
+
+   const int slot = (iteration + active_proc->level) % n_levels;
+   d->next = level_defer[slot];
+   level_defer[slot] = d;
+
+   n_deferred++;
+}
+
+static void level_release_deferred(void)
+{
+   const int slot = iteration % n_levels;
+
+   // Reverse the list so updates are applied in the original order
+   rt_defer_t *list = NULL;
+   for (rt_defer_t *it = level_defer[slot], *next; it != NULL; it = next) {
+      next = it->next;
+      it->next = list;
+      list = it;
+   }
+   level_defer[slot] = NULL;
+
+   rt_proc_t *save = active_proc;
+
+   for (rt_defer_t *it = list, *next; it != NULL; it = next) {
+      next = it->next;
+
+      int32_t *nids = alloca(it->count * sizeof(int32_t));
+      for (int i = 0; i < it->count; i++)
+         nids[i] = it->first + i;
+
+      active_proc = it->proc;
+      _sched_waveform(nids, it->data, it->count, 0, it->reject);
+
+      free(it);
+      n_deferred--;
+   }
+
+   active_proc = save;
+}
+
+static void level_free_deferred(void)
+{
+   for (int i = 0; i < n_levels; i++) {
+      for (rt_defer_t *it = level_defer[i], *next; it != NULL; it = next) {
+         next = it->next;
+         free(it);
+      }
+   }
+
+   n_deferred = 0;
+}
+
 #if TRACE_DELTAQ > 0
 static void deltaq_walk(uint64_t key, void *user, void *context)
 {
@@ -1167,6 +1372,9 @@ static void deltaq_walk(uint64_t key, void *user, void *context)
    case E_TIMEOUT:
       fprintf(stderr, "timeout\t %p %p\n", e->timeout_fn, e->timeout_user);
       break;
+   case E_CLOCK:
+      fprintf(stderr, "clock\t %s\n", fmt_group(e->group));
+      break;
    }
 }
 
@@ -1300,7 +1508,7 @@ static void *rt_tmp_alloc(size_t sz)
 }
 
 static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
-                           rt_proc_t *proc, bool is_static)
+                           rt_proc_t *proc, bool is_static, uint32_t edge)
 {
    // See if there is already a stale entry in the pending
    // list for this process
@@ -1320,6 +1528,7 @@ static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
       node->first      = first;
       node->last       = last;
       node->reenq      = (is_static ? list : NULL);
+      node->edge       = edge;
 
       *list = node;
    }
@@ -1329,6 +1538,7 @@ static void rt_sched_event(sens_list_t **list, netid_t first, netid_t last,
       it->wakeup_gen = proc->wakeup_gen;
       it->first      = first;
       it->last       = last;
+      it->edge       = edge;
    }
 }
 
@@ -1361,6 +1571,46 @@ static void rt_free_delta_events(event_t *e)
    }
 }
 
+static void rt_setup_levels(tree_t top)
+{
+   const size_t rsz = n_levels * sizeof(sens_list_t *);
+   const size_t dsz = n_levels * sizeof(event_t *);
+   const size_t fsz = n_levels * sizeof(rt_defer_t *);
+   level_resume  = xrealloc(level_resume, rsz);
+   level_drivers = xrealloc(level_drivers, dsz);
+   level_defer   = xrealloc(level_defer, fsz);
+   memset(level_resume, '\0', rsz);
+   memset(level_drivers, '\0', dsz);
+   memset(level_defer, '\0', fsz);
+
+   // A net group can only be updated within the delta cycle if every
+   // signal mapped onto it was tagged by the optimiser
+   const int ndecls = tree_decls(top);
+   for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < ndecls; i++) {
+         tree_t d = tree_decl(top, i);
+         if (tree_kind(d) != T_SIGNAL_DECL)
+            continue;
+
+         const bool comb = tree_attr_int(d, comb_net_i, 0);
+         if (comb != (pass == 0))
+            continue;
+
+         const int nnets = tree_nets(d);
+         int offset = 0;
+         while (offset < nnets) {
+            netid_t nid = tree_net(d, offset);
+            netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+            if (comb)
+               g->flags |= NET_F_COMB;
+            else
+               g->flags &= ~NET_F_COMB;
+            offset += g->length;
+         }
+      }
+   }
+}
+
 static void rt_setup(tree_t top)
 {
    now = 0;
@@ -1369,6 +1619,11 @@ static void rt_setup(tree_t top)
    force_stop = false;
    can_create_delta = true;
 
+   if (n_deferred > 0)
+      level_free_deferred();
+   n_levels = 0;
+   n_staged = 0;
+
    assert(resume == NULL);
 
    rt_free_delta_events(delta_proc);
@@ -1401,10 +1656,18 @@ static void rt_setup(tree_t top)
       procs[i].proc_fn    = jit_fun_ptr(istr(tree_ident(p)), true);
       procs[i].wakeup_gen = 0;
       procs[i].postponed  = tree_attr_int(p, postponed_i, 0);
+      procs[i].level      = tree_attr_int(p, comb_level_i, -1);
       procs[i].tmp_stack  = NULL;
       procs[i].tmp_alloc  = 0;
       procs[i].pending    = false;
+
+      n_levels = MAX(n_levels, procs[i].level + 1);
    }
+
+   if (n_levels > 0)
+      rt_setup_levels(top);
+
+   level_next = n_levels;
 }
 
 static void rt_run(struct rt_proc *proc, bool reset)
@@ -1431,6 +1694,7 @@ static void rt_run(struct rt_proc *proc, bool reset)
    }
 
    active_proc = proc;
+   n_runs++;
    (*proc->proc_fn)(reset ? 1 : 0);
 
    if (reset)
@@ -1547,10 +1811,319 @@ static void rt_group_inital(groupid_t gid, netid_t first, unsigned length)
       rt_resolve_group(g, -1, g->resolved);
 }
 
+static void rt_clock_schedule(rt_clock_t *c, uint64_t delay)
+{
+   event_t *e = rt_alloc(event_stack);
+   e->when       = now + delay;
+   e->kind       = E_CLOCK;
+   e->group      = c->group;
+   e->proc       = c->proc;
+   e->clock      = c;
+   e->wakeup_gen = UINT32_MAX;
+
+   deltaq_insert(e);
+}
+
+static void rt_clock_tick(rt_clock_t *c)
+{
+   if (c->deferred && !c->due) {
+      // The process would assign the signal with no delay here
+      c->due = true;
+      rt_clock_schedule(c, 0);
+      return;
+   }
+
+   TRACE("clock %s phase %d", fmt_group(c->group), c->phase);
+
+   c->due = false;
+
+   const int value = c->values[c->phase];
+   uint8_t *data = (uint8_t *)c->group->drivers[0].waveforms->values->data;
+   *data = (value < 0) ? !*(uint8_t *)c->group->resolved : value;
+
+   rt_update_group(c->group, 0, data);
+
+   rt_clock_schedule(c, c->delays[c->phase]);
+   c->phase = (c->phase + 1) % c->nphases;
+}
+
+static void rt_setup_clocks(void)
+{
+   // Processes tagged as clock generators by the optimiser are replaced
+   // with a periodic event which updates the signal directly
+
+   free(clocks);
+   clocks = xcalloc(n_procs * sizeof(rt_clock_t));
+
+   for (size_t i = 0; i < n_procs; i++) {
+      tree_t p = procs[i].source;
+      const int nphases = tree_attr_int(p, clock_i, 0);
+      if (nphases == 0)
+         continue;
+
+      tree_t decl = tree_ref(tree_target(tree_stmt(p, 0)));
+      netgroup_t *g = &(groups[netdb_lookup(netdb, tree_net(decl, 0))]);
+
+      if (g->length != 1 || g->size != 1 || g->n_drivers != 1
+          || g->drivers[0].proc != &(procs[i]))
+         continue;
+
+      rt_clock_t *c = &(clocks[i]);
+      c->group   = g;
+      c->proc    = &(procs[i]);
+      c->nphases = nphases;
+
+      for (int j = 0; j < nphases; j++) {
+         tree_t wave = tree_waveform(tree_stmt(p, j * 2), 0);
+
+         unsigned pos;
+         c->values[j] = folded_enum(tree_value(wave), &pos) ? pos : -1;
+
+         int64_t delay;
+         if ((c->deferred = !tree_has_delay(wave)))
+            folded_int(tree_delay(tree_stmt(p, j * 2 + 1)), &delay);
+         else
+            folded_int(tree_delay(wave), &delay);
+         c->delays[j] = delay;
+      }
+
+      TRACE("process %s is a clock for %s", istr(tree_ident(p)),
+            fmt_group(g));
+
+      // Discard the initial run of the process and any sensitivity list
+      // entries created when it was reset
+      ++(procs[i].wakeup_gen);
+
+      for (sens_list_t **it = &(g->pending); *it != NULL; ) {
+         sens_list_t *sl = *it;
+         if (sl->proc == &(procs[i])) {
+            *it = sl->next;
+            rt_free(sens_list_stack, sl);
+         }
+         else
+            it = &(sl->next);
+      }
+
+      rt_clock_schedule(c, c->deferred ? 0 : c->delays[0]);
+   }
+}
+
+static void rt_setup_demoted(tree_t top)
+{
+   // A net group can bypass the event queue if every signal mapped onto
+   // it was tagged by the optimiser and it has a single unresolved driver
+
+   const int ndecls = tree_decls(top);
+   for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < ndecls; i++) {
+         tree_t d = tree_decl(top, i);
+         if (tree_kind(d) != T_SIGNAL_DECL)
+            continue;
+
+         const bool demoted = tree_attr_int(d, demoted_i, 0);
+         if (demoted != (pass == 0))
+            continue;
+
+         const int nnets = tree_nets(d);
+         int offset = 0;
+         while (offset < nnets) {
+            netid_t nid = tree_net(d, offset);
+            netgroup_t *g = &(groups[netdb_lookup(netdb, nid)]);
+            if (demoted && g->n_drivers == 1 && g->resolution == NULL
+                && g->watching == NULL && !(g->flags & NET_F_MEMORY))
+               g->flags |= NET_F_DEMOTED;
+            else
+               g->flags &= ~NET_F_DEMOTED;
+            offset += g->length;
+         }
+      }
+   }
+}
+
+static void rt_stage_group(netgroup_t *group, const void *values)
+{
+   // The driver of a demoted group is only read when the group is
+   // committed so the new value can be written over the current one
+
+   TRACE("stage group %s values=%s", fmt_group(group),
+         fmt_values(values, group->size * group->length));
+
+   assert(group->drivers[0].proc == active_proc);
+
+   memcpy(group->drivers[0].waveforms->values->data, values,
+          group->size * group->length);
+
+   if (!(group->flags & NET_F_STAGED)) {
+      if (unlikely(n_staged == n_staged_alloc)) {
+         n_staged_alloc = MAX(n_staged_alloc * 2, 64);
+         const size_t newsz = n_staged_alloc * sizeof(struct netgroup *);
+         staged_groups = xrealloc(staged_groups, newsz);
+      }
+      staged_groups[n_staged++] = group;
+      group->flags |= NET_F_STAGED;
+   }
+}
+
+static void rt_commit_staged(void)
+{
+   // Nothing is waiting for an event on these groups so the new value
+   // just has to become visible before the next cycle
+
+   for (unsigned i = 0; i < n_staged; i++) {
+      netgroup_t *g = staged_groups[i];
+      TRACE("commit group %s", fmt_group(g));
+      rt_resolve_group(g, 0, g->drivers[0].waveforms->values->data);
+      g->flags &= ~NET_F_STAGED;
+   }
+   n_staged = 0;
+}
+
+static void rt_setup_image(tree_t top)
+{
+   // Signals with constant initial values use the resolved and last
+   // value memory mapped from the image written during elaboration
+
+   if (image != NULL)
+      netdb_close_image(image);
+
+   if ((image = netdb_open_image(top)) == NULL)
+      return;
+
+   for (unsigned i = 0; i < image->nentries; i++) {
+      const image_entry_t *e = &(image->entries[i]);
+      tree_t decl = tree_decl(top, e->decl);
+      assert(tree_kind(decl) == T_SIGNAL_DECL);
+      assert(tree_nets(decl) == e->count);
+
+      uint8_t *res_mem  = image->data + e->offset;
+      uint8_t *last_mem = res_mem + image->data_size;
+
+      for (unsigned offset = 0; offset < e->count;) {
+         netgroup_t *g = &(groups[netdb_lookup(netdb, e->first + offset)]);
+         assert(g->sig_decl == NULL);
+
+         g->sig_decl   = decl;
+         g->size       = e->size;
+         g->resolved   = res_mem;
+         g->last_value = last_mem;
+         g->flags     |= NET_F_IMAGE;
+
+         const int nbytes = g->length * e->size;
+         res_mem  += nbytes;
+         last_mem += nbytes;
+         offset   += g->length;
+      }
+   }
+
+   TRACE("initialised %u signals from image", image->nentries);
+}
+
+static void rt_setup_memories(tree_t top)
+{
+   // Signals tagged as memories by the optimiser are a single net group
+   // with writes staged a word at a time
+
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (tree_kind(d) != T_SIGNAL_DECL)
+         continue;
+
+      const int stride = tree_attr_int(d, memory_i, 0);
+      if (stride == 0)
+         continue;
+
+      netgroup_t *g = &(groups[netdb_lookup(netdb, tree_net(d, 0))]);
+      assert(g->length == tree_nets(d));
+      assert(g->length % stride == 0);
+
+      const unsigned nwords = g->length / stride;
+
+      rt_memory_t *m = xmalloc(sizeof(rt_memory_t));
+      m->stride    = stride;
+      m->dirty     = xcalloc(((nwords + 63) / 64) * sizeof(uint64_t));
+      m->words     = NULL;
+      m->data      = NULL;
+      m->nstaged   = 0;
+      m->maxstaged = 0;
+
+      g->memory = m;
+      g->flags |= NET_F_MEMORY;
+
+      TRACE("signal %s is a memory of %u words", istr(tree_ident(d)),
+            nwords);
+   }
+}
+
+static uint8_t *rt_memory_slot(netgroup_t *group, uint32_t w)
+{
+   rt_memory_t *m = group->memory;
+   const size_t wordsz = m->stride * group->size;
+
+   if (m->dirty[w / 64] & (UINT64_C(1) << (w % 64))) {
+      // Repeated writes to a word in the same cycle are almost always
+      // to one written recently
+      for (int i = m->nstaged - 1; i >= 0; i--) {
+         if (m->words[i] == w)
+            return m->data + (i * wordsz);
+      }
+      assert(false);
+   }
+
+   if (m->nstaged == m->maxstaged) {
+      m->maxstaged = MAX(m->maxstaged * 2, 16);
+      m->words = xrealloc(m->words, m->maxstaged * sizeof(uint32_t));
+      m->data  = xrealloc(m->data, m->maxstaged * wordsz);
+   }
+
+   // A word is committed as a whole so start from the current value
+   uint8_t *slot = m->data + (m->nstaged * wordsz);
+   const uint8_t *driving =
+      (uint8_t *)group->drivers[0].waveforms->values->data;
+   memcpy(slot, driving + (w * wordsz), wordsz);
+
+   m->words[m->nstaged++] = w;
+   m->dirty[w / 64] |= (UINT64_C(1) << (w % 64));
+
+   return slot;
+}
+
+static void rt_stage_memory(netgroup_t *group, int skip, int count,
+                            const void *values)
+{
+   TRACE("stage memory %s skip=%d values=%s", fmt_group(group), skip,
+         fmt_values(values, group->size * count));
+
+   assert(group->n_drivers == 1);
+   assert(group->drivers[0].proc == active_proc);
+
+   rt_memory_t *m = group->memory;
+
+   // All the staged words are committed by a single driver event
+   if (m->nstaged == 0)
+      deltaq_insert_driver(0, group, active_proc);
+
+   const uint8_t *src = values;
+   int offset = skip;
+   while (offset < skip + count) {
+      const uint32_t w = offset / m->stride;
+      const int pos    = offset % m->stride;
+      const int nets   = MIN(m->stride - pos, skip + count - offset);
+
+      uint8_t *slot = rt_memory_slot(group, w);
+      memcpy(slot + (pos * group->size), src, nets * group->size);
+
+      src    += nets * group->size;
+      offset += nets;
+   }
+}
+
 static void rt_initial(tree_t top)
 {
    // Initialisation is described in LRM 93 section 12.6.4
 
+   rt_setup_image(top);
+
    const int ncontext = tree_contexts(top);
    for (int i = 0; i < ncontext; i++) {
       tree_t c = tree_context(top, i);
@@ -1563,6 +2136,8 @@ static void rt_initial(tree_t top)
 
    rt_call_module_reset(tree_ident(top));
 
+   rt_setup_memories(top);
+
    for (size_t i = 0; i < n_procs; i++)
       rt_run(&procs[i], true /* reset */);
 
@@ -1571,6 +2146,9 @@ static void rt_initial(tree_t top)
    init_side_effect = SIDE_EFFECT_ALLOW;
    netdb_walk(netdb, rt_group_inital);
 
+   rt_setup_clocks();
+   rt_setup_demoted(top);
+
    TRACE("used %d bytes of global temporary stack", global_tmp_alloc);
 }
 
@@ -1588,6 +2166,9 @@ static void rt_watch_signal(watch_t *w)
 
       g->watching = link;
 
+      // Watchers are called from the event machinery
+      g->flags &= ~NET_F_DEMOTED;
+
       offset += g->length;
       (w->n_groups)++;
    }
@@ -1624,6 +2205,11 @@ static void rt_wakeup(sens_list_t *sl)
          sl->next  = postponed;
          postponed = sl;
       }
+      else if (sl->proc->level >= 0) {
+         sl->next = level_resume[sl->proc->level];
+         level_resume[sl->proc->level] = sl;
+         level_next = MIN(level_next, sl->proc->level);
+      }
       else {
          sl->next = resume;
          resume = sl;
@@ -1703,14 +2289,8 @@ static bool rt_sched_driver(netgroup_t *group, uint64_t after,
    return already_scheduled;
 }
 
-static void rt_update_group(netgroup_t *group, int driver, void *values)
+static void rt_activate_group(netgroup_t *group, int32_t new_flags)
 {
-   const size_t valuesz = group->size * group->length;
-
-   TRACE("update group %s values=%s driver=%d",
-         fmt_group(group), fmt_values(values, valuesz), driver);
-
-   const int32_t new_flags = rt_resolve_group(group, driver, values);
    group->flags |= new_flags;
 
    if (unlikely(n_active_groups == n_active_alloc)) {
@@ -1719,16 +2299,46 @@ static void rt_update_group(netgroup_t *group, int driver, void *values)
       active_groups = xrealloc(active_groups, newsz);
    }
    active_groups[n_active_groups++] = group;
+}
+
+static void rt_notify_watchers(netgroup_t *group)
+{
+   // Schedule any callbacks to run
+   for (watch_list_t *wl = group->watching; wl != NULL; wl = wl->next) {
+      if (!wl->watch->pending) {
+         wl->watch->chain_pending = callbacks;
+         wl->watch->pending = true;
+         callbacks = wl->watch;
+      }
+   }
+}
+
+static void rt_update_group(netgroup_t *group, int driver, void *values)
+{
+   const size_t valuesz = group->size * group->length;
+
+   TRACE("update group %s values=%s driver=%d",
+         fmt_group(group), fmt_values(values, valuesz), driver);
+
+   const int32_t new_flags = rt_resolve_group(group, driver, values);
+   rt_activate_group(group, new_flags);
 
    // Wake up any processes sensitive to this group
    if (new_flags & NET_F_EVENT) {
       sens_list_t *it, *last = NULL, *next = NULL;
 
       // First wakeup everything on the group specific pending list
+      // except processes waiting for a different edge
+      sens_list_t **where = &(group->pending);
       for (it = group->pending; it != NULL; it = next) {
          next = it->next;
-         rt_wakeup(it);
-         group->pending = next;
+         if (it->edge != 0
+             && !(it->edge & (1 << *(uint8_t *)group->resolved)))
+            where = &(it->next);
+         else {
+            *where = next;
+            rt_wakeup(it);
+         }
       }
 
       // Now check the global pending list
@@ -1755,20 +2365,115 @@ static void rt_update_group(netgroup_t *group, int driver, void *values)
          }
       }
 
-      // Schedule any callbacks to run
-      for (watch_list_t *wl = group->watching; wl != NULL; wl = wl->next) {
-         if (!wl->watch->pending) {
-            wl->watch->chain_pending = callbacks;
-            wl->watch->pending = true;
-            callbacks = wl->watch;
+      rt_notify_watchers(group);
+   }
+}
+
+static void rt_resolve_word(netgroup_t *group, void *data, int length)
+{
+   // Resolve the value of a single driver in place
+
+   if (group->resolution == NULL || (group->resolution->flags & R_IDENT))
+      return;
+   else if (group->resolution->flags & R_MEMO) {
+      int8_t *p = data;
+      for (int j = 0; j < length; j++)
+         p[j] = group->resolution->tab1[(int)p[j]];
+   }
+   else {
+      for (int j = 0; j < length; j++) {
+#define CALL_RESOLUTION_FN1(type) do {                                  \
+            type *p = data;                                             \
+            type val = p[j];                                            \
+            p[j] = (*group->resolution->fn)(&val, 1);                   \
+         } while (0)
+
+         FOR_ALL_SIZES(group->size, CALL_RESOLUTION_FN1);
+      }
+   }
+}
+
+static bool rt_memory_changed(netgroup_t *group, netid_t first, netid_t last)
+{
+   // Test whether any word overlapping the nets was changed by this update
+
+   const rt_memory_t *m = group->memory;
+   const unsigned wfirst = (first - group->first) / m->stride;
+   const unsigned wlast  = (last - group->first) / m->stride;
+
+   for (unsigned w = wfirst; w <= wlast; w++) {
+      if (m->dirty[w / 64] & (UINT64_C(1) << (w % 64)))
+         return true;
+   }
+
+   return false;
+}
+
+static void rt_update_memory(netgroup_t *group)
+{
+   rt_memory_t *m = group->memory;
+   const size_t wordsz = m->stride * group->size;
+
+   TRACE("update memory %s words=%u", fmt_group(group), m->nstaged);
+
+   uint8_t *driving  = (uint8_t *)group->drivers[0].waveforms->values->data;
+   uint8_t *resolved = group->resolved;
+   const bool forced = !!(group->flags & NET_F_FORCED);
+
+   // Leave the dirty bit set only for words whose value changed
+   unsigned nchanged = 0;
+   for (unsigned i = 0; i < m->nstaged; i++) {
+      const uint32_t w = m->words[i];
+      uint8_t *value = m->data + (i * wordsz);
+
+      memcpy(driving + (w * wordsz), value, wordsz);
+      rt_resolve_word(group, value, m->stride);
+
+      if (forced || memcmp(resolved + (w * wordsz), value, wordsz) == 0)
+         m->dirty[w / 64] &= ~(UINT64_C(1) << (w % 64));
+      else {
+         if (group->flags & NET_F_LAST_VALUE)
+            memcpy((uint8_t *)group->last_value + (w * wordsz),
+                   resolved + (w * wordsz), wordsz);
+         memcpy(resolved + (w * wordsz), value, wordsz);
+         nchanged++;
+      }
+   }
+
+   rt_activate_group(group, nchanged > 0 ? NET_F_ACTIVE | NET_F_EVENT
+                     : NET_F_ACTIVE);
+
+   if (nchanged > 0) {
+      group->last_event = now;
+
+      sens_list_t **where = &(group->pending);
+      for (sens_list_t *it = group->pending, *next; it != NULL; it = next) {
+         next = it->next;
+         if (it->first != NETID_INVALID
+             && !rt_memory_changed(group, it->first, it->last))
+            where = &(it->next);
+         else {
+            *where = next;
+            rt_wakeup(it);
          }
       }
+
+      rt_notify_watchers(group);
+
+      for (unsigned i = 0; i < m->nstaged; i++) {
+         const uint32_t w = m->words[i];
+         m->dirty[w / 64] &= ~(UINT64_C(1) << (w % 64));
+      }
    }
+
+   m->nstaged = 0;
 }
 
 static void rt_update_driver(netgroup_t *group, rt_proc_t *proc)
 {
-   if (likely(proc != NULL)) {
+   if (unlikely(group->flags & NET_F_MEMORY) && proc != NULL)
+      rt_update_memory(group);
+   else if (likely(proc != NULL)) {
       // Find the driver owned by proc
       int driver;
       for (driver = 0; driver < group->n_drivers; driver++) {
@@ -1839,11 +2544,14 @@ static void rt_iteration_limit(void)
              "The following processes are active:\n",
              opt_get_int("stop-delta"));
 
-   for (sens_list_t *it = resume; it != NULL; it = it->next) {
-      tree_t p = it->proc->source;
-      const loc_t *l = tree_loc(p);
-      tb_printf(buf, "  %-30s %s line %d\n", istr(tree_ident(p)),
-                l->file, l->first_line);
+   for (int level = -1; level < n_levels; level++) {
+      sens_list_t *list = (level == -1) ? resume : level_resume[level];
+      for (sens_list_t *it = list; it != NULL; it = it->next) {
+         tree_t p = it->proc->source;
+         const loc_t *l = tree_loc(p);
+         tb_printf(buf, "  %-30s %s line %d\n", istr(tree_ident(p)),
+                   l->file, l->first_line);
+      }
    }
 
    tb_printf(buf, "You can increase this limit with --stop-delta");
@@ -1875,6 +2583,55 @@ static void rt_resume_processes(sens_list_t **list)
    *list = NULL;
 }
 
+static void rt_resume_levels(int stop_delta)
+{
+   // Run the levelised combinational processes in topological order
+   // applying zero-delay updates to the nets between them as each level
+   // completes so a chain of processes settles in a single delta cycle
+
+   level_bypass = false;
+
+   int restarts = 0;
+   while (level_next < n_levels) {
+      const int level = level_next++;
+
+      rt_resume_processes(&(level_resume[level]));
+
+      event_t *e = level_drivers[level];
+      level_drivers[level] = NULL;
+
+      while (e != NULL) {
+         event_t *next = e->delta_chain;
+         rt_update_driver(e->group, e->proc);
+         rt_free(event_stack, e);
+         e = next;
+      }
+
+      // Processes sensitive to a whole signal may be woken again by an
+      // update to a part they do not read: this is harmless but if it
+      // keeps happening there is feedback the optimiser could not see
+      // so fall back to scheduling the remaining updates as deltas
+      if (level_next <= level && ++restarts == stop_delta) {
+         level_bypass = true;
+
+         for (int i = 0; i < n_levels; i++) {
+            for (e = level_drivers[i]; e != NULL; ) {
+               event_t *next = e->delta_chain;
+               deltaq_insert(e);
+               e = next;
+            }
+            level_drivers[i] = NULL;
+         }
+      }
+   }
+
+   level_bypass = true;
+
+   // Non-levelised processes sensitive to the nets just updated
+   rt_resume_processes(&resume);
+   rt_event_callback(false);
+}
+
 static void rt_event_callback(bool postponed)
 {
    watch_t **last = &callbacks;
@@ -1895,17 +2652,19 @@ static void rt_event_callback(bool postponed)
 
 static inline bool rt_next_cycle_is_delta(void)
 {
-   return (delta_driver != NULL) || (delta_proc != NULL);
+   return (delta_driver != NULL) || (delta_proc != NULL) || (n_deferred > 0);
 }
 
 static void rt_cycle(int stop_delta)
 {
    // Simulation cycle is described in LRM 93 section 12.6.4
 
-   const bool is_delta_cycle = (delta_driver != NULL) || (delta_proc != NULL);
+   const bool is_delta_cycle = rt_next_cycle_is_delta();
 
-   if (is_delta_cycle)
+   if (is_delta_cycle) {
       iteration = iteration + 1;
+      n_deltas++;
+   }
    else {
       event_t *peek = heap_min(eventq_heap);
       while (unlikely(rt_stale_event(peek))) {
@@ -1968,6 +2727,9 @@ static void rt_cycle(int stop_delta)
       case E_TIMEOUT:
          (*event->timeout_fn)(now, event->timeout_user);
          break;
+      case E_CLOCK:
+         rt_clock_tick(event->clock);
+         break;
       }
 
       rt_free(event_stack, event);
@@ -1984,10 +2746,19 @@ static void rt_cycle(int stop_delta)
    // Run all non-postponed event callbacks
    rt_event_callback(false);
 
+   // Updates held back from earlier levelised cycles
+   if (n_deferred > 0)
+      level_release_deferred();
+
    // Run all processes that resumed because of signal events
    rt_resume_processes(&resume);
+   if (n_levels > 0)
+      rt_resume_levels(stop_delta);
    rt_global_event(RT_END_OF_PROCESSES);
 
+   if (n_staged > 0)
+      rt_commit_staged();
+
    for (unsigned i = 0; i < n_active_groups; i++) {
       netgroup_t *g = active_groups[i];
       g->flags &= ~(NET_F_ACTIVE | NET_F_EVENT);
@@ -2101,6 +2872,11 @@ static void rt_cleanup(tree_t top)
    netdb_walk(netdb, rt_cleanup_group);
    netdb_close(netdb);
 
+   if (image != NULL) {
+      netdb_close_image(image);
+      image = NULL;
+   }
+
    while (watches != NULL) {
       watch_t *next = watches->chain_all;
       rt_free(watch_stack, watches);
@@ -2133,7 +2909,7 @@ static void rt_cleanup(tree_t top)
 
 static bool rt_stop_now(uint64_t stop_time)
 {
-   if ((delta_driver != NULL) || (delta_proc != NULL))
+   if (rt_next_cycle_is_delta())
       return false;
    else if (heap_size(eventq_heap) == 0)
       return true;
@@ -2152,20 +2928,21 @@ static void rt_stats_print(void)
    nvc_rusage_t ru;
    nvc_rusage(&ru);
 
-   notef("setup:%ums run:%ums maxrss:%ukB", ready_rusage.ms, ru.ms, ru.rss);
+   notef("setup:%ums run:%ums maxrss:%ukB deltas:%"PRIu64" runs:%"PRIu64,
+         ready_rusage.ms, ru.ms, ru.rss, n_deltas, n_runs);
 }
 
 static void rt_reset_coverage(tree_t top)
 {
    int32_t *cover_stmts = jit_var_ptr("cover_stmts", false);
    if (cover_stmts != NULL) {
-      const int ntags = tree_attr_int(top, ident_new("stmt_tags"), 0);
+      const int ntags = tree_attr_int(top, stmt_tags_i, 0);
       memset(cover_stmts, '\0', sizeof(int32_t) * ntags);
    }
 
    int32_t *cover_conds = jit_var_ptr("cover_conds", false);
    if (cover_conds != NULL) {
-      const int ntags = tree_attr_int(top, ident_new("cond_tags"), 0);
+      const int ntags = tree_attr_int(top, cond_tags_i, 0);
       memset(cover_conds, '\0', sizeof(int32_t) * ntags);
    }
 }
@@ -2178,6 +2955,21 @@ static void rt_emit_coverage(tree_t top)
       cover_report(top, cover_stmts, cover_conds);
 }
 
+static void rt_emit_profile(tree_t top)
+{
+   const char *path = opt_get_str("pgo-collect");
+   if (path == NULL)
+      return;
+
+   const pgo_unit_t *table = jit_var_ptr("pgo_table", false);
+   const int32_t *count = jit_var_ptr("pgo_count", false);
+   if (table == NULL || count == NULL)
+      warnf("%s was not elaborated with --pgo-collect",
+            istr(tree_ident(top)));
+   else
+      pgo_write(top, path, table, *count);
+}
+
 static void rt_interrupt(void)
 {
    if (active_proc != NULL)
@@ -2248,6 +3040,7 @@ void rt_end_of_tool(tree_t top)
 {
    rt_cleanup(top);
    rt_emit_coverage(top);
+   rt_emit_profile(top);
 
    jit_shutdown();
 
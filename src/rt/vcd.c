@@ -39,10 +39,10 @@ struct vcd_data {
    watch_t      *watch;
 };
 
-static FILE    *vcd_file;
-static tree_t   vcd_top;
-static ident_t  vcd_data_i;
-static uint64_t last_time;
+static FILE        *vcd_file;
+static tree_t       vcd_top;
+static vcd_data_t **vcd_data;   // Indexed by position in top-level decls
+static uint64_t     last_time;
 
 static void vcd_fmt_int(tree_t decl, watch_t *w, vcd_data_t *data)
 {
@@ -120,7 +120,7 @@ static bool vcd_can_fmt_chars(type_t type, vcd_data_t *data)
       return false;
 }
 
-static void vcd_process_signal(tree_t d, int *next_key)
+static vcd_data_t *vcd_process_signal(tree_t d, int *next_key)
 {
    type_t type = tree_type(d);
    type_t base = type_base_recur(type);
@@ -135,7 +135,7 @@ static void vcd_process_signal(tree_t d, int *next_key)
          warn_at(tree_loc(d), "cannot represent multidimensional arrays "
                  "in VCD format");
          free(data);
-         return;
+         return NULL;
       }
 
       range_t r = type_dim(type, 0);
@@ -154,7 +154,7 @@ static void vcd_process_signal(tree_t d, int *next_key)
          warn_at(tree_loc(d), "cannot represent arrays of type %s "
                  "in VCD format", type_pp(elem));
          free(data);
-         return;
+         return NULL;
       }
    }
    else {
@@ -180,7 +180,7 @@ static void vcd_process_signal(tree_t d, int *next_key)
          warn_at(tree_loc(d), "cannot represent type %s in VCD format",
                  type_pp(type));
          free(data);
-         return;
+         return NULL;
       }
    }
 
@@ -191,8 +191,6 @@ static void vcd_process_signal(tree_t d, int *next_key)
    if (type_is_array(type))
       snprintf(name + base_len, 64, "[%d:%d]\n", msb, lsb);
 
-   tree_add_attr_ptr(d, vcd_data_i, data);
-
    data->watch = rt_set_event_cb(d, vcd_event_cb, data, true);
 
    vcd_key_fmt(*next_key, data->key);
@@ -201,6 +199,26 @@ static void vcd_process_signal(tree_t d, int *next_key)
            (int)data->size, data->key, name);
 
    ++(*next_key);
+   return data;
+}
+
+static void vcd_free_data(void)
+{
+   const int ndecls = tree_decls(vcd_top);
+   for (int i = 0; i < ndecls; i++) {
+      free(vcd_data[i]);
+      vcd_data[i] = NULL;
+   }
+}
+
+static void vcd_close(void)
+{
+   fclose(vcd_file);
+   vcd_file = NULL;
+
+   vcd_free_data();
+   free(vcd_data);
+   vcd_data = NULL;
 }
 
 void vcd_restart(void)
@@ -208,6 +226,9 @@ void vcd_restart(void)
    if (vcd_file == NULL)
       return;
 
+   // Data from the previous run refers to watches which no longer exist
+   vcd_free_data();
+
    vcd_emit_header();
 
    int next_key = 0;
@@ -220,13 +241,13 @@ void vcd_restart(void)
          break;
       case T_SIGNAL_DECL:
          if (wave_should_dump(d))
-            vcd_process_signal(d, &next_key);
+            vcd_data[i] = vcd_process_signal(d, &next_key);
          break;
       default:
          break;
       }
 
-      int npop = tree_attr_int(d, ident_new("scope_pop"), 0);
+      int npop = tree_attr_int(d, scope_pop_i, 0);
       while (npop-- > 0)
          fprintf(vcd_file, "$upscope $end\n");
    }
@@ -238,12 +259,9 @@ void vcd_restart(void)
    last_time = UINT64_MAX;
 
    for (int i = 0; i < ndecls; i++) {
-      tree_t d = tree_decl(vcd_top, i);
-      if (tree_kind(d) == T_SIGNAL_DECL) {
-         vcd_data_t *data = tree_attr_ptr(d, vcd_data_i);
-         if (likely(data != NULL))
-            vcd_event_cb(0, d, data->watch, data);
-      }
+      vcd_data_t *data = vcd_data[i];
+      if (data != NULL)
+         vcd_event_cb(0, tree_decl(vcd_top, i), data->watch, data);
    }
 
    fprintf(vcd_file, "$end\n");
@@ -251,9 +269,8 @@ void vcd_restart(void)
 
 void vcd_init(const char *filename, tree_t top)
 {
-   vcd_data_i   = ident_new("vcd_data");
-
-   vcd_top = top;
+   vcd_top  = top;
+   vcd_data = xcalloc(tree_decls(top) * sizeof(vcd_data_t *));
 
    warnf("Use of the VCD file format is discouraged as it cannot fully "
          "represent many VHDL types and the performance is poor for large "
@@ -263,4 +280,6 @@ void vcd_init(const char *filename, tree_t top)
    vcd_file = fopen(filename, "w");
    if (vcd_file == NULL)
       fatal_errno("failed to open VCD output %s", filename);
+
+   atexit(vcd_close);
 }
@@ -18,45 +18,158 @@
 #include "rt.h"
 #include "util.h"
 #include "tree.h"
+#include "hash.h"
 
 #include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// The include and exclude globs are compiled into a single trie where
+// a `*' wildcard is an edge to a node which loops back to itself on any
+// character and a `?' wildcard is an edge taken by any one character.
+// A name is matched against every pattern at once by tracking the set
+// of active nodes as each character is consumed.
+
+#define GLOB_INCLUDE (1 << 0)
+#define GLOB_EXCLUDE (1 << 1)
+
+typedef struct glob_node glob_node_t;
 
 typedef struct {
-   char  *text;
-   size_t len;
-} glob_t;
+   char         ch;
+   glob_node_t *node;
+} glob_edge_t;
 
-static int     n_incl = 0;
-static int     incl_sz = 0;
-static int     n_excl = 0;
-static int     excl_sz = 0;
-static glob_t *incl;
-static glob_t *excl;
+struct glob_node {
+   glob_edge_t *edges;
+   unsigned     nedges;
+   unsigned     max_edges;
+   glob_node_t *star;
+   glob_node_t *any;
+   uint64_t     mark;
+   bool         loop;
+   uint8_t      accept;
+};
 
-void wave_include_glob(const char *glob)
+static glob_node_t   root;
+static int           n_incl = 0;
+static unsigned      n_nodes = 1;
+static uint64_t      mark = 0;
+static glob_node_t **active = NULL;
+static glob_node_t **next = NULL;
+static hash_t       *decisions = NULL;
+
+static glob_node_t *wave_new_node(bool loop)
+{
+   glob_node_t *n = xmalloc(sizeof(glob_node_t));
+   memset(n, '\0', sizeof(glob_node_t));
+   n->loop = loop;
+
+   n_nodes++;
+   return n;
+}
+
+static glob_node_t *wave_find_edge(const glob_node_t *n, char ch)
 {
-   if (n_incl == incl_sz) {
-      incl_sz = MAX(incl_sz * 2, 256);
-      incl = xrealloc(incl, incl_sz * sizeof(glob_t));
+   for (unsigned i = 0; i < n->nedges; i++) {
+      if (n->edges[i].ch == ch)
+         return n->edges[i].node;
    }
 
-   incl[n_incl].text = strdup(glob);
-   incl[n_incl].len  = strlen(glob);
+   return NULL;
+}
 
-   n_incl++;
+static void wave_clear_decisions(void)
+{
+   // Cached decisions may no longer be valid
+   if (decisions != NULL) {
+      hash_free(decisions);
+      decisions = NULL;
+   }
 }
 
-void wave_exclude_glob(const char *glob)
+static void wave_free_node(glob_node_t *n)
+{
+   for (unsigned i = 0; i < n->nedges; i++)
+      wave_free_node(n->edges[i].node);
+
+   if (n->star != NULL)
+      wave_free_node(n->star);
+   if (n->any != NULL)
+      wave_free_node(n->any);
+
+   free(n->edges);
+
+   if (n != &root)
+      free(n);
+}
+
+void wave_reset(void)
+{
+   // Forget every include and exclude pattern
+   wave_free_node(&root);
+   memset(&root, '\0', sizeof(glob_node_t));
+
+   n_incl  = 0;
+   n_nodes = 1;
+
+   wave_clear_decisions();
+
+   free(active);
+   free(next);
+   active = next = NULL;
+}
+
+static void wave_add_glob(const char *glob, uint8_t flag)
 {
-   if (n_excl == excl_sz) {
-      excl_sz = MAX(excl_sz * 2, 256);
-      excl = xrealloc(excl, excl_sz * sizeof(glob_t));
+   glob_node_t *n = &root;
+   for (const char *p = glob; *p != '\0'; p++) {
+      if (*p == '*') {
+         if (n->star == NULL)
+            n->star = wave_new_node(true);
+         n = n->star;
+      }
+      else if (*p == '?') {
+         if (n->any == NULL)
+            n->any = wave_new_node(false);
+         n = n->any;
+      }
+      else {
+         glob_node_t *e = wave_find_edge(n, *p);
+         if (e == NULL) {
+            if (n->nedges == n->max_edges) {
+               n->max_edges = MAX(n->max_edges * 2, 4);
+               n->edges = xrealloc(n->edges,
+                                   n->max_edges * sizeof(glob_edge_t));
+            }
+
+            e = wave_new_node(false);
+            n->edges[n->nedges].ch   = *p;
+            n->edges[n->nedges].node = e;
+            n->nedges++;
+         }
+         n = e;
+      }
    }
 
-   excl[n_excl].text = strdup(glob);
-   excl[n_excl].len  = strlen(glob);
+   n->accept |= flag;
 
-   n_excl++;
+   wave_clear_decisions();
+
+   free(active);
+   free(next);
+   active = next = NULL;
+}
+
+void wave_include_glob(const char *glob)
+{
+   wave_add_glob(glob, GLOB_INCLUDE);
+   n_incl++;
+}
+
+void wave_exclude_glob(const char *glob)
+{
+   wave_add_glob(glob, GLOB_EXCLUDE);
 }
 
 static void wave_process_file(const char *fname, bool include)
@@ -93,6 +206,9 @@ static void wave_process_file(const char *fname, bool include)
 
 void wave_include_file(const char *base)
 {
+   // Decisions made before the lists were loaded are no longer valid
+   wave_clear_decisions();
+
    char buf[256];
 
    checked_sprintf(buf, sizeof(buf), "%s.include", base);
@@ -102,19 +218,83 @@ void wave_include_file(const char *base)
    wave_process_file(buf, false);
 }
 
-bool wave_should_dump(tree_t decl)
+static void wave_activate(glob_node_t *n, glob_node_t **set, unsigned *count)
 {
-   ident_t name = tree_ident(decl);
+   if (n->mark != mark) {
+      n->mark = mark;
+      set[(*count)++] = n;
+   }
+}
 
-   for (int i = 0; i < n_excl; i++) {
-      if (ident_glob(name, excl[i].text, excl[i].len))
-         return false;
+static uint8_t wave_match(const char *str)
+{
+   if (active == NULL) {
+      active = xmalloc(n_nodes * sizeof(glob_node_t *));
+      next   = xmalloc(n_nodes * sizeof(glob_node_t *));
    }
 
-   for (int i = 0; i < n_incl; i++) {
-      if (ident_glob(name, incl[i].text, incl[i].len))
-         return true;
+   unsigned nactive = 1;
+   active[0] = &root;
+
+   for (const char *p = str; *p != '\0'; p++) {
+      mark++;
+
+      unsigned nnext = 0;
+      for (unsigned i = 0; i < nactive; i++) {
+         glob_node_t *n = active[i];
+
+         if (n->loop)
+            wave_activate(n, next, &nnext);
+
+         if (n->star != NULL)
+            wave_activate(n->star, next, &nnext);
+
+         if (n->any != NULL)
+            wave_activate(n->any, next, &nnext);
+
+         glob_node_t *e = wave_find_edge(n, *p);
+         if (e != NULL)
+            wave_activate(e, next, &nnext);
+      }
+
+      if (nnext == 0)
+         return 0;
+
+      glob_node_t **tmp = active;
+      active  = next;
+      next    = tmp;
+      nactive = nnext;
    }
 
-   return (n_incl == 0);
+   uint8_t accept = 0;
+   for (unsigned i = 0; i < nactive; i++)
+      accept |= active[i]->accept;
+
+   return accept;
+}
+
+bool wave_should_dump(tree_t decl)
+{
+   // The decision is cached as each waveform format asks separately
+   // and restarting the simulation asks again
+   if (decisions == NULL)
+      decisions = hash_new(1024, true);
+   else {
+      void *cached = hash_get(decisions, decl);
+      if (cached != NULL)
+         return (uintptr_t)cached - 1;
+   }
+
+   const uint8_t accept = wave_match(istr(tree_ident(decl)));
+
+   bool dump;
+   if (accept & GLOB_EXCLUDE)
+      dump = false;
+   else if (accept & GLOB_INCLUDE)
+      dump = true;
+   else
+      dump = (n_incl == 0);
+
+   hash_put(decisions, decl, (void *)(uintptr_t)(dump + 1));
+   return dump;
 }
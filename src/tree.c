@@ -324,18 +324,37 @@ static tree_kind_t decl_kinds[] = {
    T_USE,        T_PROT_BODY
 };
 
+// Subprogram bodies and large aggregates are often never used by a
+// design that loads the unit so defer decoding them until first access
+static const lazy_item_t lazy_items[] = {
+   { T_FUNC_BODY, I_DECLS | I_STMTS, 1  },
+   { T_PROC_BODY, I_DECLS | I_STMTS, 1  },
+   { T_AGGREGATE, I_ASSOCS,          32 },
+   { -1,          0,                 0  }
+};
+
 object_class_t tree_object = {
    .name           = "tree",
    .change_allowed = change_allowed,
+   .lazy_items     = lazy_items,
    .has_map        = has_map,
    .kind_text_map  = kind_text_map,
    .tag            = OBJECT_TAG_TREE,
    .last_kind      = T_LAST_TREE_KIND,
    .gc_roots       = { T_ARCH, T_ENTITY, T_PACKAGE, T_ELAB, T_PACK_BODY,
-                       T_CONTEXT },
-   .gc_num_roots   = 5
+                       T_CONTEXT, T_CONFIG },
+   .gc_num_roots   = 7
 };
 
+// Incremented by each collection so pointer-keyed caches elsewhere can
+// tell when their keys may have been freed
+static unsigned gc_epoch = 0;
+
+#define tree_array(t, mask) \
+   object_array(&(lookup_item(&tree_object, (t), (mask))->tree_array))
+#define tree_array_mut(t, mask) \
+   object_array(&(mutate_item(&tree_object, (t), (mask))->tree_array))
+
 static bool tree_kind_in(tree_t t, const tree_kind_t *list, size_t len)
 {
    for (size_t i = 0; i < len; i++) {
@@ -376,7 +395,39 @@ tree_t tree_new(tree_kind_t kind)
 
 void tree_gc(void)
 {
-   object_gc();
+   object_gc(false);
+   gc_epoch++;
+}
+
+void tree_gc_full(void)
+{
+   object_gc(true);
+   gc_epoch++;
+}
+
+unsigned tree_gc_epoch(void)
+{
+   return gc_epoch;
+}
+
+void tree_gc_stats(void)
+{
+   object_gc_stats();
+}
+
+void tree_unroot(tree_t t)
+{
+   object_unroot(&(t->object));
+}
+
+unsigned tree_gc_arenas(void)
+{
+   return object_arena_count();
+}
+
+size_t tree_gc_objects(void)
+{
+   return object_live_count();
 }
 
 const loc_t *tree_loc(tree_t t)
@@ -408,7 +459,7 @@ bool tree_has_ident(tree_t t)
 
 void tree_set_ident(tree_t t, ident_t i)
 {
-   lookup_item(&tree_object, t, I_IDENT)->ident = i;
+   mutate_item(&tree_object, t, I_IDENT)->ident = i;
 }
 
 ident_t tree_ident2(tree_t t)
@@ -420,7 +471,7 @@ ident_t tree_ident2(tree_t t)
 
 void tree_set_ident2(tree_t t, ident_t i)
 {
-   lookup_item(&tree_object, t, I_IDENT2)->ident = i;
+   mutate_item(&tree_object, t, I_IDENT2)->ident = i;
 }
 
 bool tree_has_ident2(tree_t t)
@@ -453,7 +504,7 @@ tree_t tree_port(tree_t t, unsigned n)
 void tree_add_port(tree_t t, tree_t d)
 {
    tree_assert_decl(d);
-   tree_array_add(&(lookup_item(&tree_object, t, I_PORTS)->tree_array), d);
+   tree_array_add(&(mutate_item(&tree_object, t, I_PORTS)->tree_array), d);
 }
 
 unsigned tree_subkind(tree_t t)
@@ -464,7 +515,7 @@ unsigned tree_subkind(tree_t t)
 
 void tree_set_subkind(tree_t t, unsigned sub)
 {
-   lookup_item(&tree_object, t, I_SUBKIND)->ival = sub;
+   mutate_item(&tree_object, t, I_SUBKIND)->ival = sub;
 }
 
 unsigned tree_generics(tree_t t)
@@ -481,7 +532,7 @@ tree_t tree_generic(tree_t t, unsigned n)
 void tree_add_generic(tree_t t, tree_t d)
 {
    tree_assert_decl(d);
-   tree_array_add(&(lookup_item(&tree_object, t, I_GENERICS)->tree_array), d);
+   tree_array_add(&(mutate_item(&tree_object, t, I_GENERICS)->tree_array), d);
 }
 
 type_t tree_type(tree_t t)
@@ -493,7 +544,7 @@ type_t tree_type(tree_t t)
 
 void tree_set_type(tree_t t, type_t ty)
 {
-   lookup_item(&tree_object, t, I_TYPE)->type = ty;
+   mutate_item(&tree_object, t, I_TYPE)->type = ty;
 }
 
 bool tree_has_type(tree_t t)
@@ -517,7 +568,7 @@ void tree_add_param(tree_t t, tree_t e)
    assert(tree_kind(e) == T_PARAM);
    tree_assert_expr(tree_value(e));
 
-   tree_array_t *array = &(lookup_item(&tree_object, t, I_PARAMS)->tree_array);
+   tree_array_t *array = &(mutate_item(&tree_object, t, I_PARAMS)->tree_array);
 
    if (tree_subkind(e) == P_POS)
       tree_set_pos(e, array->count);
@@ -540,12 +591,12 @@ void tree_add_genmap(tree_t t, tree_t e)
 {
    tree_assert_expr(tree_value(e));
 
-   tree_array_t *array = &(lookup_item(&tree_object, t, I_GENMAPS)->tree_array);
+   tree_array_t *array = &(mutate_item(&tree_object, t, I_GENMAPS)->tree_array);
 
    if (tree_subkind(e) == P_POS)
       tree_set_pos(e, array->count);
 
-   tree_array_add(&(lookup_item(&tree_object, t, I_GENMAPS)->tree_array), e);
+   tree_array_add(&(mutate_item(&tree_object, t, I_GENMAPS)->tree_array), e);
 }
 
 int64_t tree_ival(tree_t t)
@@ -557,7 +608,7 @@ int64_t tree_ival(tree_t t)
 void tree_set_ival(tree_t t, int64_t i)
 {
    assert((t->object.kind == T_LITERAL) && (tree_subkind(t) == L_INT));
-   lookup_item(&tree_object, t, I_IVAL)->ival = i;
+   mutate_item(&tree_object, t, I_IVAL)->ival = i;
 }
 
 double tree_dval(tree_t t)
@@ -569,7 +620,7 @@ double tree_dval(tree_t t)
 void tree_set_dval(tree_t t, double d)
 {
    assert((t->object.kind == T_LITERAL) && (tree_subkind(t) == L_REAL));
-   lookup_item(&tree_object, t, I_DVAL)->dval = d;
+   mutate_item(&tree_object, t, I_DVAL)->dval = d;
 }
 
 unsigned tree_chars(tree_t t)
@@ -588,7 +639,7 @@ tree_t tree_char(tree_t t, unsigned n)
 void tree_add_char(tree_t t, tree_t ref)
 {
    assert((t->object.kind == T_LITERAL) && (tree_subkind(t) == L_STRING));
-   tree_array_add(&(lookup_item(&tree_object, t, I_CHARS)->tree_array), ref);
+   tree_array_add(&(mutate_item(&tree_object, t, I_CHARS)->tree_array), ref);
 }
 
 bool tree_has_value(tree_t t)
@@ -607,41 +658,39 @@ void tree_set_value(tree_t t, tree_t v)
 {
    if ((v != NULL) && (t->object.kind != T_ASSOC) && (t->object.kind != T_SPEC))
       tree_assert_expr(v);
-   lookup_item(&tree_object, t, I_VALUE)->tree = v;
+   mutate_item(&tree_object, t, I_VALUE)->tree = v;
 }
 
 unsigned tree_decls(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_DECLS)->tree_array.count;
+   return tree_array(t, I_DECLS)->count;
 }
 
 tree_t tree_decl(tree_t t, unsigned n)
 {
-   item_t *item = lookup_item(&tree_object, t, I_DECLS);
-   return tree_array_nth(&(item->tree_array), n);
+   return tree_array_nth(tree_array(t, I_DECLS), n);
 }
 
 void tree_add_decl(tree_t t, tree_t d)
 {
    tree_assert_decl(d);
-   tree_array_add(&(lookup_item(&tree_object, t, I_DECLS)->tree_array), d);
+   tree_array_add(tree_array_mut(t, I_DECLS), d);
 }
 
 unsigned tree_stmts(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_STMTS)->tree_array.count;
+   return tree_array(t, I_STMTS)->count;
 }
 
 tree_t tree_stmt(tree_t t, unsigned n)
 {
-   item_t *item = lookup_item(&tree_object, t, I_STMTS);
-   return tree_array_nth(&(item->tree_array), n);
+   return tree_array_nth(tree_array(t, I_STMTS), n);
 }
 
 void tree_add_stmt(tree_t t, tree_t s)
 {
    tree_assert_stmt(s);
-   tree_array_add(&(lookup_item(&tree_object, t, I_STMTS)->tree_array), s);
+   tree_array_add(tree_array_mut(t, I_STMTS), s);
 }
 
 unsigned tree_waveforms(tree_t t)
@@ -658,7 +707,7 @@ tree_t tree_waveform(tree_t t, unsigned n)
 void tree_add_waveform(tree_t t, tree_t w)
 {
    assert(w->object.kind == T_WAVEFORM);
-   tree_array_add(&(lookup_item(&tree_object, t, I_WAVES)->tree_array), w);
+   tree_array_add(&(mutate_item(&tree_object, t, I_WAVES)->tree_array), w);
 }
 
 unsigned tree_else_stmts(tree_t t)
@@ -675,7 +724,7 @@ tree_t tree_else_stmt(tree_t t, unsigned n)
 void tree_add_else_stmt(tree_t t, tree_t s)
 {
    tree_assert_stmt(s);
-   tree_array_add(&(lookup_item(&tree_object, t, I_ELSES)->tree_array), s);
+   tree_array_add(&(mutate_item(&tree_object, t, I_ELSES)->tree_array), s);
 }
 
 unsigned tree_conds(tree_t t)
@@ -692,7 +741,7 @@ tree_t tree_cond(tree_t t, unsigned n)
 void tree_add_cond(tree_t t, tree_t c)
 {
    assert(c->object.kind == T_COND);
-   tree_array_add(&(lookup_item(&tree_object, t, I_CONDS)->tree_array), c);
+   tree_array_add(&(mutate_item(&tree_object, t, I_CONDS)->tree_array), c);
 }
 
 bool tree_has_delay(tree_t t)
@@ -710,7 +759,7 @@ tree_t tree_delay(tree_t t)
 void tree_set_delay(tree_t t, tree_t d)
 {
    tree_assert_expr(d);
-   lookup_item(&tree_object, t, I_DELAY)->tree = d;
+   mutate_item(&tree_object, t, I_DELAY)->tree = d;
 }
 
 unsigned tree_triggers(tree_t t)
@@ -727,7 +776,7 @@ tree_t tree_trigger(tree_t t, unsigned n)
 void tree_add_trigger(tree_t t, tree_t s)
 {
    tree_assert_expr(s);
-   tree_array_add(&(lookup_item(&tree_object, t, I_TRIGGERS)->tree_array), s);
+   tree_array_add(&(mutate_item(&tree_object, t, I_TRIGGERS)->tree_array), s);
 }
 
 unsigned tree_ops(tree_t t)
@@ -743,7 +792,7 @@ tree_t tree_op(tree_t t, unsigned n)
 void tree_add_op(tree_t t, tree_t s)
 {
    assert((s->object.kind == T_FUNC_DECL) || (s->object.kind == T_PROC_DECL));
-   tree_array_add(&(lookup_item(&tree_object, t, I_OPS)->tree_array), s);
+   tree_array_add(&(mutate_item(&tree_object, t, I_OPS)->tree_array), s);
 }
 
 tree_t tree_target(tree_t t)
@@ -755,7 +804,7 @@ tree_t tree_target(tree_t t)
 
 void tree_set_target(tree_t t, tree_t lhs)
 {
-   lookup_item(&tree_object, t, I_TARGET)->tree = lhs;
+   mutate_item(&tree_object, t, I_TARGET)->tree = lhs;
 }
 
 tree_t tree_ref(tree_t t)
@@ -772,7 +821,7 @@ bool tree_has_ref(tree_t t)
 
 void tree_set_ref(tree_t t, tree_t decl)
 {
-   lookup_item(&tree_object, t, I_REF)->tree = decl;
+   mutate_item(&tree_object, t, I_REF)->tree = decl;
 }
 
 vcode_unit_t tree_code(tree_t t)
@@ -789,7 +838,7 @@ bool tree_has_code(tree_t t)
 
 void tree_set_code(tree_t t, vcode_unit_t code)
 {
-   lookup_item(&tree_object, t, I_CODE)->code = code;
+   mutate_item(&tree_object, t, I_CODE)->code = code;
 }
 
 tree_t tree_spec(tree_t t)
@@ -806,7 +855,7 @@ bool tree_has_spec(tree_t t)
 
 void tree_set_spec(tree_t t, tree_t s)
 {
-   lookup_item(&tree_object, t, I_SPEC)->tree = s;
+   mutate_item(&tree_object, t, I_SPEC)->tree = s;
 }
 
 unsigned tree_contexts(tree_t t)
@@ -824,25 +873,24 @@ void tree_add_context(tree_t t, tree_t ctx)
 {
    assert(ctx->object.kind == T_USE || ctx->object.kind == T_LIBRARY
           || ctx->object.kind == T_CTXREF);
-   tree_array_add(&(lookup_item(&tree_object, t, I_CONTEXT)->tree_array), ctx);
+   tree_array_add(&(mutate_item(&tree_object, t, I_CONTEXT)->tree_array), ctx);
 }
 
 unsigned tree_assocs(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_ASSOCS)->tree_array.count;
+   return tree_array(t, I_ASSOCS)->count;
 }
 
 tree_t tree_assoc(tree_t t, unsigned n)
 {
-   item_t *item = lookup_item(&tree_object, t, I_ASSOCS);
-   return tree_array_nth(&(item->tree_array), n);
+   return tree_array_nth(tree_array(t, I_ASSOCS), n);
 }
 
 void tree_add_assoc(tree_t t, tree_t a)
 {
    assert(a->object.kind == T_ASSOC);
 
-   tree_array_t *array = &(lookup_item(&tree_object, t, I_ASSOCS)->tree_array);
+   tree_array_t *array = tree_array_mut(t, I_ASSOCS);
 
    if (tree_subkind(a) == A_POS)
       tree_set_pos(a, array->count);
@@ -852,30 +900,40 @@ void tree_add_assoc(tree_t t, tree_t a)
 
 unsigned tree_nets(tree_t t)
 {
-   return lookup_item(&tree_object, t, I_NETS)->netid_array.count;
+   return lookup_item(&tree_object, t, I_NETS)->netid_runs.count;
 }
 
 netid_t tree_net(tree_t t, unsigned n)
 {
    item_t *item = lookup_item(&tree_object, t, I_NETS);
-   netid_t nid = netid_array_nth(&(item->netid_array), n);
+   netid_t nid = netid_runs_nth(&(item->netid_runs), n, NULL);
    assert(nid != NETID_INVALID);
    return nid;
 }
 
-void tree_add_net(tree_t t, netid_t n)
+netid_t tree_net_run(tree_t t, unsigned n, unsigned *length)
 {
-   netid_array_add(&(lookup_item(&tree_object, t, I_NETS)->netid_array), n);
+   item_t *item = lookup_item(&tree_object, t, I_NETS);
+   netid_t nid = netid_runs_nth(&(item->netid_runs), n, length);
+   assert(nid != NETID_INVALID);
+   return nid;
 }
 
-void tree_change_net(tree_t t, unsigned n, netid_t i)
+void tree_add_net(tree_t t, netid_t n)
 {
-   item_t *item = lookup_item(&tree_object, t, I_NETS);
+   netid_runs_add(&(mutate_item(&tree_object, t, I_NETS)->netid_runs), n, 1);
+}
 
-   if (n >= item->netid_array.count)
-      netid_array_resize(&(item->netid_array), n + 1, NETID_INVALID);
+void tree_add_nets(tree_t t, netid_t first, unsigned count)
+{
+   item_t *item = mutate_item(&tree_object, t, I_NETS);
+   netid_runs_add(&(item->netid_runs), first, count);
+}
 
-   item->netid_array.items[n] = i;
+void tree_change_net(tree_t t, unsigned n, netid_t i)
+{
+   item_t *item = mutate_item(&tree_object, t, I_NETS);
+   netid_runs_set(&(item->netid_runs), n, i);
 }
 
 tree_t tree_severity(tree_t t)
@@ -888,7 +946,7 @@ tree_t tree_severity(tree_t t)
 void tree_set_severity(tree_t t, tree_t s)
 {
    tree_assert_expr(s);
-   lookup_item(&tree_object, t, I_SEVERITY)->tree = s;
+   mutate_item(&tree_object, t, I_SEVERITY)->tree = s;
 }
 
 tree_t tree_message(tree_t t)
@@ -906,7 +964,7 @@ bool tree_has_message(tree_t t)
 void tree_set_message(tree_t t, tree_t m)
 {
    tree_assert_expr(m);
-   lookup_item(&tree_object, t, I_MESSAGE)->tree = m;
+   mutate_item(&tree_object, t, I_MESSAGE)->tree = m;
 }
 
 range_t tree_range(tree_t t)
@@ -916,7 +974,7 @@ range_t tree_range(tree_t t)
 
 void tree_set_range(tree_t t, range_t r)
 {
-   item_t *item = lookup_item(&tree_object, t, I_RANGE);
+   item_t *item = mutate_item(&tree_object, t, I_RANGE);
    if (item->range == NULL)
       item->range = xmalloc(sizeof(range_t));
    *(item->range) = r;
@@ -929,7 +987,7 @@ unsigned tree_pos(tree_t t)
 
 void tree_set_pos(tree_t t, unsigned pos)
 {
-   lookup_item(&tree_object, t, I_POS)->ival = pos;
+   mutate_item(&tree_object, t, I_POS)->ival = pos;
 }
 
 class_t tree_class(tree_t t)
@@ -939,7 +997,7 @@ class_t tree_class(tree_t t)
 
 void tree_set_class(tree_t t, class_t c)
 {
-   lookup_item(&tree_object, t, I_CLASS)->ival = c;
+   mutate_item(&tree_object, t, I_CLASS)->ival = c;
 }
 
 tree_t tree_reject(tree_t t)
@@ -952,7 +1010,7 @@ tree_t tree_reject(tree_t t)
 void tree_set_reject(tree_t t, tree_t r)
 {
    tree_assert_expr(r);
-   lookup_item(&tree_object, t, I_REJECT)->tree = r;
+   mutate_item(&tree_object, t, I_REJECT)->tree = r;
 }
 
 bool tree_has_reject(tree_t t)
@@ -970,7 +1028,7 @@ tree_t tree_name(tree_t t)
 void tree_set_name(tree_t t, tree_t n)
 {
    tree_assert_expr(n);
-   lookup_item(&tree_object, t, I_NAME)->tree = n;
+   mutate_item(&tree_object, t, I_NAME)->tree = n;
 }
 
 tree_t tree_file_mode(tree_t t)
@@ -980,7 +1038,7 @@ tree_t tree_file_mode(tree_t t)
 
 void tree_set_file_mode(tree_t t, tree_t m)
 {
-   lookup_item(&tree_object, t, I_FILE_MODE)->tree = m;
+   mutate_item(&tree_object, t, I_FILE_MODE)->tree = m;
 }
 
 uint32_t tree_index(tree_t t)
@@ -1077,47 +1135,26 @@ tree_t tree_read_recall(tree_rd_ctx_t ctx, uint32_t index)
    return (tree_t)object_read_recall((object_rd_ctx_t *)ctx, index);
 }
 
-static attr_t *tree_find_attr(tree_t t, ident_t name, attr_kind_t kind)
+static attr_value_t *tree_find_attr(tree_t t, ident_t name,
+                                    attr_kind_t kind)
 {
+   // Each key has a dense side table indexed by the attribute slot of
+   // the node so this is a hash of the interned key and an array index
+
    assert(t != NULL);
    assert(name != NULL);
 
    item_t *item = lookup_item(&tree_object, t, I_ATTRS);
-   for (unsigned i = 0; i < item->attrs.num; i++) {
-      if ((item->attrs.table[i].kind == kind)
-          && (item->attrs.table[i].name == name))
-         return &(item->attrs.table[i]);
-   }
-
-   return NULL;
+   return object_attr_find(item->attr_slot, name, kind);
 }
 
-static attr_t *tree_add_attr(tree_t t, ident_t name, attr_kind_t kind)
+static attr_value_t *tree_add_attr(tree_t t, ident_t name, attr_kind_t kind)
 {
    assert(t != NULL);
    assert(name != NULL);
 
-   attr_t *a = tree_find_attr(t, name, kind);
-   if (a != NULL)
-      return a;
-
-   item_t *item = lookup_item(&tree_object, t, I_ATTRS);
-
-   if (item->attrs.table == NULL) {
-      item->attrs.alloc = 8;
-      item->attrs.table = xmalloc(sizeof(attr_t) * item->attrs.alloc);
-   }
-   else if (item->attrs.alloc == item->attrs.num) {
-      item->attrs.alloc *= 2;
-      item->attrs.table = xrealloc(item->attrs.table,
-                                   sizeof(attr_t) * item->attrs.alloc);
-   }
-
-   unsigned i = item->attrs.num++;
-   item->attrs.table[i].kind = kind;
-   item->attrs.table[i].name = name;
-
-   return &(item->attrs.table[i]);
+   item_t *item = mutate_item(&tree_object, t, I_ATTRS);
+   return object_attr_add(&(item->attr_slot), name, kind);
 }
 
 void tree_remove_attr(tree_t t, ident_t name)
@@ -1126,19 +1163,7 @@ void tree_remove_attr(tree_t t, ident_t name)
    assert(name != NULL);
 
    item_t *item = lookup_item(&tree_object, t, I_ATTRS);
-
-   unsigned i;
-   for (i = 0; (i < item->attrs.num)
-           && (item->attrs.table[i].name != name); i++)
-      ;
-
-   if (i == item->attrs.num)
-      return;
-
-   for (; i + 1 < item->attrs.num; i++)
-      item->attrs.table[i] = item->attrs.table[i + 1];
-
-   item->attrs.num--;
+   object_attr_remove(item->attr_slot, name);
 }
 
 void tree_add_attr_str(tree_t t, ident_t name, ident_t str)
@@ -1148,7 +1173,7 @@ void tree_add_attr_str(tree_t t, ident_t name, ident_t str)
 
 ident_t tree_attr_str(tree_t t, ident_t name)
 {
-   attr_t *a = tree_find_attr(t, name, A_STRING);
+   attr_value_t *a = tree_find_attr(t, name, A_STRING);
    return a ? a->sval : NULL;
 }
 
@@ -1159,7 +1184,7 @@ void tree_add_attr_int(tree_t t, ident_t name, int n)
 
 int tree_attr_int(tree_t t, ident_t name, int def)
 {
-   attr_t *a = tree_find_attr(t, name, A_INT);
+   attr_value_t *a = tree_find_attr(t, name, A_INT);
    return a ? a->ival : def;
 }
 
@@ -1170,13 +1195,13 @@ void tree_add_attr_ptr(tree_t t, ident_t name, void *ptr)
 
 void *tree_attr_ptr(tree_t t, ident_t name)
 {
-   attr_t *a = tree_find_attr(t, name, A_PTR);
+   attr_value_t *a = tree_find_attr(t, name, A_PTR);
    return a ? a->pval : NULL;
 }
 
 tree_t tree_attr_tree(tree_t t, ident_t name)
 {
-   attr_t *a = tree_find_attr(t, name, A_TREE);
+   attr_value_t *a = tree_find_attr(t, name, A_TREE);
    return a ? a->tval : NULL;
 }
 
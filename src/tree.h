@@ -292,7 +292,9 @@ void tree_add_char(tree_t t, tree_t ref);
 
 unsigned tree_nets(tree_t t);
 netid_t tree_net(tree_t t, unsigned n);
+netid_t tree_net_run(tree_t t, unsigned n, unsigned *length);
 void tree_add_net(tree_t t, netid_t n);
+void tree_add_nets(tree_t t, netid_t first, unsigned count);
 void tree_change_net(tree_t t, unsigned n, netid_t i);
 
 uint32_t tree_index(tree_t t);
@@ -319,6 +321,12 @@ typedef bool (*tree_copy_fn_t)(tree_t t, void *context);
 tree_t tree_copy(tree_t t, tree_copy_fn_t fn, void *context);
 
 void tree_gc(void);
+void tree_gc_full(void);
+unsigned tree_gc_epoch(void);
+void tree_gc_stats(void);
+void tree_unroot(tree_t t);
+unsigned tree_gc_arenas(void);
+size_t tree_gc_objects(void);
 
 tree_wr_ctx_t tree_write_begin(fbuf_t *f);
 void tree_write(tree_t t, tree_wr_ctx_t ctx);
@@ -245,7 +245,7 @@ bool type_has_ident(type_t t)
 void type_set_ident(type_t t, ident_t id)
 {
    assert(t != NULL);
-   lookup_item(&type_object, t, I_IDENT)->ident = id;
+   mutate_item(&type_object, t, I_IDENT)->ident = id;
 }
 
 unsigned type_dims(type_t t)
@@ -261,12 +261,12 @@ range_t type_dim(type_t t, unsigned n)
 
 void type_add_dim(type_t t, range_t r)
 {
-   range_array_add(&(lookup_item(&type_object, t, I_DIMS)->range_array), r);
+   range_array_add(&(mutate_item(&type_object, t, I_DIMS)->range_array), r);
 }
 
 void type_change_dim(type_t t, unsigned n, range_t r)
 {
-   item_t *item = lookup_item(&type_object, t, I_DIMS);
+   item_t *item = mutate_item(&type_object, t, I_DIMS);
    assert(n < item->range_array.count);
    item->range_array.items[n] = r;
 }
@@ -280,7 +280,7 @@ type_t type_base(type_t t)
 
 void type_set_base(type_t t, type_t b)
 {
-   lookup_item(&type_object, t, I_BASE)->type = b;
+   mutate_item(&type_object, t, I_BASE)->type = b;
 }
 
 type_t type_elem(type_t t)
@@ -298,7 +298,7 @@ type_t type_elem(type_t t)
 
 void type_set_elem(type_t t, type_t e)
 {
-   lookup_item(&type_object, t, I_ELEM)->type = e;
+   mutate_item(&type_object, t, I_ELEM)->type = e;
 }
 
 static type_t type_make_universal(type_kind_t kind, const char *name,
@@ -315,6 +315,9 @@ static type_t type_make_universal(type_kind_t kind, const char *name,
    tree_set_type(min, t);
    tree_set_type(max, t);
 
+   // The caller keeps this in a static variable
+   object_pin(&(t->object));
+
    return t;
 }
 
@@ -384,7 +387,7 @@ tree_t type_unit(type_t t, unsigned n)
 
 void type_add_unit(type_t t, tree_t u)
 {
-   tree_array_add(&(lookup_item(&type_object, t, I_UNITS)->tree_array), u);
+   tree_array_add(&(mutate_item(&type_object, t, I_UNITS)->tree_array), u);
 }
 
 unsigned type_enum_literals(type_t t)
@@ -401,7 +404,7 @@ tree_t type_enum_literal(type_t t, unsigned n)
 void type_enum_add_literal(type_t t, tree_t lit)
 {
    assert(tree_kind(lit) == T_ENUM_LIT);
-   tree_array_add(&(lookup_item(&type_object, t, I_LITERALS)->tree_array), lit);
+   tree_array_add(&(mutate_item(&type_object, t, I_LITERALS)->tree_array), lit);
 }
 
 unsigned type_params(type_t t)
@@ -417,12 +420,12 @@ type_t type_param(type_t t, unsigned n)
 
 void type_add_param(type_t t, type_t p)
 {
-   type_array_add(&(lookup_item(&type_object, t, I_PTYPES)->type_array), p);
+   type_array_add(&(mutate_item(&type_object, t, I_PTYPES)->type_array), p);
 }
 
 void type_change_param(type_t t, unsigned n, type_t p)
 {
-   type_array_t *a = &(lookup_item(&type_object, t, I_PTYPES)->type_array);
+   type_array_t *a = &(mutate_item(&type_object, t, I_PTYPES)->type_array);
    assert(n < a->count);
    a->items[n] = p;
 }
@@ -448,7 +451,7 @@ tree_t type_field(type_t t, unsigned n)
 void type_add_field(type_t t, tree_t p)
 {
    assert(tree_kind(p) == T_FIELD_DECL);
-   tree_array_add(&(lookup_item(&type_object, t, I_FIELDS)->tree_array), p);
+   tree_array_add(&(mutate_item(&type_object, t, I_FIELDS)->tree_array), p);
 }
 
 unsigned type_decls(type_t t)
@@ -464,7 +467,7 @@ tree_t type_decl(type_t t, unsigned n)
 
 void type_add_decl(type_t t, tree_t p)
 {
-   tree_array_add(&(lookup_item(&type_object, t, I_DECLS)->tree_array), p);
+   tree_array_add(&(mutate_item(&type_object, t, I_DECLS)->tree_array), p);
 }
 
 type_t type_result(type_t t)
@@ -476,7 +479,7 @@ type_t type_result(type_t t)
 
 void type_set_result(type_t t, type_t r)
 {
-   lookup_item(&type_object, t, I_RESULT)->type = r;
+   mutate_item(&type_object, t, I_RESULT)->type = r;
 }
 
 void type_replace(type_t t, type_t a)
@@ -494,12 +497,12 @@ unsigned type_index_constrs(type_t t)
 
 void type_add_index_constr(type_t t, type_t c)
 {
-   type_array_add(&(lookup_item(&type_object, t, I_CONSTR)->type_array), c);
+   type_array_add(&(mutate_item(&type_object, t, I_CONSTR)->type_array), c);
 }
 
 void type_change_index_constr(type_t t, unsigned n, type_t c)
 {
-   type_array_t *a = &(lookup_item(&type_object, t, I_CONSTR)->type_array);
+   type_array_t *a = &(mutate_item(&type_object, t, I_CONSTR)->type_array);
    assert(n < a->count);
    a->items[n] = c;
 }
@@ -512,7 +515,7 @@ type_t type_index_constr(type_t t, unsigned n)
 
 void type_set_resolution(type_t t, tree_t r)
 {
-   lookup_item(&type_object, t, I_RESOLUTION)->tree = r;
+   mutate_item(&type_object, t, I_RESOLUTION)->tree = r;
 }
 
 bool type_has_resolution(type_t t)
@@ -534,7 +537,7 @@ type_t type_access(type_t t)
 
 void type_set_access(type_t t, type_t a)
 {
-   lookup_item(&type_object, t, I_ACCESS)->type = a;
+   mutate_item(&type_object, t, I_ACCESS)->type = a;
 }
 
 type_t type_file(type_t t)
@@ -544,7 +547,7 @@ type_t type_file(type_t t)
 
 void type_set_file(type_t t, type_t f)
 {
-   lookup_item(&type_object, t, I_FILE)->type = f;
+   mutate_item(&type_object, t, I_FILE)->type = f;
 }
 
 tree_t type_body(type_t t)
@@ -558,7 +561,7 @@ tree_t type_body(type_t t)
 void type_set_body(type_t t, tree_t b)
 {
    assert(t->object.kind == T_PROTECTED);
-   item_t *item = lookup_item(&type_object, t, I_REF);
+   item_t *item = mutate_item(&type_object, t, I_REF);
    item->tree = b;
 }
 
@@ -487,8 +487,1833 @@ bool vcode_reg_const(vcode_reg_t reg, int64_t *value)
       return false;
 }
 
+int vcode_reg_const_data(vcode_reg_t reg, int64_t *values, int max)
+{
+   // Flatten a constant scalar or array of integers into values and
+   // return the number of elements or -1 if reg is not constant
+
+   op_t *defn = vcode_find_definition(reg);
+   if (defn == NULL)
+      return -1;
+
+   switch (defn->kind) {
+   case VCODE_OP_CONST:
+      if (max < 1)
+         return -1;
+      values[0] = defn->value;
+      return 1;
+
+   case VCODE_OP_CAST:
+      if (vcode_reg_kind(defn->result) != VCODE_TYPE_POINTER)
+         return -1;
+      // Fall-through
+   case VCODE_OP_WRAP:
+   case VCODE_OP_UNWRAP:
+      return vcode_reg_const_data(defn->args.items[0], values, max);
+
+   case VCODE_OP_CONST_ARRAY:
+      {
+         int count = 0;
+         for (int i = 0; i < defn->args.count; i++) {
+            const int n = vcode_reg_const_data(defn->args.items[i],
+                                               values + count, max - count);
+            if (n < 0)
+               return -1;
+            count += n;
+         }
+         return count;
+      }
+
+   default:
+      return -1;
+   }
+}
+
+typedef struct {
+   int64_t low;
+   int64_t high;
+} interval_t;
+
+typedef struct bce_fact bce_fact_t;
+
+// Facts are shared between a block and the blocks it dominates so are
+// kept in persistent linked lists
+struct bce_fact {
+   bce_fact_t  *next;
+   vcode_reg_t  reg;
+   interval_t   range;
+   const op_t  *check;
+};
+
+typedef struct {
+   int           nblocks;
+   int           nregs;
+   int           nvars;
+   int          *rpo;
+   int          *order;
+   int          *idom;
+   int          *npreds;
+   int         **preds;
+   op_t        **defs;
+   int          *def_block;
+   bool         *tracked;
+   interval_t   *var_top;
+   interval_t   *ranges;
+   interval_t  **out;
+   bool         *reached;
+   int          *visits;
+   bool         *header;
+   bce_fact_t  **facts;
+   bce_fact_t   *pool;
+   int           pool_used;
+   int           pool_size;
+   vcode_reg_t  *current;
+   bool          final;
+   int           elided;
+   int           folded;
+} bce_ctx_t;
+
+#define BCE_WIDEN_LIMIT 4
+
+static interval_t bce_type_range(vcode_type_t type)
+{
+   const vtype_t *vt = vcode_type_data(type);
+   if (vt->kind == VCODE_TYPE_INT || vt->kind == VCODE_TYPE_OFFSET)
+      return (interval_t){ vt->low, vt->high };
+   else
+      return (interval_t){ INT64_MIN, INT64_MAX };
+}
+
+static bool bce_is_integer(vcode_reg_t reg)
+{
+   const vtype_kind_t kind = vtype_kind(vcode_reg_data(reg)->type);
+   return kind == VCODE_TYPE_INT || kind == VCODE_TYPE_OFFSET;
+}
+
+static interval_t bce_intersect(interval_t a, interval_t b)
+{
+   return (interval_t){ MAX(a.low, b.low), MIN(a.high, b.high) };
+}
+
+static interval_t bce_hull(interval_t a, interval_t b)
+{
+   return (interval_t){ MIN(a.low, b.low), MAX(a.high, b.high) };
+}
+
+static bool bce_empty(interval_t i)
+{
+   return i.low > i.high;
+}
+
+static bool bce_within(interval_t i, int64_t low, int64_t high)
+{
+   return !bce_empty(i) && i.low >= low && i.high <= high;
+}
+
+static bce_fact_t *bce_new_fact(bce_ctx_t *ctx, bce_fact_t *next)
+{
+   if (ctx->pool_used == ctx->pool_size) {
+      // Facts are only released after the final pass so grow the pool by
+      // chaining a fresh chunk rather than moving existing nodes
+      bce_fact_t *chunk = xmalloc(sizeof(bce_fact_t) * 256);
+      chunk[0].next  = ctx->pool;
+      chunk[0].check = NULL;
+      ctx->pool      = chunk;
+      ctx->pool_used = 1;
+      ctx->pool_size = 256;
+   }
+
+   bce_fact_t *f = &(ctx->pool[ctx->pool_used++]);
+   f->next  = next;
+   f->reg   = VCODE_INVALID_REG;
+   f->check = NULL;
+   return f;
+}
+
+static void bce_free_facts(bce_ctx_t *ctx)
+{
+   while (ctx->pool != NULL) {
+      bce_fact_t *next = ctx->pool[0].next;
+      free(ctx->pool);
+      ctx->pool = next;
+   }
+
+   ctx->pool_used = ctx->pool_size = 0;
+}
+
+static interval_t bce_lookup(bce_ctx_t *ctx, bce_fact_t *facts,
+                             vcode_reg_t reg)
+{
+   interval_t r = ctx->ranges[reg];
+   for (bce_fact_t *f = facts; f != NULL; f = f->next) {
+      if (f->reg == reg)
+         r = bce_intersect(r, f->range);
+   }
+
+   return r;
+}
+
+static bce_fact_t *bce_add_fact(bce_ctx_t *ctx, bce_fact_t *facts,
+                                vcode_reg_t reg, interval_t range)
+{
+   if (!bce_is_integer(reg))
+      return facts;
+
+   interval_t old = bce_lookup(ctx, facts, reg);
+   interval_t new = bce_intersect(old, range);
+   if (bce_empty(new) || (new.low == old.low && new.high == old.high))
+      return facts;
+
+   bce_fact_t *f = bce_new_fact(ctx, facts);
+   f->reg   = reg;
+   f->range = new;
+   return f;
+}
+
+static bool bce_same_check(const op_t *a, const op_t *b)
+{
+   if (a->kind != b->kind || a->type != b->type
+       || a->args.count != b->args.count)
+      return false;
+
+   for (int i = 0; i < a->args.count; i++) {
+      if (a->args.items[i] != b->args.items[i])
+         return false;
+   }
+
+   return true;
+}
+
+static void bce_refine_cmp(vcode_cmp_t cmp, interval_t *a, interval_t *b)
+{
+   switch (cmp) {
+   case VCODE_CMP_EQ:
+      *a = *b = bce_intersect(*a, *b);
+      break;
+   case VCODE_CMP_NEQ:
+      if (b->low == b->high) {
+         if (a->low == b->low)
+            a->low = sadd64(a->low, 1);
+         else if (a->high == b->low)
+            a->high = sadd64(a->high, -1);
+      }
+      else if (a->low == a->high) {
+         if (b->low == a->low)
+            b->low = sadd64(b->low, 1);
+         else if (b->high == a->low)
+            b->high = sadd64(b->high, -1);
+      }
+      break;
+   case VCODE_CMP_LT:
+      a->high = MIN(a->high, sadd64(b->high, -1));
+      b->low  = MAX(b->low, sadd64(a->low, 1));
+      break;
+   case VCODE_CMP_LEQ:
+      a->high = MIN(a->high, b->high);
+      b->low  = MAX(b->low, a->low);
+      break;
+   case VCODE_CMP_GT:
+      a->low  = MAX(a->low, sadd64(b->low, 1));
+      b->high = MIN(b->high, sadd64(a->high, -1));
+      break;
+   case VCODE_CMP_GEQ:
+      a->low  = MAX(a->low, b->low);
+      b->high = MIN(b->high, a->high);
+      break;
+   }
+}
+
+static vcode_cmp_t bce_negate_cmp(vcode_cmp_t cmp)
+{
+   switch (cmp) {
+   case VCODE_CMP_EQ:  return VCODE_CMP_NEQ;
+   case VCODE_CMP_NEQ: return VCODE_CMP_EQ;
+   case VCODE_CMP_LT:  return VCODE_CMP_GEQ;
+   case VCODE_CMP_LEQ: return VCODE_CMP_GT;
+   case VCODE_CMP_GT:  return VCODE_CMP_LEQ;
+   case VCODE_CMP_GEQ: return VCODE_CMP_LT;
+   }
+
+   return cmp;
+}
+
+static bce_fact_t *bce_refine_test(bce_ctx_t *ctx, bce_fact_t *facts,
+                                   vcode_reg_t test, bool value,
+                                   interval_t *vars, vcode_reg_t *current)
+{
+   const op_t *defn = ctx->defs[test];
+   if (defn == NULL)
+      return facts;
+
+   switch (defn->kind) {
+   case VCODE_OP_NOT:
+      return bce_refine_test(ctx, facts, defn->args.items[0], !value,
+                             vars, current);
+
+   case VCODE_OP_AND:
+   case VCODE_OP_OR:
+      if (value == (defn->kind == VCODE_OP_AND)) {
+         // Both operands have the same value
+         for (int i = 0; i < 2; i++)
+            facts = bce_refine_test(ctx, facts, defn->args.items[i], value,
+                                    vars, current);
+      }
+      return facts;
+
+   case VCODE_OP_CMP:
+      {
+         vcode_reg_t lhs = defn->args.items[0];
+         vcode_reg_t rhs = defn->args.items[1];
+         if (!bce_is_integer(lhs) || !bce_is_integer(rhs))
+            return facts;
+
+         interval_t a = bce_lookup(ctx, facts, lhs);
+         interval_t b = bce_lookup(ctx, facts, rhs);
+
+         bce_refine_cmp(value ? defn->cmp : bce_negate_cmp(defn->cmp), &a, &b);
+
+         facts = bce_add_fact(ctx, facts, lhs, a);
+         facts = bce_add_fact(ctx, facts, rhs, b);
+
+         // Variables currently holding either operand are refined too
+         if (vars != NULL) {
+            for (int i = 0; i < ctx->nvars; i++) {
+               if (current[i] == lhs)
+                  vars[i] = bce_intersect(vars[i], a);
+               else if (current[i] == rhs)
+                  vars[i] = bce_intersect(vars[i], b);
+            }
+         }
+
+         return facts;
+      }
+
+   default:
+      return facts;
+   }
+}
+
+static bce_fact_t *bce_edge_facts(bce_ctx_t *ctx, int block, bce_fact_t *facts)
+{
+   if (ctx->npreds[block] != 1)
+      return facts;
+
+   const int pred = ctx->preds[block][0];
+   const block_t *b = &(active_unit->blocks.items[pred]);
+   const op_t *term = &(b->ops.items[b->ops.count - 1]);
+
+   switch (term->kind) {
+   case VCODE_OP_COND:
+      if (term->targets.items[0] == term->targets.items[1])
+         return facts;
+
+      return bce_refine_test(ctx, facts, term->args.items[0],
+                             term->targets.items[0] == block, NULL, NULL);
+
+   case VCODE_OP_CASE:
+      {
+         vcode_reg_t value = term->args.items[0];
+         int match = -1;
+         for (int i = 1; i < term->targets.count; i++) {
+            if (term->targets.items[i] == block) {
+               if (match != -1)
+                  return facts;
+               match = i;
+            }
+         }
+
+         if (match == -1 || term->targets.items[0] == block)
+            return facts;
+
+         interval_t r = bce_lookup(ctx, facts, term->args.items[match]);
+         return bce_add_fact(ctx, facts, value, r);
+      }
+
+   default:
+      return facts;
+   }
+}
+
+static interval_t bce_arith(op_t *op, bce_ctx_t *ctx, bce_fact_t *facts)
+{
+   interval_t a = bce_lookup(ctx, facts, op->args.items[0]);
+   interval_t b = bce_lookup(ctx, facts, op->args.items[1]);
+
+   switch (op->kind) {
+   case VCODE_OP_ADD:
+      return (interval_t){ sadd64(a.low, b.low), sadd64(a.high, b.high) };
+   case VCODE_OP_SUB:
+      {
+         const int64_t bl = (b.high == INT64_MIN) ? INT64_MAX : -b.high;
+         const int64_t bh = (b.low == INT64_MIN) ? INT64_MAX : -b.low;
+         return (interval_t){ sadd64(a.low, bl), sadd64(a.high, bh) };
+      }
+   case VCODE_OP_MUL:
+      {
+         const int64_t p[4] = {
+            smul64(a.low, b.low), smul64(a.low, b.high),
+            smul64(a.high, b.low), smul64(a.high, b.high)
+         };
+         interval_t r = { p[0], p[0] };
+         for (int i = 1; i < 4; i++)
+            r = bce_hull(r, (interval_t){ p[i], p[i] });
+         return r;
+      }
+   default:
+      return (interval_t){ INT64_MIN, INT64_MAX };
+   }
+}
+
+static interval_t bce_compare(op_t *op, bce_ctx_t *ctx, bce_fact_t *facts)
+{
+   const interval_t unknown = { 0, 1 };
+
+   if (!bce_is_integer(op->args.items[0])
+       || !bce_is_integer(op->args.items[1]))
+      return unknown;
+
+   interval_t a = bce_lookup(ctx, facts, op->args.items[0]);
+   interval_t b = bce_lookup(ctx, facts, op->args.items[1]);
+
+   int result = -1;
+   switch (op->cmp) {
+   case VCODE_CMP_EQ:
+   case VCODE_CMP_NEQ:
+      if (a.high < b.low || b.high < a.low)
+         result = 0;
+      else if (a.low == a.high && b.low == b.high)
+         result = 1;
+
+      if (result != -1 && op->cmp == VCODE_CMP_NEQ)
+         result = !result;
+      break;
+   case VCODE_CMP_LT:
+      result = (a.high < b.low) ? 1 : (a.low >= b.high) ? 0 : -1;
+      break;
+   case VCODE_CMP_LEQ:
+      result = (a.high <= b.low) ? 1 : (a.low > b.high) ? 0 : -1;
+      break;
+   case VCODE_CMP_GT:
+      result = (a.low > b.high) ? 1 : (a.high <= b.low) ? 0 : -1;
+      break;
+   case VCODE_CMP_GEQ:
+      result = (a.low >= b.high) ? 1 : (a.high < b.low) ? 0 : -1;
+      break;
+   }
+
+   return (result == -1) ? unknown : (interval_t){ result, result };
+}
+
+static void bce_fold(bce_ctx_t *ctx, op_t *op)
+{
+   // Replace an operation whose result can only take a single value
+   // with a constant
+   const interval_t r = ctx->ranges[op->result];
+   if (!ctx->final || r.low != r.high || r.low == INT64_MIN
+       || r.low == INT64_MAX)
+      return;
+
+   if (op->kind == VCODE_OP_CAST && !bce_is_integer(op->args.items[0]))
+      return;
+
+   op->kind  = VCODE_OP_CONST;
+   op->value = r.low;
+   op->type  = vcode_reg_data(op->result)->type;
+   vcode_reg_array_resize(&(op->args), 0, VCODE_INVALID_REG);
+
+   vcode_reg_data(op->result)->bounds = vtype_int(r.low, r.low);
+   ctx->folded++;
+}
+
+static bool bce_check_redundant(bce_ctx_t *ctx, bce_fact_t *facts, op_t *op)
+{
+   for (bce_fact_t *f = facts; f != NULL; f = f->next) {
+      if (f->check != NULL && bce_same_check(f->check, op))
+         return true;
+   }
+
+   switch (op->kind) {
+   case VCODE_OP_BOUNDS:
+      {
+         vcode_reg_t reg = op->args.items[0];
+         if (vtype_kind(op->type) != VCODE_TYPE_INT || !bce_is_integer(reg))
+            return false;
+
+         interval_t b = bce_type_range(op->type);
+         return bce_within(bce_lookup(ctx, facts, reg), b.low, b.high);
+      }
+
+   case VCODE_OP_DYNAMIC_BOUNDS:
+      {
+         interval_t v = bce_lookup(ctx, facts, op->args.items[0]);
+         interval_t l = bce_lookup(ctx, facts, op->args.items[1]);
+         interval_t h = bce_lookup(ctx, facts, op->args.items[2]);
+         return bce_within(v, l.high, h.low);
+      }
+
+   case VCODE_OP_INDEX_CHECK:
+      {
+         interval_t low  = bce_lookup(ctx, facts, op->args.items[0]);
+         interval_t high = bce_lookup(ctx, facts, op->args.items[1]);
+
+         if (high.high < low.low)
+            return true;   // Always a null range
+
+         int64_t min, max;
+         if (op->args.count == 2) {
+            interval_t b = bce_type_range(op->type);
+            min = b.low;
+            max = b.high;
+         }
+         else {
+            min = bce_lookup(ctx, facts, op->args.items[2]).high;
+            max = bce_lookup(ctx, facts, op->args.items[3]).low;
+         }
+
+         return low.low >= min && high.high <= max;
+      }
+
+   default:
+      return false;
+   }
+}
+
+static void bce_transfer(bce_ctx_t *ctx, int block, interval_t *vars)
+{
+   block_t *b = &(active_unit->blocks.items[block]);
+   vcode_reg_t *current = ctx->current;
+
+   for (int i = 0; i < ctx->nvars; i++)
+      current[i] = VCODE_INVALID_REG;
+
+   const int idom = ctx->idom[block];
+   bce_fact_t *facts = (idom == -1 || idom == block) ? NULL : ctx->facts[idom];
+   facts = bce_edge_facts(ctx, block, facts);
+
+   for (int i = 0; i < b->ops.count; i++) {
+      op_t *op = &(b->ops.items[i]);
+
+      const bool local = op->address != VCODE_INVALID_VAR
+         && MASK_CONTEXT(op->address) == active_unit->depth;
+      const int var = local ? MASK_INDEX(op->address) : -1;
+
+      switch (op->kind) {
+      case VCODE_OP_CONST:
+         ctx->ranges[op->result] = (interval_t){ op->value, op->value };
+         break;
+
+      case VCODE_OP_LOAD:
+         if (var != -1 && ctx->tracked[var]) {
+            interval_t bounds =
+               bce_type_range(vcode_reg_data(op->result)->bounds);
+            interval_t r = bce_intersect(vars[var], bounds);
+            ctx->ranges[op->result] = bce_empty(r) ? bounds : r;
+            current[var] = op->result;
+            bce_fold(ctx, op);
+         }
+         break;
+
+      case VCODE_OP_STORE:
+         if (var != -1 && ctx->tracked[var]) {
+            interval_t r = bce_lookup(ctx, facts, op->args.items[0]);
+            vars[var] = bce_intersect(r, ctx->var_top[var]);
+            if (bce_empty(vars[var]))
+               vars[var] = ctx->var_top[var];
+            current[var] = op->args.items[0];
+         }
+         break;
+
+      case VCODE_OP_ADD:
+      case VCODE_OP_SUB:
+      case VCODE_OP_MUL:
+         if (bce_is_integer(op->result)) {
+            interval_t bounds = bce_type_range(vcode_reg_data(op->result)->bounds);
+            ctx->ranges[op->result] =
+               bce_intersect(bce_arith(op, ctx, facts), bounds);
+            if (bce_empty(ctx->ranges[op->result]))
+               ctx->ranges[op->result] = bounds;
+            bce_fold(ctx, op);
+         }
+         break;
+
+      case VCODE_OP_CAST:
+         if (bce_is_integer(op->result) && bce_is_integer(op->args.items[0])) {
+            interval_t bounds = bce_type_range(vcode_reg_data(op->result)->bounds);
+            interval_t arg = bce_lookup(ctx, facts, op->args.items[0]);
+            ctx->ranges[op->result] =
+               bce_within(arg, bounds.low, bounds.high) ? arg : bounds;
+            bce_fold(ctx, op);
+         }
+         break;
+
+      case VCODE_OP_SELECT:
+         if (bce_is_integer(op->result)) {
+            interval_t test = bce_lookup(ctx, facts, op->args.items[0]);
+            if (test.low == test.high)
+               ctx->ranges[op->result] =
+                  bce_lookup(ctx, facts, op->args.items[test.low ? 1 : 2]);
+            else
+               ctx->ranges[op->result] =
+                  bce_hull(bce_lookup(ctx, facts, op->args.items[1]),
+                           bce_lookup(ctx, facts, op->args.items[2]));
+            bce_fold(ctx, op);
+         }
+         break;
+
+      case VCODE_OP_CMP:
+         ctx->ranges[op->result] = bce_compare(op, ctx, facts);
+         bce_fold(ctx, op);
+         break;
+
+      case VCODE_OP_NESTED_FCALL:
+      case VCODE_OP_NESTED_PCALL:
+      case VCODE_OP_RESUME:
+         // Nested subprograms may assign to any variable in this scope
+         for (int j = 0; j < ctx->nvars; j++) {
+            if (ctx->tracked[j]) {
+               vars[j] = ctx->var_top[j];
+               current[j] = VCODE_INVALID_REG;
+            }
+         }
+         break;
+
+      case VCODE_OP_BOUNDS:
+      case VCODE_OP_DYNAMIC_BOUNDS:
+      case VCODE_OP_INDEX_CHECK:
+         if (ctx->final && bce_check_redundant(ctx, facts, op)) {
+            op->comment = xasprintf("Elided redundant %s check",
+                                    vcode_op_string(op->kind));
+            op->kind = VCODE_OP_COMMENT;
+            vcode_reg_array_resize(&(op->args), 0, VCODE_INVALID_REG);
+            ctx->elided++;
+            break;
+         }
+
+         {
+            bce_fact_t *f = bce_new_fact(ctx, facts);
+            f->check = op;
+            facts = f;
+         }
+
+         // The checked value is known to be in range afterwards
+         if (op->kind == VCODE_OP_BOUNDS
+             && vtype_kind(op->type) == VCODE_TYPE_INT) {
+            vcode_reg_t reg = op->args.items[0];
+            interval_t r = bce_type_range(op->type);
+            facts = bce_add_fact(ctx, facts, reg, r);
+
+            for (int j = 0; j < ctx->nvars; j++) {
+               if (current[j] == reg)
+                  vars[j] = bce_intersect(vars[j], r);
+            }
+         }
+         else if (op->kind == VCODE_OP_DYNAMIC_BOUNDS) {
+            vcode_reg_t reg = op->args.items[0];
+            interval_t r = {
+               bce_lookup(ctx, facts, op->args.items[1]).low,
+               bce_lookup(ctx, facts, op->args.items[2]).high
+            };
+            facts = bce_add_fact(ctx, facts, reg, r);
+         }
+         break;
+
+      case VCODE_OP_COND:
+         if (op->targets.items[0] != op->targets.items[1]) {
+            // Record the refined variable ranges along each edge
+            interval_t *out_true = ctx->out[block];
+            interval_t *out_false = ctx->out[block] + ctx->nvars;
+            memcpy(out_true, vars, ctx->nvars * sizeof(interval_t));
+            memcpy(out_false, vars, ctx->nvars * sizeof(interval_t));
+
+            bce_refine_test(ctx, facts, op->args.items[0], true,
+                            out_true, current);
+            bce_refine_test(ctx, facts, op->args.items[0], false,
+                            out_false, current);
+
+            ctx->facts[block] = facts;
+            return;
+         }
+         break;
+
+      default:
+         if (op->result != VCODE_INVALID_REG && bce_is_integer(op->result))
+            ctx->ranges[op->result] =
+               bce_type_range(vcode_reg_data(op->result)->bounds);
+         break;
+      }
+   }
+
+   memcpy(ctx->out[block], vars, ctx->nvars * sizeof(interval_t));
+   memcpy(ctx->out[block] + ctx->nvars, vars, ctx->nvars * sizeof(interval_t));
+   ctx->facts[block] = facts;
+}
+
+static bool bce_entry_state(bce_ctx_t *ctx, int block, interval_t *vars)
+{
+   if (ctx->idom[block] == block) {
+      // Variables are uninitialised or unknown on entry
+      memcpy(vars, ctx->var_top, ctx->nvars * sizeof(interval_t));
+      return true;
+   }
+
+   bool reached = false;
+   for (int i = 0; i < ctx->npreds[block]; i++) {
+      const int pred = ctx->preds[block][i];
+      if (!ctx->reached[pred])
+         continue;
+
+      // The false edge of a conditional branch uses the second state
+      const block_t *b = &(active_unit->blocks.items[pred]);
+      const op_t *term = &(b->ops.items[b->ops.count - 1]);
+      const bool second = term->kind == VCODE_OP_COND
+         && term->targets.items[1] == block;
+
+      const interval_t *out = ctx->out[pred] + (second ? ctx->nvars : 0);
+
+      for (int j = 0; j < ctx->nvars; j++) {
+         if (bce_empty(out[j]))
+            continue;
+         vars[j] = reached ? bce_hull(vars[j], out[j]) : out[j];
+      }
+
+      reached = true;
+   }
+
+   return reached;
+}
+
+static bool bce_pass(bce_ctx_t *ctx, interval_t *entry)
+{
+   bool changed = false;
+
+   bce_free_facts(ctx);
+
+   for (int i = 0; i < ctx->nblocks; i++) {
+      const int block = ctx->rpo[i];
+
+      interval_t vars[ctx->nvars + 1];
+      for (int j = 0; j < ctx->nvars; j++)
+         vars[j] = ctx->var_top[j];
+
+      if (!bce_entry_state(ctx, block, vars))
+         continue;
+
+      interval_t *old = entry + block * ctx->nvars;
+      for (int j = 0; j < ctx->nvars; j++) {
+         if (ctx->reached[block]
+             && old[j].low == vars[j].low && old[j].high == vars[j].high)
+            continue;
+
+         // Widen the bounds of variables which have not converged
+         if (ctx->header[block] && ctx->visits[block] > BCE_WIDEN_LIMIT) {
+            if (vars[j].low < old[j].low)
+               vars[j].low = MIN(ctx->var_top[j].low, vars[j].low);
+            else
+               vars[j].low = old[j].low;
+
+            if (vars[j].high > old[j].high)
+               vars[j].high = MAX(ctx->var_top[j].high, vars[j].high);
+            else
+               vars[j].high = old[j].high;
+         }
+
+         changed = changed || !ctx->reached[block]
+            || old[j].low != vars[j].low || old[j].high != vars[j].high;
+      }
+
+      if (!ctx->reached[block])
+         changed = true;
+
+      ctx->visits[block]++;
+      ctx->reached[block] = true;
+      memcpy(old, vars, ctx->nvars * sizeof(interval_t));
+
+      bce_transfer(ctx, block, vars);
+   }
+
+   return changed;
+}
+
+static int bce_intersect_dom(bce_ctx_t *ctx, int a, int b)
+{
+   while (a != b) {
+      while (ctx->order[a] > ctx->order[b])
+         a = ctx->idom[a];
+      while (ctx->order[b] > ctx->order[a])
+         b = ctx->idom[b];
+   }
+
+   return a;
+}
+
+static bool bce_dominates(bce_ctx_t *ctx, int a, int b)
+{
+   for (;;) {
+      if (a == b)
+         return true;
+      else if (ctx->idom[b] == -1 || ctx->idom[b] == b)
+         return false;
+      b = ctx->idom[b];
+   }
+}
+
+static void bce_dfs(bce_ctx_t *ctx, int block, bool *visited, int *post,
+                    int *npost)
+{
+   visited[block] = true;
+
+   const block_t *b = &(active_unit->blocks.items[block]);
+   if (b->ops.count > 0) {
+      const op_t *term = &(b->ops.items[b->ops.count - 1]);
+      for (int i = 0; i < term->targets.count; i++) {
+         const int succ = term->targets.items[i];
+         if (!visited[succ])
+            bce_dfs(ctx, succ, visited, post, npost);
+      }
+   }
+
+   post[(*npost)++] = block;
+}
+
+static bool bce_pure_op(vcode_op_t kind)
+{
+   switch (kind) {
+   case VCODE_OP_COMMENT:
+   case VCODE_OP_CONST:
+   case VCODE_OP_CONST_REAL:
+   case VCODE_OP_LOAD:
+   case VCODE_OP_ADD:
+   case VCODE_OP_SUB:
+   case VCODE_OP_MUL:
+   case VCODE_OP_CMP:
+   case VCODE_OP_CAST:
+   case VCODE_OP_SELECT:
+   case VCODE_OP_NOT:
+   case VCODE_OP_AND:
+   case VCODE_OP_OR:
+   case VCODE_OP_NEG:
+   case VCODE_OP_ABS:
+   case VCODE_OP_INDEX:
+   case VCODE_OP_UARRAY_LEFT:
+   case VCODE_OP_UARRAY_RIGHT:
+   case VCODE_OP_UARRAY_DIR:
+   case VCODE_OP_UARRAY_LEN:
+   case VCODE_OP_UNWRAP:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static void bce_hoist(bce_ctx_t *ctx)
+{
+   // Move checks whose operands are all defined outside a loop from the
+   // loop header into the single block that enters the loop
+   for (int h = 0; h < ctx->nblocks; h++) {
+      if (!ctx->reached[h] || ctx->npreds[h] != 2)
+         continue;
+
+      int pre = -1, latch = -1;
+      for (int i = 0; i < 2; i++) {
+         const int p = ctx->preds[h][i];
+         if (bce_dominates(ctx, h, p))
+            latch = p;
+         else
+            pre = p;
+      }
+
+      if (pre == -1 || latch == -1 || !ctx->reached[pre])
+         continue;
+
+      block_t *pb = &(active_unit->blocks.items[pre]);
+      if (pb->ops.items[pb->ops.count - 1].kind != VCODE_OP_JUMP)
+         continue;
+
+      block_t *hb = &(active_unit->blocks.items[h]);
+      for (int i = 0; i < hb->ops.count; i++) {
+         op_t *op = &(hb->ops.items[i]);
+
+         if (bce_pure_op(op->kind))
+            continue;
+         else if (op->kind != VCODE_OP_BOUNDS
+                  && op->kind != VCODE_OP_DYNAMIC_BOUNDS
+                  && op->kind != VCODE_OP_INDEX_CHECK)
+            break;
+
+         bool invariant = true;
+         for (int j = 0; j < op->args.count && invariant; j++) {
+            const int def = ctx->def_block[op->args.items[j]];
+            invariant = def == -1 || (def != h && bce_dominates(ctx, def, h));
+         }
+
+         if (!invariant)
+            break;
+
+         // Insert before the jump which terminates the preheader
+         op_t copy = *op;
+         op_array_alloc(&(pb->ops));
+         pb->ops.items[pb->ops.count - 1] = pb->ops.items[pb->ops.count - 2];
+         pb->ops.items[pb->ops.count - 2] = copy;
+
+         op->kind    = VCODE_OP_COMMENT;
+         op->comment = xasprintf("Hoisted %s check into block %d",
+                                 vcode_op_string(copy.kind), pre);
+         memset(&(op->args), '\0', sizeof(op->args));
+      }
+   }
+}
+
+static void vcode_opt_bounds(void)
+{
+   // Propagate ranges of integer registers and local variables through
+   // the control flow graph and delete bounds checks which cannot fail
+
+   const int nblocks = active_unit->blocks.count;
+   const int nregs   = active_unit->regs.count;
+   const int nvars   = active_unit->vars.count;
+
+   bce_ctx_t ctx = {
+      .nblocks   = nblocks,
+      .nregs     = nregs,
+      .nvars     = nvars,
+      .rpo       = xmalloc(nblocks * sizeof(int)),
+      .order     = xmalloc((nblocks + 1) * sizeof(int)),
+      .idom      = xmalloc((nblocks + 1) * sizeof(int)),
+      .npreds    = xcalloc(nblocks * sizeof(int)),
+      .preds     = xcalloc(nblocks * sizeof(int *)),
+      .defs      = xcalloc(MAX(nregs, 1) * sizeof(op_t *)),
+      .def_block = xmalloc(MAX(nregs, 1) * sizeof(int)),
+      .tracked   = xcalloc(MAX(nvars, 1) * sizeof(bool)),
+      .var_top   = xmalloc(MAX(nvars, 1) * sizeof(interval_t)),
+      .ranges    = xmalloc(MAX(nregs, 1) * sizeof(interval_t)),
+      .out       = xmalloc(nblocks * sizeof(interval_t *)),
+      .reached   = xcalloc(nblocks * sizeof(bool)),
+      .visits    = xcalloc(nblocks * sizeof(int)),
+      .header    = xcalloc(nblocks * sizeof(bool)),
+      .facts     = xcalloc(nblocks * sizeof(bce_fact_t *)),
+      .current   = xmalloc(MAX(nvars, 1) * sizeof(vcode_reg_t)),
+      .final     = false
+   };
+
+   for (int i = 0; i < nregs; i++) {
+      ctx.def_block[i] = -1;
+      ctx.ranges[i] = bce_type_range(active_unit->regs.items[i].bounds);
+   }
+
+   for (int i = 0; i < nvars; i++) {
+      const var_t *v = &(active_unit->vars.items[i]);
+      const vtype_kind_t kind = vtype_kind(v->type);
+      ctx.tracked[i] = kind == VCODE_TYPE_INT || kind == VCODE_TYPE_OFFSET;
+      ctx.var_top[i] = bce_type_range(v->bounds);
+   }
+
+   for (int i = 0; i < nblocks; i++) {
+      const block_t *b = &(active_unit->blocks.items[i]);
+      for (int j = 0; j < b->ops.count; j++) {
+         op_t *op = &(b->ops.items[j]);
+         if (op->result != VCODE_INVALID_REG) {
+            ctx.defs[op->result] = op;
+            ctx.def_block[op->result] = i;
+         }
+
+         // Variables whose address is taken may be modified indirectly
+         if (op->kind == VCODE_OP_INDEX
+             && MASK_CONTEXT(op->address) == active_unit->depth)
+            ctx.tracked[MASK_INDEX(op->address)] = false;
+
+         for (int k = 0; k < op->targets.count; k++)
+            ctx.npreds[op->targets.items[k]]++;
+      }
+   }
+
+   for (int i = 0; i < nblocks; i++) {
+      ctx.preds[i] = xmalloc(MAX(ctx.npreds[i], 1) * sizeof(int));
+      ctx.npreds[i] = 0;
+      ctx.out[i] = xmalloc(MAX(nvars, 1) * 2 * sizeof(interval_t));
+      ctx.idom[i] = -1;
+   }
+
+   for (int i = 0; i < nblocks; i++) {
+      const block_t *b = &(active_unit->blocks.items[i]);
+      if (b->ops.count == 0)
+         continue;
+
+      const op_t *term = &(b->ops.items[b->ops.count - 1]);
+      for (int k = 0; k < term->targets.count; k++) {
+         const int succ = term->targets.items[k];
+         bool dup = false;
+         for (int p = 0; p < ctx.npreds[succ]; p++)
+            dup = dup || ctx.preds[succ][p] == i;
+         if (!dup)
+            ctx.preds[succ][ctx.npreds[succ]++] = i;
+      }
+   }
+
+   // Number the reachable blocks in reverse post-order
+   bool *visited = xcalloc(nblocks * sizeof(bool));
+   int *post = xmalloc(nblocks * sizeof(int));
+   int npost = 0;
+   bce_dfs(&ctx, 0, visited, post, &npost);
+
+   // The runtime enters a process at block 1 after the reset code in
+   // block 0 has returned so treat it as a second root as long as no
+   // edge leads back into the reset code
+   const int nreset = npost;
+   if (active_unit->kind == VCODE_UNIT_PROCESS && nblocks > 1
+       && !visited[1]) {
+      bool *reset = xmalloc(nblocks * sizeof(bool));
+      memcpy(reset, visited, nblocks * sizeof(bool));
+
+      bce_dfs(&ctx, 1, visited, post, &npost);
+
+      bool disjoint = true;
+      for (int i = 0; i < nreset && disjoint; i++) {
+         const int b = post[i];
+         for (int p = 0; p < ctx.npreds[b]; p++)
+            disjoint = disjoint && (reset[ctx.preds[b][p]]
+                                    || !visited[ctx.preds[b][p]]);
+      }
+
+      free(reset);
+
+      if (!disjoint) {
+         for (int i = nreset; i < npost; i++)
+            visited[post[i]] = false;
+         npost = nreset;
+      }
+   }
+
+   ctx.nblocks = npost;
+   for (int i = 0; i < nblocks; i++)
+      ctx.order[i] = INT32_MAX;
+   for (int i = 0; i < npost; i++) {
+      ctx.rpo[i] = post[npost - 1 - i];
+      ctx.order[ctx.rpo[i]] = i;
+   }
+
+   // Unreachable predecessors do not affect dominance
+   for (int i = 0; i < nblocks; i++) {
+      int n = 0;
+      for (int p = 0; p < ctx.npreds[i]; p++) {
+         if (visited[ctx.preds[i][p]])
+            ctx.preds[i][n++] = ctx.preds[i][p];
+      }
+      ctx.npreds[i] = n;
+   }
+
+   // Dominators using the algorithm of Cooper, Harvey and Kennedy
+   ctx.idom[0] = 0;
+   if (npost > nreset)
+      ctx.idom[1] = 1;
+   bool changed;
+   do {
+      changed = false;
+      for (int i = 0; i < npost; i++) {
+         const int b = ctx.rpo[i];
+         if (ctx.idom[b] == b)
+            continue;
+
+         int new_idom = -1;
+         for (int p = 0; p < ctx.npreds[b]; p++) {
+            const int pred = ctx.preds[b][p];
+            if (ctx.idom[pred] == -1)
+               continue;
+            else if (new_idom == -1)
+               new_idom = pred;
+            else
+               new_idom = bce_intersect_dom(&ctx, pred, new_idom);
+         }
+
+         if (new_idom != ctx.idom[b]) {
+            ctx.idom[b] = new_idom;
+            changed = true;
+         }
+      }
+   } while (changed);
+
+   // Variable ranges are only widened at the head of loops
+   for (int i = 0; i < npost; i++) {
+      const int b = ctx.rpo[i];
+      for (int p = 0; p < ctx.npreds[b]; p++)
+         ctx.header[b] = ctx.header[b] || bce_dominates(&ctx, b, ctx.preds[b][p]);
+   }
+
+   interval_t *entry = xmalloc(MAX(nblocks * nvars, 1) * sizeof(interval_t));
+
+   while (bce_pass(&ctx, entry))
+      ;
+
+   ctx.final = true;
+   bce_pass(&ctx, entry);
+
+   bce_hoist(&ctx);
+
+   // Remove assertions which always pass and make conditional branches
+   // on a constant test unconditional
+   for (int i = 0; i < nblocks; i++) {
+      block_t *b = &(active_unit->blocks.items[i]);
+      if (!ctx.reached[i] || b->ops.count == 0)
+         continue;
+
+      for (int j = 0; j < b->ops.count; j++) {
+         op_t *op = &(b->ops.items[j]);
+         if (op->kind != VCODE_OP_ASSERT)
+            continue;
+
+         const interval_t test = ctx.ranges[op->args.items[0]];
+         if (test.low == 1 && test.high == 1) {
+            op->comment = xasprintf("Always true assertion on r%d",
+                                    op->args.items[0]);
+            op->kind = VCODE_OP_COMMENT;
+            vcode_reg_array_resize(&(op->args), 0, VCODE_INVALID_REG);
+         }
+      }
+
+      op_t *term = &(b->ops.items[b->ops.count - 1]);
+      if (term->kind != VCODE_OP_COND)
+         continue;
+
+      const interval_t test = ctx.ranges[term->args.items[0]];
+      if (test.low != test.high)
+         continue;
+
+      const vcode_block_t target = term->targets.items[test.low ? 0 : 1];
+
+      term->kind = VCODE_OP_JUMP;
+      vcode_reg_array_resize(&(term->args), 0, VCODE_INVALID_REG);
+      vcode_block_array_resize(&(term->targets), 1, VCODE_INVALID_BLOCK);
+      term->targets.items[0] = target;
+   }
+
+   bce_free_facts(&ctx);
+
+   for (int i = 0; i < nblocks; i++) {
+      free(ctx.preds[i]);
+      free(ctx.out[i]);
+   }
+
+   free(entry);
+   free(visited);
+   free(post);
+   free(ctx.rpo);
+   free(ctx.order);
+   free(ctx.idom);
+   free(ctx.npreds);
+   free(ctx.preds);
+   free(ctx.defs);
+   free(ctx.def_block);
+   free(ctx.tracked);
+   free(ctx.var_top);
+   free(ctx.ranges);
+   free(ctx.out);
+   free(ctx.reached);
+   free(ctx.visits);
+   free(ctx.header);
+   free(ctx.facts);
+   free(ctx.current);
+}
+
+typedef enum {
+   CSE_MEM_NONE,     // Result does not depend on memory
+   CSE_MEM_LOCAL,    // Load of a variable whose address is never taken
+   CSE_MEM_ANY       // May be changed by any store or call
+} cse_mem_t;
+
+typedef struct {
+   op_t        *op;
+   vcode_reg_t  reg;
+   int          block;
+   int          next;
+   unsigned     bucket;
+   unsigned     stamp;
+   cse_mem_t    mem;
+} cse_entry_t;
+
+typedef struct {
+   int           nblocks;
+   int          *order;
+   int          *idom;
+   int          *npreds;
+   int         **preds;
+   int          *nchildren;
+   int          *child_start;
+   int          *children;
+   bool         *root;
+   bool         *tracked;
+   vcode_reg_t  *map;
+   unsigned     *end_gen;
+   unsigned     *end_lgen;
+   cse_entry_t  *entries;
+   int           nentries;
+   int           max_entries;
+   int          *buckets;
+   unsigned      nbuckets;
+   unsigned      counter;
+   unsigned      gen;
+   unsigned      lgen;
+   int           replaced;
+} cse_ctx_t;
+
+static bool cse_resumes(const op_t *term)
+{
+   // The target of these operations is entered through the jump table
+   // after the process or procedure is suspended so no register values
+   // survive along the edge
+   return term->kind == VCODE_OP_WAIT || term->kind == VCODE_OP_PCALL
+      || term->kind == VCODE_OP_NESTED_PCALL;
+}
+
+static bool cse_candidate(cse_ctx_t *ctx, const op_t *op, cse_mem_t *mem)
+{
+   switch (op->kind) {
+   case VCODE_OP_ADD:
+   case VCODE_OP_SUB:
+   case VCODE_OP_MUL:
+   case VCODE_OP_CMP:
+   case VCODE_OP_CAST:
+   case VCODE_OP_NEG:
+   case VCODE_OP_ABS:
+   case VCODE_OP_NOT:
+   case VCODE_OP_AND:
+   case VCODE_OP_OR:
+   case VCODE_OP_SELECT:
+   case VCODE_OP_INDEX:
+   case VCODE_OP_NETS:
+   case VCODE_OP_RECORD_REF:
+   case VCODE_OP_UNWRAP:
+   case VCODE_OP_UARRAY_LEFT:
+   case VCODE_OP_UARRAY_RIGHT:
+   case VCODE_OP_UARRAY_DIR:
+   case VCODE_OP_UARRAY_LEN:
+      *mem = CSE_MEM_NONE;
+      return true;
+
+   case VCODE_OP_LOAD:
+      if (MASK_CONTEXT(op->address) == active_unit->depth
+          && ctx->tracked[MASK_INDEX(op->address)])
+         *mem = CSE_MEM_LOCAL;
+      else
+         *mem = CSE_MEM_ANY;
+      return true;
+
+   case VCODE_OP_LOAD_INDIRECT:
+      *mem = CSE_MEM_ANY;
+      return true;
+
+   default:
+      return false;
+   }
+}
+
+static bool cse_writes_memory(const op_t *op)
+{
+   switch (op->kind) {
+   case VCODE_OP_COMMENT:
+   case VCODE_OP_CONST:
+   case VCODE_OP_CONST_REAL:
+   case VCODE_OP_CONST_ARRAY:
+   case VCODE_OP_CONST_RECORD:
+   case VCODE_OP_LOAD:
+   case VCODE_OP_LOAD_INDIRECT:
+   case VCODE_OP_ADD:
+   case VCODE_OP_SUB:
+   case VCODE_OP_MUL:
+   case VCODE_OP_DIV:
+   case VCODE_OP_MOD:
+   case VCODE_OP_REM:
+   case VCODE_OP_EXP:
+   case VCODE_OP_NEG:
+   case VCODE_OP_ABS:
+   case VCODE_OP_CMP:
+   case VCODE_OP_CAST:
+   case VCODE_OP_SELECT:
+   case VCODE_OP_NOT:
+   case VCODE_OP_AND:
+   case VCODE_OP_OR:
+   case VCODE_OP_XOR:
+   case VCODE_OP_XNOR:
+   case VCODE_OP_NAND:
+   case VCODE_OP_NOR:
+   case VCODE_OP_INDEX:
+   case VCODE_OP_NETS:
+   case VCODE_OP_RECORD_REF:
+   case VCODE_OP_WRAP:
+   case VCODE_OP_UNWRAP:
+   case VCODE_OP_UARRAY_LEFT:
+   case VCODE_OP_UARRAY_RIGHT:
+   case VCODE_OP_UARRAY_DIR:
+   case VCODE_OP_UARRAY_LEN:
+   case VCODE_OP_ARRAY_SIZE:
+   case VCODE_OP_BOUNDS:
+   case VCODE_OP_DYNAMIC_BOUNDS:
+   case VCODE_OP_INDEX_CHECK:
+   case VCODE_OP_NULL_CHECK:
+   case VCODE_OP_EVENT:
+   case VCODE_OP_ACTIVE:
+   case VCODE_OP_LAST_EVENT:
+   case VCODE_OP_COVER_STMT:
+   case VCODE_OP_COVER_COND:
+   case VCODE_OP_STORAGE_HINT:
+   case VCODE_OP_DEBUG_OUT:
+   case VCODE_OP_JUMP:
+   case VCODE_OP_COND:
+   case VCODE_OP_CASE:
+   case VCODE_OP_RETURN:
+      return false;
+   default:
+      return true;
+   }
+}
+
+static unsigned cse_hash(cse_ctx_t *ctx, vcode_op_t kind, const op_t *op)
+{
+   unsigned h = kind * 2654435761u;
+
+   switch (kind) {
+   case VCODE_OP_LOAD:
+   case VCODE_OP_INDEX:
+      h ^= op->address * 40503u;
+      break;
+   case VCODE_OP_NETS:
+      h ^= op->signal * 40503u;
+      break;
+   case VCODE_OP_CMP:
+      h ^= op->cmp * 40503u;
+      break;
+   default:
+      break;
+   }
+
+   // Stores are entered under the key of the load they can replace
+   if (op->kind != VCODE_OP_STORE) {
+      for (int i = 0; i < op->args.count; i++)
+         h = (h << 5) + h + op->args.items[i];
+   }
+
+   return h & (ctx->nbuckets - 1);
+}
+
+static bool cse_same_op(const op_t *a, const op_t *b)
+{
+   if (a->kind == VCODE_OP_STORE)
+      return b->kind == VCODE_OP_LOAD && a->address == b->address;
+   else if (a->kind != b->kind || a->args.count != b->args.count)
+      return false;
+
+   for (int i = 0; i < a->args.count; i++) {
+      if (a->args.items[i] != b->args.items[i])
+         return false;
+   }
+
+   switch (a->kind) {
+   case VCODE_OP_LOAD:
+   case VCODE_OP_INDEX:
+      if (a->address != b->address)
+         return false;
+      break;
+   case VCODE_OP_NETS:
+      if (a->signal != b->signal)
+         return false;
+      break;
+   case VCODE_OP_CMP:
+      if (a->cmp != b->cmp)
+         return false;
+      break;
+   case VCODE_OP_UARRAY_LEFT:
+   case VCODE_OP_UARRAY_RIGHT:
+   case VCODE_OP_UARRAY_DIR:
+   case VCODE_OP_UARRAY_LEN:
+      if (a->dim != b->dim)
+         return false;
+      break;
+   case VCODE_OP_RECORD_REF:
+      if (a->field != b->field)
+         return false;
+      break;
+   default:
+      break;
+   }
+
+   // Both results must have the same type and bounds so that one
+   // register can stand in for the other
+   const reg_t *ra = vcode_reg_data(a->result);
+   const reg_t *rb = vcode_reg_data(b->result);
+   return vtype_eq(ra->type, rb->type) && vtype_eq(ra->bounds, rb->bounds)
+      && (a->kind != VCODE_OP_CAST || vtype_eq(a->type, b->type));
+}
+
+static void cse_push(cse_ctx_t *ctx, op_t *op, vcode_reg_t reg, int block,
+                     cse_mem_t mem)
+{
+   if (ctx->nentries == ctx->max_entries) {
+      ctx->max_entries = MAX(ctx->max_entries * 2, 256);
+      ctx->entries = xrealloc(ctx->entries,
+                              ctx->max_entries * sizeof(cse_entry_t));
+   }
+
+   const vcode_op_t kind =
+      op->kind == VCODE_OP_STORE ? VCODE_OP_LOAD : op->kind;
+
+   cse_entry_t *e = &(ctx->entries[ctx->nentries]);
+   e->op     = op;
+   e->reg    = reg;
+   e->block  = block;
+   e->mem    = mem;
+   e->stamp  = (mem == CSE_MEM_LOCAL) ? ctx->lgen : ctx->gen;
+   e->bucket = cse_hash(ctx, kind, op);
+   e->next   = ctx->buckets[e->bucket];
+
+   ctx->buckets[e->bucket] = ctx->nentries++;
+}
+
+static void cse_pop(cse_ctx_t *ctx, int height)
+{
+   while (ctx->nentries > height) {
+      const cse_entry_t *e = &(ctx->entries[--(ctx->nentries)]);
+      ctx->buckets[e->bucket] = e->next;
+   }
+}
+
+static cse_entry_t *cse_lookup(cse_ctx_t *ctx, op_t *op)
+{
+   const unsigned bucket = cse_hash(ctx, op->kind, op);
+   for (int i = ctx->buckets[bucket]; i != -1; i = ctx->entries[i].next) {
+      cse_entry_t *e = &(ctx->entries[i]);
+      if (!cse_same_op(e->op, op))
+         continue;
+
+      // Only the most recent entry for a load can be valid
+      switch (e->mem) {
+      case CSE_MEM_LOCAL:
+         return e->stamp == ctx->lgen ? e : NULL;
+      case CSE_MEM_ANY:
+         return e->stamp == ctx->gen ? e : NULL;
+      default:
+         return e;
+      }
+   }
+
+   return NULL;
+}
+
+static void cse_block(cse_ctx_t *ctx, int block)
+{
+   const int height = ctx->nentries;
+
+   // Values loaded from memory in a dominating block are only still
+   // valid if there is no other path into this block
+   const int idom = ctx->idom[block];
+   if (ctx->npreds[block] == 1 && ctx->preds[block][0] == idom
+       && !ctx->root[block]) {
+      ctx->gen  = ctx->end_gen[idom];
+      ctx->lgen = ctx->end_lgen[idom];
+   }
+   else {
+      ctx->gen  = ++(ctx->counter);
+      ctx->lgen = ++(ctx->counter);
+   }
+
+   block_t *b = &(active_unit->blocks.items[block]);
+   for (int i = 0; i < b->ops.count; i++) {
+      op_t *op = &(b->ops.items[i]);
+
+      for (int j = 0; j < op->args.count; j++) {
+         if (op->args.items[j] != VCODE_INVALID_REG)
+            op->args.items[j] = ctx->map[op->args.items[j]];
+      }
+
+      int64_t test;
+      cse_mem_t mem;
+      if (op->kind == VCODE_OP_SELECT
+          && vcode_reg_const(op->args.items[0], &test)) {
+         ctx->map[op->result] = op->args.items[test ? 1 : 2];
+
+         op->comment = xasprintf("Constant select of r%d",
+                                 ctx->map[op->result]);
+         op->kind = VCODE_OP_COMMENT;
+         vcode_reg_array_resize(&(op->args), 0, VCODE_INVALID_REG);
+         ctx->replaced++;
+      }
+      else if (cse_candidate(ctx, op, &mem)) {
+         const cse_entry_t *e = cse_lookup(ctx, op);
+         if (e != NULL) {
+            ctx->map[op->result] = e->reg;
+
+            op->comment = xasprintf("Replaced %s of r%d with r%d",
+                                    vcode_op_string(op->kind),
+                                    op->result, e->reg);
+            op->kind = VCODE_OP_COMMENT;
+            vcode_reg_array_resize(&(op->args), 0, VCODE_INVALID_REG);
+            ctx->replaced++;
+         }
+         else
+            cse_push(ctx, op, op->result, block, mem);
+      }
+      else if (op->kind == VCODE_OP_STORE
+               && MASK_CONTEXT(op->address) == active_unit->depth
+               && ctx->tracked[MASK_INDEX(op->address)]) {
+         // A later load of the variable yields the stored value
+         cse_push(ctx, op, op->args.items[0], block, CSE_MEM_LOCAL);
+      }
+      else if (op->kind == VCODE_OP_NESTED_FCALL
+               || op->kind == VCODE_OP_NESTED_PCALL
+               || op->kind == VCODE_OP_RESUME) {
+         // Nested subprograms may assign to any variable in this scope
+         ctx->gen  = ++(ctx->counter);
+         ctx->lgen = ++(ctx->counter);
+      }
+      else if (cse_writes_memory(op))
+         ctx->gen = ++(ctx->counter);
+   }
+
+   ctx->end_gen[block]  = ctx->gen;
+   ctx->end_lgen[block] = ctx->lgen;
+
+   for (int i = 0; i < ctx->nchildren[block]; i++)
+      cse_block(ctx, ctx->children[ctx->child_start[block] + i]);
+
+   cse_pop(ctx, height);
+}
+
+static void cse_dfs(cse_ctx_t *ctx, int block, bool *visited, int *post,
+                    int *npost)
+{
+   visited[block] = true;
+
+   const block_t *b = &(active_unit->blocks.items[block]);
+   if (b->ops.count > 0) {
+      const op_t *term = &(b->ops.items[b->ops.count - 1]);
+      for (int i = 0; i < term->targets.count && !cse_resumes(term); i++) {
+         const int succ = term->targets.items[i];
+         if (!visited[succ])
+            cse_dfs(ctx, succ, visited, post, npost);
+      }
+   }
+
+   post[(*npost)++] = block;
+}
+
+static int cse_intersect_dom(cse_ctx_t *ctx, int a, int b)
+{
+   while (a != b) {
+      while (ctx->order[a] > ctx->order[b])
+         a = ctx->idom[a];
+      while (ctx->order[b] > ctx->order[a])
+         b = ctx->idom[b];
+   }
+
+   return a;
+}
+
+static void vcode_opt_cse(void)
+{
+   // Replace operations with the result of an identical operation in
+   // the same block or a dominating block
+
+   const int nblocks = active_unit->blocks.count;
+   const int nregs   = active_unit->regs.count;
+   const int nvars   = active_unit->vars.count;
+
+   cse_ctx_t ctx = {
+      .nblocks     = nblocks,
+      .order       = xmalloc((nblocks + 1) * sizeof(int)),
+      .idom        = xmalloc((nblocks + 1) * sizeof(int)),
+      .npreds      = xcalloc(nblocks * sizeof(int)),
+      .preds       = xcalloc(nblocks * sizeof(int *)),
+      .nchildren   = xcalloc(nblocks * sizeof(int)),
+      .child_start = xmalloc((nblocks + 1) * sizeof(int)),
+      .children    = xmalloc(MAX(nblocks, 1) * sizeof(int)),
+      .root        = xcalloc(nblocks * sizeof(bool)),
+      .tracked     = xmalloc(MAX(nvars, 1) * sizeof(bool)),
+      .map         = xmalloc(MAX(nregs, 1) * sizeof(vcode_reg_t)),
+      .end_gen     = xcalloc(nblocks * sizeof(unsigned)),
+      .end_lgen    = xcalloc(nblocks * sizeof(unsigned)),
+      .nbuckets    = next_power_of_2(MAX(nregs, 16))
+   };
+
+   ctx.buckets = xmalloc(ctx.nbuckets * sizeof(int));
+   for (unsigned i = 0; i < ctx.nbuckets; i++)
+      ctx.buckets[i] = -1;
+
+   for (int i = 0; i < nregs; i++)
+      ctx.map[i] = i;
+
+   for (int i = 0; i < nvars; i++)
+      ctx.tracked[i] = true;
+
+   // The entry block, the first block of a process after reset, and
+   // every block entered through the jump table are roots
+   ctx.root[0] = true;
+   if (active_unit->kind == VCODE_UNIT_PROCESS && nblocks > 1)
+      ctx.root[1] = true;
+
+   for (int i = 0; i < nblocks; i++) {
+      const block_t *b = &(active_unit->blocks.items[i]);
+      for (int j = 0; j < b->ops.count; j++) {
+         const op_t *op = &(b->ops.items[j]);
+
+         // Variables whose address is taken may be modified indirectly
+         if (op->kind == VCODE_OP_INDEX
+             && MASK_CONTEXT(op->address) == active_unit->depth)
+            ctx.tracked[MASK_INDEX(op->address)] = false;
+      }
+
+      if (b->ops.count == 0)
+         continue;
+
+      const op_t *term = &(b->ops.items[b->ops.count - 1]);
+      for (int k = 0; k < term->targets.count; k++) {
+         if (cse_resumes(term))
+            ctx.root[term->targets.items[k]] = true;
+         else
+            ctx.npreds[term->targets.items[k]]++;
+      }
+   }
+
+   for (int i = 0; i < nblocks; i++) {
+      ctx.preds[i] = xmalloc(MAX(ctx.npreds[i], 1) * sizeof(int));
+      ctx.npreds[i] = 0;
+      ctx.idom[i] = -1;
+   }
+
+   for (int i = 0; i < nblocks; i++) {
+      const block_t *b = &(active_unit->blocks.items[i]);
+      if (b->ops.count == 0)
+         continue;
+
+      const op_t *term = &(b->ops.items[b->ops.count - 1]);
+      for (int k = 0; k < term->targets.count && !cse_resumes(term); k++) {
+         const int succ = term->targets.items[k];
+         bool dup = false;
+         for (int p = 0; p < ctx.npreds[succ]; p++)
+            dup = dup || ctx.preds[succ][p] == i;
+         if (!dup)
+            ctx.preds[succ][ctx.npreds[succ]++] = i;
+      }
+   }
+
+   // Number the blocks in reverse post-order from each root in turn
+   bool *visited = xcalloc(nblocks * sizeof(bool));
+   int *post = xmalloc(nblocks * sizeof(int));
+   int npost = 0;
+   for (int i = nblocks - 1; i >= 0; i--) {
+      if (ctx.root[i] && !visited[i])
+         cse_dfs(&ctx, i, visited, post, &npost);
+   }
+
+   int *rpo = xmalloc(MAX(npost, 1) * sizeof(int));
+   for (int i = 0; i < nblocks; i++)
+      ctx.order[i] = INT32_MAX;
+   for (int i = 0; i < npost; i++) {
+      rpo[i] = post[npost - 1 - i];
+      ctx.order[rpo[i]] = i;
+   }
+
+   // Dominators using the algorithm of Cooper, Harvey and Kennedy with
+   // a virtual entry block numbered after the last real block that
+   // dominates all the roots
+   const int entry = nblocks;
+   ctx.order[entry] = -1;
+   ctx.idom[entry] = entry;
+   for (int i = 0; i < nblocks; i++) {
+      if (ctx.root[i] && visited[i])
+         ctx.idom[i] = entry;
+   }
+
+   bool changed;
+   do {
+      changed = false;
+      for (int i = 0; i < npost; i++) {
+         const int b = rpo[i];
+         if (ctx.root[b])
+            continue;
+
+         int new_idom = -1;
+         for (int p = 0; p < ctx.npreds[b]; p++) {
+            const int pred = ctx.preds[b][p];
+            if (ctx.idom[pred] == -1)
+               continue;
+            else if (new_idom == -1)
+               new_idom = pred;
+            else
+               new_idom = cse_intersect_dom(&ctx, pred, new_idom);
+         }
+
+         if (new_idom != ctx.idom[b]) {
+            ctx.idom[b] = new_idom;
+            changed = true;
+         }
+      }
+   } while (changed);
+
+   // Blocks are generated in order so a register can only be reused by
+   // a block with a higher number than its definition
+   for (int i = 0; i < npost; i++) {
+      const int b = rpo[i];
+      const int idom = ctx.idom[b];
+      if (!ctx.root[b] && idom != -1 && idom < b)
+         ctx.nchildren[idom]++;
+      else if (!ctx.root[b])
+         ctx.root[b] = true;
+   }
+
+   // Each block has at most one parent so the child lists are packed
+   // into a single array of nblocks entries
+   ctx.child_start[0] = 0;
+   for (int i = 0; i < nblocks; i++) {
+      ctx.child_start[i + 1] = ctx.child_start[i] + ctx.nchildren[i];
+      ctx.nchildren[i] = 0;
+   }
+
+   for (int i = 0; i < npost; i++) {
+      const int b = rpo[i];
+      if (!ctx.root[b]) {
+         const int idom = ctx.idom[b];
+         ctx.children[ctx.child_start[idom] + ctx.nchildren[idom]++] = b;
+      }
+   }
+
+   for (int i = 0; i < npost; i++) {
+      if (ctx.root[rpo[i]])
+         cse_block(&ctx, rpo[i]);
+   }
+
+   // Rewrite any remaining uses in unreachable blocks
+   if (ctx.replaced > 0) {
+      for (int i = 0; i < nblocks; i++) {
+         block_t *b = &(active_unit->blocks.items[i]);
+         for (int j = 0; j < b->ops.count; j++) {
+            op_t *op = &(b->ops.items[j]);
+            for (int k = 0; k < op->args.count; k++) {
+               if (op->args.items[k] != VCODE_INVALID_REG)
+                  op->args.items[k] = ctx.map[op->args.items[k]];
+            }
+         }
+      }
+   }
+
+   for (int i = 0; i < nblocks; i++)
+      free(ctx.preds[i]);
+
+   free(visited);
+   free(post);
+   free(rpo);
+   free(ctx.order);
+   free(ctx.idom);
+   free(ctx.npreds);
+   free(ctx.preds);
+   free(ctx.nchildren);
+   free(ctx.child_start);
+   free(ctx.children);
+   free(ctx.root);
+   free(ctx.tracked);
+   free(ctx.map);
+   free(ctx.end_gen);
+   free(ctx.end_lgen);
+   free(ctx.entries);
+   free(ctx.buckets);
+}
+
+static void vcode_opt_unreachable(void)
+{
+   // Delete blocks which cannot be reached from the entry point and
+   // renumber those that remain
+
+   const int nblocks = active_unit->blocks.count;
+
+   int *map = xmalloc(nblocks * sizeof(int));
+   int *stack = xmalloc(nblocks * sizeof(int));
+   int sp = 0;
+
+   for (int i = 0; i < nblocks; i++)
+      map[i] = -1;
+
+   map[0] = 0;
+   stack[sp++] = 0;
+
+   if (active_unit->kind == VCODE_UNIT_PROCESS && nblocks > 1) {
+      map[1] = 0;
+      stack[sp++] = 1;
+   }
+
+   while (sp > 0) {
+      const block_t *b = &(active_unit->blocks.items[stack[--sp]]);
+      for (int i = 0; i < b->ops.count; i++) {
+         const op_t *op = &(b->ops.items[i]);
+         for (int j = 0; j < op->targets.count; j++) {
+            const int succ = op->targets.items[j];
+            if (map[succ] == -1) {
+               map[succ] = 0;
+               stack[sp++] = succ;
+            }
+         }
+      }
+   }
+
+   int nlive = 0;
+   for (int i = 0; i < nblocks; i++) {
+      if (map[i] != -1)
+         map[i] = nlive++;
+   }
+
+   if (nlive < nblocks) {
+      for (int i = 0; i < nblocks; i++) {
+         if (map[i] == -1)
+            continue;
+
+         block_t *b = &(active_unit->blocks.items[i]);
+         for (int j = 0; j < b->ops.count; j++) {
+            op_t *op = &(b->ops.items[j]);
+            for (int k = 0; k < op->targets.count; k++)
+               op->targets.items[k] = map[op->targets.items[k]];
+         }
+
+         active_unit->blocks.items[map[i]] = *b;
+      }
+
+      active_unit->blocks.count = nlive;
+
+      if (active_block != VCODE_INVALID_BLOCK)
+         active_block = map[active_block];
+   }
+
+   free(map);
+   free(stack);
+}
+
+static void vcode_opt_copies(void)
+{
+   // Remove copies which have become no-ops after other optimisations
+
+   for (int i = 0; i < active_unit->blocks.count; i++) {
+      block_t *b = &(active_unit->blocks.items[i]);
+      for (int j = 0; j < b->ops.count; j++) {
+         op_t *op = &(b->ops.items[j]);
+         if (op->kind != VCODE_OP_COPY)
+            continue;
+
+         int64_t count;
+         const bool redundant = op->args.items[0] == op->args.items[1]
+            || (op->args.count > 2 && vcode_reg_const(op->args.items[2], &count)
+                && count == 0);
+
+         if (redundant) {
+            op->comment = xasprintf("Redundant copy to r%d",
+                                    op->args.items[0]);
+            op->kind = VCODE_OP_COMMENT;
+            vcode_reg_array_resize(&(op->args), 0, VCODE_INVALID_REG);
+         }
+      }
+   }
+}
+
 void vcode_opt(void)
 {
+   vcode_opt_bounds();
+   vcode_opt_unreachable();
+   vcode_opt_cse();
+   vcode_opt_copies();
+
    // Prune assignments to unused registers
 
    int *uses = xmalloc(active_unit->regs.count * sizeof(int));
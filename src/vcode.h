@@ -232,6 +232,7 @@ vcode_type_t vcode_reg_type(vcode_reg_t reg);
 vtype_kind_t vcode_reg_kind(vcode_reg_t reg);
 vcode_type_t vcode_reg_bounds(vcode_reg_t reg);
 bool vcode_reg_const(vcode_reg_t reg, int64_t *value);
+int vcode_reg_const_data(vcode_reg_t reg, int64_t *values, int max);
 void vcode_heap_allocate(vcode_reg_t reg);
 
 int vcode_count_signals(void);
@@ -655,6 +655,21 @@ vhpiHandleT vhpi_handle_by_name(const char *name, vhpiHandleT scope)
          return (vhpiHandleT)vhpi_tree_to_obj(d, vhpiSigDeclK);
    }
 
+   const int nstmts = tree_stmts(top_level);
+   for (int i = 0; i < nstmts; i++) {
+      tree_t s = tree_stmt(top_level, i);
+
+      // The original processes are chained from a fused process
+      tree_t it = tree_attr_tree(s, fused_i);
+      if (it == NULL && tree_ident(s) == search)
+         return (vhpiHandleT)vhpi_tree_to_obj(s, vhpiProcessStmtK);
+
+      for (; it != NULL; it = tree_attr_tree(it, fused_i)) {
+         if (tree_ident(it) == search)
+            return (vhpiHandleT)vhpi_tree_to_obj(it, vhpiProcessStmtK);
+      }
+   }
+
    vhpi_error(vhpiError, NULL, "object %s not found", istr(search));
    return NULL;
 }
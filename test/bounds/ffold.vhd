@@ -0,0 +1,27 @@
+entity ffold is
+end entity;
+
+architecture test of ffold is
+
+    function get_bits(x, len : natural) return bit_vector is
+    begin
+        return bit_vector'(1 to len => '0');
+    end function;
+
+    function get_bits(n : natural) return bit_vector is
+    begin
+        return (n - 1 downto 0 => '0');
+    end function;
+
+    signal x : bit_vector(7 downto 0) := get_bits(1, 12);  -- Error
+
+begin
+
+    process is
+        variable x : bit_vector(7 downto 0) := get_bits(12);  -- Error
+    begin
+        report "should not print this";
+        wait;
+    end process;
+
+end architecture;
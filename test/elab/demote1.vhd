@@ -0,0 +1,24 @@
+entity demote1 is
+end entity;
+
+architecture test of demote1 is
+    signal a, b, c, d : integer;
+begin
+
+    p1: process is
+    begin
+        a <= 1;
+        b <= 2 after 1 ns;              -- Delay
+        c <= 3;
+        d <= 4;
+        wait for 1 ns;
+        assert c'event;                 -- Event observed
+        wait;
+    end process;
+
+    p2: process (d) is                 -- Waits on D
+    begin
+        report integer'image(d);
+    end process;
+
+end architecture;
@@ -0,0 +1,29 @@
+entity fuse1 is
+end entity;
+
+architecture test of fuse1 is
+    signal clk     : bit;
+    signal a, b, c : integer;
+begin
+
+    p1: process (clk) is
+        variable n : integer := 0;
+    begin
+        n := n + 1;
+        a <= n;
+    end process;
+
+    p2: process (clk) is
+        variable n : integer := 0;
+    begin
+        n := n + 2;
+        b <= n;
+    end process;
+
+    -- Different sensitivity
+    p3: process (a) is
+    begin
+        c <= a;
+    end process;
+
+end architecture;
@@ -0,0 +1,28 @@
+entity level1 is
+end entity;
+
+architecture test of level1 is
+    signal a, b, c, d : integer;
+    signal x, y, z    : integer;
+    signal p, q       : bit;
+    signal v          : bit_vector(1 to 3);
+begin
+
+    -- A chain of three levels
+    s1: b <= a + 1;
+    s2: c <= b * 2;
+    s3: d <= c + 1;
+
+    -- Reads signals from two different levels
+    s4: x <= a;
+    s5: y <= x + 1;
+    s6: z <= x + y;
+
+    -- Feedback loop
+    s7: p <= q;
+    s8: q <= p;
+
+    -- Only sensitive to the element read
+    s9: v(1) <= v(2);
+
+end architecture;
@@ -0,0 +1,15 @@
+entity memory1 is
+end entity;
+
+architecture test of memory1 is
+    type mem_t is array (0 to 63) of bit_vector(1 downto 0);
+    signal mem  : mem_t;
+    signal addr : integer;
+begin
+
+    process (addr) is
+    begin
+        mem(addr) <= "11";
+    end process;
+
+end architecture;
@@ -1,11 +1,25 @@
 #include "ident.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+
+#define NIDENTS 100000
+#define NLOOKUP 100
+
+static double now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 int main(int argc, char **argv)
 {
+   double start = now();
+
    for (int i = 0; i < 10000000; i++) {
       char buf[16];
       size_t len = (random() % (sizeof(buf) - 3)) + 2;
@@ -19,5 +33,29 @@ int main(int argc, char **argv)
       assert(strcmp(istr(i1), buf) == 0);
    }
 
+   printf("ident_new: %.3fs\n", now() - start);
+
+   // Hierarchical names similar to those built during elaboration
+   static ident_t idents[NIDENTS];
+   for (int i = 0; i < NIDENTS; i++) {
+      char buf[64];
+      snprintf(buf, sizeof(buf), ":top:sub%d:inst%d:signal%d",
+               i % 7, i % 113, i);
+      idents[i] = ident_prefix(ident_new(buf), ident_new("x"), '.');
+   }
+
+   start = now();
+
+   size_t total = 0;
+   for (int n = 0; n < NLOOKUP; n++) {
+      for (int i = 0; i < NIDENTS; i++) {
+         const char *str = istr(idents[i]);
+         assert(str == istr(idents[i]));
+         total += str[0];
+      }
+   }
+
+   printf("istr: %.3fs (%zu)\n", now() - start, total);
+
    return 0;
 }
@@ -0,0 +1,20 @@
+entity bounds2 is
+end entity;
+
+architecture test of bounds2 is
+    signal s : integer;
+begin
+
+    process is
+        variable x : integer;
+        variable y : integer range 0 to 9;
+    begin
+        x := s;
+        if x >= 0 and x < 10 then
+            y := x;                     -- No bounds check required
+        end if;
+        y := x;                         -- Must be checked
+        wait;
+    end process;
+
+end architecture;
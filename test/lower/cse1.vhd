@@ -0,0 +1,31 @@
+entity cse1 is
+end entity;
+
+architecture test of cse1 is
+
+    function func(a, b : integer) return integer is
+        variable r : integer;
+    begin
+        r := a * b;
+        if a > b then
+            r := r + a * b;
+        end if;
+        return r;
+    end function;
+
+    signal s : integer;
+
+begin
+
+    process is
+        variable v : integer;
+    begin
+        v := s;
+        wait for 1 ns;
+        v := v + 1;
+        wait for 1 ns;
+        v := v + 1;
+        wait;
+    end process;
+
+end architecture;
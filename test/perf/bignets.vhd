@@ -0,0 +1,36 @@
+-- Stress test for elaborating a design with 16M nets
+
+entity bignets is
+end entity;
+
+architecture test of bignets is
+    constant WIDTH : integer := 16;
+    constant DEPTH : integer := 2 ** 20;
+
+    type ram_t is array (0 to DEPTH - 1) of bit_vector(WIDTH - 1 downto 0);
+
+    signal ram  : ram_t;
+    signal addr : integer range 0 to DEPTH - 1;
+    signal din  : bit_vector(WIDTH - 1 downto 0);
+    signal dout : bit_vector(WIDTH - 1 downto 0);
+begin
+
+    write: process (addr, din) is
+    begin
+        ram(addr) <= din;
+    end process;
+
+    dout <= ram(addr);
+
+    stim: process is
+    begin
+        for i in 0 to 15 loop
+            addr <= i;
+            din  <= (others => '1');
+            wait for 1 ns;
+            assert dout = (WIDTH - 1 downto 0 => '1');
+        end loop;
+        wait;
+    end process;
+
+end architecture;
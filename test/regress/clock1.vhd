@@ -0,0 +1,86 @@
+entity clock1 is
+end entity;
+
+architecture test of clock1 is
+    signal clk1 : bit := '0';
+    signal clk2 : boolean := false;
+    signal clk3 : bit := '1';
+    signal n1, n2, n3 : natural := 0;
+    signal t1, t3 : delay_length;
+begin
+
+    -- The three clock generators are replaced by the kernel so the gold
+    -- file checks the number of runs reported by --stats. Each of the
+    -- eight processes is reset once and the clock generators never run.
+    -- The two edge filtered processes run at startup and on 20 rising
+    -- edges, the one on CLK2 runs at startup and on 67 changes, and
+    -- CHECK and DELTA run 4 and 6 times: 8 + 21 + 21 + 68 + 4 + 6 = 128
+    clk1 <= not clk1 after 5 ns;
+
+    process is
+    begin
+        clk2 <= not clk2;
+        wait for 3 ns;
+    end process;
+
+    process is
+    begin
+        clk3 <= '0';
+        wait for 4 ns;
+        clk3 <= '1';
+        wait for 6 ns;
+    end process;
+
+    process (clk1) is
+    begin
+        if clk1'event and clk1 = '1' then
+            n1 <= n1 + 1;
+            t1 <= now;
+        end if;
+    end process;
+
+    process (clk2) is
+    begin
+        if clk2 then
+            n2 <= n2 + 1;
+        end if;
+    end process;
+
+    process (clk3) is
+    begin
+        if clk3'event and clk3 = '1' then
+            n3 <= n3 + 1;
+            t3 <= now;
+        end if;
+    end process;
+
+    -- Check the delta cycle in which each clock changes
+    delta: process is
+    begin
+        wait for 4 ns;
+        assert clk3 = '0';
+        wait for 0 ns;
+        assert clk3 = '1';
+        wait for 1 ns;
+        assert clk1 = '1';
+        wait for 1 ns;
+        assert not clk2;
+        wait for 0 ns;
+        assert clk2;
+        wait;
+    end process;
+
+    check: process is
+    begin
+        wait for 100 ns;
+        assert n1 = 10 report integer'image(n1);
+        assert t1 = 95 ns;
+        assert n2 = 17 report integer'image(n2);
+        assert n3 = 10 report integer'image(n3);
+        assert t3 = 94 ns;
+        wait until clk3 = '1';
+        assert now = 104 ns;
+        wait;
+    end process;
+
+end architecture;
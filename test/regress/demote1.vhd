@@ -0,0 +1,75 @@
+entity demote1 is
+end entity;
+
+architecture test of demote1 is
+    signal clk   : bit := '0';
+    signal count : integer := 0;
+    signal prev  : integer := -1;
+    signal t     : integer := 0;
+    signal v     : bit_vector(1 to 3) := "000";
+    signal d     : integer := 0;
+    signal e     : bit := '0';
+begin
+
+    clkgen: process is
+    begin
+        for i in 1 to 20 loop
+            clk <= not clk;
+            wait for 5 ns;
+        end loop;
+        wait;
+    end process;
+
+    counter: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            count <= count + 1;
+            prev  <= count;
+        end if;
+    end process;
+
+    check_clk: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            -- Both values are from the previous edge
+            assert prev = count - 1;
+        end if;
+    end process;
+
+    stim: process is
+    begin
+        t <= 1;
+        assert t = 0;
+        wait for 0 ns;
+        assert t = 1;
+        t <= 2;
+        t <= 3;
+        v(2) <= '1';
+        assert t = 1;
+        wait for 0 ns;
+        assert t = 3;
+        assert v = "010";
+
+        -- Also assigned with a delay so must not be demoted
+        d <= 1;
+        d <= transport 2 after 2 ns;
+        wait for 0 ns;
+        assert d = 1;
+        wait for 2 ns;
+        assert d = 2;
+
+        -- The event must still be visible
+        e <= '1';
+        wait for 0 ns;
+        assert e'event;
+        assert e = '1';
+        e <= '1';
+        wait for 0 ns;
+        assert not e'event;
+        wait for 200 ns;
+        assert count = 10;
+        assert prev = 9;
+        wait;
+    end process;
+
+end architecture;
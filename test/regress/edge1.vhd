@@ -0,0 +1,78 @@
+entity edge1 is
+end entity;
+
+architecture test of edge1 is
+    type state_t is (IDLE, BUSY, DONE);
+
+    signal clk          : bit := '0';
+    signal en           : boolean := false;
+    signal state        : state_t := IDLE;
+    signal rise, fall   : natural := 0;
+    signal gated, other : natural := 0;
+    signal done_count   : natural := 0;
+begin
+
+    -- Processes filtered on an edge are not run at all for other values
+    -- so the gold file checks the number of runs reported by --stats.
+    -- Each process is reset and run once at startup. After that P_RISE
+    -- (fused with P_GATED) and P_FALL run on 8 edges and P_STATE on 3
+    -- changes while P_OTHER runs on all 16 changes of CLK and STIM
+    -- resumes 17 times: 10 + 10 + 5 + 18 + 19 = 62
+    p_rise: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            rise <= rise + 1;
+        end if;
+    end process;
+
+    p_fall: process (clk) is
+    begin
+        if clk = '0' and clk'event then
+            fall <= fall + 1;
+        end if;
+    end process;
+
+    p_gated: process (clk) is
+    begin
+        if clk = '1' and en then
+            gated <= gated + 1;
+        end if;
+    end process;
+
+    -- Not filtered as EN is tested first
+    p_other: process (clk) is
+    begin
+        if en and clk = '1' then
+            other <= other + 1;
+        end if;
+    end process;
+
+    p_state: process (state) is
+    begin
+        if state = DONE then
+            done_count <= done_count + 1;
+        end if;
+    end process;
+
+    stim: process is
+    begin
+        for i in 1 to 8 loop
+            clk <= '1';
+            wait for 5 ns;
+            clk <= '0';
+            wait for 5 ns;
+            if i = 4 then
+                en <= true;
+            end if;
+            state <= state_t'val(i mod 3);
+        end loop;
+        wait for 1 ns;
+        assert rise = 8;
+        assert fall = 8;
+        assert gated = 4;
+        assert other = 4;
+        assert done_count = 3;
+        wait;
+    end process;
+
+end architecture;
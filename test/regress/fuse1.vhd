@@ -0,0 +1,110 @@
+entity fuse1 is
+end entity;
+
+architecture test of fuse1 is
+    signal clk  : bit := '0';
+    signal a, b : integer := 0;
+    signal c, d : integer := 0;
+
+    type int_vec is array (natural range <>) of integer;
+
+    function sum (v : int_vec) return integer is
+        variable result : integer := 0;
+    begin
+        for i in v'range loop
+            result := result + v(i);
+        end loop;
+        return result;
+    end function;
+
+    subtype sum_int is sum integer;
+
+    signal r : sum_int := 0;
+begin
+
+    p1: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            a <= a + 1;
+        end if;
+    end process;
+
+    p2: process (clk) is
+        variable n : integer := 0;
+    begin
+        if clk'event and clk = '1' then
+            n := n + 1;
+            b <= n * 2;
+        end if;
+    end process;
+
+    -- These two must keep separate drivers
+    p3: process (clk) is
+    begin
+        if clk = '1' then
+            r <= 1;
+        end if;
+    end process;
+
+    p4: process (clk) is
+    begin
+        if clk = '1' then
+            r <= 2;
+        end if;
+    end process;
+
+    p5: process (clk) is
+    begin
+        if clk'event and clk = '1' and a = 3 then
+            report "a is three";
+        end if;
+    end process;
+
+    -- Each declares a variable with the same name as the one in p2
+    p6: process (clk) is
+        variable n : integer := 0;
+    begin
+        if clk'event and clk = '1' then
+            n := n + 1;
+            c <= n;
+        end if;
+    end process;
+
+    p7: process (clk) is
+        variable n : integer := 100;
+    begin
+        if clk'event and clk = '1' then
+            n := n - 1;
+            d <= n;
+        end if;
+    end process;
+
+    clkgen: process is
+    begin
+        for i in 1 to 10 loop
+            clk <= '1';
+            wait for 5 ns;
+            clk <= '0';
+            wait for 5 ns;
+        end loop;
+        wait;
+    end process;
+
+    check: process is
+    begin
+        wait until clk = '1';
+        wait for 1 ns;
+        assert a = 1;
+        assert b = 2;
+        assert r = 3;
+        assert c = 1;
+        assert d = 99;
+        wait for 40 ns;
+        assert a = 5;
+        assert b = 10;
+        assert c = 5;
+        assert d = 95;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,59 @@
+package gcfold1_pack is
+    function double(x : integer) return integer;
+    constant k : integer;
+end package;
+
+package body gcfold1_pack is
+    function double(x : integer) return integer is
+    begin
+        return x * 2;
+    end function;
+
+    constant k : integer := double(21);
+end package body;
+
+-------------------------------------------------------------------------------
+
+use work.gcfold1_pack.all;
+
+entity sub is
+    generic ( g : integer );
+end entity;
+
+architecture test of sub is
+    -- Folded during elaboration after the analysed units are collected
+    constant c : integer := double(g);
+begin
+
+    process is
+    begin
+        assert c = g * 2;
+        wait;
+    end process;
+
+end architecture;
+
+-------------------------------------------------------------------------------
+
+entity gcfold1 is
+end entity;
+
+use work.gcfold1_pack.all;
+
+architecture test of gcfold1 is
+    constant c1 : integer := double(21);
+    constant c2 : integer := double(5);
+begin
+
+    u1: entity work.sub generic map ( 21 );
+    u2: entity work.sub generic map ( 7 );
+
+    process is
+    begin
+        assert c1 = 42;
+        assert c2 = 10;
+        assert k = 42;
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,80 @@
+entity image1 is
+end entity;
+
+architecture test of image1 is
+    type state_t is (IDLE, BUSY, DONE);
+
+    type lvl_t is ('0', '1', 'Z');
+    type lvl_vec_t is array (natural range <>) of lvl_t;
+
+    function resolve (v : lvl_vec_t) return lvl_t is
+        variable r : lvl_t := 'Z';
+    begin
+        for i in v'range loop
+            if v(i) /= 'Z' then
+                r := v(i);
+            end if;
+        end loop;
+        return r;
+    end function;
+
+    type int_vec_t is array (natural range <>) of integer;
+
+    subtype rlvl_t is resolve lvl_t;
+    type rlvl_vec_t is array (natural range <>) of rlvl_t;
+
+    function get_init return integer is
+    begin
+        return 42;
+    end function;
+
+    signal i   : integer := -5;
+    signal b   : boolean := true;
+    signal s   : state_t := BUSY;
+    signal t   : time := 5 ns;
+    signal bv  : bit_vector(7 downto 0) := X"a5";
+    signal sl  : rlvl_t := '1';
+    signal slv : rlvl_vec_t(1 to 4) := (others => 'Z');
+    signal arr : int_vec_t(1 to 3) := (1, -2, 3);
+    signal dyn : integer := get_init;
+    signal r   : real := 1.5;
+begin
+
+    driver: process is
+    begin
+        assert i = -5;
+        assert b;
+        assert s = BUSY;
+        assert t = 5 ns;
+        assert bv = X"a5";
+        assert sl = '1';
+        assert slv = "ZZZZ";
+        assert arr = (1, -2, 3);
+        assert dyn = 42;
+        assert r = 1.5;
+
+        i   <= i - 1;
+        s   <= DONE;
+        bv  <= not bv;
+        sl  <= '0';
+        slv <= "01Z1";
+        arr(2) <= 7;
+        wait for 1 ns;
+
+        assert i = -6;
+        assert i'last_value = -5;
+        assert s = DONE;
+        assert s'last_value = BUSY;
+        assert bv = X"5a";
+        assert bv'last_value = X"a5";
+        assert sl = '0';
+        assert slv = "01Z1";
+        assert slv'last_value = "ZZZZ";
+        assert arr = (1, 7, 3);
+        assert arr'last_value = (1, -2, 3);
+
+        report "done";
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,64 @@
+entity level1 is
+end entity;
+
+architecture test of level1 is
+    type int_vec is array (0 to 10) of integer;
+    signal clk   : bit := '0';
+    signal count : integer := 0;
+    signal chain : int_vec;
+    signal x, y  : bit;
+    signal sum   : integer;
+    signal res   : integer;
+begin
+
+    clk <= not clk after 5 ns when count < 20;
+
+    counter: process (clk) is
+    begin
+        if clk'event and clk = '1' then
+            count <= count + 1;
+        end if;
+    end process;
+
+    chain(0) <= count;
+
+    stages: for i in 1 to 10 generate
+        chain(i) <= chain(i - 1) + i;
+    end generate;
+
+    -- Feedback loop which cannot be levelised
+    x <= y and clk;
+    y <= x;
+
+    -- Reads the end of the chain and a signal from the middle
+    sum <= chain(10) + chain(5);
+
+    res <= chain(10);
+
+    -- Levelisation must not change the delta cycle in which a signal
+    -- changes: chain(i) changes i + 1 deltas after count so res changes
+    -- after 12 and sum after 7 and again after 12
+    deltas: process is
+    begin
+        wait on count;
+        for d in 1 to 12 loop
+            wait for 0 ns;
+            assert sum'event = (d = 7 or d = 12)
+                report "sum event in delta " & integer'image(d);
+            assert res'event = (d = 12)
+                report "res event in delta " & integer'image(d);
+        end loop;
+    end process;
+
+    check: process (clk) is
+        variable expect : integer;
+    begin
+        if clk'event and clk = '0' and count > 0 then
+            expect := count + 55;
+            assert res = expect
+                report integer'image(res) & " /= " & integer'image(expect);
+            assert sum = expect + count + 15;
+        end if;
+    end process;
+
+end architecture;
@@ -0,0 +1,68 @@
+entity memory1 is
+end entity;
+
+architecture test of memory1 is
+    subtype word is bit_vector(7 downto 0);
+    type mem_t is array (0 to 1023) of word;
+
+    signal mem    : mem_t;
+    signal wakes5 : integer := 0;
+    signal wakes6 : integer := 0;
+    signal wakesa : integer := 0;
+begin
+
+    writer: process is
+        variable a : integer := 5;
+    begin
+        wait for 1 ns;
+        mem(a) <= X"11";
+        assert mem(5) = X"00";
+        wait for 0 ns;
+        assert mem(5) = X"11";
+        mem(a) <= X"11";                -- No event
+        wait for 1 ns;
+        mem(a + 1) <= X"22";
+        wait for 1 ns;
+        mem(a)(3 downto 0) <= "1111";   -- Partial words in one delta
+        mem(a)(7 downto 4) <= "0101";
+        wait for 1 ns;
+        assert mem(5) = X"5F";
+        assert mem(6) = X"22";
+        assert mem(7) = X"00";
+        for i in mem'range loop
+            mem(i) <= X"FF";
+        end loop;
+        wait for 1 ns;
+        for i in mem'range loop
+            assert mem(i) = X"FF";
+        end loop;
+        wait;
+    end process;
+
+    watch5: process (mem(5)) is
+    begin
+        wakes5 <= wakes5 + 1;
+    end process;
+
+    watch6: process is
+    begin
+        wait on mem(6);
+        wakes6 <= wakes6 + 1;
+    end process;
+
+    watcha: process is
+    begin
+        wait on mem;
+        wakesa <= wakesa + 1;
+    end process;
+
+    check: process is
+    begin
+        wait for 10 ns;
+        assert wakes5 = 4 report integer'image(wakes5);
+        assert wakes6 = 2 report integer'image(wakes6);
+        assert wakesa = 4 report integer'image(wakesa);
+        wait;
+    end process;
+
+end architecture;
@@ -0,0 +1,45 @@
+entity pgo1 is
+end entity;
+
+architecture test of pgo1 is
+
+    function collatz(n : integer) return integer is
+        variable x     : integer := n;
+        variable steps : integer := 0;
+    begin
+        while x /= 1 loop
+            if x mod 2 = 0 then
+                x := x / 2;
+            else
+                x := 3 * x + 1;
+            end if;
+            steps := steps + 1;
+        end loop;
+        return steps;
+    end function;
+
+    procedure never_called(x : out integer) is
+    begin
+        x := 42;
+    end procedure;
+
+    signal total : integer := 0;
+
+begin
+
+    process is
+        variable sum : integer := 0;
+    begin
+        for i in 1 to 1000 loop
+            sum := sum + collatz(i);
+        end loop;
+        total <= sum;
+        wait for 1 ns;
+        assert total = 59542;
+        if total < 0 then
+            never_called(sum);
+        end if;
+        wait;
+    end process;
+
+end architecture;
@@ -68,8 +68,10 @@ def analyse_elab_run(t)
   cmd += " -e #{t[:name]} #{native}"
   cmd += ' --disable-opt' unless t[:flags].member? 'opt'
   cmd += ' --cover' if t[:flags].member? 'cover'
+  cmd += ' --pgo-collect' if t[:flags].member? 'pgo'
   t[:flags].each do |f|
     cmd += " -#{f}" if f =~ /^g.*=.*$/
+    cmd += " -#{f}" if f =~ /^O[0-3]$/
   end
 
   if t[:flags].member?('fail') then
@@ -82,7 +84,18 @@ def analyse_elab_run(t)
     cmd += " --stop-time=#{Regexp.last_match(1)}" if f =~ /stop=(.*)/
     cmd += " --load=#{BuildDir}/lib/#{t[:name]}.so#{ENV['EXEEXT']}" if f == 'vhpi'
   end
+  cmd += ' --pgo-collect' if t[:flags].member? 'pgo'
+  cmd += ' --stats' if t[:flags].member? 'stats'
   cmd += " #{t[:name]}"
+
+  if t[:flags].member?('pgo') then
+    # Elaborate and run again using the profile just collected and dump
+    # the IR so the gold file can check the branch weights
+    run_cmd cmd
+    cmd = "#{nvc} #{std t} -e #{t[:name]} #{native} --pgo-use --dump-llvm"
+    cmd += " -r #{t[:name]}"
+  end
+
   run_cmd cmd, t[:flags].member?('fail')
 end
 
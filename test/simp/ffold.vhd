@@ -87,6 +87,27 @@ architecture a of ffold is
     signal s6 : integer := case1(7);
     signal s7 : integer := adddef;
     signal s8 : boolean := chain2("foo", "hello");
+
+    function sum_to(n : in integer) return integer is
+        variable r : integer := 0;
+    begin
+        for i in 1 to n loop
+            r := r + i;
+        end loop;
+        return r;
+    end function;
+
+    function ones(n : in natural) return bit_vector is
+        variable r : bit_vector(1 to n) := (others => '0');
+    begin
+        for i in r'range loop
+            r(i) := '1';
+        end loop;
+        return r;
+    end function;
+
+    signal s9  : integer := sum_to(100);
+    signal s10 : bit_vector(1 to 3) := ones(3);
 begin
 
 end architecture;
@@ -0,0 +1,57 @@
+package gcfold_pack is
+    function fact(n : integer) return integer;
+    function same(x, y : real) return boolean;
+    function negzero(x : real) return boolean;
+end package;
+
+package body gcfold_pack is
+
+    type real_array is array (natural range <>) of real;
+
+    function fact(n : integer) return integer is
+        variable r : integer := 1;
+    begin
+        for i in 2 to n loop
+            r := r * i;
+        end loop;
+        return r;
+    end function;
+
+    function same(x, y : real) return boolean is
+        constant a : real_array(1 to 2) := (x, 1.0);
+        constant b : real_array(1 to 2) := (y, 1.0);
+    begin
+        return a = b;
+    end function;
+
+    function negzero(x : real) return boolean is
+        constant a : real_array(1 to 2) := (x, 1.0);
+        constant b : real_array(1 to 2) := (-x, 1.0);
+    begin
+        return a = b;
+    end function;
+
+end package body;
+
+-------------------------------------------------------------------------------
+
+entity gcfold is
+end entity;
+
+use work.gcfold_pack.all;
+
+architecture a1 of gcfold is
+    constant c1 : integer := fact(5);
+    constant c2 : boolean := negzero(0.0);
+    constant c3 : boolean := same(1.0, 2.0);
+begin
+end architecture;
+
+-------------------------------------------------------------------------------
+
+use work.gcfold_pack.all;
+
+architecture a2 of gcfold is
+    constant c1 : integer := fact(5);
+begin
+end architecture;
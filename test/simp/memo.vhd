@@ -0,0 +1,29 @@
+entity memo is
+end entity;
+
+architecture a of memo is
+
+    function fact(n : integer) return integer is
+        variable r : integer := 1;
+    begin
+        for i in 2 to n loop
+            r := r * i;
+        end loop;
+        return r;
+    end function;
+
+    function zeros(n : natural) return bit_vector is
+        variable r : bit_vector(1 to n);
+    begin
+        return r;
+    end function;
+
+    constant c1 : integer := fact(5);
+    constant c2 : integer := fact(5);
+    constant c3 : integer := fact(6);
+    constant c4 : bit_vector := zeros(3);
+    constant c5 : bit_vector := zeros(3);
+
+begin
+
+end architecture;
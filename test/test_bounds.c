@@ -292,6 +292,30 @@ START_TEST(test_issue269)
 }
 END_TEST
 
+START_TEST(test_ffold)
+{
+   // Pure functions called with constant arguments are folded so length
+   // mismatches in the result are found during analysis but they are
+   // only warnings as the call may never be executed
+   const error_t expect[] = {
+      { 16, "length of value 12 does not match length of target 8" },
+      { 21, "length of value 12 does not match length of target 8" },
+      { -1, NULL }
+   };
+   expect_errors(expect);
+
+   input_from_file(TESTDIR "/bounds/ffold.vhd");
+
+   tree_t a = parse_and_check(T_ENTITY, T_ARCH);
+   fail_unless(sem_errors() == 0);
+
+   simplify(a);
+   bounds_check(a);
+
+   fail_unless(bounds_errors() == 0);
+}
+END_TEST
+
 int main(void)
 {
    Suite *s = suite_create("bounds");
@@ -308,6 +332,7 @@ int main(void)
    tcase_add_test(tc_core, test_issue208);
    tcase_add_test(tc_core, test_issue247);
    tcase_add_test(tc_core, test_issue269);
+   tcase_add_test(tc_core, test_ffold);
    suite_add_tcase(s, tc_core);
 
    return nvc_run_test(s);
@@ -430,6 +430,128 @@ START_TEST(test_jcore1)
 }
 END_TEST
 
+static tree_t find_stmt(tree_t top, const char *name)
+{
+   const int nstmts = tree_stmts(top);
+   for (int i = 0; i < nstmts; i++) {
+      tree_t s = tree_stmt(top, i);
+      if (icmp(tree_ident(s), name))
+         return s;
+   }
+
+   fail("missing statement %s", name);
+   return NULL;
+}
+
+static tree_t find_decl(tree_t top, const char *name)
+{
+   const int ndecls = tree_decls(top);
+   for (int i = 0; i < ndecls; i++) {
+      tree_t d = tree_decl(top, i);
+      if (icmp(tree_ident(d), name))
+         return d;
+   }
+
+   fail("missing declaration %s", name);
+   return NULL;
+}
+
+START_TEST(test_level1)
+{
+   input_from_file(TESTDIR "/elab/level1.vhd");
+
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+
+   opt_set_int("optimise", 3);
+   opt(top);
+
+   const struct {
+      const char *name;
+      int         level;
+   } procs[] = {
+      { ":level1:s1", 0 },
+      { ":level1:s2", 1 },
+      { ":level1:s3", 2 },
+      { ":level1:s4", 0 },
+      { ":level1:s5", 0 },
+      { ":level1:s6", -1 },
+      { ":level1:s7", -1 },
+      { ":level1:s8", -1 },
+      { ":level1:s9", 0 },
+   };
+
+   for (int i = 0; i < ARRAY_LEN(procs); i++) {
+      tree_t p = find_stmt(top, procs[i].name);
+      const int level = tree_attr_int(p, comb_level_i, -1);
+      fail_unless(level == procs[i].level, "%s has level %d",
+                  procs[i].name, level);
+   }
+
+   // Only sensitive to the element read
+   tree_t s9 = find_stmt(top, ":level1:s9");
+   tree_t wait = tree_stmt(s9, tree_stmts(s9) - 1);
+   fail_unless(tree_kind(wait) == T_WAIT);
+   fail_unless(tree_triggers(wait) == 1);
+   fail_unless(tree_kind(tree_trigger(wait, 0)) == T_ARRAY_REF);
+
+   // Signals which are also read by a process that is not levelised
+   // keep the normal delta cycle update
+   fail_unless(tree_attr_int(find_decl(top, ":level1:b"), comb_net_i, 0));
+   fail_unless(tree_attr_int(find_decl(top, ":level1:c"), comb_net_i, 0));
+   fail_if(tree_attr_int(find_decl(top, ":level1:x"), comb_net_i, 0));
+   fail_if(tree_attr_int(find_decl(top, ":level1:y"), comb_net_i, 0));
+   fail_if(tree_attr_int(find_decl(top, ":level1:p"), comb_net_i, 0));
+}
+END_TEST
+
+START_TEST(test_fuse1)
+{
+   input_from_file(TESTDIR "/elab/fuse1.vhd");
+
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+
+   opt(top);
+
+   fail_unless(tree_stmts(top) == 2);
+
+   // The fused process is chained to the original p1 and p2
+   tree_t p1 = find_stmt(top, ":fuse1:p1");
+   tree_t orig = tree_attr_tree(p1, fused_i);
+   fail_if(orig == p1);
+   fail_unless(tree_ident(orig) == tree_ident(p1));
+   orig = tree_attr_tree(orig, fused_i);
+   fail_unless(icmp(tree_ident(orig), ":fuse1:p2"));
+   fail_unless(tree_stmts(p1) == 5);
+
+   // Both variables are kept even though they have the same name
+   fail_unless(tree_decls(p1) == 2);
+   tree_t n1 = tree_decl(p1, 0);
+   tree_t n2 = tree_decl(p1, 1);
+   fail_unless(tree_ident(n1) == tree_ident(n2));
+   fail_if(n1 == n2);
+
+   find_stmt(top, ":fuse1:p3");
+}
+END_TEST
+
+START_TEST(test_demote1)
+{
+   input_from_file(TESTDIR "/elab/demote1.vhd");
+
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+
+   opt(top);
+
+   fail_unless(tree_attr_int(find_decl(top, ":demote1:a"), demoted_i, 0));
+   fail_if(tree_attr_int(find_decl(top, ":demote1:b"), demoted_i, 0));
+   fail_if(tree_attr_int(find_decl(top, ":demote1:c"), demoted_i, 0));
+   fail_if(tree_attr_int(find_decl(top, ":demote1:d"), demoted_i, 0));
+}
+END_TEST
+
 int main(void)
 {
    Suite *s = suite_create("elab");
@@ -462,6 +584,9 @@ int main(void)
    tcase_add_test(tc, test_libbind3);
    tcase_add_test(tc, test_issue251);
    tcase_add_test(tc, test_jcore1);
+   tcase_add_test(tc, test_level1);
+   tcase_add_test(tc, test_fuse1);
+   tcase_add_test(tc, test_demote1);
    suite_add_tcase(s, tc);
 
    return nvc_run_test(s);
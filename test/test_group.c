@@ -18,7 +18,7 @@ typedef struct {
 static void group_dump(group_nets_ctx_t *ctx)
 {
    printf("-------------\n");
-   for (group_t *it = ctx->groups; it != NULL; it = it->next)
+   for (group_node_t *it = ctx->groups; it != NULL; it = it->next)
       printf("%3d : %d..%d\n", it->gid, it->first, it->first + it->length - 1);
 }
 
@@ -28,7 +28,7 @@ static bool group_sanity_check(group_nets_ctx_t *ctx, netid_t max)
 
    for (netid_t i = 0; i <= max; i++) {
       bool have = false;
-      for (group_t *it = ctx->groups; it != NULL; it = it->next) {
+      for (group_node_t *it = ctx->groups; it != NULL; it = it->next) {
          if ((i >= it->first) && (i < it->first + it->length)) {
             if (have) {
                printf("net %d appears in multiple groups\n", i);
@@ -54,7 +54,7 @@ static void group_expect(group_nets_ctx_t *ctx, const group_expect_t *expect,
                          int n_expect)
 {
    int ngroups = 0;
-   for (group_t *it = ctx->groups; it != NULL; it = it->next)
+   for (group_node_t *it = ctx->groups; it != NULL; it = it->next)
       ngroups++;
 
    const int n_expect_orig = n_expect;
@@ -63,7 +63,8 @@ static void group_expect(group_nets_ctx_t *ctx, const group_expect_t *expect,
       const int length = expect->last - expect->first + 1;
 
       bool found = false;
-      for (group_t *it = ctx->groups; (it != NULL) && !found; it = it->next) {
+      for (group_node_t *it = ctx->groups;
+           (it != NULL) && !found; it = it->next) {
          if ((it->first == expect->first) && (it->length == length))
             found = true;
       }
@@ -456,6 +457,73 @@ START_TEST(test_jcore4)
 }
 END_TEST
 
+START_TEST(test_memory1)
+{
+   input_from_file(TESTDIR "/group/memory1.vhd");
+
+   tree_t top = run_elab();
+   fail_if(top == NULL);
+   opt(top);
+
+   group_nets_ctx_t ctx;
+   group_test_init(&ctx, NULL);
+   tree_visit(top, group_nets_visit_fn, &ctx);
+
+   const int nnets = tree_attr_int(top, ident_new("nnets"), 0);
+   fail_unless(group_sanity_check(&ctx, nnets - 1));
+
+   const group_expect_t expect[] = {
+      { 0, 127 }, { 128, 128 }
+   };
+
+   group_expect(&ctx, expect, ARRAY_LEN(expect));
+}
+END_TEST
+
+static int group_check_tree(group_node_t *n)
+{
+   if (n == NULL)
+      return 0;
+
+   const int lh = group_check_tree(n->left);
+   const int rh = group_check_tree(n->right);
+
+   fail_if(lh - rh > 1 || rh - lh > 1);
+   fail_unless(n->height == MAX(lh, rh) + 1);
+   fail_if(n->left != NULL && n->left->span_end > n->first);
+   fail_if(n->right != NULL && n->right->span_first < n->first + n->length);
+
+   return n->height;
+}
+
+START_TEST(test_many)
+{
+   const int nnets = 1 << 20;
+
+   group_nets_ctx_t ctx;
+   group_init_context(&ctx, nnets);
+
+   fail_unless(group_add(&ctx, 0, nnets) == 0);
+
+   for (int i = 0; i < nnets; i += 16)
+      fail_if(group_add(&ctx, i, 16) == GROUPID_INVALID);
+
+   fail_unless(ctx.next_gid == nnets / 16);
+
+   for (int i = 0; i < nnets; i += 1024)
+      group_add(&ctx, i + 3, 1);
+
+   fail_unless(ctx.next_gid == (nnets / 16) + 2 * (nnets / 1024));
+   fail_unless(group_add(&ctx, 1024, 3) != GROUPID_INVALID);
+   fail_unless(group_add(&ctx, 0, 32) == GROUPID_INVALID);
+
+   fail_unless(ctx.root->covered == nnets);
+   fail_unless(group_check_tree(ctx.root) <= 2 * ilog2(ctx.next_gid));
+
+   group_free_context(&ctx);
+}
+END_TEST
+
 int main(void)
 {
    Suite *s = suite_create("group");
@@ -480,6 +548,8 @@ int main(void)
    tcase_add_test(tc_core, test_arrayref3);
    tcase_add_test(tc_core, test_jcore2);
    tcase_add_test(tc_core, test_jcore4);
+   tcase_add_test(tc_core, test_many);
+   tcase_add_test(tc_core, test_memory1);
    suite_add_tcase(s, tc_core);
 
    return nvc_run_test(s);
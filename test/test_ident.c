@@ -68,7 +68,7 @@ START_TEST(test_read_write)
    i2 = ident_new("foo");
    i3 = ident_new("foo");
 
-   fbuf_t *f = fbuf_open("test.ident", FBUF_OUT);
+   fbuf_t *f = fbuf_open("test.ident", FBUF_OUT, 0);
    fail_if(f == NULL);
 
    ident_wr_ctx_t wctx = ident_write_begin(f);
@@ -81,7 +81,7 @@ START_TEST(test_read_write)
 
    fbuf_close(f);
 
-   f = fbuf_open("test.ident", FBUF_IN);
+   f = fbuf_open("test.ident", FBUF_IN, 0);
    fail_if(f == NULL);
 
    ident_rd_ctx_t rctx = ident_read_begin(f);
@@ -240,6 +240,32 @@ START_TEST(test_interned)
 }
 END_TEST
 
+START_TEST(test_grow)
+{
+   const int count = 100000;
+   ident_t *idents = malloc(count * sizeof(ident_t));
+
+   for (int i = 0; i < count; i++) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), ":top:u%d:sig", i);
+      idents[i] = ident_new(buf);
+   }
+
+   for (int i = 0; i < count; i++) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), ":top:u%d:sig", i);
+      fail_unless(ident_new(buf) == idents[i]);
+      fail_unless(strcmp(istr(idents[i]), buf) == 0);
+      fail_unless(ident_runtil(idents[i], ':')
+                  == ident_prefix(ident_new(":top"),
+                                  ident_rfrom(ident_runtil(idents[i], ':'),
+                                              ':'), ':'));
+   }
+
+   free(idents);
+}
+END_TEST
+
 int main(void)
 {
    srandom((unsigned)time(NULL));
@@ -262,6 +288,7 @@ int main(void)
    tcase_add_test(tc_core, test_rfrom);
    tcase_add_test(tc_core, test_from);
    tcase_add_test(tc_core, test_interned);
+   tcase_add_test(tc_core, test_grow);
    suite_add_tcase(s, tc_core);
 
    SRunner *sr = srunner_create(s);
@@ -2,6 +2,7 @@
 #include "tree.h"
 #include "util.h"
 #include "common.h"
+#include "fbuf.h"
 
 #include <check.h>
 #include <stdlib.h>
@@ -14,6 +15,8 @@ static void setup(void)
 {
    work = lib_new("test_lib", "/tmp/test_lib");
    fail_if(work == NULL);
+
+   opt_set_int("uncompressed", 0);
 }
 
 static void teardown(void)
@@ -94,6 +97,50 @@ START_TEST(test_lib_fopen)
 }
 END_TEST
 
+static void check_fbuf(const char *name)
+{
+   // Enough data to span several compressed blocks
+   const uint32_t nwords = 100000;
+
+   fbuf_t *f = lib_fbuf_open(work, name, FBUF_OUT);
+   fail_if(f == NULL);
+   for (uint32_t i = 0; i < nwords; i++)
+      write_u32(i * 7, f);
+   write_u64(UINT64_C(0x123456789abcdef), f);
+   fail_unless(fbuf_tell(f) == nwords * 4 + 8);
+   fbuf_close(f);
+
+   f = lib_fbuf_open(work, name, FBUF_IN);
+   fail_if(f == NULL);
+
+   fbuf_seek(f, 77777 * 4);
+   fail_unless(read_u32(f) == 77777 * 7);
+   fail_unless(fbuf_tell(f) == 77778 * 4);
+
+   fbuf_seek(f, 12 * 4);
+   fail_unless(read_u32(f) == 12 * 7);
+
+   for (uint32_t i = 13; i < nwords; i++)
+      fail_unless(read_u32(f) == i * 7);
+
+   fail_unless(read_u64(f) == UINT64_C(0x123456789abcdef));
+   fail_unless(fbuf_tell(f) == nwords * 4 + 8);
+
+   fbuf_close(f);
+}
+
+START_TEST(test_lib_fbuf)
+{
+   check_fbuf("_fbuf");
+
+   opt_set_int("uncompressed", 1);
+   check_fbuf("_fbuf_raw");
+   opt_set_int("uncompressed", 0);
+
+   fail_unless(lib_stat(work, "_fbuf_raw", NULL));
+}
+END_TEST
+
 START_TEST(test_lib_save)
 {
    {
@@ -259,6 +306,320 @@ START_TEST(test_lib_save)
 }
 END_TEST
 
+static void count_entities(ident_t name, int kind, void *context)
+{
+   if (kind == T_ENTITY)
+      (*(int *)context)++;
+}
+
+START_TEST(test_lib_index)
+{
+   const int nunits = 1000;
+   for (int i = 0; i < nunits; i++) {
+      char name[16];
+      checked_sprintf(name, sizeof(name), "ent%d", i);
+
+      tree_t ent = tree_new(T_ENTITY);
+      tree_set_ident(ent, ident_new(name));
+      lib_put(work, ent);
+   }
+
+   lib_save(work);
+   lib_free(work);
+
+   // A file in the library directory that is not in the index is not
+   // a design unit
+   lib_add_search_path("/tmp");
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+
+   FILE *f = lib_fopen(work, "stray", "w");
+   fail_if(f == NULL);
+   fclose(f);
+
+   fail_unless(lib_index_size(work) == nunits);
+
+   int nentities = 0;
+   lib_walk_index(work, count_entities, &nentities);
+   fail_unless(nentities == nunits);
+
+   tree_t ent = lib_get(work, ident_new("ent500"));
+   fail_if(ent == NULL);
+   fail_unless(tree_kind(ent) == T_ENTITY);
+   fail_unless(tree_ident(ent) == ident_new("ent500"));
+   fail_unless(lib_get(work, ident_new("ent500")) == ent);
+
+   fail_unless(lib_get(work, ident_new("missing")) == NULL);
+   fail_unless(lib_get(work, ident_new("stray")) == NULL);
+}
+END_TEST
+
+START_TEST(test_lib_lazy)
+{
+   {
+      tree_t pb = tree_new(T_PACK_BODY);
+      tree_set_ident(pb, ident_new("pack-body"));
+
+      tree_t v1 = tree_new(T_VAR_DECL);
+      tree_set_ident(v1, ident_new("v1"));
+      tree_set_type(v1, type_universal_int());
+
+      tree_t f1 = tree_new(T_FUNC_BODY);
+      tree_set_ident(f1, ident_new("f1"));
+      tree_add_decl(f1, v1);
+      tree_add_decl(pb, f1);
+
+      tree_t r1 = tree_new(T_REF);
+      tree_set_ident(r1, ident_new("v1"));
+      tree_set_ref(r1, v1);
+
+      tree_t ret = tree_new(T_RETURN);
+      tree_set_value(ret, r1);
+      tree_add_stmt(f1, ret);
+
+      // Reference from a later lazy array into an earlier one
+      tree_t f2 = tree_new(T_FUNC_BODY);
+      tree_set_ident(f2, ident_new("f2"));
+      tree_add_decl(pb, f2);
+
+      tree_t ret2 = tree_new(T_RETURN);
+      tree_set_value(ret2, r1);
+      tree_add_stmt(f2, ret2);
+
+      tree_t c = tree_new(T_CONST_DECL);
+      tree_set_ident(c, ident_new("c"));
+      tree_set_value(c, str_to_agg("the quick brown fox jumps over the "
+                                   "lazy dog", NULL));
+      tree_add_decl(pb, c);
+
+      // Reference from the unit itself into a lazy array
+      tree_add_attr_tree(pb, ident_new("var"), v1);
+
+      lib_put(work, pb);
+   }
+
+   tree_gc();
+
+   lib_save(work);
+   lib_free(work);
+
+   lib_add_search_path("/tmp");
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+
+   {
+      tree_t pb = lib_get(work, ident_new("pack-body"));
+      fail_if(pb == NULL);
+      fail_unless(tree_kind(pb) == T_PACK_BODY);
+      fail_unless(tree_decls(pb) == 3);
+
+      tree_t v1 = tree_attr_tree(pb, ident_new("var"));
+      fail_if(v1 == NULL);
+      fail_unless(tree_kind(v1) == T_VAR_DECL);
+      fail_unless(tree_ident(v1) == ident_new("v1"));
+
+      tree_t f2 = tree_decl(pb, 1);
+      fail_unless(tree_kind(f2) == T_FUNC_BODY);
+      fail_unless(tree_decls(f2) == 0);
+      fail_unless(tree_stmts(f2) == 1);
+
+      tree_t r1 = tree_value(tree_stmt(f2, 0));
+      fail_unless(tree_kind(r1) == T_REF);
+      fail_unless(tree_ref(r1) == v1);
+
+      tree_t f1 = tree_decl(pb, 0);
+      fail_unless(tree_kind(f1) == T_FUNC_BODY);
+      fail_unless(tree_decls(f1) == 1);
+      fail_unless(tree_decl(f1, 0) == v1);
+      fail_unless(tree_stmts(f1) == 1);
+      fail_unless(tree_value(tree_stmt(f1, 0)) == r1);
+
+      tree_t agg = tree_value(tree_decl(pb, 2));
+      fail_unless(tree_kind(agg) == T_AGGREGATE);
+      fail_unless(tree_assocs(agg) == 43);
+      fail_unless(tree_ident(tree_value(tree_assoc(agg, 42)))
+                  == ident_new("'g'"));
+      fail_unless(tree_pos(tree_assoc(agg, 42)) == 42);
+   }
+}
+END_TEST
+
+START_TEST(test_lib_gc)
+{
+   {
+      tree_t pack = tree_new(T_PACKAGE);
+      tree_set_ident(pack, ident_new("pack"));
+
+      tree_t c = tree_new(T_CONST_DECL);
+      tree_set_ident(c, ident_new("c"));
+      tree_set_type(c, type_universal_int());
+      tree_add_decl(pack, c);
+
+      lib_put(work, pack);
+   }
+
+   lib_save(work);
+   lib_free(work);
+
+   lib_add_search_path("/tmp");
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+
+   tree_t pack = lib_get(work, ident_new("pack"));
+   fail_if(pack == NULL);
+
+   // The package is old after it is read so the only reference to the
+   // new literal is through the remembered set
+   tree_t lit = tree_new(T_LITERAL);
+   tree_set_subkind(lit, L_INT);
+   tree_set_ival(lit, 42);
+   tree_set_value(tree_decl(pack, 0), lit);
+
+   tree_t young = tree_new(T_LITERAL);
+   tree_set_subkind(young, L_INT);
+   tree_add_attr_tree(young, ident_new("lit"), lit);
+
+   tree_gc();
+
+   fail_unless(tree_value(tree_decl(pack, 0)) == lit);
+   fail_unless(tree_kind(lit) == T_LITERAL);
+   fail_unless(tree_ival(lit) == 42);
+
+   // Modifying the literal now it has survived a collection
+   tree_t lit2 = tree_new(T_LITERAL);
+   tree_set_subkind(lit2, L_INT);
+   tree_set_ival(lit2, 5);
+   tree_add_attr_tree(lit, ident_new("next"), lit2);
+
+   tree_gc();
+
+   fail_unless(tree_attr_tree(lit, ident_new("next")) == lit2);
+   fail_unless(tree_ival(lit2) == 5);
+}
+END_TEST
+
+START_TEST(test_lib_forget)
+{
+   {
+      tree_t pack = tree_new(T_PACKAGE);
+      tree_set_ident(pack, ident_new("forget"));
+
+      tree_t v = tree_new(T_VAR_DECL);
+      tree_set_ident(v, ident_new("v"));
+      tree_set_type(v, type_universal_int());
+
+      tree_t f = tree_new(T_FUNC_BODY);
+      tree_set_ident(f, ident_new("f"));
+      tree_add_decl(f, v);
+      tree_add_decl(pack, f);
+
+      lib_put(work, pack);
+   }
+
+   lib_save(work);
+   lib_free(work);
+
+   lib_add_search_path("/tmp");
+   work = lib_find(ident_new("test_lib"), false);
+   fail_if(work == NULL);
+
+   tree_gc_full();
+   const unsigned before = tree_gc_arenas();
+
+   tree_t pack = lib_get(work, ident_new("forget"));
+   fail_if(pack == NULL);
+   fail_unless(tree_gc_arenas() == before + 1);
+
+   // Objects decoded lazily are allocated in the arena of the unit
+   tree_t f = tree_decl(pack, 0);
+   fail_unless(tree_decls(f) == 1);
+   fail_unless(tree_ident(tree_decl(f, 0)) == ident_new("v"));
+
+   lib_forget(work, ident_new("forget"));
+   tree_gc_full();
+   fail_unless(tree_gc_arenas() == before);
+
+   // The unit is read back from disk into a new arena
+   pack = lib_get(work, ident_new("forget"));
+   fail_if(pack == NULL);
+   fail_unless(tree_gc_arenas() == before + 1);
+   fail_unless(tree_decls(tree_decl(pack, 0)) == 1);
+}
+END_TEST
+
+START_TEST(test_lib_minor)
+{
+   type_t type = type_universal_int();
+
+   tree_gc_full();
+   const size_t before = tree_gc_objects();
+
+   tree_t pack = tree_new(T_PACKAGE);
+   tree_set_ident(pack, ident_new("minor"));
+
+   tree_t c = tree_new(T_CONST_DECL);
+   tree_set_ident(c, ident_new("c"));
+   tree_set_type(c, type);
+   tree_add_decl(pack, c);
+
+   for (int i = 0; i < 10; i++) {
+      tree_t garbage = tree_new(T_LITERAL);
+      tree_set_subkind(garbage, L_INT);
+      tree_set_ival(garbage, i);
+   }
+
+   fail_unless(tree_gc_objects() == before + 12);
+
+   // A minor collection only sweeps young objects
+   tree_gc();
+
+   fail_unless(tree_gc_objects() == before + 2);
+   fail_unless(tree_decl(pack, 0) == c);
+   fail_unless(tree_type(c) == type);
+}
+END_TEST
+
+START_TEST(test_lib_attrs)
+{
+   ident_t name = ident_new("attrs");
+   ident_t other = ident_new("other");
+
+   tree_t pack = tree_new(T_PACKAGE);
+   tree_set_ident(pack, name);
+
+   // Attributes with the same name but a different kind are distinct
+   tree_add_attr_int(pack, name, 42);
+   tree_add_attr_str(pack, name, other);
+   tree_add_attr_int(pack, name, 43);
+   fail_unless(tree_attr_int(pack, name, 0) == 43);
+   fail_unless(tree_attr_str(pack, name) == other);
+   fail_unless(tree_attr_int(pack, other, -1) == -1);
+
+   tree_remove_attr(pack, name);
+   fail_unless(tree_attr_int(pack, name, -1) == -1);
+   fail_unless(tree_attr_str(pack, name) == NULL);
+
+   for (int i = 0; i < 1000; i++) {
+      tree_t garbage = tree_new(T_LITERAL);
+      tree_add_attr_int(garbage, other, i);
+   }
+
+   tree_add_attr_int(pack, other, 5);
+
+   tree_gc();
+
+   // Slots released by the collection are reused without their values
+   for (int i = 0; i < 1000; i++) {
+      tree_t t = tree_new(T_LITERAL);
+      fail_unless(tree_attr_int(t, other, -1) == -1);
+      tree_add_attr_int(t, name, i);
+      fail_unless(tree_attr_int(t, name, -1) == i);
+   }
+
+   fail_unless(tree_attr_int(pack, other, 0) == 5);
+}
+END_TEST
+
 int main(void)
 {
    register_trace_signal_handlers();
@@ -269,7 +630,14 @@ int main(void)
    tcase_add_unchecked_fixture(tc_core, setup, teardown);
    tcase_add_test(tc_core, test_lib_new);
    tcase_add_test(tc_core, test_lib_fopen);
+   tcase_add_test(tc_core, test_lib_fbuf);
    tcase_add_test(tc_core, test_lib_save);
+   tcase_add_test(tc_core, test_lib_index);
+   tcase_add_test(tc_core, test_lib_lazy);
+   tcase_add_test(tc_core, test_lib_gc);
+   tcase_add_test(tc_core, test_lib_forget);
+   tcase_add_test(tc_core, test_lib_minor);
+   tcase_add_test(tc_core, test_lib_attrs);
    suite_add_tcase(s, tc_core);
 
    SRunner *sr = srunner_create(s);
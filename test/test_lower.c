@@ -407,14 +407,9 @@ START_TEST(test_assign1)
 
    CHECK_BB(2);
 
+   // X and Y are known to be 5 and 7 after the wait so the assertion
+   // always passes and is removed
    const check_bb_t bb3[] = {
-      { VCODE_OP_CONST, .value = 2 },
-      { VCODE_OP_LOAD, .name = "X" },
-      { VCODE_OP_LOAD, .name = "Y" },
-      { VCODE_OP_ADD },
-      { VCODE_OP_CONST, .value = 12 },
-      { VCODE_OP_CMP },
-      { VCODE_OP_ASSERT },
       { VCODE_OP_WAIT, .target = 4 }
    };
 
@@ -676,42 +671,17 @@ START_TEST(test_arith1)
 
    CHECK_BB(1);
 
+   // X and Y are still 3 and 12 after the wait so the loads are replaced
+   // with constants and the comparisons that fold are removed
    EXPECT_BB(2) = {
       { VCODE_OP_CONST, .value = 2 },
-      { VCODE_OP_LOAD, .name = "X" },
-      { VCODE_OP_LOAD, .name = "Y" },
-      { VCODE_OP_ADD },
-      { VCODE_OP_CONST, .value = 15 },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_SUB },
-      { VCODE_OP_CONST, .value = -9 },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_MUL },
-      { VCODE_OP_CONST, .value = 36 },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
-      { VCODE_OP_ASSERT },
+      { VCODE_OP_CONST, .value = 3 },
+      { VCODE_OP_CONST, .value = 12 },
       { VCODE_OP_CONST, .value = 12 },
       { VCODE_OP_DIV },
       { VCODE_OP_CONST, .value = 0 },
       { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
       { VCODE_OP_ASSERT },
-      { VCODE_OP_CONST, .value = 3 },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_NEQ },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_LT },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_GT },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_LEQ },
-      { VCODE_OP_ASSERT },
-      { VCODE_OP_CMP, .cmp = VCODE_CMP_GEQ },
-      { VCODE_OP_ASSERT },
       { VCODE_OP_NEG },
       { VCODE_OP_CONST, .value = -3 },
       { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
@@ -1390,11 +1360,10 @@ START_TEST(test_while1)
 
    CHECK_BB(2);
 
+   // N is positive inside the loop so the subtraction cannot overflow
    EXPECT_BB(3) = {
-      { VCODE_OP_LOAD, .name = "N" },
       { VCODE_OP_CONST, .value = 1 },
       { VCODE_OP_SUB },
-      { VCODE_OP_BOUNDS, .low = INT32_MIN, .high = INT32_MAX },
       { VCODE_OP_STORE, .name = "N" },
       { VCODE_OP_JUMP, .target = 2 }
    };
@@ -1524,16 +1493,23 @@ START_TEST(test_loop2)
    EXPECT_BB(2) = {
       { VCODE_OP_CONST, .value = 1000 },
       { VCODE_OP_CMP, .cmp = VCODE_CMP_GEQ },
-      { VCODE_OP_COND, .target = 4, .target_else = 5 }
+      { VCODE_OP_COND, .target = 3, .target_else = 4 }
    };
 
    CHECK_BB(2);
 
+   // The unreachable block following the infinite loop is deleted
    EXPECT_BB(3) = {
       { VCODE_OP_RETURN },
    };
 
    CHECK_BB(3);
+
+   EXPECT_BB(4) = {
+      { VCODE_OP_JUMP, .target = 1 }
+   };
+
+   CHECK_BB(4);
 }
 END_TEST
 
@@ -1616,14 +1592,12 @@ START_TEST(test_memset)
       vcode_unit_t v0 = tree_code(tree_decl(e, 1));
       vcode_select_unit(v0);
 
+      // X is positive so the length is never clamped to zero
       EXPECT_BB(0) = {
          { VCODE_OP_CONST, .value = 1 },
          { VCODE_OP_SUB },
          { VCODE_OP_ADD },
          { VCODE_OP_CAST },
-         { VCODE_OP_CONST, .value = 0 },
-         { VCODE_OP_CMP, .cmp = VCODE_CMP_LT },
-         { VCODE_OP_SELECT },
          { VCODE_OP_ALLOCA, .subkind = VCODE_ALLOCA_HEAP },
          { VCODE_OP_CONST, .value = 0 },
          { VCODE_OP_WRAP },
@@ -1644,9 +1618,6 @@ START_TEST(test_memset)
          { VCODE_OP_SUB },
          { VCODE_OP_ADD },
          { VCODE_OP_CAST },
-         { VCODE_OP_CONST, .value = 0 },
-         { VCODE_OP_CMP, .cmp = VCODE_CMP_LT },
-         { VCODE_OP_SELECT },
          { VCODE_OP_ALLOCA, .subkind = VCODE_ALLOCA_HEAP },
          { VCODE_OP_CONST, .value = 0 },
          { VCODE_OP_WRAP },
@@ -1825,6 +1796,8 @@ START_TEST(test_proc7)
    vcode_unit_t v0 = tree_code(tree_decl(e, 1));
    vcode_select_unit(v0);
 
+   // The bounds of X already lie within NATURAL so the index check on
+   // the range of Y is removed
    EXPECT_BB(0) = {
       { VCODE_OP_UARRAY_LEFT },
       { VCODE_OP_CAST },
@@ -1847,7 +1820,6 @@ START_TEST(test_proc7)
       { VCODE_OP_MEMSET },
       { VCODE_OP_SELECT },
       { VCODE_OP_SELECT },
-      { VCODE_OP_INDEX_CHECK, .subkind = BOUNDS_INDEX_TO },
       { VCODE_OP_CONST, .value = 1000000 },
       { VCODE_OP_WAIT, .target = 1 }
    };
@@ -1945,7 +1917,7 @@ START_TEST(test_cover)
       { VCODE_OP_LOAD_INDIRECT },
       { VCODE_OP_CMP, .cmp = VCODE_CMP_EQ },
       { VCODE_OP_COVER_COND, .index = 0, .subkind = 1 },
-      { VCODE_OP_LOAD_INDIRECT },
+      // Value of S reused for the second comparison
       { VCODE_OP_CONST, .value = 10 },
       { VCODE_OP_CMP, .cmp = VCODE_CMP_GT },
       { VCODE_OP_COVER_COND, .index = 0, .subkind = 2 },
@@ -2264,6 +2236,7 @@ START_TEST(test_sigvar)
       vcode_unit_t v0 = tree_code(tree_decl(e, 1));
       vcode_select_unit(v0);
 
+      // No index check is needed for Y as in test_proc7
       EXPECT_BB(0) = {
          { VCODE_OP_UNWRAP },
          { VCODE_OP_UARRAY_LEN },
@@ -2288,7 +2261,6 @@ START_TEST(test_sigvar)
          { VCODE_OP_MEMSET },
          { VCODE_OP_SELECT },
          { VCODE_OP_SELECT },
-         { VCODE_OP_INDEX_CHECK, .subkind = BOUNDS_INDEX_TO },
          { VCODE_OP_ARRAY_SIZE },
          { VCODE_OP_VEC_LOAD },
          { VCODE_OP_COPY },
@@ -2421,6 +2393,77 @@ START_TEST(test_choice1)
 }
 END_TEST
 
+START_TEST(test_bounds2)
+{
+   input_from_file(TESTDIR "/lower/bounds2.vhd");
+
+   tree_t e = run_elab();
+   opt(e);
+   lower_unit(e);
+
+   vcode_unit_t v0 = tree_code(tree_stmt(e, 0));
+   vcode_select_unit(v0);
+
+   EXPECT_BB(2) = {
+      { VCODE_OP_STORE, .name = "Y" },
+      { VCODE_OP_JUMP, .target = 3 }
+   };
+
+   CHECK_BB(2);
+
+   EXPECT_BB(3) = {
+      { VCODE_OP_LOAD, .name = "X" },
+      { VCODE_OP_BOUNDS, .low = 0, .high = 9 },
+      { VCODE_OP_STORE, .name = "Y" },
+      { VCODE_OP_WAIT, .target = 4 }
+   };
+
+   CHECK_BB(3);
+}
+END_TEST
+
+START_TEST(test_cse1)
+{
+   input_from_file(TESTDIR "/lower/cse1.vhd");
+
+   tree_t e = run_elab();
+   opt(e);
+   lower_unit(e);
+
+   {
+      vcode_unit_t v0 = tree_code(tree_decl(e, 1));
+      vcode_select_unit(v0);
+
+      // The product and the value of R are available from block 0
+      EXPECT_BB(1) = {
+         { VCODE_OP_ADD },
+         { VCODE_OP_BOUNDS, .low = INT32_MIN, .high = INT32_MAX },
+         { VCODE_OP_STORE, .name = "R" },
+         { VCODE_OP_JUMP, .target = 2 }
+      };
+
+      CHECK_BB(1);
+   }
+
+   {
+      vcode_unit_t v0 = tree_code(tree_stmt(e, 0));
+      vcode_select_unit(v0);
+
+      // Registers cannot be reused after a wait
+      EXPECT_BB(3) = {
+         { VCODE_OP_LOAD, .name = "V" },
+         { VCODE_OP_CONST, .value = 1 },
+         { VCODE_OP_ADD },
+         { VCODE_OP_BOUNDS, .low = INT32_MIN, .high = INT32_MAX },
+         { VCODE_OP_STORE, .name = "V" },
+         { VCODE_OP_WAIT, .target = 4 }
+      };
+
+      CHECK_BB(3);
+   }
+}
+END_TEST
+
 int main(void)
 {
    term_init();
@@ -2478,6 +2521,8 @@ int main(void)
    tcase_add_test(tc, test_issue203);
    tcase_add_test(tc, test_issue215);
    tcase_add_test(tc, test_choice1);
+   tcase_add_test(tc, test_bounds2);
+   tcase_add_test(tc, test_cse1);
    suite_add_tcase(s, tc);
 
    return nvc_run_test(s);
@@ -292,6 +292,16 @@ START_TEST(test_ffold)
    fail_unless(folded_i(tree_value(tree_decl(a, 11)), 5));
    fail_unless(folded_i(tree_value(tree_decl(a, 12)), 10));
    fail_unless(folded_b(tree_value(tree_decl(a, 13)), true));
+   fail_unless(folded_i(tree_value(tree_decl(a, 16)), 5050));
+
+   tree_t ones = tree_value(tree_decl(a, 17));
+   fail_unless(tree_kind(ones) == T_AGGREGATE);
+   fail_unless(tree_assocs(ones) == 3);
+   for (int i = 0; i < 3; i++) {
+      unsigned pos;
+      fail_unless(folded_enum(tree_value(tree_assoc(ones, i)), &pos));
+      fail_unless(pos == 1);
+   }
 }
 END_TEST
 
@@ -368,6 +378,73 @@ START_TEST(test_issue212)
 }
 END_TEST
 
+START_TEST(test_memo)
+{
+   input_from_file(TESTDIR "/simp/memo.vhd");
+
+   tree_t a = parse_and_check(T_ENTITY, T_ARCH);
+   fail_unless(sem_errors() == 0);
+
+   const int hits = eval_fold_hits();
+
+   simplify(a);
+
+   fail_unless(eval_fold_hits() == hits + 2);
+
+   tree_t c1 = tree_value(tree_decl(a, 2));
+   tree_t c2 = tree_value(tree_decl(a, 3));
+   fail_unless(folded_i(c1, 120));
+   fail_unless(folded_i(c2, 120));
+   fail_unless(c1 != c2);
+   fail_unless(tree_loc(c2)->first_line == 22);
+   fail_unless(folded_i(tree_value(tree_decl(a, 4)), 720));
+
+   for (int i = 5; i <= 6; i++) {
+      tree_t zeros = tree_value(tree_decl(a, i));
+      fail_unless(tree_kind(zeros) == T_AGGREGATE);
+      fail_unless(tree_assocs(zeros) == 3);
+      fail_unless(tree_loc(zeros)->first_line == 19 + i);
+   }
+}
+END_TEST
+
+START_TEST(test_gcfold)
+{
+   input_from_file(TESTDIR "/simp/gcfold.vhd");
+
+   tree_t a1 = NULL;
+   for (int i = 0; i < 4; i++) {
+      fail_if((a1 = parse()) == NULL);
+      sem_check(a1);
+   }
+   fail_unless(tree_kind(a1) == T_ARCH);
+   fail_unless(sem_errors() == 0);
+
+   simplify(a1);
+
+   fail_unless(folded_i(tree_value(tree_decl(a1, 0)), 120));
+
+   // Array equality compares real elements by value
+   fail_unless(folded_b(tree_value(tree_decl(a1, 1)), true));
+   fail_unless(folded_b(tree_value(tree_decl(a1, 2)), false));
+
+   // Cached results are discarded by a collection as the declarations
+   // they are keyed on may have been freed
+   tree_gc();
+
+   tree_t a2 = parse();
+   fail_if(a2 == NULL);
+   sem_check(a2);
+   fail_unless(sem_errors() == 0);
+   fail_unless(parse() == NULL);
+
+   const int hits = eval_fold_hits();
+   simplify(a2);
+   fail_unless(folded_i(tree_value(tree_decl(a2, 0)), 120));
+   fail_unless(eval_fold_hits() == hits);
+}
+END_TEST
+
 int main(void)
 {
    Suite *s = suite_create("simplify");
@@ -381,6 +458,8 @@ int main(void)
    tcase_add_test(tc_core, test_issue155);
    tcase_add_test(tc_core, test_context);
    tcase_add_test(tc_core, test_issue212);
+   tcase_add_test(tc_core, test_memo);
+   tcase_add_test(tc_core, test_gcfold);
    suite_add_tcase(s, tc_core);
 
    return nvc_run_test(s);
@@ -0,0 +1,163 @@
+#include "rt/rt.h"
+#include "tree.h"
+#include "util.h"
+
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static void setup(void)
+{
+   wave_reset();
+}
+
+static void teardown(void)
+{
+   wave_reset();
+}
+
+static tree_t make_signal(const char *name)
+{
+   tree_t d = tree_new(T_SIGNAL_DECL);
+   tree_set_ident(d, ident_new(name));
+   return d;
+}
+
+static bool should_dump(const char *name)
+{
+   return wave_should_dump(make_signal(name));
+}
+
+START_TEST(test_star)
+{
+   wave_include_glob(":top:*");
+   wave_include_glob("*:x");
+
+   fail_unless(should_dump(":top:a"));
+   fail_unless(should_dump(":top:sub:b"));
+   fail_unless(should_dump(":other:x"));
+   fail_if(should_dump(":other:y"));
+
+   // A wildcard matches one or more characters
+   fail_if(should_dump(":top:"));
+   fail_if(should_dump(":x"));
+}
+END_TEST
+
+START_TEST(test_question)
+{
+   wave_include_glob(":top:s?");
+   wave_include_glob(":top:?:z");
+   wave_include_glob(":top:x?*");
+
+   // A question mark matches exactly one character
+   fail_unless(should_dump(":top:s1"));
+   fail_unless(should_dump(":top:sb"));
+   fail_if(should_dump(":top:s"));
+   fail_if(should_dump(":top:s12"));
+
+   fail_unless(should_dump(":top:u:z"));
+   fail_if(should_dump(":top:uu:z"));
+   fail_if(should_dump(":top::z"));
+
+   fail_unless(should_dump(":top:xab"));
+   fail_unless(should_dump(":top:xabc"));
+   fail_if(should_dump(":top:xa"));
+}
+END_TEST
+
+START_TEST(test_exclude)
+{
+   // Everything is included when there are no include patterns
+   wave_exclude_glob(":top:sub:*");
+
+   fail_unless(should_dump(":top:a"));
+   fail_if(should_dump(":top:sub:a"));
+
+   // Exclude takes precedence over include
+   wave_include_glob(":top:*");
+   wave_include_glob(":top:sub:a");
+
+   fail_unless(should_dump(":top:a"));
+   fail_if(should_dump(":top:sub:a"));
+   fail_if(should_dump(":top:sub:b"));
+   fail_if(should_dump(":other:a"));
+}
+END_TEST
+
+START_TEST(test_overlap)
+{
+   // These patterns share a prefix in the trie
+   wave_include_glob(":top:abc");
+   wave_include_glob(":top:ab*");
+   wave_include_glob(":top:a");
+   wave_exclude_glob(":top:abd");
+   wave_exclude_glob(":top:a?c:*");
+
+   fail_unless(should_dump(":top:abc"));
+   fail_unless(should_dump(":top:abx"));
+   fail_unless(should_dump(":top:abcd"));
+   fail_unless(should_dump(":top:a"));
+   fail_if(should_dump(":top:ab"));
+   fail_if(should_dump(":top:abd"));
+   fail_if(should_dump(":top:abc:x"));
+   fail_if(should_dump(":top:b"));
+}
+END_TEST
+
+START_TEST(test_cache)
+{
+   wave_include_glob(":top:a*");
+
+   tree_t a = make_signal(":top:a1");
+   tree_t b = make_signal(":top:b1");
+
+   fail_unless(wave_should_dump(a));
+   fail_if(wave_should_dump(b));
+
+   // Repeated queries return the cached decision without matching the
+   // name again
+   tree_set_ident(a, ident_new(":top:b2"));
+   tree_set_ident(b, ident_new(":top:a2"));
+
+   fail_unless(wave_should_dump(a));
+   fail_if(wave_should_dump(b));
+
+   // Changing the patterns discards the cached decisions
+   wave_include_glob(":top:z");
+
+   fail_if(wave_should_dump(a));
+   fail_unless(wave_should_dump(b));
+
+   // As does resetting the lists
+   tree_set_ident(b, ident_new(":top:b3"));
+   wave_reset();
+
+   fail_unless(wave_should_dump(a));
+   fail_unless(wave_should_dump(b));
+}
+END_TEST
+
+int main(void)
+{
+   Suite *s = suite_create("wave");
+
+   TCase *tc_core = tcase_create("Core");
+   tcase_add_checked_fixture(tc_core, setup, teardown);
+   tcase_add_test(tc_core, test_star);
+   tcase_add_test(tc_core, test_question);
+   tcase_add_test(tc_core, test_exclude);
+   tcase_add_test(tc_core, test_overlap);
+   tcase_add_test(tc_core, test_cache);
+   suite_add_tcase(s, tc_core);
+
+   SRunner *sr = srunner_create(s);
+   srunner_run_all(sr, CK_NORMAL);
+
+   int nfail = srunner_ntests_failed(sr);
+
+   srunner_free(sr);
+
+   return nfail == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}